@@ -0,0 +1,103 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Arduino API surface for the native (Linux host) build. The firmware is
+// compiled unchanged against these headers; the hal_*.cpp files provide the
+// Linux backends (virtual clock, CSV-fed ADC, file-backed EEPROM, loopback
+// WiFi/HTTP). Runtime knobs live in hal.h.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "WString.h"
+#include "Print.h"
+#include "IPAddress.h"
+#include "hal.h"
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define strlen_P strlen
+#define strncmp_P strncmp
+#define memcpy_P memcpy
+
+// RTC slow memory keeps its contents over a software reset on the device;
+// here it lives as long as the process
+#define RTC_NOINIT_ATTR
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define LOW 0
+#define HIGH 1
+
+typedef enum {
+  ADC_0db,
+  ADC_2_5db,
+  ADC_6db,
+  ADC_11db
+} adc_attenuation_t;
+
+// Clock (virtual, see hal::setTimeScale)
+inline unsigned long millis() { return (unsigned long)(hal::nowMicros() / 1000); }
+inline unsigned long micros() { return (unsigned long)hal::nowMicros(); }
+inline void delay(unsigned long ms) { hal::sleepMicros((uint64_t)ms * 1000); }
+inline void delayMicroseconds(unsigned int us) { hal::sleepMicros(us); }
+inline void yield() {}
+
+// ADC (simulated, see hal::loadAdcTrace)
+inline int analogRead(uint8_t pin) { return hal::adcRead(pin); }
+inline uint32_t analogReadMilliVolts(uint8_t pin) { return hal::adcReadMilliVolts(pin); }
+inline void analogReadResolution(uint8_t bits) { hal::adcSetResolution(bits); }
+inline void analogSetAttenuation(adc_attenuation_t atten) { hal::adcSetAttenuation(-1, atten); }
+inline void analogSetPinAttenuation(uint8_t pin, adc_attenuation_t atten) { hal::adcSetAttenuation(pin, atten); }
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+
+inline long random(long max) { return max > 0 ? ::random() % max : 0; }
+inline long random(long min, long max) { return max > min ? min + ::random() % (max - min) : min; }
+inline void randomSeed(unsigned long seed) { ::srandom(seed); }
+
+// Hardware RNG
+uint32_t esp_random();
+
+// SNTP is simulated against the virtual clock, see hal::startSntp
+inline void configTime(long, int, const char*, const char* = nullptr, const char* = nullptr) {
+  hal::startSntp();
+}
+
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long) {}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  int availableForWrite() override { return 4096; }
+  operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint32_t getHeapSize();
+  uint32_t getCycleCount() { return (uint32_t)(hal::nowMicros() * getCpuFreqMHz()); }
+  uint32_t getCpuFreqMHz() { return 160; }
+  uint64_t getEfuseMac();
+  void restart();
+};
+
+extern EspClass ESP;
+
+// Entry points implemented by the firmware
+void setup();
+void loop();
+
+#endif
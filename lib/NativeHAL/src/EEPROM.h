@@ -0,0 +1,51 @@
+#ifndef NATIVE_EEPROM_H
+#define NATIVE_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// File-backed EEPROM emulation (see hal::setEepromPath). Like the ESP32
+// core, writes go to a RAM copy and reach the file on commit(), a begin()
+// with another size truncates, and access past the size is ignored (reads
+// give 0).
+class EEPROMClass {
+public:
+  bool begin(size_t size);
+  void end();
+  bool commit();
+  size_t length() const { return data.size(); }
+
+  uint8_t read(int address) const;
+  void write(int address, uint8_t value);
+  uint8_t* getDataPtr() { return data.data(); }
+
+  template <typename T>
+  T& get(int address, T& value) const {
+    if (address >= 0 && address + sizeof(T) <= data.size()) {
+      memcpy(&value, data.data() + address, sizeof(T));
+    }
+    return value;
+  }
+
+  template <typename T>
+  const T& put(int address, const T& value) {
+    if (address >= 0 && address + sizeof(T) <= data.size()) {
+      memcpy(data.data() + address, &value, sizeof(T));
+      dirty = true;
+    }
+    return value;
+  }
+
+  uint32_t commits() const { return commitCount; }
+
+private:
+  std::vector<uint8_t> data;
+  bool dirty = false;
+  uint32_t commitCount = 0;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
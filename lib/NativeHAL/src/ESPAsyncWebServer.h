@@ -0,0 +1,218 @@
+#ifndef NATIVE_ESPASYNCWEBSERVER_H
+#define NATIVE_ESPASYNCWEBSERVER_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "Arduino.h"
+
+// ESPAsyncWebServer stand-in for the native build. One server thread
+// accepts connections on hal::webServerPort() and runs handlers one request
+// at a time, like the single AsyncTCP task on the device. The response is
+// then written by a thread of its own and the request freed afterwards, so
+// responses to slow clients stay in memory side by side as they do in
+// AsyncTCP's send queues.
+
+#ifndef HTTP_GET
+#define HTTP_GET     0x01
+#define HTTP_HEAD    0x02
+#define HTTP_POST    0x04
+#define HTTP_PUT     0x08
+#define HTTP_DELETE  0x10
+#define HTTP_CONNECT 0x20
+#define HTTP_OPTIONS 0x40
+#define HTTP_TRACE   0x80
+#define HTTP_PATCH   0x100
+#define HTTP_ANY     0xFF
+#endif
+
+typedef int WebRequestMethodComposite;
+
+// Filler return value: no data yet, call again later
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF
+
+class AsyncWebServerRequest;
+
+typedef std::function<void(AsyncWebServerRequest*)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest*, const String& filename, size_t index,
+                           uint8_t* data, size_t len, bool final)> ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest*, uint8_t* data, size_t len, size_t index,
+                           size_t total)> ArBodyHandlerFunction;
+typedef std::function<size_t(uint8_t* buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+typedef std::function<void()> ArDisconnectHandler;
+
+// The TCP connection of a request (AsyncTCP's AsyncClient, reduced)
+class AsyncClient {
+public:
+  // Reset the connection (RST) instead of finishing the response; the
+  // response stops after the current filler call
+  int8_t abort() {
+    aborted = true;
+    return -13;  // ERR_ABRT
+  }
+  bool connected() const { return !aborted; }
+  int fd() const { return socket; }
+
+private:
+  friend class AsyncWebServer;
+  int socket = -1;
+  bool aborted = false;
+};
+
+class AsyncWebParameter {
+public:
+  AsyncWebParameter(const String& name, const String& value, bool post)
+      : paramName(name), paramValue(value), post(post) {}
+  const String& name() const { return paramName; }
+  const String& value() const { return paramValue; }
+  bool isPost() const { return post; }
+  bool isFile() const { return false; }
+
+private:
+  String paramName;
+  String paramValue;
+  bool post;
+};
+
+class AsyncWebHeader {
+public:
+  AsyncWebHeader(const String& name, const String& value) : headerName(name), headerValue(value) {}
+  const String& name() const { return headerName; }
+  const String& value() const { return headerValue; }
+
+private:
+  String headerName;
+  String headerValue;
+};
+
+class AsyncWebServerResponse {
+public:
+  AsyncWebServerResponse(int code, const String& contentType)
+      : code(code), contentType(contentType) {}
+  virtual ~AsyncWebServerResponse() {}
+
+  void addHeader(const String& name, const String& value) {
+    headers.push_back(AsyncWebHeader(name, value));
+  }
+  void setCode(int c) { code = c; }
+  void setContentLength(size_t len) { contentLength = (long)len; }
+
+  // Write the whole response to the connection
+  virtual bool writeTo(AsyncClient& client) = 0;
+
+protected:
+  bool writeHead(int fd, long length);
+
+  int code;
+  String contentType;
+  long contentLength = -1;
+  std::vector<AsyncWebHeader> headers;
+};
+
+class AsyncBasicResponse : public AsyncWebServerResponse {
+public:
+  AsyncBasicResponse(int code, const String& contentType, const String& content)
+      : AsyncWebServerResponse(code, contentType), content(content) {}
+  bool writeTo(AsyncClient& client) override;
+
+private:
+  String content;
+};
+
+class AsyncFillerResponse : public AsyncWebServerResponse {
+public:
+  AsyncFillerResponse(int code, const String& contentType, AwsResponseFiller filler, long length)
+      : AsyncWebServerResponse(code, contentType), filler(filler) { contentLength = length; }
+  bool writeTo(AsyncClient& client) override;
+
+private:
+  AwsResponseFiller filler;
+};
+
+class AsyncWebServerRequest {
+public:
+  ~AsyncWebServerRequest() { free(_tempObject); }
+
+  const String& url() const { return requestUrl; }
+  WebRequestMethodComposite method() const { return requestMethod; }
+  const char* methodToString() const;
+  size_t contentLength() const { return body.length(); }
+
+  bool hasParam(const String& name, bool post = false, bool file = false) const;
+  AsyncWebParameter* getParam(const String& name, bool post = false, bool file = false) const;
+  size_t params() const { return parameters.size(); }
+  AsyncWebParameter* getParam(size_t index) const;
+  bool hasArg(const char* name) const;
+  const String& arg(const char* name) const;
+
+  bool hasHeader(const String& name) const;
+  AsyncWebHeader* getHeader(const String& name) const;
+
+  void send(int code, const String& contentType = String(), const String& content = String());
+  void send(AsyncWebServerResponse* response);
+  AsyncWebServerResponse* beginResponse(int code, const String& contentType = String(),
+                                        const String& content = String());
+  AsyncWebServerResponse* beginResponse(const String& contentType, size_t len,
+                                        AwsResponseFiller filler);
+  AsyncWebServerResponse* beginChunkedResponse(const String& contentType, AwsResponseFiller filler);
+
+  void onDisconnect(ArDisconnectHandler fn) { disconnectHandlers.push_back(fn); }
+  AsyncClient* client() { return &connection; }
+
+  // Free-form per-request state, like the library's _tempObject; must come
+  // from malloc(), the request frees it
+  void* _tempObject = nullptr;
+
+private:
+  friend class AsyncWebServer;
+
+  int fd = -1;
+  AsyncClient connection;
+  String requestUrl;
+  WebRequestMethodComposite requestMethod = HTTP_GET;
+  String body;
+  std::vector<std::unique_ptr<AsyncWebParameter>> parameters;
+  std::vector<std::unique_ptr<AsyncWebHeader>> requestHeaders;
+  std::unique_ptr<AsyncWebServerResponse> response;
+  std::vector<ArDisconnectHandler> disconnectHandlers;
+};
+
+class AsyncCallbackWebHandler {
+public:
+  String uri;
+  WebRequestMethodComposite method = HTTP_ANY;
+  ArRequestHandlerFunction onRequest;
+  ArUploadHandlerFunction onUpload;
+  ArBodyHandlerFunction onBody;
+
+  bool canHandle(const AsyncWebServerRequest* request) const;
+};
+
+class AsyncWebServer {
+public:
+  explicit AsyncWebServer(uint16_t port) : devicePort(port) {}
+  ~AsyncWebServer();
+
+  AsyncCallbackWebHandler& on(const char* uri, ArRequestHandlerFunction onRequest);
+  AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method,
+                              ArRequestHandlerFunction onRequest);
+  AsyncCallbackWebHandler& on(const char* uri, WebRequestMethodComposite method,
+                              ArRequestHandlerFunction onRequest,
+                              ArUploadHandlerFunction onUpload,
+                              ArBodyHandlerFunction onBody = nullptr);
+  void onNotFound(ArRequestHandlerFunction fn) { notFound = fn; }
+
+  void begin();
+  void end();
+
+private:
+  void serve();
+  void handleConnection(int fd);  // closes fd
+
+  uint16_t devicePort;
+  int listenFd = -1;
+  std::vector<std::unique_ptr<AsyncCallbackWebHandler>> handlers;
+  ArRequestHandlerFunction notFound;
+};
+
+#endif
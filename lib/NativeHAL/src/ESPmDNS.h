@@ -0,0 +1,24 @@
+#ifndef NATIVE_ESPMDNS_H
+#define NATIVE_ESPMDNS_H
+
+#include "Arduino.h"
+
+// mDNS responder stand-in: keeps the name and services so tests can check
+// them, answers no queries
+class MDNSResponder {
+public:
+  bool begin(const char* hostName) { name = hostName; return true; }
+  void end() { name = String(); services = 0; }
+  bool addService(const char*, const char*, uint16_t) { services++; return true; }
+
+  const char* hostname() const { return name.c_str(); }
+  int serviceCount() const { return services; }
+
+private:
+  String name;
+  int services = 0;
+};
+
+extern MDNSResponder MDNS;
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef NATIVE_HTTPCLIENT_H
+#define NATIVE_HTTPCLIENT_H
+
+#include <vector>
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+// HTTPClient for the native build. Requests go to the in-process handler
+// (hal::setHttpHandler) if one is set, otherwise over a plain TCP socket.
+// https:// URLs only work with hal::setHttpOverride pointing at a local
+// plain-HTTP stand-in, since there is no TLS here.
+class HTTPClient {
+public:
+  bool begin(const String& url);
+  bool begin(const String& url, const char* caCert) { (void)caCert; return begin(url); }
+  void end();
+
+  void addHeader(const String& name, const String& value);
+  void setTimeout(uint16_t timeoutMs) { timeout = timeoutMs; }
+  void setConnectTimeout(int32_t timeoutMs) { timeout = timeoutMs; }
+  void setReuse(bool) {}
+  void collectHeaders(const char* headerKeys[], size_t count);
+
+  int GET();
+  int POST(const String& body);
+  int POST(uint8_t* body, size_t size);
+  int PUT(const String& body);
+  int PATCH(const String& body);
+  int sendRequest(const char* method, const String& body = String());
+
+  String getString() const { return response; }
+  int getSize() const;  // Content-Length, -1 if the server sent none
+  WiFiClient* getStreamPtr() { return &stream; }
+  bool connected() const { return stream.connected(); }
+  String header(const char* name) const;
+
+  static String errorToString(int error);
+
+private:
+  int request(const char* method, const String& body);
+  int requestSocket(const char* method, const String& url, const String& body);
+
+  String url;
+  std::vector<std::pair<String, String>> requestHeaders;
+  std::vector<String> wantedHeaders;
+  std::vector<std::pair<String, String>> responseHeaders;
+  String response;
+  WiFiClient stream;
+  uint16_t timeout = 5000;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef NATIVE_MQTT_H
+#define NATIVE_MQTT_H
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+// lwmqtt codes as returned by lastError()
+typedef enum {
+  LWMQTT_SUCCESS = 0,
+  LWMQTT_BUFFER_TOO_SHORT = -1,
+  LWMQTT_NETWORK_FAILED_CONNECT = -3,
+  LWMQTT_NETWORK_TIMEOUT = -4,
+  LWMQTT_MISSING_OR_WRONG_PACKET = -9,
+  LWMQTT_CONNECTION_DENIED = -10,
+} lwmqtt_err_t;
+
+// MQTTClient (256dpi arduino-mqtt) for the native build. There is no
+// broker here: CONNECT and PUBLISH go to the in-process handler
+// (hal::setMqttHandler). A refused packet drops the connection like a
+// broker that stopped answering; so does the station losing WiFi.
+class MQTTClient {
+public:
+  explicit MQTTClient(int bufSize = 128) : bufSize(bufSize) {}
+
+  void begin(const char* host, int port, WiFiClient& net) {
+    (void)net;
+    this->host = host;
+    this->port = port;
+  }
+  void setCleanSession(bool clean) { cleanSession = clean; }
+  void setKeepAlive(int seconds) { (void)seconds; }
+  void setTimeout(int ms) { (void)ms; }
+
+  bool connect(const char* clientId, bool skip = false);
+  bool publish(const char* topic, const char* payload, int length, bool retained, int qos);
+  bool connected();
+  bool loop() { return connected(); }
+  bool disconnect();
+
+  lwmqtt_err_t lastError() const { return error; }
+  bool sessionPresent() const { return present; }
+
+private:
+  int bufSize;
+  const char* host = nullptr;
+  int port = 0;
+  bool cleanSession = true;
+  String clientId;
+  bool open = false;
+  bool present = false;
+  lwmqtt_err_t error = LWMQTT_SUCCESS;
+};
+
+#endif
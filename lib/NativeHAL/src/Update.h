@@ -0,0 +1,49 @@
+#ifndef NATIVE_UPDATE_H
+#define NATIVE_UPDATE_H
+
+#include "Arduino.h"
+
+#define UPDATE_ERROR_OK           (0)
+#define UPDATE_ERROR_WRITE        (1)
+#define UPDATE_ERROR_SPACE        (4)
+#define UPDATE_ERROR_SIZE         (5)
+#define UPDATE_ERROR_MAGIC_BYTE   (8)
+#define UPDATE_ERROR_ACTIVATE     (9)
+#define UPDATE_ERROR_ABORT        (12)
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+#define U_FLASH 0
+
+// Arduino Updater for the native build. The inactive app partition is a
+// file (hal::otaSlotPath()); end() checks the image magic like the device
+// does and marks the slot as the next boot partition. The ESP image
+// checksum and SHA-256 are not verified here.
+class UpdateClass {
+public:
+  bool begin(size_t size = UPDATE_SIZE_UNKNOWN, int command = U_FLASH, int ledPin = -1,
+             uint8_t ledOn = LOW, const char* label = nullptr);
+  size_t write(uint8_t* data, size_t len);
+  bool end(bool evenIfRemaining = false);
+  void abort();
+
+  bool isRunning() const { return running; }
+  bool isFinished() const { return running && expected != UPDATE_SIZE_UNKNOWN && written == expected; }
+  bool hasError() const { return error != UPDATE_ERROR_OK; }
+  uint8_t getError() const { return error; }
+  const char* errorString() const;
+  size_t size() const { return expected; }
+  size_t progress() const { return written; }
+  size_t remaining() const { return expected == UPDATE_SIZE_UNKNOWN ? 0 : expected - written; }
+
+private:
+  bool running = false;
+  uint8_t error = UPDATE_ERROR_OK;
+  size_t expected = 0;
+  size_t written = 0;
+  FILE* file = nullptr;
+};
+
+extern UpdateClass Update;
+
+#endif
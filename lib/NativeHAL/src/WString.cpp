@@ -0,0 +1,115 @@
+#include "WString.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+static std::string formatInteger(unsigned long long value, bool negative, unsigned char base) {
+  if (base < 2 || base > 36) base = 10;
+  char buf[72];
+  int pos = sizeof(buf) - 1;
+  buf[pos] = '\0';
+  do {
+    int digit = value % base;
+    buf[--pos] = digit < 10 ? '0' + digit : 'a' + digit - 10;
+    value /= base;
+  } while (value != 0);
+  if (negative) buf[--pos] = '-';
+  return std::string(buf + pos);
+}
+
+String::String(int value, unsigned char base)
+    : str(formatInteger(value < 0 ? -(long long)value : value, value < 0, base)) {}
+
+String::String(unsigned int value, unsigned char base) : str(formatInteger(value, false, base)) {}
+
+String::String(long value, unsigned char base)
+    : str(formatInteger(value < 0 ? -(long long)value : value, value < 0, base)) {}
+
+String::String(unsigned long value, unsigned char base) : str(formatInteger(value, false, base)) {}
+
+String::String(float value, unsigned int decimals) : String((double)value, decimals) {}
+
+String::String(double value, unsigned int decimals) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", (int)decimals, value);
+  str = buf;
+}
+
+bool String::endsWith(const String& suffix) const {
+  if (suffix.str.size() > str.size()) return false;
+  return str.compare(str.size() - suffix.str.size(), suffix.str.size(), suffix.str) == 0;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  size_t pos = str.find(c, from);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String& s, unsigned int from) const {
+  size_t pos = str.find(s.str, from);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char c) const {
+  size_t pos = str.rfind(c);
+  return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int from) const {
+  if (from >= str.size()) return String();
+  return String(str.substr(from));
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) std::swap(from, to);
+  if (from >= str.size()) return String();
+  if (to > str.size()) to = str.size();
+  return String(str.substr(from, to - from));
+}
+
+void String::replace(char find, char replacement) {
+  std::replace(str.begin(), str.end(), find, replacement);
+}
+
+void String::replace(const String& find, const String& replacement) {
+  if (find.str.empty()) return;
+  size_t pos = 0;
+  while ((pos = str.find(find.str, pos)) != std::string::npos) {
+    str.replace(pos, find.str.size(), replacement.str);
+    pos += replacement.str.size();
+  }
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+  if (index >= str.size()) return;
+  str.erase(index, count);
+}
+
+void String::toLowerCase() {
+  for (char& c : str) c = tolower((unsigned char)c);
+}
+
+void String::toUpperCase() {
+  for (char& c : str) c = toupper((unsigned char)c);
+}
+
+void String::trim() {
+  size_t start = 0;
+  while (start < str.size() && isspace((unsigned char)str[start])) start++;
+  size_t end = str.size();
+  while (end > start && isspace((unsigned char)str[end - 1])) end--;
+  str = str.substr(start, end - start);
+}
+
+long String::toInt() const {
+  return strtol(str.c_str(), nullptr, 10);
+}
+
+float String::toFloat() const {
+  return strtof(str.c_str(), nullptr);
+}
+
+double String::toDouble() const {
+  return strtod(str.c_str(), nullptr);
+}
@@ -0,0 +1,74 @@
+#ifndef NATIVE_WIFI_H
+#define NATIVE_WIFI_H
+
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+  WIFI_OFF = 0,
+  WIFI_STA = 1,
+  WIFI_AP = 2,
+  WIFI_AP_STA = 3
+} wifi_mode_t;
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+// Loopback WiFi: the station "connects" instantly to the host network
+// unless hal::setWiFiUp(false). Scans return a fixed set of networks.
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t m) { currentMode = m; return true; }
+  wifi_mode_t getMode() const { return currentMode; }
+  void persistent(bool) {}
+  bool setAutoReconnect(bool) { return true; }
+  bool setSleep(bool enabled) { modemSleep = enabled; return true; }
+  bool getSleep() const { return modemSleep; }
+  bool setHostname(const char* name) { hostname = name; return true; }
+  const char* getHostname() const { return hostname.c_str(); }
+
+  wl_status_t begin(const char* ssid, const char* password = nullptr);
+  bool disconnect(bool wifiOff = false);
+  wl_status_t status();
+  bool isConnected() { return status() == WL_CONNECTED; }
+
+  IPAddress localIP();
+  String SSID() const { return ssid; }
+  int32_t RSSI() const { return -55; }
+  String macAddress();
+
+  bool softAPConfig(IPAddress ip, IPAddress gateway, IPAddress subnet);
+  bool softAP(const char* ssid, const char* password = nullptr, int channel = 1,
+              int hidden = 0, int maxConnections = 4);
+  IPAddress softAPIP() const { return apIP; }
+
+  int16_t scanNetworks(bool async = false, bool showHidden = false);
+  int16_t scanComplete() const { return scanCount; }
+  void scanDelete() { scanCount = WIFI_SCAN_FAILED; }
+  String SSID(uint8_t index) const;
+  int32_t RSSI(uint8_t index) const;
+
+private:
+  wifi_mode_t currentMode = WIFI_OFF;
+  String ssid;
+  String hostname = "esp32";
+  bool started = false;
+  uint64_t startedAt = 0;  // hal::nowMicros() of begin()
+  bool modemSleep = true;  // Arduino default: modem sleep on in STA mode
+  IPAddress apIP = IPAddress(192, 168, 4, 1);
+  int16_t scanCount = WIFI_SCAN_FAILED;
+};
+
+extern WiFiClass WiFi;
+
+#endif
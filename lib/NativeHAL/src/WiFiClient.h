@@ -0,0 +1,40 @@
+#ifndef NATIVE_WIFICLIENT_H
+#define NATIVE_WIFICLIENT_H
+
+#include "Arduino.h"
+
+// Read side of a TCP connection as handed out by HTTPClient::getStreamPtr().
+// The native HTTPClient has the whole body by the time GET() returns, so
+// this reads from that buffer; the connection counts as open until the
+// buffer is drained.
+class WiFiClient {
+public:
+  int available() const { return body ? (int)(body->length() - pos) : 0; }
+  bool connected() const { return available() > 0; }
+  void stop() { body = nullptr; }
+
+  int read() {
+    if (available() <= 0) return -1;
+    return (uint8_t)body->c_str()[pos++];
+  }
+
+  int read(uint8_t* buf, size_t size) {
+    int n = available();
+    if (n <= 0) return -1;
+    if ((size_t)n > size) n = (int)size;
+    memcpy(buf, body->c_str() + pos, n);
+    pos += n;
+    return n;
+  }
+
+  void attach(const String* data) {
+    body = data;
+    pos = 0;
+  }
+
+private:
+  const String* body = nullptr;
+  size_t pos = 0;
+};
+
+#endif
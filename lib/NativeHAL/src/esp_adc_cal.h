@@ -0,0 +1,53 @@
+#ifndef NATIVE_ESP_ADC_CAL_H
+#define NATIVE_ESP_ADC_CAL_H
+
+#include "hal.h"
+
+// ADC characterization from eFuse data. The simulated ADC is ideal, so the
+// characteristic is its nominal full scale; hal::setAdcEfuse(false) makes
+// it behave like a chip without calibration data (default Vref only).
+
+typedef int esp_err_t;
+#ifndef ESP_OK
+#define ESP_OK 0
+#endif
+#ifndef ESP_ERR_NOT_SUPPORTED
+#define ESP_ERR_NOT_SUPPORTED 0x106
+#endif
+
+typedef enum { ADC_UNIT_1 = 1, ADC_UNIT_2 = 2 } adc_unit_t;
+typedef enum { ADC_ATTEN_DB_0, ADC_ATTEN_DB_2_5, ADC_ATTEN_DB_6, ADC_ATTEN_DB_11 } adc_atten_t;
+typedef enum { ADC_WIDTH_BIT_12 = 3 } adc_bits_width_t;
+
+typedef enum {
+  ESP_ADC_CAL_VAL_EFUSE_VREF = 0,
+  ESP_ADC_CAL_VAL_EFUSE_TP = 1,
+  ESP_ADC_CAL_VAL_DEFAULT_VREF = 2,
+  ESP_ADC_CAL_VAL_EFUSE_TP_FIT = 3,
+} esp_adc_cal_value_t;
+
+typedef struct {
+  adc_unit_t adc_num;
+  adc_atten_t atten;
+  adc_bits_width_t bit_width;
+  uint32_t vref;
+} esp_adc_cal_characteristics_t;
+
+inline esp_err_t esp_adc_cal_check_efuse(esp_adc_cal_value_t value_type) {
+  return value_type == ESP_ADC_CAL_VAL_EFUSE_TP_FIT && hal::adcEfuse() ? ESP_OK : ESP_ERR_NOT_SUPPORTED;
+}
+
+inline esp_adc_cal_value_t esp_adc_cal_characterize(adc_unit_t adc_num, adc_atten_t atten, adc_bits_width_t bit_width,
+                                                    uint32_t default_vref, esp_adc_cal_characteristics_t* chars) {
+  chars->adc_num = adc_num;
+  chars->atten = atten;
+  chars->bit_width = bit_width;
+  chars->vref = default_vref;
+  return hal::adcEfuse() ? ESP_ADC_CAL_VAL_EFUSE_TP_FIT : ESP_ADC_CAL_VAL_DEFAULT_VREF;
+}
+
+inline uint32_t esp_adc_cal_raw_to_voltage(uint32_t adc_reading, const esp_adc_cal_characteristics_t* chars) {
+  return (uint32_t)(adc_reading * hal::adcFullScaleMilliVolts(chars->atten) / 4095.0f + 0.5f);
+}
+
+#endif
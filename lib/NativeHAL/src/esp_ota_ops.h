@@ -0,0 +1,37 @@
+#ifndef NATIVE_ESP_OTA_OPS_H
+#define NATIVE_ESP_OTA_OPS_H
+
+#include <stdint.h>
+
+// Subset of the ESP-IDF OTA API used for rollback. The running slot and
+// its state come from hal::otaRunning() / hal::otaImageState(); marking
+// the image invalid restarts the process like the device would.
+
+typedef int esp_err_t;
+#ifndef ESP_OK
+#define ESP_OK 0
+#define ESP_FAIL -1
+#endif
+
+typedef struct {
+  uint32_t address;
+  uint32_t size;
+  char label[17];
+} esp_partition_t;
+
+typedef enum {
+  ESP_OTA_IMG_NEW = 0x0U,
+  ESP_OTA_IMG_PENDING_VERIFY = 0x1U,
+  ESP_OTA_IMG_VALID = 0x2U,
+  ESP_OTA_IMG_INVALID = 0x3U,
+  ESP_OTA_IMG_ABORTED = 0x4U,
+  ESP_OTA_IMG_UNDEFINED = 0xFFFFFFFFU
+} esp_ota_img_states_t;
+
+const esp_partition_t* esp_ota_get_running_partition();
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from);
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* state);
+esp_err_t esp_ota_mark_app_valid_cancel_rollback();
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot();
+
+#endif
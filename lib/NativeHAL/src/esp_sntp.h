@@ -0,0 +1,14 @@
+#ifndef NATIVE_ESP_SNTP_H
+#define NATIVE_ESP_SNTP_H
+
+#include <sys/time.h>
+
+// Subset of the lwIP SNTP API used by the firmware. The callback runs on
+// the thread that observes the sync (delay()/time() in the main loop),
+// where the device runs it on the lwIP task.
+
+typedef void (*sntp_sync_time_cb_t)(struct timeval* tv);
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef NATIVE_ESP_TIMER_H
+#define NATIVE_ESP_TIMER_H
+
+#include "hal.h"
+
+// Monotonic microseconds since boot
+inline int64_t esp_timer_get_time() { return (int64_t)hal::nowMicros(); }
+
+#endif
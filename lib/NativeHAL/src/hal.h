@@ -0,0 +1,116 @@
+#ifndef NATIVE_HAL_H
+#define NATIVE_HAL_H
+
+#include <stdint.h>
+#include <functional>
+#include "WString.h"
+
+// Native hardware abstraction layer - Linux backends behind the Arduino
+// API used by the firmware. Every knob can be set from code or from the
+// environment when the process starts:
+//
+//   VOLTAGELOG_TIME_SCALE    1 = real time, 100 = 100x faster, 0 = free-running
+//                            virtual time (delay() returns immediately)
+//   VOLTAGELOG_RUN_SECONDS   stop after this much virtual time (0 = forever)
+//   VOLTAGELOG_ADC_TRACE     CSV of "millivolts" or "time_ms,millivolts" at the pin
+//   VOLTAGELOG_ADC_NOISE     gaussian noise added to every reading, in mV
+//   VOLTAGELOG_ADC_EFUSE     0 = chip without ADC calibration in eFuse
+//   VOLTAGELOG_EEPROM        backing file for EEPROM (default eeprom.bin)
+//   VOLTAGELOG_SERIAL        file the Serial console goes to (default stdout)
+//   VOLTAGELOG_WIFI          "down" to start with the station disconnected
+//   VOLTAGELOG_WIFI_CONNECT_MS time from WiFi.begin() to connected (default 3000)
+//   VOLTAGELOG_WIFI_FLAP     seconds; the station drops for the second half of
+//                            every period (a flapping access point)
+//   VOLTAGELOG_HTTP_OVERRIDE base URL (http://host:port) all HTTPClient requests
+//                            are redirected to, e.g. a local Firebase stand-in
+//   VOLTAGELOG_HTTP_PORT     port of the AsyncWebServer stand-in (default 8080)
+//   VOLTAGELOG_MAC           12 hex digits returned as the eFuse MAC
+//   VOLTAGELOG_UTC_START     UTC epoch seconds at boot (default: host time)
+//   VOLTAGELOG_CLOCK_PPM     crystal error of the device; positive = local
+//                            clock runs fast against UTC
+//   VOLTAGELOG_NTP           "off" to never answer SNTP
+//   VOLTAGELOG_NTP_DELAY_MS  time from configTime() to the first sync (default 1500)
+//   VOLTAGELOG_NTP_INTERVAL  seconds between SNTP resyncs (default 3600)
+//   VOLTAGELOG_OTA_SLOT      file standing in for the inactive app partition
+//                            (default ota_slot.bin)
+//   VOLTAGELOG_OTA_STATE     "pending_verify" to boot as a freshly updated
+//                            image that still has to pass its health check
+
+namespace hal {
+
+void init(int argc, char** argv);
+
+// Clock
+uint64_t nowMicros();
+void sleepMicros(uint64_t us);
+void setTimeScale(double scale);
+double timeScale();
+uint64_t runLimitMicros();
+
+// ADC
+bool loadAdcTrace(const char* path);
+void setAdcMilliVolts(float millivolts);  // constant input when no trace is loaded
+void setAdcNoise(float millivolts);
+int adcRead(uint8_t pin);
+uint32_t adcReadMilliVolts(uint8_t pin);
+void adcSetResolution(uint8_t bits);
+void adcSetAttenuation(int pin, int attenuation);  // pin -1 = all pins
+float adcFullScaleMilliVolts(int attenuation);
+void setAdcEfuse(bool present);  // eFuse calibration data, see esp_adc_cal.h
+bool adcEfuse();
+uint32_t adcReads();
+
+// Serial console; nullptr = stdout
+bool setSerialOutput(const char* path);
+
+// EEPROM
+void setEepromPath(const char* path);
+const char* eepromPath();
+
+// WiFi
+void setWiFiUp(bool up);
+bool wifiUp();
+void setWiFiConnectDelay(uint32_t ms);
+void setWiFiFlapPeriod(uint32_t ms);
+uint32_t wifiConnectDelay();
+
+// HTTP client. An in-process handler takes precedence over the network.
+typedef std::function<int(const char* method, const String& url, const String& body,
+                          String& response)> HttpHandler;
+void setHttpHandler(HttpHandler handler);
+const HttpHandler& httpHandler();
+void setHttpOverride(const char* baseUrl);
+const char* httpOverride();
+
+// MQTT client (MQTT.h). Each CONNECT (topic nullptr) and PUBLISH goes to
+// an in-process handler; false refuses it. Without a handler nothing
+// connects. Setting a handler forgets the persistent sessions.
+typedef std::function<bool(const char* clientId, const char* topic, const char* payload,
+                           size_t length)> MqttHandler;
+void setMqttHandler(MqttHandler handler);
+const MqttHandler& mqttHandler();
+
+// Web server stand-in
+uint16_t webServerPort();
+
+// eFuse MAC
+uint64_t efuseMac();
+
+// Wall clock and SNTP. The device clock starts at 0 (1970) like the ESP,
+// counts with the virtual clock and is stepped to true UTC on each sync;
+// true UTC advances at (1 - ppm) of the virtual clock.
+void startSntp();
+void pollSntp();  // runs a due sync; called from delay() and the clock reads
+void setClockDriftPpm(double ppm);
+void setSntpEnabled(bool enabled);
+int64_t trueUtcMicros();    // what a perfect reference clock would show
+int64_t systemUtcMicros();  // what gettimeofday() returns on the device
+uint32_t sntpSyncs();
+
+// OTA app slots
+const char* otaSlotPath();
+void setOtaPendingVerify(bool pending);
+
+}  // namespace hal
+
+#endif
@@ -0,0 +1,159 @@
+#include "Arduino.h"
+#include <mutex>
+#include <random>
+#include <vector>
+
+// Simulated ESP32-C3 ADC. The input is the voltage at the pin in mV, either
+// constant or replayed from a CSV trace against the virtual clock. The
+// conversion is ideal (linear, no offset) with a full scale per attenuation.
+
+namespace hal {
+
+namespace {
+  struct TracePoint {
+    uint64_t timeMs;
+    float millivolts;
+  };
+
+  std::mutex adcMutex;
+  std::vector<TracePoint> trace;
+  bool traceTimed = false;   // first column is a timestamp
+  size_t nextIndex = 0;      // for untimed traces: one row per read
+
+  float constantMilliVolts = 1500.0f;
+  float noiseMilliVolts = 0.0f;
+  std::mt19937 rng(12345);
+
+  uint8_t resolutionBits = 12;
+  int attenuation[32];
+  bool attenuationInit = false;
+  uint32_t readCount = 0;
+  bool efuse = true;
+
+  // Full scale in mV for ADC_0db, ADC_2_5db, ADC_6db, ADC_11db.
+  // 11 dB uses 3300 mV to match the firmware's adcReferenceVoltage.
+  const float FULL_SCALE_MV[] = {950.0f, 1250.0f, 1750.0f, 3300.0f};
+
+  void ensureAttenuation() {
+    if (attenuationInit) return;
+    for (int& a : attenuation) a = ADC_11db;
+    attenuationInit = true;
+  }
+
+  float inputMilliVolts() {
+    float mv = constantMilliVolts;
+    if (!trace.empty()) {
+      if (traceTimed) {
+        // Loop the trace over its own duration
+        uint64_t span = trace.back().timeMs + 1;
+        uint64_t t = (nowMicros() / 1000) % span;
+        size_t lo = 0, hi = trace.size();
+        while (hi - lo > 1) {
+          size_t mid = (lo + hi) / 2;
+          if (trace[mid].timeMs <= t) lo = mid; else hi = mid;
+        }
+        mv = trace[lo].millivolts;
+      } else {
+        mv = trace[nextIndex].millivolts;
+        nextIndex = (nextIndex + 1) % trace.size();
+      }
+    }
+    if (noiseMilliVolts > 0.0f) {
+      std::normal_distribution<float> noise(0.0f, noiseMilliVolts);
+      mv += noise(rng);
+    }
+    return mv < 0.0f ? 0.0f : mv;
+  }
+}
+
+bool loadAdcTrace(const char* path) {
+  FILE* f = fopen(path, "r");
+  if (!f) return false;
+
+  std::lock_guard<std::mutex> lock(adcMutex);
+  trace.clear();
+  nextIndex = 0;
+  traceTimed = false;
+
+  char line[128];
+  while (fgets(line, sizeof(line), f)) {
+    double a, b;
+    int fields = sscanf(line, "%lf , %lf", &a, &b);
+    if (fields == 2) {
+      traceTimed = true;
+      trace.push_back({(uint64_t)a, (float)b});
+    } else if (fields == 1) {
+      trace.push_back({0, (float)a});
+    }
+    // anything else (header, comments) is skipped
+  }
+  fclose(f);
+  return !trace.empty();
+}
+
+void setAdcMilliVolts(float millivolts) {
+  std::lock_guard<std::mutex> lock(adcMutex);
+  constantMilliVolts = millivolts;
+}
+
+void setAdcNoise(float millivolts) {
+  std::lock_guard<std::mutex> lock(adcMutex);
+  noiseMilliVolts = millivolts;
+}
+
+int adcRead(uint8_t pin) {
+  std::lock_guard<std::mutex> lock(adcMutex);
+  ensureAttenuation();
+  readCount++;
+  float fullScale = FULL_SCALE_MV[attenuation[pin % 32]];
+  float mv = inputMilliVolts();
+  int maxCode = (1 << resolutionBits) - 1;
+  int code = (int)(mv / fullScale * maxCode + 0.5f);
+  return code > maxCode ? maxCode : code;
+}
+
+uint32_t adcReadMilliVolts(uint8_t pin) {
+  std::lock_guard<std::mutex> lock(adcMutex);
+  ensureAttenuation();
+  readCount++;
+  float fullScale = FULL_SCALE_MV[attenuation[pin % 32]];
+  float mv = inputMilliVolts();
+  return (uint32_t)(mv > fullScale ? fullScale : mv);
+}
+
+void adcSetResolution(uint8_t bits) {
+  std::lock_guard<std::mutex> lock(adcMutex);
+  if (bits >= 9 && bits <= 12) resolutionBits = bits;
+}
+
+void adcSetAttenuation(int pin, int atten) {
+  std::lock_guard<std::mutex> lock(adcMutex);
+  ensureAttenuation();
+  if (atten < ADC_0db || atten > ADC_11db) return;
+  if (pin < 0) {
+    for (int& a : attenuation) a = atten;
+  } else {
+    attenuation[pin % 32] = atten;
+  }
+}
+
+float adcFullScaleMilliVolts(int atten) {
+  return FULL_SCALE_MV[atten >= ADC_0db && atten <= ADC_11db ? atten : ADC_11db];
+}
+
+void setAdcEfuse(bool present) {
+  std::lock_guard<std::mutex> lock(adcMutex);
+  efuse = present;
+}
+
+bool adcEfuse() {
+  std::lock_guard<std::mutex> lock(adcMutex);
+  return efuse;
+}
+
+uint32_t adcReads() {
+  std::lock_guard<std::mutex> lock(adcMutex);
+  return readCount;
+}
+
+}  // namespace hal
@@ -0,0 +1,207 @@
+#include "Arduino.h"
+#include <stdarg.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+namespace hal {
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  Clock::time_point realStart = Clock::now();
+  std::atomic<double> scale(1.0);
+  std::atomic<uint64_t> skipped(0);     // virtual time added by delay() at scale 0
+  std::atomic<uint64_t> rebase(0);      // virtual time accumulated before the last scale change
+  Clock::time_point scaleStart = realStart;
+  uint64_t runLimit = 0;
+  uint64_t mac = 0;
+
+  FILE* serialOut = nullptr;  // nullptr = stdout
+
+  FILE* serialFile() { return serialOut ? serialOut : stdout; }
+
+  size_t heapBaseline = 0;
+  uint32_t minFreeHeap = UINT32_MAX;
+
+  // Roughly what the C3 Arduino core leaves to the application
+  const uint32_t SIMULATED_HEAP = 280 * 1024;
+
+  // Give background tasks (serial drain) a moment before the process ends
+  void finish() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    fflush(stdout);
+  }
+
+  const char* env(const char* name) {
+    const char* v = getenv(name);
+    return (v && *v) ? v : nullptr;
+  }
+}
+
+uint64_t nowMicros() {
+  double s = scale.load();
+  uint64_t real = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - scaleStart).count();
+  return rebase.load() + (uint64_t)(real * s) + skipped.load();
+}
+
+void sleepMicros(uint64_t us) {
+  double s = scale.load();
+  if (s <= 0.0) {
+    skipped += us;
+    std::this_thread::yield();
+  } else {
+    std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)(us / s)));
+  }
+  pollSntp();
+
+  if (runLimit != 0 && nowMicros() >= runLimit) {
+    finish();
+    exit(0);
+  }
+}
+
+void setTimeScale(double s) {
+  uint64_t now = nowMicros();
+  scaleStart = Clock::now();
+  skipped = 0;
+  rebase = now;
+  scale = s < 0.0 ? 0.0 : s;
+}
+
+double timeScale() {
+  return scale.load();
+}
+
+uint64_t runLimitMicros() {
+  return runLimit;
+}
+
+uint64_t efuseMac() {
+  return mac;
+}
+
+bool setSerialOutput(const char* path) {
+  FILE* f = nullptr;
+  if (path && !(f = fopen(path, "w"))) return false;
+  if (serialOut) fclose(serialOut);
+  serialOut = f;
+  return true;
+}
+
+void init(int argc, char** argv) {
+  (void)argc;
+  (void)argv;
+
+  heapBaseline = mallinfo2().uordblks;
+
+  if (const char* v = env("VOLTAGELOG_TIME_SCALE")) setTimeScale(atof(v));
+  if (const char* v = env("VOLTAGELOG_RUN_SECONDS")) runLimit = (uint64_t)(atof(v) * 1e6);
+  if (const char* v = env("VOLTAGELOG_ADC_TRACE")) {
+    if (!loadAdcTrace(v)) fprintf(stderr, "[hal] cannot read ADC trace %s\n", v);
+  }
+  if (const char* v = env("VOLTAGELOG_ADC_NOISE")) setAdcNoise(atof(v));
+  if (const char* v = env("VOLTAGELOG_ADC_EFUSE")) setAdcEfuse(atoi(v) != 0);
+  if (const char* v = env("VOLTAGELOG_EEPROM")) setEepromPath(v);
+  if (const char* v = env("VOLTAGELOG_SERIAL")) {
+    if (!setSerialOutput(v)) fprintf(stderr, "[hal] cannot write serial output %s\n", v);
+  }
+  if (const char* v = env("VOLTAGELOG_WIFI")) setWiFiUp(strcmp(v, "down") != 0);
+  if (const char* v = env("VOLTAGELOG_WIFI_CONNECT_MS")) setWiFiConnectDelay(atoi(v));
+  if (const char* v = env("VOLTAGELOG_WIFI_FLAP")) setWiFiFlapPeriod((uint32_t)(atof(v) * 1000));
+  if (const char* v = env("VOLTAGELOG_HTTP_OVERRIDE")) setHttpOverride(v);
+
+  if (const char* v = env("VOLTAGELOG_MAC")) {
+    mac = strtoull(v, nullptr, 16);
+  } else {
+    // Stable per host: derived from the hostname
+    char host[64] = {0};
+    gethostname(host, sizeof(host) - 1);
+    uint64_t h = 1469598103934665603ULL;
+    for (const char* p = host; *p; p++) h = (h ^ (uint8_t)*p) * 1099511628211ULL;
+    mac = h & 0xFFFFFFFFFFFFULL;
+  }
+}
+
+}  // namespace hal
+
+uint32_t esp_random() {
+  static std::random_device rd;
+  return rd();
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (size--) n += write(*buffer++);
+  return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (n < 0) return 0;
+  return write((const uint8_t*)buf, (size_t)n < sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return fwrite(&c, 1, 1, hal::serialFile());
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  FILE* out = hal::serialFile();
+  size_t n = fwrite(buffer, 1, size, out);
+  fflush(out);
+  return n;
+}
+
+uint32_t EspClass::getHeapSize() {
+  return hal::SIMULATED_HEAP;
+}
+
+uint32_t EspClass::getFreeHeap() {
+  // Simulated C3 heap minus what the process allocated since start
+  size_t used = mallinfo2().uordblks;
+  size_t grown = used > hal::heapBaseline ? used - hal::heapBaseline : 0;
+  uint32_t free = grown >= hal::SIMULATED_HEAP ? 0 : hal::SIMULATED_HEAP - grown;
+  if (free < hal::minFreeHeap) hal::minFreeHeap = free;
+  return free;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+  getFreeHeap();
+  return hal::minFreeHeap;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+  return getFreeHeap();
+}
+
+uint64_t EspClass::getEfuseMac() {
+  return hal::efuseMac();
+}
+
+void EspClass::restart() {
+  fprintf(stderr, "[hal] ESP.restart() - exiting\n");
+  hal::finish();
+  exit(0);
+}
+
+int main(int argc, char** argv) {
+  hal::init(argc, argv);
+  setup();
+  for (;;) {
+    loop();
+    if (hal::runLimitMicros() != 0 && hal::nowMicros() >= hal::runLimitMicros()) break;
+  }
+  hal::finish();
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include "EEPROM.h"
+#include "hal.h"
+#include <stdio.h>
+#include <string>
+
+EEPROMClass EEPROM;
+
+namespace hal {
+
+namespace {
+  std::string path = "eeprom.bin";
+}
+
+void setEepromPath(const char* p) {
+  path = p;
+}
+
+const char* eepromPath() {
+  return path.c_str();
+}
+
+}  // namespace hal
+
+bool EEPROMClass::begin(size_t size) {
+  if (size == 0) return false;
+  if (size == data.size()) return true;
+
+  // Like the ESP32 core: another size reallocates the RAM copy (changes not
+  // committed yet are lost) and resizes what is stored. Bytes past the end
+  // of a shorter store read as 0, bytes past a smaller size are gone.
+  data.assign(size, 0);
+  dirty = false;
+  long stored = 0;
+  FILE* f = fopen(hal::eepromPath(), "rb");
+  if (f) {
+    size_t n = fread(data.data(), 1, size, f);
+    (void)n;
+    if (fseek(f, 0, SEEK_END) == 0) stored = ftell(f);
+    fclose(f);
+  }
+  if (stored > (long)size) {
+    f = fopen(hal::eepromPath(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(data.data(), 1, size, f) == size;
+    fclose(f);
+    return ok;
+  }
+  return true;
+}
+
+void EEPROMClass::end() {
+  commit();
+  data.clear();
+}
+
+bool EEPROMClass::commit() {
+  if (data.empty()) return false;
+  if (!dirty) return true;
+
+  FILE* f = fopen(hal::eepromPath(), "wb");
+  if (!f) return false;
+  bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+  fclose(f);
+  dirty = false;
+  commitCount++;
+  return ok;
+}
+
+uint8_t EEPROMClass::read(int address) const {
+  if (address < 0 || (size_t)address >= data.size()) return 0;
+  return data[address];
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  if (address < 0 || (size_t)address >= data.size()) return;
+  if (data[address] != value) {
+    data[address] = value;
+    dirty = true;
+  }
+}
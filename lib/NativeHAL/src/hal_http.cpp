@@ -0,0 +1,250 @@
+#include "HTTPClient.h"
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <mutex>
+#include <string>
+
+namespace hal {
+
+namespace {
+  std::mutex httpMutex;
+  HttpHandler handler;
+  std::string overrideBase;
+}
+
+void setHttpHandler(HttpHandler h) {
+  std::lock_guard<std::mutex> lock(httpMutex);
+  handler = h;
+}
+
+const HttpHandler& httpHandler() {
+  return handler;
+}
+
+void setHttpOverride(const char* baseUrl) {
+  std::lock_guard<std::mutex> lock(httpMutex);
+  overrideBase = baseUrl ? baseUrl : "";
+  while (!overrideBase.empty() && overrideBase.back() == '/') overrideBase.pop_back();
+}
+
+const char* httpOverride() {
+  return overrideBase.c_str();
+}
+
+}  // namespace hal
+
+namespace {
+  struct ParsedUrl {
+    std::string host;
+    uint16_t port;
+    std::string path;
+    bool tls;
+  };
+
+  bool parseUrl(const std::string& url, ParsedUrl& out) {
+    size_t schemeEnd = url.find("://");
+    if (schemeEnd == std::string::npos) return false;
+    std::string scheme = url.substr(0, schemeEnd);
+    out.tls = scheme == "https";
+    out.port = out.tls ? 443 : 80;
+
+    size_t hostStart = schemeEnd + 3;
+    size_t pathStart = url.find('/', hostStart);
+    std::string hostPort = url.substr(hostStart, pathStart == std::string::npos
+                                                     ? std::string::npos
+                                                     : pathStart - hostStart);
+    out.path = pathStart == std::string::npos ? "/" : url.substr(pathStart);
+
+    size_t colon = hostPort.find(':');
+    if (colon != std::string::npos) {
+      out.port = (uint16_t)atoi(hostPort.c_str() + colon + 1);
+      hostPort = hostPort.substr(0, colon);
+    }
+    out.host = hostPort;
+    return !out.host.empty();
+  }
+
+  // Replace scheme://host[:port] with the override base URL
+  std::string applyOverride(const std::string& url) {
+    std::string base = hal::httpOverride();
+    if (base.empty()) return url;
+    size_t schemeEnd = url.find("://");
+    if (schemeEnd == std::string::npos) return url;
+    size_t pathStart = url.find('/', schemeEnd + 3);
+    return base + (pathStart == std::string::npos ? "/" : url.substr(pathStart));
+  }
+}
+
+bool HTTPClient::begin(const String& u) {
+  url = u;
+  requestHeaders.clear();
+  responseHeaders.clear();
+  response = String();
+  return true;
+}
+
+void HTTPClient::end() {
+  requestHeaders.clear();
+  stream.stop();
+}
+
+void HTTPClient::addHeader(const String& name, const String& value) {
+  requestHeaders.push_back(std::make_pair(name, value));
+}
+
+void HTTPClient::collectHeaders(const char* headerKeys[], size_t count) {
+  wantedHeaders.clear();
+  for (size_t i = 0; i < count; i++) wantedHeaders.push_back(String(headerKeys[i]));
+}
+
+int HTTPClient::getSize() const {
+  // In-process handlers answer without headers; their body is all there is
+  if (responseHeaders.empty()) return response.length();
+  String length = header("Content-Length");
+  return length.length() ? length.toInt() : -1;
+}
+
+String HTTPClient::header(const char* name) const {
+  for (const auto& h : responseHeaders) {
+    if (strcasecmp(h.first.c_str(), name) == 0) return h.second;
+  }
+  return String();
+}
+
+int HTTPClient::GET() { return request("GET", String()); }
+int HTTPClient::POST(const String& body) { return request("POST", body); }
+int HTTPClient::POST(uint8_t* body, size_t size) { return request("POST", String((const char*)body, size)); }
+int HTTPClient::PUT(const String& body) { return request("PUT", body); }
+int HTTPClient::PATCH(const String& body) { return request("PATCH", body); }
+int HTTPClient::sendRequest(const char* method, const String& body) { return request(method, body); }
+
+String HTTPClient::errorToString(int error) {
+  switch (error) {
+    case HTTPC_ERROR_CONNECTION_REFUSED: return "connection refused";
+    case HTTPC_ERROR_SEND_PAYLOAD_FAILED: return "send payload failed";
+    case HTTPC_ERROR_NOT_CONNECTED: return "not connected";
+    case HTTPC_ERROR_CONNECTION_LOST: return "connection lost";
+    case HTTPC_ERROR_READ_TIMEOUT: return "read Timeout";
+  }
+  return String();
+}
+
+int HTTPClient::request(const char* method, const String& body) {
+  response = String();
+  responseHeaders.clear();
+  stream.stop();
+  if (!hal::wifiUp()) return HTTPC_ERROR_CONNECTION_REFUSED;
+
+  hal::HttpHandler h;
+  {
+    std::lock_guard<std::mutex> lock(hal::httpMutex);
+    h = hal::handler;
+  }
+  int code = h ? h(method, url, body, response)
+               : requestSocket(method, String(applyOverride(url.std())), body);
+  if (code > 0) stream.attach(&response);
+  return code;
+}
+
+int HTTPClient::requestSocket(const char* method, const String& target, const String& body) {
+  ParsedUrl u;
+  if (!parseUrl(target.std(), u) || u.tls) return HTTPC_ERROR_CONNECTION_REFUSED;
+
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* res = nullptr;
+  char port[8];
+  snprintf(port, sizeof(port), "%u", u.port);
+  if (getaddrinfo(u.host.c_str(), port, &hints, &res) != 0 || !res) {
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+
+  int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  if (fd >= 0) {
+    timeval tv = {timeout / 1000, (timeout % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  }
+  if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+    if (fd >= 0) close(fd);
+    freeaddrinfo(res);
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  freeaddrinfo(res);
+
+  std::string req = std::string(method) + " " + u.path + " HTTP/1.1\r\n";
+  req += "Host: " + u.host + "\r\nConnection: close\r\n";
+  req += "Content-Length: " + std::to_string(body.length()) + "\r\n";
+  for (const auto& h : requestHeaders) {
+    req += h.first.std() + ": " + h.second.std() + "\r\n";
+  }
+  req += "\r\n";
+  req += body.std();
+
+  size_t sent = 0;
+  while (sent < req.size()) {
+    ssize_t n = send(fd, req.data() + sent, req.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      close(fd);
+      return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+    }
+    sent += n;
+  }
+
+  std::string raw;
+  char buf[4096];
+  for (;;) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n < 0) {
+      close(fd);
+      return raw.empty() ? HTTPC_ERROR_READ_TIMEOUT : HTTPC_ERROR_CONNECTION_LOST;
+    }
+    if (n == 0) break;
+    raw.append(buf, n);
+  }
+  close(fd);
+
+  size_t headerEnd = raw.find("\r\n\r\n");
+  if (headerEnd == std::string::npos) return HTTPC_ERROR_CONNECTION_LOST;
+
+  int code = 0;
+  if (sscanf(raw.c_str(), "HTTP/%*s %d", &code) != 1) return HTTPC_ERROR_CONNECTION_LOST;
+
+  bool chunked = false;
+  size_t lineStart = raw.find("\r\n") + 2;
+  while (lineStart < headerEnd) {
+    size_t lineEnd = raw.find("\r\n", lineStart);
+    std::string line = raw.substr(lineStart, lineEnd - lineStart);
+    size_t colon = line.find(':');
+    if (colon != std::string::npos) {
+      std::string name = line.substr(0, colon);
+      size_t valueStart = line.find_first_not_of(' ', colon + 1);
+      std::string value = valueStart == std::string::npos ? "" : line.substr(valueStart);
+      if (strcasecmp(name.c_str(), "Transfer-Encoding") == 0 && value == "chunked") chunked = true;
+      responseHeaders.push_back(std::make_pair(String(name), String(value)));
+    }
+    lineStart = lineEnd + 2;
+  }
+
+  std::string payload = raw.substr(headerEnd + 4);
+  if (chunked) {
+    std::string decoded;
+    size_t pos = 0;
+    for (;;) {
+      size_t sizeEnd = payload.find("\r\n", pos);
+      if (sizeEnd == std::string::npos) break;
+      size_t size = strtoul(payload.c_str() + pos, nullptr, 16);
+      if (size == 0) break;
+      decoded.append(payload, sizeEnd + 2, size);
+      pos = sizeEnd + 2 + size + 2;
+    }
+    payload = decoded;
+  }
+  response = String(payload);
+  return code;
+}
@@ -0,0 +1,46 @@
+#include "rom/miniz.h"
+#include <string.h>
+
+// zlib keeps its own history window, so output can go straight to wherever
+// the caller points pOut_buf_next. zlib state is released when the stream
+// ends or fails; an inflater freed mid-stream leaks it (the ROM one has no
+// heap state, so the firmware never cleans up).
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const mz_uint8* pIn_buf_next,
+                              size_t* pIn_buf_size, mz_uint8* pOut_buf_start,
+                              mz_uint8* pOut_buf_next, size_t* pOut_buf_size,
+                              const mz_uint32 decomp_flags) {
+  (void)pOut_buf_start;
+  if (r->state >= 2) {
+    *pIn_buf_size = 0;
+    *pOut_buf_size = 0;
+    return r->state == 2 ? TINFL_STATUS_DONE : TINFL_STATUS_FAILED;
+  }
+  if (r->state == 0) {
+    memset(&r->stream, 0, sizeof(r->stream));
+    int bits = (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER) ? 15 : -15;
+    if (inflateInit2(&r->stream, bits) != Z_OK) return TINFL_STATUS_FAILED;
+    r->state = 1;
+  }
+
+  z_stream& s = r->stream;
+  s.next_in = (Bytef*)pIn_buf_next;
+  s.avail_in = (uInt)*pIn_buf_size;
+  s.next_out = pOut_buf_next;
+  s.avail_out = (uInt)*pOut_buf_size;
+  int rc = inflate(&s, Z_NO_FLUSH);
+  *pIn_buf_size -= s.avail_in;
+  *pOut_buf_size -= s.avail_out;
+
+  if (rc == Z_STREAM_END) {
+    inflateEnd(&s);
+    r->state = 2;
+    return TINFL_STATUS_DONE;
+  }
+  if (rc != Z_OK && rc != Z_BUF_ERROR) {
+    inflateEnd(&s);
+    r->state = 3;
+    return TINFL_STATUS_FAILED;
+  }
+  if (s.avail_out == 0) return TINFL_STATUS_HAS_MORE_OUTPUT;
+  return TINFL_STATUS_NEEDS_MORE_INPUT;
+}
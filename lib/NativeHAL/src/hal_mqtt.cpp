@@ -0,0 +1,96 @@
+#include "MQTT.h"
+#include "WiFi.h"
+#include "hal.h"
+#include <mutex>
+#include <set>
+#include <string>
+
+namespace hal {
+
+namespace {
+  std::mutex mqttMutex;
+  MqttHandler handler;
+  std::set<std::string> sessions;  // client IDs the "broker" keeps state for
+}
+
+void setMqttHandler(MqttHandler h) {
+  std::lock_guard<std::mutex> lock(mqttMutex);
+  handler = h;
+  sessions.clear();
+}
+
+const MqttHandler& mqttHandler() {
+  return handler;
+}
+
+}  // namespace hal
+
+bool MQTTClient::connect(const char* id, bool) {
+  open = false;
+  present = false;
+  if (WiFi.status() != WL_CONNECTED || !host) {
+    error = LWMQTT_NETWORK_FAILED_CONNECT;
+    return false;
+  }
+  hal::MqttHandler handler;
+  {
+    std::lock_guard<std::mutex> lock(hal::mqttMutex);
+    handler = hal::handler;
+  }
+  if (!handler) {
+    error = LWMQTT_NETWORK_FAILED_CONNECT;
+    return false;
+  }
+  if (!handler(id, nullptr, nullptr, 0)) {
+    error = LWMQTT_CONNECTION_DENIED;
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(hal::mqttMutex);
+  if (cleanSession) {
+    hal::sessions.erase(id);
+  } else {
+    present = !hal::sessions.insert(id).second;
+  }
+  clientId = id;
+  open = true;
+  error = LWMQTT_SUCCESS;
+  return true;
+}
+
+bool MQTTClient::connected() {
+  if (open && WiFi.status() != WL_CONNECTED) open = false;
+  return open;
+}
+
+bool MQTTClient::publish(const char* topic, const char* payload, int length, bool, int) {
+  if (!connected()) {
+    error = LWMQTT_NETWORK_FAILED_CONNECT;
+    return false;
+  }
+  // Topic and payload have to fit the client's buffer
+  if (length < 0 || (size_t)length + strlen(topic) + 8 > (size_t)bufSize) {
+    error = LWMQTT_BUFFER_TOO_SHORT;
+    open = false;
+    return false;
+  }
+  hal::MqttHandler handler;
+  {
+    std::lock_guard<std::mutex> lock(hal::mqttMutex);
+    handler = hal::handler;
+  }
+  // No PUBACK within the timeout
+  if (!handler || !handler(clientId.c_str(), topic, payload, (size_t)length)) {
+    error = LWMQTT_NETWORK_TIMEOUT;
+    open = false;
+    return false;
+  }
+  error = LWMQTT_SUCCESS;
+  return true;
+}
+
+bool MQTTClient::disconnect() {
+  bool was = open;
+  open = false;
+  return was;
+}
@@ -0,0 +1,137 @@
+#include "Arduino.h"
+#include "esp_sntp.h"
+#include <sys/time.h>
+#include <mutex>
+
+// Simulated device wall clock and SNTP client on top of the virtual clock.
+// The firmware's time() and gettimeofday() calls resolve to the versions
+// below instead of the host's, so accelerated runs see a consistent clock.
+
+namespace hal {
+
+namespace {
+  std::mutex timeMutex;
+
+  int64_t utcAtBoot = 0;        // true UTC at virtual time 0, in us
+  double driftPpm = 0.0;
+  bool sntpEnabled = true;
+  uint64_t sntpDelayUs = 1500000;
+  uint64_t sntpIntervalUs = 3600000000ULL;
+
+  bool sntpStarted = false;
+  uint64_t nextSync = 0;
+  uint32_t syncCount = 0;
+
+  // Device clock: base + elapsed virtual time since the last step
+  int64_t systemBase = 0;
+  uint64_t systemBaseMono = 0;
+
+  sntp_sync_time_cb_t syncCallback = nullptr;
+  bool initialized = false;
+
+  void ensureInit() {
+    if (initialized) return;
+    initialized = true;
+
+    const char* v = getenv("VOLTAGELOG_UTC_START");
+    if (v && *v) {
+      utcAtBoot = (int64_t)(atof(v) * 1e6);
+    } else {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      utcAtBoot = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+    if ((v = getenv("VOLTAGELOG_CLOCK_PPM")) && *v) driftPpm = atof(v);
+    if ((v = getenv("VOLTAGELOG_NTP")) && *v) sntpEnabled = strcmp(v, "off") != 0;
+    if ((v = getenv("VOLTAGELOG_NTP_DELAY_MS")) && *v) sntpDelayUs = (uint64_t)(atof(v) * 1000);
+    if ((v = getenv("VOLTAGELOG_NTP_INTERVAL")) && *v) sntpIntervalUs = (uint64_t)(atof(v) * 1e6);
+  }
+
+  int64_t trueUtcAt(uint64_t mono) {
+    return utcAtBoot + (int64_t)(mono * (1.0 - driftPpm * 1e-6));
+  }
+
+  int64_t systemAt(uint64_t mono) {
+    return systemBase + (int64_t)(mono - systemBaseMono);
+  }
+}
+
+void pollSntp() {
+  sntp_sync_time_cb_t cb = nullptr;
+  struct timeval tv;
+  {
+    std::lock_guard<std::mutex> lock(timeMutex);
+    ensureInit();
+    if (!sntpStarted || !sntpEnabled) return;
+    uint64_t mono = nowMicros();
+    if (mono < nextSync) return;
+
+    // Step the device clock to the reference
+    systemBase = trueUtcAt(mono);
+    systemBaseMono = mono;
+    nextSync = mono + sntpIntervalUs;
+    syncCount++;
+    tv.tv_sec = systemBase / 1000000;
+    tv.tv_usec = systemBase % 1000000;
+    cb = syncCallback;
+  }
+  if (cb) cb(&tv);
+}
+
+void startSntp() {
+  std::lock_guard<std::mutex> lock(timeMutex);
+  ensureInit();
+  if (sntpStarted) return;  // lwIP keeps one client running
+  sntpStarted = true;
+  nextSync = nowMicros() + sntpDelayUs;
+}
+
+void setClockDriftPpm(double ppm) {
+  std::lock_guard<std::mutex> lock(timeMutex);
+  ensureInit();
+  driftPpm = ppm;
+}
+
+void setSntpEnabled(bool enabled) {
+  std::lock_guard<std::mutex> lock(timeMutex);
+  ensureInit();
+  sntpEnabled = enabled;
+}
+
+int64_t trueUtcMicros() {
+  std::lock_guard<std::mutex> lock(timeMutex);
+  ensureInit();
+  return trueUtcAt(nowMicros());
+}
+
+int64_t systemUtcMicros() {
+  pollSntp();
+  std::lock_guard<std::mutex> lock(timeMutex);
+  return systemAt(nowMicros());
+}
+
+uint32_t sntpSyncs() {
+  std::lock_guard<std::mutex> lock(timeMutex);
+  return syncCount;
+}
+
+}  // namespace hal
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback) {
+  std::lock_guard<std::mutex> lock(hal::timeMutex);
+  hal::syncCallback = callback;
+}
+
+// Interpose the libc wall clock for the whole program
+extern "C" int gettimeofday(struct timeval* tv, void*) noexcept {
+  int64_t us = hal::systemUtcMicros();
+  tv->tv_sec = us / 1000000;
+  tv->tv_usec = us % 1000000;
+  return 0;
+}
+
+extern "C" time_t time(time_t* out) noexcept {
+  time_t t = (time_t)(hal::systemUtcMicros() / 1000000);
+  if (out) *out = t;
+  return t;
+}
@@ -0,0 +1,156 @@
+#include "Update.h"
+#include "esp_ota_ops.h"
+#include <string.h>
+#include <mutex>
+#include <string>
+
+// Two app slots like the default Arduino partition table. The process
+// always "runs" from app0 and an update goes to app1, a file on the host.
+
+UpdateClass Update;
+
+namespace hal {
+
+namespace {
+  std::mutex otaMutex;
+  bool initialized = false;
+  std::string slotPath = "ota_slot.bin";
+  esp_ota_img_states_t runningState = ESP_OTA_IMG_VALID;
+
+  const uint32_t SLOT_SIZE = 0x140000;  // 1.25 MB, default_4MB.csv
+  const esp_partition_t APP0 = {0x10000, SLOT_SIZE, "app0"};
+  const esp_partition_t APP1 = {0x150000, SLOT_SIZE, "app1"};
+
+  void ensureInit() {
+    if (initialized) return;
+    initialized = true;
+    const char* v = getenv("VOLTAGELOG_OTA_SLOT");
+    if (v && *v) slotPath = v;
+    v = getenv("VOLTAGELOG_OTA_STATE");
+    if (v && strcmp(v, "pending_verify") == 0) runningState = ESP_OTA_IMG_PENDING_VERIFY;
+  }
+}
+
+const char* otaSlotPath() {
+  std::lock_guard<std::mutex> lock(otaMutex);
+  ensureInit();
+  return slotPath.c_str();
+}
+
+void setOtaPendingVerify(bool pending) {
+  std::lock_guard<std::mutex> lock(otaMutex);
+  ensureInit();
+  runningState = pending ? ESP_OTA_IMG_PENDING_VERIFY : ESP_OTA_IMG_VALID;
+}
+
+}  // namespace hal
+
+bool UpdateClass::begin(size_t size, int command, int ledPin, uint8_t ledOn, const char* label) {
+  (void)command;
+  (void)ledPin;
+  (void)ledOn;
+  (void)label;
+  if (running) abort();
+  error = UPDATE_ERROR_OK;
+  written = 0;
+  expected = size;
+  if (size != UPDATE_SIZE_UNKNOWN && size > hal::SLOT_SIZE) {
+    error = UPDATE_ERROR_SPACE;
+    return false;
+  }
+  file = fopen(hal::otaSlotPath(), "wb");
+  if (!file) {
+    error = UPDATE_ERROR_WRITE;
+    return false;
+  }
+  running = true;
+  return true;
+}
+
+size_t UpdateClass::write(uint8_t* data, size_t len) {
+  if (!running || hasError()) return 0;
+  if (written == 0 && len > 0 && data[0] != 0xE9) {
+    abort();
+    error = UPDATE_ERROR_MAGIC_BYTE;
+    return 0;
+  }
+  size_t limit = expected == UPDATE_SIZE_UNKNOWN ? hal::SLOT_SIZE : expected;
+  if (written + len > limit) {
+    error = UPDATE_ERROR_SPACE;
+    return 0;
+  }
+  if (fwrite(data, 1, len, file) != len) {
+    error = UPDATE_ERROR_WRITE;
+    return 0;
+  }
+  written += len;
+  return len;
+}
+
+bool UpdateClass::end(bool evenIfRemaining) {
+  if (!running || hasError()) return false;
+  if (!evenIfRemaining && expected != UPDATE_SIZE_UNKNOWN && written != expected) {
+    error = UPDATE_ERROR_SIZE;
+    return false;
+  }
+  if (written == 0) {
+    error = UPDATE_ERROR_SIZE;
+    return false;
+  }
+  fclose(file);
+  file = nullptr;
+  running = false;
+  fprintf(stderr, "[hal] OTA image (%zu bytes) in %s, next boot from app1\n", written,
+          hal::otaSlotPath());
+  return true;
+}
+
+void UpdateClass::abort() {
+  if (file) fclose(file);
+  file = nullptr;
+  running = false;
+  error = UPDATE_ERROR_ABORT;
+}
+
+const char* UpdateClass::errorString() const {
+  switch (error) {
+    case UPDATE_ERROR_OK: return "No Error";
+    case UPDATE_ERROR_WRITE: return "Flash Write Failed";
+    case UPDATE_ERROR_SPACE: return "Not Enough Space";
+    case UPDATE_ERROR_SIZE: return "Bad Size Given";
+    case UPDATE_ERROR_MAGIC_BYTE: return "Wrong Magic Byte";
+    case UPDATE_ERROR_ACTIVATE: return "Could Not Activate The Firmware";
+    case UPDATE_ERROR_ABORT: return "Aborted";
+  }
+  return "UNKNOWN";
+}
+
+const esp_partition_t* esp_ota_get_running_partition() {
+  return &hal::APP0;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t*) {
+  return &hal::APP1;
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition,
+                                      esp_ota_img_states_t* state) {
+  std::lock_guard<std::mutex> lock(hal::otaMutex);
+  hal::ensureInit();
+  if (partition != &hal::APP0) return ESP_FAIL;
+  *state = hal::runningState;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback() {
+  std::lock_guard<std::mutex> lock(hal::otaMutex);
+  hal::ensureInit();
+  hal::runningState = ESP_OTA_IMG_VALID;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot() {
+  fprintf(stderr, "[hal] image marked invalid - rolling back to the previous slot\n");
+  ESP.restart();
+  return ESP_OK;
+}
@@ -0,0 +1,408 @@
+#include "ESPAsyncWebServer.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <thread>
+
+namespace hal {
+
+uint16_t webServerPort() {
+  const char* v = getenv("VOLTAGELOG_HTTP_PORT");
+  return v && *v ? (uint16_t)atoi(v) : 8080;
+}
+
+}  // namespace hal
+
+namespace {
+  const char* reason(int code) {
+    switch (code) {
+      case 200: return "OK";
+      case 204: return "No Content";
+      case 206: return "Partial Content";
+      case 400: return "Bad Request";
+      case 401: return "Unauthorized";
+      case 404: return "Not Found";
+      case 410: return "Gone";
+      case 413: return "Payload Too Large";
+      case 416: return "Range Not Satisfiable";
+      case 500: return "Internal Server Error";
+      case 503: return "Service Unavailable";
+    }
+    return "";
+  }
+
+  bool sendAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+      ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+      if (n <= 0) return false;
+      data += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  std::string urlDecode(const std::string& s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); i++) {
+      if (s[i] == '+') {
+        out += ' ';
+      } else if (s[i] == '%' && i + 2 < s.size()) {
+        out += (char)strtol(s.substr(i + 1, 2).c_str(), nullptr, 16);
+        i += 2;
+      } else {
+        out += s[i];
+      }
+    }
+    return out;
+  }
+
+  WebRequestMethodComposite parseMethod(const std::string& m) {
+    if (m == "GET") return HTTP_GET;
+    if (m == "HEAD") return HTTP_HEAD;
+    if (m == "POST") return HTTP_POST;
+    if (m == "PUT") return HTTP_PUT;
+    if (m == "DELETE") return HTTP_DELETE;
+    if (m == "OPTIONS") return HTTP_OPTIONS;
+    if (m == "PATCH") return HTTP_PATCH;
+    return HTTP_ANY;
+  }
+}
+
+// --- Responses ---
+
+bool AsyncWebServerResponse::writeHead(int fd, long length) {
+  std::string head = "HTTP/1.1 " + std::to_string(code) + " " + reason(code) + "\r\n";
+  if (contentType.length() > 0) head += "Content-Type: " + contentType.std() + "\r\n";
+  if (length >= 0) head += "Content-Length: " + std::to_string(length) + "\r\n";
+  for (const AsyncWebHeader& h : headers) {
+    head += h.name().std() + ": " + h.value().std() + "\r\n";
+  }
+  head += "Connection: close\r\n\r\n";
+  return sendAll(fd, head.data(), head.size());
+}
+
+bool AsyncBasicResponse::writeTo(AsyncClient& client) {
+  if (!writeHead(client.fd(), content.length())) return false;
+  return sendAll(client.fd(), content.c_str(), content.length());
+}
+
+bool AsyncFillerResponse::writeTo(AsyncClient& client) {
+  // Close-delimited body, filled in TCP-window sized pieces like AsyncTCP
+  const int fd = client.fd();
+  if (!writeHead(fd, contentLength)) return false;
+  uint8_t buf[1436];
+  size_t index = 0;
+  for (;;) {
+    size_t n = filler(buf, sizeof(buf), index);
+    if (!client.connected()) {
+      // abort(): RST on close
+      linger reset = {1, 0};
+      setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+      return false;
+    }
+    if (n == RESPONSE_TRY_AGAIN) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      continue;
+    }
+    if (n == 0) {
+      if (contentLength >= 0 && (long)index < contentLength) {
+        // Short of the Content-Length the library sends nothing more and
+        // waits for acks that never come, until the client gives up
+        fprintf(stderr, "[hal] response stalled at %zu of %ld bytes\n", index, contentLength);
+        char sink[256];
+        for (;;) {
+          ssize_t r = recv(fd, sink, sizeof(sink), 0);
+          if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) break;
+        }
+        return false;
+      }
+      break;
+    }
+    if (!sendAll(fd, (const char*)buf, n)) return false;
+    index += n;
+    if (contentLength >= 0 && (long)index >= contentLength) break;
+  }
+  return true;
+}
+
+// --- Requests ---
+
+const char* AsyncWebServerRequest::methodToString() const {
+  switch (requestMethod) {
+    case HTTP_GET: return "GET";
+    case HTTP_HEAD: return "HEAD";
+    case HTTP_POST: return "POST";
+    case HTTP_PUT: return "PUT";
+    case HTTP_DELETE: return "DELETE";
+    case HTTP_OPTIONS: return "OPTIONS";
+    case HTTP_PATCH: return "PATCH";
+  }
+  return "UNKNOWN";
+}
+
+bool AsyncWebServerRequest::hasParam(const String& name, bool post, bool file) const {
+  return getParam(name, post, file) != nullptr;
+}
+
+AsyncWebParameter* AsyncWebServerRequest::getParam(const String& name, bool post, bool) const {
+  for (const auto& p : parameters) {
+    if (p->name() == name && p->isPost() == post) return p.get();
+  }
+  return nullptr;
+}
+
+AsyncWebParameter* AsyncWebServerRequest::getParam(size_t index) const {
+  return index < parameters.size() ? parameters[index].get() : nullptr;
+}
+
+bool AsyncWebServerRequest::hasArg(const char* name) const {
+  for (const auto& p : parameters) {
+    if (p->name() == name) return true;
+  }
+  return false;
+}
+
+const String& AsyncWebServerRequest::arg(const char* name) const {
+  static const String empty;
+  for (const auto& p : parameters) {
+    if (p->name() == name) return p->value();
+  }
+  return empty;
+}
+
+bool AsyncWebServerRequest::hasHeader(const String& name) const {
+  return getHeader(name) != nullptr;
+}
+
+AsyncWebHeader* AsyncWebServerRequest::getHeader(const String& name) const {
+  for (const auto& h : requestHeaders) {
+    if (strcasecmp(h->name().c_str(), name.c_str()) == 0) return h.get();
+  }
+  return nullptr;
+}
+
+void AsyncWebServerRequest::send(int code, const String& contentType, const String& content) {
+  send(beginResponse(code, contentType, content));
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse* r) {
+  response.reset(r);
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(int code, const String& contentType,
+                                                             const String& content) {
+  return new AsyncBasicResponse(code, contentType, content);
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginResponse(const String& contentType, size_t len,
+                                                             AwsResponseFiller filler) {
+  return new AsyncFillerResponse(200, contentType, filler, (long)len);
+}
+
+AsyncWebServerResponse* AsyncWebServerRequest::beginChunkedResponse(const String& contentType,
+                                                                    AwsResponseFiller filler) {
+  return new AsyncFillerResponse(200, contentType, filler, -1);
+}
+
+// --- Handlers and server ---
+
+bool AsyncCallbackWebHandler::canHandle(const AsyncWebServerRequest* request) const {
+  if (!(method & request->method())) return false;
+  const String& url = request->url();
+  if (uri.endsWith("*")) return url.startsWith(uri.substring(0, uri.length() - 1));
+  return url == uri || url.startsWith(uri + "/");
+}
+
+AsyncWebServer::~AsyncWebServer() {
+  end();
+}
+
+AsyncCallbackWebHandler& AsyncWebServer::on(const char* uri, ArRequestHandlerFunction onRequest) {
+  return on(uri, HTTP_ANY, onRequest, nullptr, nullptr);
+}
+
+AsyncCallbackWebHandler& AsyncWebServer::on(const char* uri, WebRequestMethodComposite method,
+                                            ArRequestHandlerFunction onRequest) {
+  return on(uri, method, onRequest, nullptr, nullptr);
+}
+
+AsyncCallbackWebHandler& AsyncWebServer::on(const char* uri, WebRequestMethodComposite method,
+                                            ArRequestHandlerFunction onRequest,
+                                            ArUploadHandlerFunction onUpload,
+                                            ArBodyHandlerFunction onBody) {
+  std::unique_ptr<AsyncCallbackWebHandler> h(new AsyncCallbackWebHandler());
+  h->uri = uri;
+  h->method = method;
+  h->onRequest = onRequest;
+  h->onUpload = onUpload;
+  h->onBody = onBody;
+  handlers.push_back(std::move(h));
+  return *handlers.back();
+}
+
+void AsyncWebServer::begin() {
+  if (listenFd >= 0) return;
+
+  // Port 80 needs root on Linux, the stand-in listens on a high port
+  uint16_t port = hal::webServerPort();
+  (void)devicePort;
+
+  listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, 64) != 0) {
+    fprintf(stderr, "[hal] web server cannot listen on port %u\n", port);
+    close(listenFd);
+    listenFd = -1;
+    return;
+  }
+  fprintf(stderr, "[hal] web server on http://127.0.0.1:%u\n", port);
+  std::thread(&AsyncWebServer::serve, this).detach();
+}
+
+void AsyncWebServer::end() {
+  if (listenFd >= 0) {
+    shutdown(listenFd, SHUT_RDWR);
+    close(listenFd);
+    listenFd = -1;
+  }
+}
+
+void AsyncWebServer::serve() {
+  for (;;) {
+    int listening = listenFd;
+    if (listening < 0) return;
+    int fd = accept(listening, nullptr, nullptr);
+    if (fd < 0) continue;
+    timeval tv = {5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    // lwIP's TCP_SND_BUF, so a slow client holds its response back the way
+    // it would on the device
+    int sndbuf = 5744;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    handleConnection(fd);
+  }
+}
+
+void AsyncWebServer::handleConnection(int fd) {
+  // Read the head, then the body as announced by Content-Length
+  std::string raw;
+  char buf[2048];
+  size_t headerEnd;
+  while ((headerEnd = raw.find("\r\n\r\n")) == std::string::npos) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0 || raw.size() > 16384) {
+      close(fd);
+      return;
+    }
+    raw.append(buf, n);
+  }
+
+  std::unique_ptr<AsyncWebServerRequest> owned(new AsyncWebServerRequest());
+  AsyncWebServerRequest& request = *owned;
+  request.fd = fd;
+  request.connection.socket = fd;
+
+  size_t lineEnd = raw.find("\r\n");
+  std::string requestLine = raw.substr(0, lineEnd);
+  size_t sp1 = requestLine.find(' ');
+  size_t sp2 = requestLine.find(' ', sp1 + 1);
+  if (sp1 == std::string::npos || sp2 == std::string::npos) {
+    close(fd);
+    return;
+  }
+  request.requestMethod = parseMethod(requestLine.substr(0, sp1));
+  std::string target = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+
+  size_t contentLength = 0;
+  bool formBody = false;
+  size_t pos = lineEnd + 2;
+  while (pos < headerEnd) {
+    size_t end = raw.find("\r\n", pos);
+    std::string line = raw.substr(pos, end - pos);
+    size_t colon = line.find(':');
+    if (colon != std::string::npos) {
+      std::string name = line.substr(0, colon);
+      size_t vs = line.find_first_not_of(' ', colon + 1);
+      std::string value = vs == std::string::npos ? "" : line.substr(vs);
+      if (strcasecmp(name.c_str(), "Content-Length") == 0) contentLength = strtoul(value.c_str(), nullptr, 10);
+      if (strcasecmp(name.c_str(), "Content-Type") == 0 &&
+          value.find("application/x-www-form-urlencoded") != std::string::npos) formBody = true;
+      request.requestHeaders.emplace_back(new AsyncWebHeader(String(name), String(value)));
+    }
+    pos = end + 2;
+  }
+
+  std::string body = raw.substr(headerEnd + 4);
+  while (body.size() < contentLength) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      close(fd);
+      return;
+    }
+    body.append(buf, n);
+  }
+  request.body = String(body);
+
+  auto addParams = [&request](const std::string& query, bool post) {
+    size_t start = 0;
+    while (start < query.size()) {
+      size_t amp = query.find('&', start);
+      std::string pair = query.substr(start, amp == std::string::npos ? std::string::npos : amp - start);
+      size_t eq = pair.find('=');
+      std::string name = urlDecode(pair.substr(0, eq));
+      std::string value = eq == std::string::npos ? "" : urlDecode(pair.substr(eq + 1));
+      if (!name.empty()) {
+        request.parameters.emplace_back(new AsyncWebParameter(String(name), String(value), post));
+      }
+      if (amp == std::string::npos) break;
+      start = amp + 1;
+    }
+  };
+
+  size_t q = target.find('?');
+  request.requestUrl = String(urlDecode(target.substr(0, q)));
+  if (q != std::string::npos) addParams(target.substr(q + 1), false);
+  if (formBody) addParams(body, true);
+
+  AsyncCallbackWebHandler* handler = nullptr;
+  for (const auto& h : handlers) {
+    if (h->canHandle(&request)) {
+      handler = h.get();
+      break;
+    }
+  }
+
+  if (handler) {
+    if (handler->onBody && !body.empty()) {
+      handler->onBody(&request, (uint8_t*)&body[0], body.size(), 0, body.size());
+    }
+    if (handler->onRequest) handler->onRequest(&request);
+  } else if (notFound) {
+    notFound(&request);
+  } else {
+    request.send(404);
+  }
+
+  // Send in the background; the disconnect handlers run once the client
+  // has the response, then the request goes
+  AsyncWebServerRequest* done = owned.release();
+  std::thread([done]() {
+    if (done->response) done->response->writeTo(done->connection);
+    close(done->fd);
+    for (auto& fn : done->disconnectHandlers) fn();
+    delete done;
+  }).detach();
+}
@@ -0,0 +1,114 @@
+#include "WiFi.h"
+#include "ESPmDNS.h"
+#include <atomic>
+
+WiFiClass WiFi;
+MDNSResponder MDNS;
+
+namespace hal {
+
+namespace {
+  std::atomic<bool> up(true);
+  std::atomic<uint32_t> connectDelayMs(3000);
+  std::atomic<uint32_t> flapPeriodMs(0);
+}
+
+void setWiFiUp(bool value) {
+  up = value;
+}
+
+void setWiFiConnectDelay(uint32_t ms) {
+  connectDelayMs = ms;
+}
+
+void setWiFiFlapPeriod(uint32_t ms) {
+  flapPeriodMs = ms;
+}
+
+uint32_t wifiConnectDelay() {
+  return connectDelayMs.load();
+}
+
+bool wifiUp() {
+  uint32_t period = flapPeriodMs.load();
+  if (period > 0 && (nowMicros() / 1000) % period >= period / 2) return false;
+  return up.load();
+}
+
+}  // namespace hal
+
+namespace {
+  struct SimulatedNetwork {
+    const char* ssid;
+    int32_t rssi;
+  };
+
+  const SimulatedNetwork NETWORKS[] = {
+    {"plant-floor", -48}, {"office", -67}, {"guest", -81}
+  };
+  const int16_t NETWORK_COUNT = sizeof(NETWORKS) / sizeof(NETWORKS[0]);
+}
+
+wl_status_t WiFiClass::begin(const char* s, const char*) {
+  ssid = s ? s : "";
+  if (!started) startedAt = hal::nowMicros();
+  started = true;
+  if (currentMode == WIFI_OFF || currentMode == WIFI_AP) currentMode = WIFI_STA;
+  return status();
+}
+
+bool WiFiClass::disconnect(bool wifiOff) {
+  started = false;
+  if (wifiOff) currentMode = WIFI_OFF;
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  if (!started || (currentMode != WIFI_STA && currentMode != WIFI_AP_STA)) {
+    return WL_DISCONNECTED;
+  }
+  if (!hal::wifiUp()) return WL_DISCONNECTED;
+  // Association and DHCP take a while after begin()
+  if (hal::nowMicros() - startedAt < (uint64_t)hal::wifiConnectDelay() * 1000) return WL_IDLE_STATUS;
+  return WL_CONNECTED;
+}
+
+IPAddress WiFiClass::localIP() {
+  return status() == WL_CONNECTED ? IPAddress(127, 0, 0, 1) : IPAddress();
+}
+
+String WiFiClass::macAddress() {
+  uint64_t mac = hal::efuseMac();
+  char buf[18];
+  snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X",
+           (unsigned)(mac & 0xFF), (unsigned)((mac >> 8) & 0xFF), (unsigned)((mac >> 16) & 0xFF),
+           (unsigned)((mac >> 24) & 0xFF), (unsigned)((mac >> 32) & 0xFF),
+           (unsigned)((mac >> 40) & 0xFF));
+  return String(buf);
+}
+
+bool WiFiClass::softAPConfig(IPAddress ip, IPAddress, IPAddress) {
+  apIP = ip;
+  return true;
+}
+
+bool WiFiClass::softAP(const char*, const char*, int, int, int) {
+  if (currentMode == WIFI_STA) currentMode = WIFI_AP_STA;
+  else if (currentMode == WIFI_OFF) currentMode = WIFI_AP;
+  return true;
+}
+
+int16_t WiFiClass::scanNetworks(bool, bool) {
+  // A real scan blocks the radio for a couple of seconds
+  delay(2000);
+  scanCount = NETWORK_COUNT;
+  return scanCount;
+}
+
+String WiFiClass::SSID(uint8_t index) const {
+  return index < NETWORK_COUNT ? String(NETWORKS[index].ssid) : String();
+}
+
+int32_t WiFiClass::RSSI(uint8_t index) const {
+  return index < NETWORK_COUNT ? NETWORKS[index].rssi : 0;
+}
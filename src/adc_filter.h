@@ -0,0 +1,186 @@
+#ifndef ADC_FILTER_H
+#define ADC_FILTER_H
+
+#include <Arduino.h>
+
+// Compile-time filter chain for raw ADC codes. All stages use integer
+// arithmetic only (the C3 has no FPU) and keep their state inline, so a
+// chain is a plain object with no heap and no virtual calls.
+//
+// A stage is any class with
+//   bool process(int32_t in, int32_t& out);  // false = no output this time
+//   void reset();
+//   static constexpr size_t DECIMATION;      // inputs per output
+// and FilterChain<A, B, C> feeds each output into the next stage. Its
+// DECIMATION is the product of the stages', so a burst of exactly that
+// many samples gives one value.
+
+// Median of the last N samples, rejects single spikes (N odd, small)
+template <size_t N>
+class MedianFilter {
+  static_assert(N % 2 == 1, "MedianFilter needs an odd window");
+
+public:
+  static constexpr size_t DECIMATION = 1;
+
+  MedianFilter() { reset(); }
+
+  bool process(int32_t in, int32_t& out) {
+    window[next] = in;
+    next = (next + 1) % N;
+    if (filled < N) filled++;
+
+    // Insertion sort of at most N values, N is tiny
+    int32_t sorted[N];
+    for (size_t i = 0; i < filled; i++) {
+      int32_t v = window[i];
+      size_t j = i;
+      while (j > 0 && sorted[j - 1] > v) {
+        sorted[j] = sorted[j - 1];
+        j--;
+      }
+      sorted[j] = v;
+    }
+    out = sorted[filled / 2];
+    return true;
+  }
+
+  void reset() {
+    next = 0;
+    filled = 0;
+  }
+
+private:
+  int32_t window[N];
+  size_t next;
+  size_t filled;
+};
+
+// Moving average over the last N samples, O(1) per sample via a running sum
+template <size_t N>
+class MovingAverage {
+public:
+  static constexpr size_t DECIMATION = 1;
+
+  MovingAverage() { reset(); }
+
+  bool process(int32_t in, int32_t& out) {
+    if (filled == N) {
+      sum -= window[next];
+    } else {
+      filled++;
+    }
+    window[next] = in;
+    sum += in;
+    next = (next + 1) % N;
+    out = (int32_t)((sum + (int32_t)filled / 2) / (int32_t)filled);
+    return true;
+  }
+
+  void reset() {
+    next = 0;
+    filled = 0;
+    sum = 0;
+  }
+
+private:
+  int32_t window[N];
+  size_t next;
+  size_t filled;
+  int32_t sum;
+};
+
+// First-order IIR / EMA with alpha = 1 / 2^SHIFT, state in Q16 fixed point.
+// The first sample initializes the state so there is no ramp from zero.
+template <uint8_t SHIFT>
+class EmaFilter {
+  static_assert(SHIFT < 16, "EmaFilter SHIFT must be below 16");
+
+public:
+  static constexpr size_t DECIMATION = 1;
+
+  EmaFilter() { reset(); }
+
+  bool process(int32_t in, int32_t& out) {
+    int32_t x = in * 65536;
+    if (!primed) {
+      acc = x;
+      primed = true;
+    } else {
+      acc += (x - acc) / (1 << SHIFT);
+    }
+    out = (acc + 32768) / 65536;
+    return true;
+  }
+
+  void reset() {
+    acc = 0;
+    primed = false;
+  }
+
+private:
+  int32_t acc;
+  bool primed;
+};
+
+// Pass every Nth sample on, drop the rest
+template <size_t N>
+class Decimator {
+  static_assert(N > 0, "Decimator needs N > 0");
+
+public:
+  static constexpr size_t DECIMATION = N;
+
+  Decimator() { reset(); }
+
+  bool process(int32_t in, int32_t& out) {
+    if (++phase < N) return false;
+    phase = 0;
+    out = in;
+    return true;
+  }
+
+  void reset() { phase = 0; }
+
+private:
+  size_t phase;
+};
+
+// Stages applied left to right
+template <typename... Stages>
+class FilterChain;
+
+template <>
+class FilterChain<> {
+public:
+  static constexpr size_t DECIMATION = 1;
+
+  bool process(int32_t in, int32_t& out) {
+    out = in;
+    return true;
+  }
+  void reset() {}
+};
+
+template <typename First, typename... Rest>
+class FilterChain<First, Rest...> {
+public:
+  static constexpr size_t DECIMATION = First::DECIMATION * FilterChain<Rest...>::DECIMATION;
+
+  bool process(int32_t in, int32_t& out) {
+    int32_t mid;
+    if (!first.process(in, mid)) return false;
+    return rest.process(mid, out);
+  }
+
+  void reset() {
+    first.reset();
+    rest.reset();
+  }
+
+private:
+  First first;
+  FilterChain<Rest...> rest;
+};
+
+#endif
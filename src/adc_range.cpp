@@ -0,0 +1,135 @@
+#include "adc_range.h"
+#include <esp_adc_cal.h>
+#include "serial_log.h"
+#include "settings.h"
+
+// Nominal full scale per attenuation and the recommended linear range of
+// the ESP32-C3 ADC. Only the 11 dB entry has a board calibration (3.3 V
+// reference, factor 0.91); auto-ranging uses the eFuse data instead.
+static const AdcRange RANGES[ADC_RANGE_COUNT] = {
+  {ADC_0db,   "0dB",   950.0f,  1.0f,  0.0f, 750},
+  {ADC_2_5db, "2.5dB", 1250.0f, 1.0f,  0.0f, 1050},
+  {ADC_6db,   "6dB",   1750.0f, 1.0f,  0.0f, 1300},
+  {ADC_11db,  "11dB",  3300.0f, 0.91f, 0.0f, 3300},
+};
+
+static const int ADC_MAX_CODE = 4095;
+
+// Two points of the eFuse characteristic, in its linear part; a straight
+// line through them keeps the sub-mV steps of the fine ranges, which the
+// integer mV of esp_adc_cal_raw_to_voltage() would round away
+static const uint32_t CAL_CODE_LO = 400;
+static const uint32_t CAL_CODE_HI = 3600;
+
+namespace {
+  uint8_t adcPin = 0;
+  uint8_t active = ADC_RANGE_COUNT - 1;  // range the hardware is set to
+  uint8_t wanted = ADC_RANGE_COUNT - 1;  // range for the next window
+  uint32_t switchCount = 0;
+  uint32_t windowCount[ADC_RANGE_COUNT] = {};
+
+  bool efuse = false;
+  bool autoRange = false;  // latched per window, conversion follows it
+  float slopeMv[ADC_RANGE_COUNT];   // mV per code
+  float interceptMv[ADC_RANGE_COUNT];
+
+  bool characterize() {
+    for (uint8_t i = 0; i < ADC_RANGE_COUNT; i++) {
+      esp_adc_cal_characteristics_t chars;
+      esp_adc_cal_value_t source = esp_adc_cal_characterize(ADC_UNIT_1, (adc_atten_t)RANGES[i].attenuation,
+                                                            ADC_WIDTH_BIT_12, ADC_DEFAULT_VREF_MV, &chars);
+      if (source == ESP_ADC_CAL_VAL_DEFAULT_VREF) return false;
+      float lo = esp_adc_cal_raw_to_voltage(CAL_CODE_LO, &chars);
+      float hi = esp_adc_cal_raw_to_voltage(CAL_CODE_HI, &chars);
+      slopeMv[i] = (hi - lo) / (CAL_CODE_HI - CAL_CODE_LO);
+      interceptMv[i] = lo - CAL_CODE_LO * slopeMv[i];
+    }
+    return true;
+  }
+}
+
+namespace AdcRanging {
+
+void begin(uint8_t pin) {
+  adcPin = pin;
+  active = ADC_RANGE_COUNT - 1;
+  wanted = active;
+  analogSetPinAttenuation(adcPin, RANGES[active].attenuation);
+  autoRange = false;
+  efuse = characterize();
+  if (!efuse && Settings::get().adcAutoRange) {
+    LOG_WARN("[ADC] No eFuse calibration, staying on 11 dB");
+  }
+}
+
+bool prepare() {
+  bool on = efuse && Settings::get().adcAutoRange;
+  if (on != autoRange) LOG_INFO("[ADC] Auto-ranging %s", on ? "on" : "off");
+  autoRange = on;
+  if (!autoRange) wanted = ADC_RANGE_COUNT - 1;
+  windowCount[wanted]++;
+  if (wanted == active) return false;
+
+  // Only a register write; the caller drops the first conversion after it
+  LOG_DEBUG("[ADC] Range %s -> %s", RANGES[active].name, RANGES[wanted].name);
+  active = wanted;
+  analogSetPinAttenuation(adcPin, RANGES[active].attenuation);
+  switchCount++;
+  return true;
+}
+
+float toMilliVolts(int code) {
+  if (autoRange) return code * slopeMv[active] + interceptMv[active];
+  const AdcRange& r = RANGES[active];
+  return (code * (r.fullScaleMv / ADC_MAX_CODE)) * r.gain + r.offsetMv;
+}
+
+void update(int code, int peakCode) {
+  if (!autoRange) return;
+  const AdcRange& r = RANGES[active];
+  float mv = code * (r.fullScaleMv / ADC_MAX_CODE);  // uncalibrated is fine for range choice
+
+  if (peakCode >= ADC_MAX_CODE) {
+    // Clipped: the real value could be anywhere above, go straight to the top
+    wanted = ADC_RANGE_COUNT - 1;
+  } else if (mv > r.usableMaxMv && active < ADC_RANGE_COUNT - 1) {
+    wanted = active + 1;
+  } else {
+    // Lowest range whose limit (minus hysteresis) still holds the reading
+    wanted = active;
+    while (wanted > 0 &&
+           mv < RANGES[wanted - 1].usableMaxMv * ADC_RANGE_HYSTERESIS_PCT / 100.0f) {
+      wanted--;
+    }
+  }
+}
+
+uint8_t range() {
+  return active;
+}
+
+const AdcRange& current() {
+  return RANGES[active];
+}
+
+const AdcRange& rangeInfo(uint8_t index) {
+  return RANGES[index < ADC_RANGE_COUNT ? index : ADC_RANGE_COUNT - 1];
+}
+
+uint32_t switches() {
+  return switchCount;
+}
+
+bool efuseCalibrated() {
+  return efuse;
+}
+
+bool autoRanging() {
+  return autoRange;
+}
+
+uint32_t windows(uint8_t index) {
+  return index < ADC_RANGE_COUNT ? windowCount[index] : 0;
+}
+
+}  // namespace AdcRanging
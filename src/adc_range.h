@@ -0,0 +1,67 @@
+#ifndef ADC_RANGE_H
+#define ADC_RANGE_H
+
+#include <Arduino.h>
+
+// ADC auto-ranging: picks the attenuation per measurement window so low
+// voltages use the fine 0 dB / 2.5 dB / 6 dB ranges instead of a small
+// corner of the 11 dB scale. All ranges then convert through the chip's
+// eFuse characterization (esp_adc_cal), so a range switch does not step
+// the reading; without eFuse data it stays on 11 dB.
+
+// Default of the adcAutoRange setting; 0 = always 11 dB with the board
+// calibration (3.3 V x 0.91)
+#ifndef ADC_AUTO_RANGE
+#define ADC_AUTO_RANGE 0
+#endif
+
+// Vref used by esp_adc_cal when the eFuse has none
+#ifndef ADC_DEFAULT_VREF_MV
+#define ADC_DEFAULT_VREF_MV 1100
+#endif
+
+// Switch down only once the reading is below this share of the lower
+// range's usable limit, so a value sitting on a boundary does not flap
+#ifndef ADC_RANGE_HYSTERESIS_PCT
+#define ADC_RANGE_HYSTERESIS_PCT 85
+#endif
+
+// Calibration and limits of one attenuation setting
+struct AdcRange {
+  adc_attenuation_t attenuation;
+  const char* name;
+  float fullScaleMv;     // pin voltage at code 4095
+  float gain;            // board calibration, without eFuse data
+  float offsetMv;
+  uint16_t usableMaxMv;  // linear region ends here, switch up above it
+};
+
+static const uint8_t ADC_RANGE_COUNT = 4;
+
+namespace AdcRanging {
+  // Called from setup() instead of analogSetAttenuation()
+  void begin(uint8_t pin);
+
+  // Start of a measurement window: takes the adcAutoRange setting and
+  // applies the range chosen by the last update() (11 dB when auto-ranging
+  // is off). Returns true when the attenuation changed, in which case
+  // filter state in ADC codes is stale and the caller should reset it.
+  bool prepare();
+
+  // Pin voltage in mV for a code read in the current range
+  float toMilliVolts(int code);
+
+  // End of a measurement window: choose the range for the next one from
+  // the window's (filtered) code and the highest raw code seen in it
+  void update(int code, int peakCode);
+
+  uint8_t range();  // index into the range table, 0 = 0 dB
+  const AdcRange& current();
+  const AdcRange& rangeInfo(uint8_t index);
+  uint32_t switches();
+  bool efuseCalibrated();  // eFuse characterization present
+  bool autoRanging();      // on for the window in progress
+  uint32_t windows(uint8_t index);  // measurement windows per range
+}
+
+#endif
@@ -0,0 +1,90 @@
+#include "webserver.h"
+#include "admission.h"
+#include <mutex>
+#include "serial_log.h"
+
+namespace {
+  const uint8_t ROUTE_LIMITS[Metrics::ROUTE_COUNT] = ADMISSION_ROUTE_LIMITS;
+  const char* const REASONS[Metrics::REJECT_COUNT] = {"busy", "memory", "rate"};
+
+  // admit() runs on the AsyncTCP task, the release from the disconnect
+  // callback too; the mutex keeps check and charge together
+  std::mutex admissionMutex;
+  uint8_t routeInFlight[Metrics::ROUTE_COUNT] = {};
+  size_t bytesInFlight = 0;
+  size_t bytesPeak = 0;
+  unsigned long lastScan = 0;
+  bool scanned = false;
+
+  void reject(AsyncWebServerRequest* request, Metrics::Route route,
+              Metrics::RejectReason reason, unsigned long retryAfter) {
+    Metrics::countRejection(route, reason);
+    AsyncWebServerResponse* response = request->beginResponse(503, "text/plain", "Busy, try again");
+    response->addHeader("Retry-After", String(retryAfter));
+    request->send(response);
+  }
+
+  void release(Metrics::Route route, size_t charged) {
+    std::lock_guard<std::mutex> lock(admissionMutex);
+    routeInFlight[route]--;
+    bytesInFlight -= charged;
+  }
+}
+
+namespace Admission {
+
+bool admit(AsyncWebServerRequest* request, Metrics::Route route, size_t cost) {
+  size_t charged = cost + ADMISSION_REQUEST_OVERHEAD;
+  Metrics::RejectReason reason;
+  unsigned long retryAfter = ADMISSION_RETRY_AFTER_S;
+  {
+    std::lock_guard<std::mutex> lock(admissionMutex);
+    unsigned long now = millis();
+    if (routeInFlight[route] >= ROUTE_LIMITS[route]) {
+      reason = Metrics::REJECT_BUSY;
+    } else if (bytesInFlight + charged > ADMISSION_BUDGET_BYTES ||
+               ESP.getFreeHeap() < ADMISSION_MIN_FREE_HEAP + charged) {
+      reason = Metrics::REJECT_MEMORY;
+    } else if (route == Metrics::ROUTE_SCAN && scanned &&
+               now - lastScan < ADMISSION_SCAN_INTERVAL_MS) {
+      reason = Metrics::REJECT_RATE;
+      retryAfter = (ADMISSION_SCAN_INTERVAL_MS - (now - lastScan) + 999) / 1000;
+    } else {
+      routeInFlight[route]++;
+      bytesInFlight += charged;
+      if (bytesInFlight > bytesPeak) bytesPeak = bytesInFlight;
+      if (route == Metrics::ROUTE_SCAN) {
+        lastScan = now;
+        scanned = true;
+      }
+      reason = Metrics::REJECT_COUNT;
+    }
+  }
+
+  if (reason != Metrics::REJECT_COUNT) {
+    LOG_DEBUG("[Web] 503 for %s (%s)", request->url().c_str(), REASONS[reason]);
+    reject(request, route, reason, retryAfter);
+    return false;
+  }
+
+  // Called once the connection is closed, after the response went out
+  request->onDisconnect([route, charged]() { release(route, charged); });
+  return true;
+}
+
+uint8_t inFlight(Metrics::Route route) {
+  std::lock_guard<std::mutex> lock(admissionMutex);
+  return routeInFlight[route];
+}
+
+size_t inFlightBytes() {
+  std::lock_guard<std::mutex> lock(admissionMutex);
+  return bytesInFlight;
+}
+
+size_t peakBytes() {
+  std::lock_guard<std::mutex> lock(admissionMutex);
+  return bytesPeak;
+}
+
+}  // namespace Admission
@@ -0,0 +1,61 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <Arduino.h>
+#include "metrics.h"
+
+// Admission control for the web server. AsyncTCP runs the handlers one at
+// a time, but their responses stay in the heap until the client has read
+// them, so a few slow clients on / or /status can pile up enough Strings
+// to reset the device. Every route handler asks admit() first: the
+// request is charged an estimated cost until the client disconnects, and
+// is turned away with a quick 503 + Retry-After when its route is at its
+// concurrency cap or the in-flight budget / free heap would run out.
+
+// Heap all admitted requests together may hold
+#ifndef ADMISSION_BUDGET_BYTES
+#define ADMISSION_BUDGET_BYTES 32768
+#endif
+
+// Never admit a request that would leave less free heap than this
+#ifndef ADMISSION_MIN_FREE_HEAP
+#define ADMISSION_MIN_FREE_HEAP 32768
+#endif
+
+// Charged on top of the route's own cost: request object, headers, TCP
+// buffers of the connection
+#ifndef ADMISSION_REQUEST_OVERHEAD
+#define ADMISSION_REQUEST_OVERHEAD 1024
+#endif
+
+// Concurrent requests per route, in Metrics::Route order
+#ifndef ADMISSION_ROUTE_LIMITS
+#define ADMISSION_ROUTE_LIMITS {2, 4, 1, 1, 2, 1, 2, 2, 1, 1, 2}
+#endif
+
+// A blocking WiFi scan stalls the whole server, so /scan runs at most
+// once per interval
+#ifndef ADMISSION_SCAN_INTERVAL_MS
+#define ADMISSION_SCAN_INTERVAL_MS 5000
+#endif
+
+// Retry-After sent with a 503, seconds
+#ifndef ADMISSION_RETRY_AFTER_S
+#define ADMISSION_RETRY_AFTER_S 1
+#endif
+
+class AsyncWebServerRequest;
+
+namespace Admission {
+
+// true: go ahead, cost bytes are held until the request is gone.
+// false: a 503 has been sent, return from the handler.
+bool admit(AsyncWebServerRequest* request, Metrics::Route route, size_t cost);
+
+uint8_t inFlight(Metrics::Route route);
+size_t inFlightBytes();
+size_t peakBytes();
+
+}  // namespace Admission
+
+#endif
@@ -0,0 +1,783 @@
+// Micro-benchmarks (native only, pio run -e bench): the firmware's hot
+// paths in isolation, on top of NativeHAL, so a performance change can be
+// measured before and after instead of argued about.
+//
+// Each case runs its operation in a loop until one repetition takes at
+// least BENCH_MIN_MS, then BENCH_REPS repetitions of that many operations
+// are timed in thread CPU time; the median is the result, the
+// fastest is shown next to it. Inputs come from a fixed seed and the
+// virtual clock stands still unless a case moves it, so two runs of the
+// same build do the same work.
+//
+//   adc_filter     VoltageFilter over one burst of codes (16 reads)
+//   filter_*       one burst (16 codes) through each stage on its own:
+//                  median3, moving_avg8, ema2, decimator16; and through
+//                  median_ema, median-of-3 and EMA without decimation
+//   adc_to_volts   loop()'s reading: AdcBurst + Calibrate on the HAL ADC
+//   stage_*        each stage after the source on its own, on one reading:
+//                  calibrate, serial_report (compiled out at this log
+//                  level, trace probes only), accumulate, store (into a
+//                  full ring), publish (one send interval passes each
+//                  time: window close, dead-band, hand-over to the sink),
+//                  status
+//   pipeline_step  the whole composition of main.cpp, one reading
+//   pipeline_handwritten  the same reading with the stages written out in
+//                  one function, state of its own; should match the above
+//   settings_get   64 readings scaled by Settings::get().dividerFactor and
+//                  timed by its sampleIntervalMs, as the hot path reads them
+//   settings_const the same with the two as constexpr, as they were before
+//                  the settings store; the two should match
+//   stats_add      VoltageStats::add, one sample into the window and the
+//                  run (Welford, three P² markers, histogram, each twice)
+//   stats_p2       P2Quantile::add on its own
+//   stats_window   closing a window of 6 samples: summary and histogram
+//                  copy, reset
+//   sample_append  SampleStore::append into a full ring
+//   sample_scan    decoding the whole full ring, 64 samples a read
+//   sample_from    SampleStore::from() a time in the ring and the read
+//                  of the first 64 samples from there
+//   chart_lttb     Chart::lttb() of 100k random-walk points with steps
+//                  down to 400, both passes
+//   chart_store    Chart::downsample() of the full history to 400 points,
+//                  decoding included (the /chart work before sending)
+//   chart_render   the 400-point /chart payload in 1436-byte chunks
+//   html_page      buildHtmlPage(), the / response
+//   status_json    buildStatusJson(), the /status response
+//   log_call       SerialLog::write() of loop()'s reading line: what a LOG_*
+//                  call costs its caller, compiled in whatever the level
+//                  (the ring is written out untimed every 32 calls)
+//   log_serial_printf  the same line through a synchronous Serial.printf,
+//                  as loop() printed before the serial log
+//   log_event      Logger::logError, a repeat (merged into its entry)
+//   logs_json      Logger::getLogsAsJSON() of 24 entries
+//   firebase_body  buildRecordsUpdate() of a batch of FirebaseSink's size
+//   firebase_send  sendRecordsToFirebase(), URL + body + client, against
+//                  an in-process handler that answers 200
+//   prune_parse    expiredDays() over a shallow raw/ listing of 40 days
+//
+// Knobs (environment):
+//   BENCH_FILTER     only cases whose name contains this
+//   BENCH_REPS       repetitions per case (default 5)
+//   BENCH_MIN_MS     shortest repetition (default 50)
+//   BENCH_SEED       for the generated inputs (default 1)
+//   BENCH_JSON       file to write the results to
+//   BENCH_BASELINE   results of an earlier run (BENCH_JSON) to compare
+//                    with; exits 1 if a case got slower by more than
+//   BENCH_THRESHOLD  percent (default 10)
+//   VOLTAGELOG_EEPROM  as for the native build; default bench_eeprom.bin,
+//                    removed at the end
+//   VOLTAGELOG_SERIAL  as for the native build; default /dev/null
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <ArduinoJson.h>
+#include <algorithm>
+#include <random>
+#include <time.h>
+#include <vector>
+#include "hal.h"
+#include "measurement.h"
+#include "webserver.h"
+#include "logger.h"
+#include "firebase_handler.h"
+#include "firebase_sink.h"
+#include "firebase_layout.h"
+#include "time_service.h"
+#include "device_identity.h"
+#include "settings.h"
+#include "config.h"
+#include "chart.h"
+
+// Defined by main.cpp in the firmware; read by buildStatusJson()
+bool wifiConnected = true;
+SeqLock<DeviceStatus> deviceStatus;
+VoltageStats voltageStats;
+SampleStore sampleStore;
+
+namespace {
+  const int PIN = 4;
+  const char* const EEPROM_FILE = "bench_eeprom.bin";
+
+  struct Case {
+    const char* name;
+    void (*prepare)();  // before timing, may be nullptr
+    void (*op)();
+  };
+
+  struct Result {
+    const char* name;
+    double ns;     // median per operation
+    double minNs;  // fastest repetition
+    uint64_t iterations;
+  };
+
+  struct Options {
+    const char* filter;
+    uint32_t reps;
+    double minMs;
+    uint32_t seed;
+    double threshold;
+  };
+
+  double envNumber(const char* name, double fallback) {
+    const char* v = getenv(name);
+    return (v && *v) ? atof(v) : fallback;
+  }
+
+  // Results go here so the compiler can't drop the work
+  volatile size_t sink;
+
+  // CPU time of this thread, ns: time the process is scheduled out for
+  // does not count, so a busy host adds less noise than with wall time
+  double cpuNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+  }
+
+  // For housekeeping inside an operation that is not part of it
+  double pausedNs = 0;
+  double pauseStart = 0;
+
+  void pauseTiming() {
+    pauseStart = cpuNanos();
+  }
+
+  void resumeTiming() {
+    pausedNs += cpuNanos() - pauseStart;
+  }
+
+  // Inputs, filled in by setUp()
+  std::vector<int> codes;  // ADC codes around 2000 with the odd spike
+  size_t nextCode = 0;
+  TelemetryRecord records[4];
+  String listing;
+  char cutoff[FirebaseLayout::DAY_LEN];
+  FirebaseSession session;
+
+  // A series in memory, read as often as LTTB wants
+  class VectorSeries : public Chart::Series {
+  public:
+    explicit VectorSeries(const std::vector<Sample>& points) : points(points) {}
+    void rewind() override { pos = 0; }
+    bool next(Sample& out) override {
+      if (pos >= points.size()) return false;
+      out = points[pos++];
+      return true;
+    }
+
+  private:
+    const std::vector<Sample>& points;
+    size_t pos = 0;
+  };
+
+  std::vector<Sample> chartInput;  // 100k points, filled in by setUp()
+  Sample chartPoints[CHART_DEFAULT_POINTS];
+  size_t chartCount = 0;
+
+  VoltageFilter filter;
+  Pipeline<AdcBurst<PIN, VoltageFilter>, Calibrate> reading;
+
+  // Stages of main.cpp's pipeline, timed one at a time on stageReading
+  Reading stageReading;
+  DeviceStatus stageStatus;
+  DeadBand deadBand;
+  Calibrate calibrate;
+  SerialReport serialReport;
+  Accumulate accumulate(voltageStats);
+  Store store(sampleStore);
+  Publish publish(voltageStats, deadBand);
+  StatusUpdate statusUpdate(stageStatus, voltageStats);
+  Pipeline<AdcBurst<PIN, VoltageFilter>, Calibrate, SerialReport, Accumulate, Store, Publish, StatusUpdate> pipeline{
+      AdcBurst<PIN, VoltageFilter>(), Calibrate(), SerialReport(), Accumulate(voltageStats), Store(sampleStore),
+      Publish(voltageStats, deadBand), StatusUpdate(stageStatus, voltageStats)};
+  VoltageFilter handFilter;
+  unsigned long handLastSend = 0;
+  VoltageStats benchStats;
+  P2Quantile benchQuantile(0.99f);
+  uint32_t appendTime = 0;
+  uint32_t fromSpot = 0;
+
+  // What main.cpp had before the settings store
+  constexpr float CONST_DIVIDER_FACTOR = SETTINGS_DIVIDER_FACTOR;
+  constexpr uint32_t CONST_SAMPLE_INTERVAL_MS = SETTINGS_SAMPLE_INTERVAL_MS;
+  const size_t HOT_READINGS = 64;
+  float hotVolts[HOT_READINGS];  // ADC volts, filled in by setUp()
+
+  // Next burst of codes, without a division per code
+  const int* nextBurst() {
+    if (nextCode + VoltageFilter::DECIMATION > codes.size()) nextCode = 0;
+    const int* burst = &codes[nextCode];
+    nextCode += VoltageFilter::DECIMATION;
+    return burst;
+  }
+
+  void adcFilter() {
+    const int* burst = nextBurst();
+    int32_t out = 0;
+    for (size_t i = 0; i < VoltageFilter::DECIMATION; i++) filter.process(burst[i], out);
+    sink = out;
+  }
+
+  // Same codes as adc_filter through another configuration
+  template <typename Filter>
+  void filterBurst() {
+    static Filter f;
+    const int* burst = nextBurst();
+    int32_t out = 0;
+    for (size_t i = 0; i < VoltageFilter::DECIMATION; i++) f.process(burst[i], out);
+    sink = out;
+  }
+
+  void adcToVolts() {
+    Reading r = Reading();
+    reading.step(r);
+    sink = (size_t)r.raw;
+  }
+
+  void fillStore() {
+    sampleStore.clear();
+    appendTime = 0;
+    while (sampleStore.dropped() == 0) {
+      appendTime += 10000;
+      sampleStore.append(appendTime, 12000 + codes[nextCode++ % codes.size()] % 40);
+    }
+  }
+
+  void sampleAppend() {
+    appendTime += 10000;
+    sampleStore.append(appendTime, 12000 + codes[nextCode++ % codes.size()] % 40);
+  }
+
+  void sampleScan() {
+    SampleStore::Iterator it = sampleStore.begin();
+    Sample buf[64];
+    size_t n, total = 0;
+    while ((n = it.read(buf, 64)) > 0) total += n;
+    sink = total;
+  }
+
+  void sampleFrom() {
+    uint32_t oldest, newest;
+    sampleStore.span(oldest, newest);
+    // 101 spots over the ring, visited out of order
+    fromSpot = (fromSpot + 37) % 101;
+    SampleStore::Iterator it = sampleStore.from(oldest + (uint32_t)((uint64_t)(newest - oldest) * fromSpot / 101));
+    Sample buf[64];
+    sink = it.read(buf, 64);
+  }
+
+  // Voltages around 12 V from the codes
+  float nextVolts() {
+    return 12.0f + codes[nextCode++ % codes.size()] % 40 / 100.0f;
+  }
+
+  // A real reading to start from
+  void prepareStage() {
+    stageReading = Reading();
+    reading.step(stageReading);
+  }
+
+  // Appends continue the history fillStore() left
+  void prepareStore() {
+    fillStore();
+    prepareStage();
+    stageReading.timeMs = appendTime;
+  }
+
+  void stageCalibrate() {
+    calibrate.process(stageReading);
+    sink = (size_t)stageReading.volts;
+  }
+
+  void stageSerialReport() {
+    serialReport.process(stageReading);
+  }
+
+  void stageAccumulate() {
+    stageReading.volts = nextVolts();
+    accumulate.process(stageReading);
+  }
+
+  void stageStore() {
+    stageReading.timeMs += 10000;
+    stageReading.volts = nextVolts();
+    store.process(stageReading);
+  }
+
+  void stagePublish() {
+    // A window of one reading, closed every time
+    voltageStats.add(nextVolts());
+    hal::sleepMicros((Settings::get().sendIntervalMs + 1) * 1000ULL);
+    publish.process(stageReading);
+    sink = stageReading.published;
+  }
+
+  void stageStatusUpdate() {
+    statusUpdate.process(stageReading);
+    sink = stageStatus.windows;
+  }
+
+  void pipelineStep() {
+    sink = pipeline.step();
+  }
+
+  // pipeline's stages inlined by hand, in the same order
+  void pipelineHandwritten() {
+    TRACE_BEGIN("adc_read");
+    unsigned long start = micros();
+    if (AdcRanging::prepare()) {
+      handFilter.reset();
+      analogRead(PIN);
+    }
+    uint8_t adcRange = AdcRanging::range();
+    int32_t raw = 0;
+    int32_t peak = 0;
+    bool filtered = false;
+    for (size_t i = 0; i < VoltageFilter::DECIMATION; i++) {
+      int sample = analogRead(PIN);
+      if (sample > peak) peak = sample;
+      int32_t out;
+      if (handFilter.process(sample, out)) {
+        raw = out;
+        filtered = true;
+      }
+    }
+    Metrics::adcReadMicros.observe(micros() - start);
+    TRACE_END("adc_read");
+    Metrics::inc(Metrics::samplesTotal, VoltageFilter::DECIMATION);
+    unsigned long timeMs = millis();
+    if (!filtered) {
+      sink = false;
+      return;
+    }
+
+    float adcVolts = AdcRanging::toMilliVolts(raw) / 1000.0f;
+    AdcRanging::update(raw, peak);
+    float volts = adcVolts * Settings::get().dividerFactor;
+
+    TRACE_BEGIN("log");
+    LOG_INFO("Filtered raw value: %d (%s) -> ADC voltage: %.3f V -> Measured voltage: %.2f V",
+             (int)raw, AdcRanging::rangeInfo(adcRange).name, adcVolts, volts);
+    TRACE_END("log");
+
+    voltageStats.add(volts);
+    sampleStore.append(timeMs, lroundf(volts * 1000.0f));
+
+    bool published = false;
+    unsigned long windowStart = handLastSend;
+    if (handLastSend == 0 || millis() - handLastSend > Settings::get().sendIntervalMs) {
+      published = publishWindow(voltageStats, deadBand, raw, adcRange, true);
+      handLastSend = windowStart = millis();
+    }
+
+    stageStatus.lastVoltage = volts;
+    stageStatus.lastRawValue = raw;
+    stageStatus.lastAdcRange = adcRange;
+    stageStatus.lastReadTime = timeMs;
+    stageStatus.windowStart = windowStart;
+    if (published) stageStatus.recordNumber++;
+    StatusUpdate::copyStats(stageStatus, voltageStats);
+    sink = true;
+  }
+
+  void settingsGet() {
+    float sum = 0;
+    uint32_t due = 0;
+    for (size_t i = 0; i < HOT_READINGS; i++) {
+      sum += hotVolts[i] * Settings::get().dividerFactor;
+      due += Settings::get().sampleIntervalMs;
+    }
+    sink = (size_t)sum + due;
+  }
+
+  void settingsConst() {
+    float sum = 0;
+    uint32_t due = 0;
+    for (size_t i = 0; i < HOT_READINGS; i++) {
+      sum += hotVolts[i] * CONST_DIVIDER_FACTOR;
+      due += CONST_SAMPLE_INTERVAL_MS;
+    }
+    sink = (size_t)sum + due;
+  }
+
+  void statsAdd() {
+    benchStats.add(nextVolts());
+  }
+
+  void statsP2() {
+    benchQuantile.add(nextVolts());
+  }
+
+  void statsWindow() {
+    for (int i = 0; i < 6; i++) benchStats.add(nextVolts());
+    sink = benchStats.closeWindow().count;
+  }
+
+  void chartLttb() {
+    VectorSeries series(chartInput);
+    sink = Chart::lttb(series, chartInput.size(), chartPoints, CHART_DEFAULT_POINTS);
+  }
+
+  void chartStore() {
+    sink = Chart::downsample(sampleStore, chartPoints, CHART_DEFAULT_POINTS);
+  }
+
+  void prepareRender() {
+    fillStore();
+    chartCount = Chart::downsample(sampleStore, chartPoints, CHART_DEFAULT_POINTS);
+  }
+
+  void chartRender() {
+    uint8_t buf[1436];  // one TCP segment
+    size_t total = Chart::payloadBytes(chartCount);
+    for (size_t index = 0; index < total;) index += Chart::render(chartPoints, chartCount, 0, 0, buf, sizeof(buf), index);
+    sink = buf[0];
+  }
+
+  void htmlPage() {
+    sink = buildHtmlPage().length();
+  }
+
+  void statusJson() {
+    sink = buildStatusJson().length();
+  }
+
+  // loop()'s line (SerialReport) and its arguments
+  const char* const READING_LINE = "Filtered raw value: %d (%s) -> ADC voltage: %.3f V -> Measured voltage: %.2f V";
+  size_t logQueued = 0;
+
+  // Empty ring, and the virtual time the rate limit wants for a ring full
+  void refillLog() {
+    SerialLog::flush();
+    hal::sleepMicros(SERIAL_LOG_SLOTS * 1000000ULL / SERIAL_LOG_RATE);
+    logQueued = 0;
+  }
+
+  void logCall() {
+    int raw = codes[nextCode++ % codes.size()];
+    SerialLog::write(LOG_LEVEL_INFO, READING_LINE, raw, "11dB", raw * 0.000733f, raw * 0.003667f);
+    if (++logQueued < SERIAL_LOG_SLOTS) return;
+    // The drain task's work, on another task in the firmware
+    pauseTiming();
+    refillLog();
+    resumeTiming();
+  }
+
+  void logSerialPrintf() {
+    int raw = codes[nextCode++ % codes.size()];
+    unsigned long now = millis();
+    Serial.printf("[%lu.%03lu] I Filtered raw value: %d (%s) -> ADC voltage: %.3f V -> Measured voltage: %.2f V\n",
+                  now / 1000, now % 1000, raw, "11dB", raw * 0.000733f, raw * 0.003667f);
+  }
+
+  void logEvent() {
+    Logger::logError("bench: repeated message");
+  }
+
+  void fillLog() {
+    Logger::clearLogs();
+    for (uint8_t code = 0; code < EVENT_COUNT; code++) {
+      for (uint8_t severity = SEVERITY_INFO; severity <= SEVERITY_ERROR; severity++) {
+        Logger::event((LogEvent)code, (LogSeverity)severity, -60 - code, 1000 * severity);
+      }
+    }
+  }
+
+  void logsJson() {
+    sink = Logger::getLogsAsJSON().length();
+  }
+
+  void firebaseBody() {
+    FirebaseLayout::HourSummary hour = session.hour;
+    time_t newest;
+    String body;
+    buildRecordsUpdate(records, 4, hour, newest, body);
+    sink = body.length();
+  }
+
+  void firebaseSend() {
+    sink = sendRecordsToFirebase(records, 4);
+  }
+
+  void countDay(const char*, void* ctx) {
+    (*(size_t*)ctx)++;
+  }
+
+  void pruneParse() {
+    size_t n = 0;
+    expiredDays(listing, cutoff, countDay, &n);
+    sink = n;
+  }
+
+  const Case CASES[] = {
+    {"adc_filter", nullptr, adcFilter},
+    {"filter_median3", nullptr, filterBurst<MedianFilter<3>>},
+    {"filter_moving_avg8", nullptr, filterBurst<MovingAverage<8>>},
+    {"filter_ema2", nullptr, filterBurst<EmaFilter<2>>},
+    {"filter_decimator16", nullptr, filterBurst<Decimator<16>>},
+    {"filter_median_ema", nullptr, filterBurst<FilterChain<MedianFilter<3>, EmaFilter<2>>>},
+    {"adc_to_volts", nullptr, adcToVolts},
+    {"stage_calibrate", prepareStage, stageCalibrate},
+    {"stage_serial_report", prepareStage, stageSerialReport},
+    {"stage_accumulate", prepareStage, stageAccumulate},
+    {"stage_store", prepareStore, stageStore},
+    {"stage_publish", prepareStage, stagePublish},
+    {"stage_status", prepareStage, stageStatusUpdate},
+    {"pipeline_step", fillStore, pipelineStep},
+    {"pipeline_handwritten", fillStore, pipelineHandwritten},
+    {"settings_get", nullptr, settingsGet},
+    {"settings_const", nullptr, settingsConst},
+    {"stats_add", nullptr, statsAdd},
+    {"stats_p2", nullptr, statsP2},
+    {"stats_window", nullptr, statsWindow},
+    {"sample_append", fillStore, sampleAppend},
+    {"sample_scan", fillStore, sampleScan},
+    {"sample_from", fillStore, sampleFrom},
+    {"chart_lttb", nullptr, chartLttb},
+    {"chart_store", fillStore, chartStore},
+    {"chart_render", prepareRender, chartRender},
+    {"html_page", nullptr, htmlPage},
+    {"status_json", nullptr, statusJson},
+    {"log_call", refillLog, logCall},
+    {"log_serial_printf", nullptr, logSerialPrintf},
+    {"log_event", nullptr, logEvent},
+    {"logs_json", fillLog, logsJson},
+    {"firebase_body", nullptr, firebaseBody},
+    {"firebase_send", nullptr, firebaseSend},
+    {"prune_parse", nullptr, pruneParse},
+  };
+
+  // Device state as after a while of running: synced clock, a few closed
+  // windows, a full history, a signed-in Firebase session
+  void setUp(const Options& o) {
+    std::mt19937 rng(o.seed);
+    std::normal_distribution<float> noise(0.0f, 12.0f);
+    std::uniform_int_distribution<int> spike(0, 63);
+    codes.resize(4096);
+    for (int& c : codes) c = spike(rng) == 0 ? 4095 : 2000 + (int)noise(rng);
+    for (size_t i = 0; i < HOT_READINGS; i++) hotVolts[i] = codes[i] * 3.3f / 4095;
+
+    // Random walk every ~10 s with the odd step, as on a rail under load
+    std::uniform_int_distribution<int> walk(-20, 20);
+    std::uniform_int_distribution<int> event(0, 499);
+    std::uniform_int_distribution<int> jitter(-200, 200);
+    chartInput.resize(100000);
+    uint32_t t = 0;
+    int32_t mv = 12000;
+    for (Sample& p : chartInput) {
+      t += 10000 + jitter(rng);
+      int e = event(rng);
+      mv += walk(rng) + (e == 0 ? 2000 : e == 1 ? -2000 : 0);
+      p = {t, mv};
+    }
+
+    hal::setTimeScale(0);
+    if (!getenv("VOLTAGELOG_SERIAL")) hal::setSerialOutput("/dev/null");
+    hal::setAdcNoise(0);
+    hal::setAdcMilliVolts(1650);
+    hal::setWiFiConnectDelay(0);
+    WiFi.mode(WIFI_STA);
+    WiFi.begin("bench", "bench");
+    TimeService::begin();
+    hal::sleepMicros(600 * 1000000ULL);  // records of the batch below are from after boot
+    TimeService::loop();
+
+    DeviceIdentity::begin();
+    initEEPROM();
+    Settings::begin();
+    Logger::init();
+    AdcRanging::begin(PIN);
+
+    static FirebaseSink firebaseSink;
+    Telemetry::addSink(&firebaseSink);
+
+    for (uint32_t w = 0; w < 8; w++) {
+      for (int i = 0; i < 6; i++) voltageStats.add(12.0f + codes[w * 6 + i] % 40 / 100.0f);
+      voltageStats.closeWindow();
+    }
+    fillStore();
+    DeviceStatus status = {};
+    status.lastVoltage = 12.3f;
+    status.lastRawValue = 2001;
+    status.lastReadTime = status.lastSendTime = millis();
+    status.firebaseConnected = true;
+    status.recordNumber = 8;
+    status.version = "bench";
+    StatusUpdate::copyStats(status, voltageStats);
+    deviceStatus.write(status);
+
+    for (size_t i = 0; i < 4; i++) {
+      TelemetryRecord& r = records[i];
+      r = TelemetryRecord();
+      r.voltage = 12.0f + i / 100.0f;
+      r.rawValue = 2000 + i;
+      r.readTime = millis() - (3 - i) * 70000;
+      r.summary = voltageStats.lastWindow();
+    }
+
+    session.deviceId = "bench0000001";
+    session.tags = "site-1";
+    session.initialized = true;
+    session.registered = true;
+    session.idToken = String(std::string(900, 't').c_str());  // about a Firebase ID token
+    session.tokenExpiryTime = ULONG_MAX;
+    session.bootId = rng() | 1;
+    useFirebaseSession(&session);
+    hal::setHttpHandler([](const char*, const String&, const String&, String& response) {
+      response = "{}";
+      return 200;
+    });
+
+    // Shallow listing as the retention check gets it: 40 days, the oldest
+    // 9 past the default 30, and the unsynced bucket
+    time_t now = TimeService::now();
+    listing = "{";
+    for (int d = 39; d >= 0; d--) {
+      char day[FirebaseLayout::DAY_LEN];
+      FirebaseLayout::dayKey(now - d * 86400, day);
+      listing += String("\"") + day + "\":true,";
+    }
+    listing += "\"unsynced\":true}";
+    FirebaseLayout::dayKey(now - 30 * 86400, cutoff);
+  }
+
+  double timeOps(void (*op)(), uint64_t n) {
+    pausedNs = 0;
+    double start = cpuNanos();
+    for (uint64_t i = 0; i < n; i++) op();
+    return cpuNanos() - start - pausedNs;
+  }
+
+  Result measure(const Case& c, const Options& o) {
+    if (c.prepare) c.prepare();
+
+    // Warm-up, and enough operations for a repetition to last minMs
+    uint64_t n = 1;
+    for (;;) {
+      double ns = timeOps(c.op, n);
+      if (ns >= o.minMs * 1e6 || n >= (1ULL << 30)) break;
+      double scale = ns > 0 ? o.minMs * 1e6 * 1.2 / ns : 10;
+      n = (uint64_t)(n * std::min(std::max(scale, 2.0), 100.0));
+    }
+
+    std::vector<double> perOp(o.reps);
+    for (double& t : perOp) t = timeOps(c.op, n) / n;
+    std::sort(perOp.begin(), perOp.end());
+    size_t mid = perOp.size() / 2;
+    double median = perOp.size() % 2 ? perOp[mid] : (perOp[mid - 1] + perOp[mid]) / 2;
+    Result r = {c.name, median, perOp.front(), n};
+    return r;
+  }
+
+  bool readFile(const char* path, String& out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    char buf[512];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf) - 1, f)) > 0) {
+      buf[n] = '\0';
+      out += buf;
+    }
+    fclose(f);
+    return true;
+  }
+
+  void writeJson(const char* path, const std::vector<Result>& results, const Options& o) {
+    DynamicJsonDocument doc(256 + 128 * results.size());
+    doc["reps"] = o.reps;
+    doc["minMs"] = o.minMs;
+    doc["seed"] = o.seed;
+    JsonObject cases = doc.createNestedObject("cases");
+    for (const Result& r : results) {
+      JsonObject c = cases.createNestedObject(r.name);
+      c["ns"] = r.ns;
+      c["minNs"] = r.minNs;
+      c["iterations"] = r.iterations;
+    }
+    String out;
+    serializeJson(doc, out);
+    FILE* f = fopen(path, "w");
+    if (!f) {
+      printf("Can't write %s\n", path);
+      return;
+    }
+    fputs(out.c_str(), f);
+    fputs("\n", f);
+    fclose(f);
+  }
+
+  // Returns the number of cases slower than the baseline by more than the
+  // threshold; -1 if the baseline can't be read
+  int compare(const char* path, const std::vector<Result>& results, const Options& o) {
+    String text;
+    DynamicJsonDocument doc(4096);
+    if (!readFile(path, text) || deserializeJson(doc, text) || !doc["cases"].is<JsonObject>()) {
+      printf("Can't read baseline %s\n", path);
+      return -1;
+    }
+    JsonObject baseline = doc["cases"];
+
+    printf("\nAgainst %s (threshold %.0f %%)\n", path, o.threshold);
+    printf("  %-20s %12s %12s %9s\n", "case", "base ns/op", "ns/op", "change");
+    int regressions = 0;
+    for (const Result& r : results) {
+      JsonVariant old = baseline[r.name]["ns"];
+      if (!old.is<double>() || old.as<double>() <= 0) {
+        printf("  %-20s %12s %12.1f %9s\n", r.name, "-", r.ns, "new");
+        continue;
+      }
+      double change = (r.ns - old.as<double>()) / old.as<double>() * 100.0;
+      bool slower = change > o.threshold;
+      if (slower) regressions++;
+      printf("  %-20s %12.1f %12.1f %+8.1f%%%s\n", r.name, old.as<double>(), r.ns, change,
+             slower ? "  REGRESSION" : "");
+    }
+    printf("%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+    return regressions;
+  }
+
+  int run() {
+    Options o;
+    o.filter = getenv("BENCH_FILTER");
+    o.reps = std::max(1, (int)envNumber("BENCH_REPS", 5));
+    o.minMs = envNumber("BENCH_MIN_MS", 50);
+    o.seed = (uint32_t)envNumber("BENCH_SEED", 1);
+    o.threshold = envNumber("BENCH_THRESHOLD", 10);
+
+    bool ownEeprom = !getenv("VOLTAGELOG_EEPROM");
+    if (ownEeprom) {
+      hal::setEepromPath(EEPROM_FILE);
+      remove(EEPROM_FILE);
+    }
+    setUp(o);
+
+    printf("Benchmarks: %u repetitions of >= %.0f ms, seed %u\n", (unsigned)o.reps, o.minMs,
+           (unsigned)o.seed);
+    printf("  %-20s %12s %12s %12s\n", "case", "ns/op", "min ns/op", "ops/rep");
+    std::vector<Result> results;
+    for (const Case& c : CASES) {
+      if (o.filter && *o.filter && !strstr(c.name, o.filter)) continue;
+      Result r = measure(c, o);
+      printf("  %-20s %12.1f %12.1f %12llu\n", r.name, r.ns, r.minNs, (unsigned long long)r.iterations);
+      fflush(stdout);
+      results.push_back(r);
+    }
+    useFirebaseSession(nullptr);
+    if (ownEeprom) remove(EEPROM_FILE);
+
+    if (const char* path = getenv("BENCH_JSON")) writeJson(path, results, o);
+    if (const char* path = getenv("BENCH_BASELINE")) {
+      if (compare(path, results, o) != 0) return 1;
+    }
+    return 0;
+  }
+}
+
+void setup() {
+  int code = run();
+  fflush(stdout);
+  exit(code);
+}
+
+void loop() {}
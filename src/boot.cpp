@@ -0,0 +1,150 @@
+#include "boot.h"
+#include <WiFi.h>
+#include <atomic>
+#include "webserver.h"
+#include "firebase_handler.h"
+#include "logger.h"
+#include "telemetry_sink.h"
+#include "telemetry_config.h"
+#include "time_service.h"
+#include "serial_log.h"
+#include "device_identity.h"
+
+namespace {
+  // Written from loop(), read by the web handlers
+  std::atomic<uint32_t> phaseTimes[Boot::PHASE_COUNT];
+  std::atomic<uint32_t> phasesReached(0);
+
+  const char* const PHASE_NAMES[Boot::PHASE_COUNT] = {
+    "setup", "sampling", "web", "first_sample", "wifi", "time", "auth", "first_upload"
+  };
+
+  enum Stage : uint8_t {
+    STAGE_IDLE,      // no stored credentials, AP only
+    STAGE_WIFI,      // waiting for the station
+    STAGE_AUTH,      // signing in to Firebase
+    STAGE_DONE
+  };
+
+  Stage stage = STAGE_IDLE;
+  unsigned long wifiStart = 0;
+  unsigned long nextAuth = 0;
+  bool timedOut = false;
+
+  void onWiFiConnected() {
+    wifiConnected = true;
+    Boot::mark(Boot::PHASE_WIFI);
+    LOG_INFO("✓ Connected to WiFi after %lu ms! IP address: %s", millis() - wifiStart,
+             WiFi.localIP().toString().c_str());
+
+    // NTP runs in the background from here on
+    TimeService::begin();
+    DeviceIdentity::announce();
+  }
+
+  // Sign in, then send the logs kept from before the boot
+  bool signIn() {
+    initFirebase();
+    if (!isFirebaseInitialized()) return false;
+    Boot::mark(Boot::PHASE_AUTH);
+
+    if (Logger::hasPendingLogs()) {
+      LOG_INFO("Slanje spremljenih logova na Firebase...");
+      sendLogsToFirebase();
+    }
+    return true;
+  }
+}
+
+namespace Boot {
+
+void mark(Phase phase) {
+  markAt(phase, millis());
+}
+
+void markAt(Phase phase, unsigned long ms) {
+  uint32_t bit = 1UL << phase;
+  if (phasesReached.load(std::memory_order_acquire) & bit) return;
+  phaseTimes[phase].store(ms, std::memory_order_relaxed);
+  phasesReached.fetch_or(bit, std::memory_order_release);
+  LOG_INFO("[Boot] %s at %lu ms", PHASE_NAMES[phase], ms);
+}
+
+bool reached(Phase phase) {
+  return phasesReached.load(std::memory_order_acquire) & (1UL << phase);
+}
+
+unsigned long at(Phase phase) {
+  return reached(phase) ? phaseTimes[phase].load(std::memory_order_relaxed) : 0;
+}
+
+const char* phaseName(Phase phase) {
+  return PHASE_NAMES[phase];
+}
+
+void connect(const char* ssid, const char* password) {
+  LOG_INFO("Attempting to connect to WiFi, SSID: %s", ssid);
+
+  WiFi.setHostname(DeviceIdentity::hostname());  // before mode(), or DHCP keeps the default
+  WiFi.mode(WIFI_STA);
+  WiFi.persistent(false);       // do not save automatically to flash
+  WiFi.setAutoReconnect(true);  // auto reconnect
+  WiFi.begin(ssid, password);
+
+  wifiStart = millis();
+  timedOut = false;
+  stage = STAGE_WIFI;
+}
+
+bool connecting() {
+  return stage == STAGE_WIFI && !timedOut;
+}
+
+bool loop() {
+  bool uplinkReady = false;
+
+  switch (stage) {
+    case STAGE_WIFI:
+      if (WiFi.status() == WL_CONNECTED) {
+        onWiFiConnected();
+        // An uplink without sign-in (MQTT, HTTP POST) can start now
+        uplinkReady = true;
+        stage = TELEMETRY_FIREBASE_ENABLED ? STAGE_AUTH : STAGE_DONE;
+        nextAuth = 0;
+      } else if (!timedOut && millis() - wifiStart > BOOT_WIFI_TIMEOUT_MS) {
+        // loop() starts the AP; the station keeps trying in AP_STA mode
+        timedOut = true;
+        LOG_WARN("✗ Unable to connect to WiFi!");
+      }
+      break;
+
+    case STAGE_AUTH:
+      if (WiFi.status() != WL_CONNECTED) break;
+      if (nextAuth != 0 && (long)(millis() - nextAuth) < 0) break;
+      if (signIn()) {
+        uplinkReady = true;
+        stage = STAGE_DONE;
+      } else {
+        nextAuth = millis() + BOOT_AUTH_RETRY_MS;
+        if (nextAuth == 0) nextAuth = 1;
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  // Uploads hold records back until the first sync, so it counts as the
+  // uplink becoming ready too
+  if (TimeService::loop()) {
+    Logger::resolveTimestamps();
+    markAt(PHASE_TIME, TimeService::lastSyncMillis());
+    uplinkReady = true;
+  }
+  if (!reached(PHASE_FIRST_UPLOAD) && Telemetry::lastSuccessTime() != 0) {
+    markAt(PHASE_FIRST_UPLOAD, Telemetry::lastSuccessTime());
+  }
+  return uplinkReady;
+}
+
+}  // namespace Boot
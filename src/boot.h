@@ -0,0 +1,68 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <Arduino.h>
+
+// Staged start-up. setup() only does the local, quick part (ADC, sinks,
+// web server) and starts the station without waiting for it; sampling
+// begins on the first loop(). Network bring-up then runs as a small state
+// machine driven from the wait between readings:
+//   WiFi connected -> SNTP started (background) -> Firebase sign-in ->
+//   pending logs sent
+// No stage blocks another: readings go on and queue while the uplink
+// comes up. The time each phase was first reached is kept for /status
+// and /metrics.
+
+// Time the station gets before the AP is started as a fallback. The
+// station keeps trying afterwards and the boot carries on if it connects.
+#ifndef BOOT_WIFI_TIMEOUT_MS
+#define BOOT_WIFI_TIMEOUT_MS 10000
+#endif
+
+// Pause between failed Firebase sign-ins
+#ifndef BOOT_AUTH_RETRY_MS
+#define BOOT_AUTH_RETRY_MS 30000
+#endif
+
+// How often the state machine runs while loop() waits for the next reading
+#ifndef BOOT_POLL_MS
+#define BOOT_POLL_MS 50
+#endif
+
+namespace Boot {
+
+enum Phase : uint8_t {
+  PHASE_SETUP,         // setup() entered
+  PHASE_SAMPLING,      // ADC ready
+  PHASE_WEB,           // web server listening
+  PHASE_FIRST_SAMPLE,  // first reading done
+  PHASE_WIFI,          // station connected
+  PHASE_TIME,          // first SNTP sync
+  PHASE_AUTH,          // Firebase ID token
+  PHASE_FIRST_UPLOAD,  // first record delivered by any sink
+  PHASE_COUNT
+};
+
+// Record millis() for a phase; only the first call per phase counts
+void mark(Phase phase);
+void markAt(Phase phase, unsigned long ms);
+
+bool reached(Phase phase);
+unsigned long at(Phase phase);  // millis() when reached, 0 if not yet
+const char* phaseName(Phase phase);
+
+// Start the station with stored credentials. Returns at once.
+void connect(const char* ssid, const char* password);
+
+// The station is still within BOOT_WIFI_TIMEOUT_MS: don't fall back to
+// the AP yet
+bool connecting();
+
+// Advance the start-up stages. Returns true when an uplink has just
+// become ready, so queued records can go out without waiting for the
+// next reading.
+bool loop();
+
+}  // namespace Boot
+
+#endif
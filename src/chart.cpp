@@ -0,0 +1,148 @@
+#include "chart.h"
+#include <math.h>
+
+namespace {
+  // The store read from its oldest sample, as a Chart::Series
+  class StoreSeries : public Chart::Series {
+  public:
+    StoreSeries(const SampleStore& store, uint32_t start) : store(store), start(start) {}
+    void rewind() override { it = store.from(start); }
+    bool next(Sample& out) override { return it.next(out); }
+
+  private:
+    const SampleStore& store;
+    uint32_t start;
+    SampleStore::Iterator it;
+  };
+
+  // First point of bucket b (points 1..n-2 split into equal buckets)
+  size_t bucketStart(size_t b, size_t n, size_t buckets) {
+    return 1 + (size_t)((uint64_t)b * (n - 2) / buckets);
+  }
+
+  int16_t toUnits(int32_t mv) {
+    int32_t u = (mv >= 0 ? mv + Chart::VALUE_UNIT_MV / 2 : mv - Chart::VALUE_UNIT_MV / 2) / Chart::VALUE_UNIT_MV;
+    if (u > INT16_MAX) u = INT16_MAX;
+    if (u < INT16_MIN) u = INT16_MIN;
+    return (int16_t)u;
+  }
+}
+
+namespace Chart {
+
+size_t lttb(Series& series, size_t n, Sample* out, size_t maxPoints) {
+  if (n == 0 || maxPoints == 0) return 0;
+  series.rewind();
+
+  if (n <= maxPoints) {
+    size_t i = 0;
+    while (i < n && series.next(out[i])) i++;
+    return i;
+  }
+  if (maxPoints < 3) return 0;
+
+  const size_t buckets = maxPoints - 2;
+  Sample p;
+
+  // Pass 1: mean of every bucket into out[b + 1], the last point into
+  // out[maxPoints - 1]
+  if (!series.next(p)) return 0;
+  out[0] = p;
+  const uint32_t t0 = p.time;
+  size_t b = 0;
+  size_t end = bucketStart(1, n, buckets);
+  double sumT = 0, sumV = 0;
+  size_t count = 0;
+
+  for (size_t i = 1; i < n; i++) {
+    if (!series.next(p)) return 0;
+    if (i == n - 1) {
+      out[maxPoints - 1] = p;
+      break;
+    }
+    if (i >= end) {
+      out[b + 1] = {t0 + (uint32_t)lround(sumT / count), (int32_t)lround(sumV / count)};
+      b++;
+      end = bucketStart(b + 1, n, buckets);
+      sumT = sumV = 0;
+      count = 0;
+    }
+    sumT += (double)(p.time - t0);
+    sumV += p.value;
+    count++;
+  }
+  out[b + 1] = {t0 + (uint32_t)lround(sumT / count), (int32_t)lround(sumV / count)};
+
+  // Pass 2: pick from each bucket against the point kept before it and the
+  // mean of the next one. out[b + 1] is replaced once its mean is used.
+  series.rewind();
+  if (!series.next(p) || p.time != t0) return 0;  // the oldest data went meanwhile
+  Sample a = out[0];
+  size_t i = 1;
+  for (b = 0; b < buckets; b++) {
+    const Sample c = out[b + 2];
+    const double ct = (int32_t)(c.time - a.time);
+    const double cv = (double)c.value - a.value;
+    double best = -1;
+    Sample chosen = a;
+
+    for (end = bucketStart(b + 1, n, buckets); i < end; i++) {
+      if (!series.next(p)) return 0;
+      // Twice the triangle area, a at the origin
+      double area = fabs(ct * ((double)p.value - a.value) - (double)(int32_t)(p.time - a.time) * cv);
+      if (area > best) {
+        best = area;
+        chosen = p;
+      }
+    }
+    out[b + 1] = chosen;
+    a = chosen;
+  }
+  return maxPoints;
+}
+
+size_t downsample(const SampleStore& store, Sample* out, size_t maxPoints) {
+  // Retried if a block is recycled between the passes (once an hour or so)
+  for (int attempt = 0; attempt < 3; attempt++) {
+    uint32_t oldest, newest;
+    if (!store.span(oldest, newest)) return 0;
+    StoreSeries series(store, oldest);
+    size_t n = lttb(series, store.samples(), out, maxPoints);
+    if (n > 0) return n;
+  }
+  return 0;
+}
+
+size_t payloadBytes(size_t n) {
+  return HEADER_BYTES + n * BYTES_PER_POINT;
+}
+
+size_t render(const Sample* points, size_t n, uint32_t firstUtc, uint32_t firstAgeMs,
+              uint8_t* buf, size_t maxLen, size_t index) {
+  const size_t timesEnd = HEADER_BYTES + 4 * n;
+  const size_t total = payloadBytes(n);
+  size_t written = 0;
+
+  while (written < maxLen && index < total) {
+    uint32_t word;
+    size_t byte;
+    if (index < HEADER_BYTES) {
+      const uint32_t header[3] = {(uint32_t)n, firstUtc, firstAgeMs};
+      word = header[index / 4];
+      byte = index % 4;
+    } else if (index < timesEnd) {
+      size_t k = index - HEADER_BYTES;
+      word = points[k / 4].time - points[0].time;
+      byte = k % 4;
+    } else {
+      size_t k = index - timesEnd;
+      word = (uint16_t)toUnits(points[k / 2].value);
+      byte = k % 2;
+    }
+    buf[written++] = (uint8_t)(word >> (8 * byte));
+    index++;
+  }
+  return written;
+}
+
+}  // namespace Chart
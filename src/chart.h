@@ -0,0 +1,63 @@
+#ifndef CHART_H
+#define CHART_H
+
+#include <Arduino.h>
+#include "sample_store.h"
+
+// Downsampled voltage series for the dashboard chart (/chart?points=N).
+// The history in the sample store is thinned with Largest-Triangle-Three-
+// Buckets to at most as many points as the chart is pixels wide, and sent
+// as a small binary payload the page reads straight into typed arrays:
+//
+//   offset       size  content (little endian)
+//   0            4     uint32 n, points that follow
+//   4            4     uint32 UTC of the first point, epoch s (0 = not synced)
+//   8            4     uint32 age of the first point, ms before the response
+//   12           4n    uint32 time of each point, ms after the first
+//   12 + 4n      2n    int16 value of each point, units of 10 mV
+//
+// The points come from the store's values, so at its resolution (1 s and
+// 10 mV by default, see sample_store.h) before any thinning.
+
+// Points when the request does not say, and the most ever sent
+#ifndef CHART_DEFAULT_POINTS
+#define CHART_DEFAULT_POINTS 400
+#endif
+#ifndef CHART_MAX_POINTS
+#define CHART_MAX_POINTS 1000
+#endif
+
+namespace Chart {
+
+static const size_t HEADER_BYTES = 12;
+static const size_t BYTES_PER_POINT = 6;
+static const int32_t VALUE_UNIT_MV = 10;
+
+// An ordered series that can be read more than once
+class Series {
+public:
+  virtual ~Series() {}
+  virtual void rewind() = 0;
+  virtual bool next(Sample& out) = 0;
+};
+
+// Largest-Triangle-Three-Buckets: keeps the first and last of the n points
+// and, from each of maxPoints - 2 equal buckets in between, the point that
+// spans the largest triangle with the point kept before it and the mean of
+// the next bucket. Two passes over the series, O(maxPoints) memory.
+// Returns the points written to out: n if n <= maxPoints, else maxPoints,
+// 0 if the series came up short of n.
+size_t lttb(Series& series, size_t n, Sample* out, size_t maxPoints);
+
+// LTTB over everything in the store
+size_t downsample(const SampleStore& store, Sample* out, size_t maxPoints);
+
+size_t payloadBytes(size_t n);
+
+// Chunk of the binary payload starting at byte index, for a filler response
+size_t render(const Sample* points, size_t n, uint32_t firstUtc, uint32_t firstAgeMs,
+              uint8_t* buf, size_t maxLen, size_t index);
+
+}  // namespace Chart
+
+#endif
@@ -4,7 +4,13 @@
 #include <Arduino.h>
 #include <EEPROM.h>
 
-#define EEPROM_SIZE   512
+// Whole emulated EEPROM, begun once by initEEPROM() before any region is
+// used. On the ESP32 core a begin() with another size reallocates the
+// buffer and truncates the stored blob, so every region has to fit this:
+//   0-127      WiFiConfig
+//   128-2183   Logger (logger.cpp)
+//   2304-      Settings (settings.h)
+#define EEPROM_SIZE   4096
 #define SSID_MAX_LEN  32
 #define PASS_MAX_LEN  64
 
@@ -0,0 +1,70 @@
+#ifndef DEAD_BAND_H
+#define DEAD_BAND_H
+
+#include <Arduino.h>
+#include <math.h>
+#include "stream_stats.h"
+
+// Report-by-exception for the send windows. A window is uploaded only if
+// one of its samples left the band around the last uploaded voltage, or
+// the last upload is a heartbeat interval old; the others are counted and
+// the next record says how many were held back.
+//
+// A consumer reconstructs the series by holding each record's voltage
+// until the next record: every sample of the windows in between was
+// within the band of it, so the error is never larger than the band.
+//
+// The band is the larger of an absolute width and a share of the
+// reference voltage; both at 0 turns the filter off and every window goes
+// out, as before.
+class DeadBand {
+public:
+  struct Limits {
+    float absolute;        // V
+    float relative;        // fraction of the reference, 0.01 = 1 %
+    uint32_t heartbeatMs;  // longest time without a record
+  };
+
+  // Half-width of the band around reference
+  static float width(const Limits& limits, float reference) {
+    float rel = limits.relative * fabsf(reference);
+    return rel > limits.absolute ? rel : limits.absolute;
+  }
+
+  // The window has to be uploaded
+  bool due(const VoltageSummary& window, uint32_t now, const Limits& limits) const {
+    if (!started || (limits.absolute <= 0 && limits.relative <= 0)) return true;
+    if (now - lastMs >= limits.heartbeatMs) return true;
+    float band = width(limits, reference);
+    return window.min < reference - band || window.max > reference + band;
+  }
+
+  void suppress() {
+    if (held < UINT16_MAX) held++;
+  }
+
+  // A record with this voltage went out; returns the windows held back
+  // since the previous one
+  uint16_t published(float voltage, uint32_t now) {
+    uint16_t n = held;
+    reference = voltage;
+    lastMs = now;
+    held = 0;
+    started = true;
+    return n;
+  }
+
+  // The next window goes out whatever it holds, e.g. when the reference
+  // means something else from now on
+  void restart() { started = false; }
+
+  uint16_t suppressed() const { return held; }
+
+private:
+  bool started = false;
+  float reference = 0;
+  uint32_t lastMs = 0;
+  uint16_t held = 0;
+};
+
+#endif
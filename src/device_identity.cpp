@@ -0,0 +1,91 @@
+#include "device_identity.h"
+#include <ESPmDNS.h>
+#include <ctype.h>
+#include "serial_log.h"
+
+namespace {
+  bool ready = false;
+  char deviceId[DeviceIdentity::ID_LEN];
+  char deviceName[sizeof(DEVICE_NAME_PREFIX) + 7];
+  char deviceHost[sizeof(DEVICE_NAME_PREFIX) + 7];
+  bool mdnsStarted = false;
+
+  // Characters RTDB allows in a key, minus the ones that need escaping in
+  // a URL or an MQTT topic
+  bool keyChar(char c) {
+    return isalnum((unsigned char)c) || c == '-' || c == '_';
+  }
+}
+
+namespace DeviceIdentity {
+
+void begin() {
+  if (ready) return;
+  formatId(ESP.getEfuseMac(), deviceId);
+
+  // Last three bytes: short enough for an SSID, unique within one site
+  snprintf(deviceName, sizeof(deviceName), "%s-%s", DEVICE_NAME_PREFIX, deviceId + 6);
+  for (size_t i = 0; deviceName[i]; i++) {
+    deviceHost[i] = keyChar(deviceName[i]) ? tolower((unsigned char)deviceName[i]) : '-';
+    deviceHost[i + 1] = '\0';
+  }
+  ready = true;
+  LOG_INFO("[Identity] %s (%s), tags: %s", deviceId, deviceName, DEVICE_TAGS[0] ? DEVICE_TAGS : "-");
+}
+
+const char* id() {
+  begin();
+  return deviceId;
+}
+
+const char* name() {
+  begin();
+  return deviceName;
+}
+
+const char* hostname() {
+  begin();
+  return deviceHost;
+}
+
+const char* tags() {
+  return DEVICE_TAGS;
+}
+
+void formatId(uint64_t efuseMac, char* out) {
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+  for (int i = 0; i < 6; i++) {
+    uint8_t b = (uint8_t)(efuseMac >> (8 * i));
+    out[2 * i] = HEX_DIGITS[b >> 4];
+    out[2 * i + 1] = HEX_DIGITS[b & 0x0F];
+  }
+  out[12] = '\0';
+}
+
+bool nextTag(const char*& cursor, char* out) {
+  while (cursor && *cursor) {
+    size_t len = 0;
+    while (*cursor && *cursor != ',') {
+      char c = *cursor++;
+      if (isspace((unsigned char)c)) continue;
+      if (len + 1 < TAG_LEN) out[len++] = keyChar(c) ? c : '-';
+    }
+    if (*cursor == ',') cursor++;
+    out[len] = '\0';
+    if (len > 0) return true;
+  }
+  return false;
+}
+
+void announce() {
+  if (mdnsStarted) return;
+  if (!MDNS.begin(hostname())) {
+    LOG_WARN("[Identity] mDNS start failed");
+    return;
+  }
+  MDNS.addService("http", "tcp", 80);
+  mdnsStarted = true;
+  LOG_INFO("[Identity] mDNS: %s.local", hostname());
+}
+
+}  // namespace DeviceIdentity
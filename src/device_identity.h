@@ -0,0 +1,54 @@
+#ifndef DEVICE_IDENTITY_H
+#define DEVICE_IDENTITY_H
+
+#include <Arduino.h>
+
+// Who this board is, derived from the factory (eFuse) MAC so it survives
+// reflashing and needs no provisioning:
+//
+//   id        "3c61053f8a2c"        database node, MQTT client ID and topic,
+//                                   X-Device-Id header of the HTTP sink
+//   name      "VoltageLog-3f8a2c"   AP SSID
+//   hostname  "voltagelog-3f8a2c"   DHCP and mDNS (voltagelog-3f8a2c.local)
+//
+// Group tags are a comma separated list set at build time. The device
+// lists itself under <FIREBASE_DATA_ROOT>/groups/<tag>/<id>, so a group is
+// read without scanning every device. Tags are cut down to the characters
+// allowed in a database key.
+
+#ifndef DEVICE_NAME_PREFIX
+#define DEVICE_NAME_PREFIX "VoltageLog"
+#endif
+
+#ifndef DEVICE_TAGS
+#define DEVICE_TAGS ""  // e.g. "site-zagreb,rack-3"
+#endif
+
+namespace DeviceIdentity {
+
+static const size_t ID_LEN = 13;   // 12 hex digits + NUL
+static const size_t TAG_LEN = 32;  // longest tag kept, with NUL
+static const size_t MAX_TAGS = 8;
+
+// Reads the MAC; the getters call it themselves if needed
+void begin();
+
+const char* id();
+const char* name();
+const char* hostname();
+const char* tags();
+
+// Lower-case hex of a MAC as the radio sends it (the eFuse value holds
+// the first byte in its low bits)
+void formatId(uint64_t efuseMac, char* out);
+
+// Next tag of a comma separated list, trimmed and cleaned. Returns false
+// at the end of the list; empty entries are skipped.
+bool nextTag(const char*& cursor, char* out);
+
+// mDNS responder for hostname() with the web server on port 80
+void announce();
+
+}  // namespace DeviceIdentity
+
+#endif
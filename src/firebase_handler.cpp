@@ -4,29 +4,43 @@
 #include <WiFi.h>
 #include <time.h>
 #include "logger.h"
+#include "metrics.h"
+#include "trace.h"
+#include "serial_log.h"
+#include "adc_range.h"
+#include "time_service.h"
+#include "firebase_layout.h"
+#include "device_identity.h"
+#include "settings.h"
+
+static FirebaseSession defaultSession;
+static FirebaseSession* session = &defaultSession;
+
+static void onRetentionChanged(uint32_t changed);
+
+void useFirebaseSession(FirebaseSession* s) {
+  session = s ? s : &defaultSession;
+}
 
-bool firebaseInitialized = false;
-String idToken = "";
-unsigned long tokenExpiryTime = 0;
-
-// Record counter 1..20 (loop)
-static int recordCounter = 0;
-static bool timeSynced = false;
+bool isFirebaseInitialized() {
+  return session->initialized;
+}
 
 // Function to obtain ID Token via email/password authentication
 bool getIdToken() {
-  Serial.println(F("Pokušaj dobivanja ID Token-a..."));
+  TRACE_SCOPE("firebase_sign_in");
+  LOG_INFO("Pokušaj dobivanja ID Token-a...");
+  Metrics::inc(Metrics::tokenRefreshes);
   
   // Check if WiFi is connected
   if (WiFi.status() != WL_CONNECTED) {
-    Serial.println(F("✗ WiFi nije spojen!"));
+    LOG_ERROR("✗ WiFi nije spojen!");
+    Metrics::inc(Metrics::tokenRefreshFailures);
     return false;
   }
 
   // URL for signInWithPassword (email/password)
   String url = "https://identitytoolkit.googleapis.com/v1/accounts:signInWithPassword?key=" + String(FIREBASE_API_KEY);
-  Serial.print(F("URL: "));
-  Serial.println(url);
 
   HTTPClient http;
   http.begin(url);
@@ -35,14 +49,11 @@ bool getIdToken() {
   // POST body with email/password (from firebase_config.h)
   String body = "{\"email\":\"" + String(FIREBASE_USER_EMAIL) + "\",\"password\":\"" + String(FIREBASE_USER_PASSWORD) + "\",\"returnSecureToken\": true}";
   
-  Serial.println(F("Slanje POST zahtjeva (signInWithPassword)..."));
+  LOG_DEBUG("Slanje POST zahtjeva (signInWithPassword)...");
   int httpCode = http.POST(body);
   String response = http.getString();
 
-  Serial.print(F("HTTP Code: "));
-  Serial.println(httpCode);
-  Serial.print(F("Response: "));
-  Serial.println(response);
+  LOG_DEBUG("HTTP Code: %d", httpCode);
 
   if (httpCode == 200) {
     // Parse JSON response
@@ -50,174 +61,165 @@ bool getIdToken() {
     DeserializationError error = deserializeJson(doc, response);
 
     if (!error) {
-      idToken = doc["idToken"].as<String>();
+      session->idToken = doc["idToken"].as<String>();
       
       // Check expiration time (tokenExpires in seconds)
       int expiresIn = doc["expiresIn"] | 3600;  // default 1 hour
-      tokenExpiryTime = millis() + (expiresIn * 1000);
+      session->tokenExpiryTime = millis() + (expiresIn * 1000);
 
-      Serial.println(F("✓ ID Token uspješno dobiven!"));
-      Serial.print(F("Token (first 20 chars): "));
-      Serial.println(idToken.substring(0, 20));
+      LOG_INFO("✓ ID Token uspješno dobiven!");
       
       http.end();
       return true;
     } else {
-      Serial.print(F("✗ Greška pri parsiranju JSON odgovora: "));
-      Serial.println(error.c_str());
+      LOG_ERROR("✗ Greška pri parsiranju JSON odgovora: %s", error.c_str());
     }
   } else {
-    Serial.print(F("✗ Greška pri dobivanju ID Token-a - HTTP kod: "));
-    Serial.println(httpCode);
-    Serial.println(response);
+    LOG_ERROR("✗ Greška pri dobivanju ID Token-a - HTTP kod: %d", httpCode);
+    LOG_DEBUG("Odgovor: %s", response.c_str());
   }
 
   http.end();
+  Metrics::inc(Metrics::tokenRefreshFailures);
+  Logger::event(EVENT_AUTH_FAILED, SEVERITY_ERROR, httpCode);
   return false;
 }
 
 void initFirebase() {
-  Serial.println(F("Inicijalizacija Firebase-a..."));
+  LOG_INFO("Inicijalizacija Firebase-a...");
+  static bool subscribed = false;
+  if (!subscribed) subscribed = Settings::subscribe(Settings::bit(Settings::RETENTION_DAYS), onRetentionChanged);
   
   // Attempt to get ID Token
   if (getIdToken()) {
-    firebaseInitialized = true;
-    Serial.println(F("✓ Firebase inicijaliziran!"));
-    Serial.print(F("Database URL: "));
-    Serial.println(FIREBASE_DATABASE_URL);
-    // Attempt to sync time with NTP (UTC)
-    configTime(0, 0, "pool.ntp.org", "time.google.com");
-    // Attempt time sync (short timeout)
-    timeSynced = false;
-    time_t now = time(nullptr);
-    unsigned long start = millis();
-    while ((now < 100000) && (millis() - start < 10000)) {
-      delay(500);
-      now = time(nullptr);
-    }
-    if (now >= 100000) {
-      timeSynced = true;
-      Serial.println(F("✓ Vrijeme sinkronizirano (UTC)."));
-    } else {
-      Serial.println(F("✗ Neuspjela sinkronizacija vremena (NTP) - pokušat će se kasnije."));
-    }
+    session->initialized = true;
+    LOG_INFO("✓ Firebase inicijaliziran! Database URL: %s", FIREBASE_DATABASE_URL);
   } else {
-    Serial.println(F("✗ Inicijalizacija Firebase-a neuspješna"));
-    firebaseInitialized = false;
+    LOG_ERROR("✗ Inicijalizacija Firebase-a neuspješna");
+    session->initialized = false;
   }
 }
 
-// Ensure time is synced; call before using time. Non-blocking short attempt.
-void ensureTimeSynced() {
-  if (timeSynced) return;
-  configTime(0, 0, "pool.ntp.org", "time.google.com");
-  time_t now = time(nullptr);
-  unsigned long start = millis();
-  while ((now < 100000) && (millis() - start < 5000)) {
-    delay(300);
-    now = time(nullptr);
-  }
-  if (now >= 100000) {
-    timeSynced = true;
-    Serial.println(F("✓ Vrijeme sinkronizirano (UTC) (on-demand)."));
+// Sign in again if the token ran out
+static bool ensureToken() {
+  if (millis() > session->tokenExpiryTime) {
+    LOG_WARN("ID Token istekao, ponovno se autentificiram...");
+    return getIdToken();
   }
+  return true;
 }
 
-// Delete old entries (keep only the last 20)
-void deleteOldEntries() {
-  // Fetch all entries with orderBy key
-  String url = String(FIREBASE_DATABASE_URL) + FIREBASE_PATH + ".json?orderBy=\"$key\"&limitToFirst=100&auth=" + idToken;
-  
-  HTTPClient http;
-  http.begin(url);
-  http.addHeader("Content-Type", "application/json");
-  
-  int httpCode = http.GET();
-  String response = http.getString();
-  
-  if (httpCode == 200 && response != "null") {
-    // Parse JSON response
-    DynamicJsonDocument doc(4096);
-    DeserializationError error = deserializeJson(doc, response);
-    
-    if (!error && doc.is<JsonObject>()) {
-      JsonObject obj = doc.as<JsonObject>();
-      
-      // Count entries
-      int count = 0;
-      unsigned long oldestKey = ULONG_MAX;
-      
-      for (JsonPair p : obj) {
-        count++;
-        unsigned long keyNum = strtoul(p.key().c_str(), NULL, 10);
-        if (keyNum < oldestKey) {
-          oldestKey = keyNum;
-        }
-      }
-      
-      // If more than 20, delete the 5 oldest (avoid API limits)
-      if (count > 20) {
-        int deletedCount = 0;
-        for (JsonPair p : obj) {
-          if (deletedCount >= 5) break;  // Delete only 5 at a time
-          
-          unsigned long keyNum = strtoul(p.key().c_str(), NULL, 10);
-          if (keyNum == oldestKey) {
-            String deleteUrl = String(FIREBASE_DATABASE_URL) + FIREBASE_PATH + "/" + p.key().c_str() + ".json?auth=" + idToken;
-            HTTPClient deleteHttp;
-            deleteHttp.begin(deleteUrl);
-            int delCode = deleteHttp.sendRequest("DELETE");
-            deleteHttp.end();
-            
-            if (delCode == 200) {
-              deletedCount++;
-              Serial.print(F("✓ Obrisan unos: "));
-              Serial.println(p.key().c_str());
-            }
-          }
-        }
-      }
-    }
-  }
-  
-  http.end();
+static const char* deviceId() {
+  return session->deviceId ? session->deviceId : DeviceIdentity::id();
 }
 
-bool sendVoltageToFirebase(float voltage, int rawValue) {
-  if (!firebaseInitialized) {
-    Serial.println(F("Firebase nije inicijaliziran"));
-    return false;
+// <FIREBASE_DATABASE_URL><device node><rel>.json?auth=...
+static String deviceUrl(const String& rel, const char* query = "") {
+  return String(FIREBASE_DATABASE_URL) + FirebaseLayout::devicePath(deviceId()) + rel + ".json?" + query + "auth=" + session->idToken;
+}
+
+// Once a boot: devices/<id>/info and the device's entry in each of its
+// groups, in one update at the root. Groups from the last registration
+// (info/tags) that the device has left are removed. Returns the HTTP code
+// of the request that failed, or 200.
+static int registerDevice() {
+  TRACE_SCOPE("firebase_register");
+  const char* id = deviceId();
+
+  HTTPClient get;
+  get.begin(deviceUrl("/info/tags"));
+  int httpCode = get.GET();
+  String previous = get.getString();
+  get.end();
+  if (httpCode != 200) return httpCode;
+
+  DynamicJsonDocument doc(1024);
+  JsonObject updates = doc.to<JsonObject>();
+  char path[96], tag[DeviceIdentity::TAG_LEN], boot[9];
+
+  snprintf(path, sizeof(path), "devices/%s/info", id);
+  JsonObject info = updates.createNestedObject(path);
+  snprintf(boot, sizeof(boot), "%08x", (unsigned)session->bootId);
+  info["boot"] = boot;
+  info["seen"] = (unsigned long)TimeService::now();
+  JsonObject tags = info.createNestedObject("tags");
+
+  const char* cursor = session->tags ? session->tags : DeviceIdentity::tags();
+  for (size_t n = 0; n < DeviceIdentity::MAX_TAGS && DeviceIdentity::nextTag(cursor, tag); n++) {
+    tags[tag] = true;
+    snprintf(path, sizeof(path), "groups/%s/%s", tag, id);
+    updates[path] = true;
   }
 
-  // Check if the token expired
-  if (millis() > tokenExpiryTime) {
-    Serial.println(F("ID Token istekao, ponovno se autentificiram..."));
-    if (!getIdToken()) {
-      return false;
+  DynamicJsonDocument old(512);
+  if (!deserializeJson(old, previous) && old.is<JsonObject>()) {
+    for (JsonPair p : old.as<JsonObject>()) {
+      if (tags.containsKey(p.key().c_str())) continue;
+      snprintf(path, sizeof(path), "groups/%s/%s", p.key().c_str(), id);
+      updates[path] = (const char*)nullptr;  // null deletes in an update
     }
   }
 
-  // Increment counter and loop 1..20
-  recordCounter++;
-  if (recordCounter > 20) {
-    recordCounter = 1;
+  String body;
+  serializeJson(doc, body);
+  HTTPClient http;
+  http.begin(String(FIREBASE_DATABASE_URL) + FIREBASE_DATA_ROOT + ".json?auth=" + session->idToken);
+  http.addHeader("Content-Type", "application/json");
+  httpCode = http.PATCH(body);
+  http.end();
+
+  if (httpCode == 200) LOG_INFO("✓ Uređaj %s registriran", id);
+  return httpCode;
+}
+
+// Registration is not needed for the upload, so a failed one only comes
+// back after the retry policy's backoff. A 403 (the rules refuse groups/)
+// or another permanent error is not tried again until the next boot.
+static void tryRegister() {
+  if (session->registered || session->registrationRefused || !session->registration.allow()) return;
+  int httpCode = registerDevice();
+  if (httpCode == 200) {
+    session->registered = true;
+    session->registration.onSuccess();
+    return;
   }
 
-  // Ensure time is synced (short attempt if not)
-  ensureTimeSynced();
-
-  // Create JSON object
-  StaticJsonDocument<256> json;
-  json["recordNumber"] = recordCounter;
-  json["voltage"]   = voltage;
-  json["rawValue"]  = rawValue;
-  json["device"]    = "ESP32-C3-VoltageLog";
-
-  // Add UTC timestamp (epoch) and ISO8601 string if available
-  time_t now = time(nullptr);
-  if (now >= 100000) {
-    json["timestamp"] = (unsigned long)now;
-    struct tm *tminfo = gmtime(&now);
+  RetryPolicy::ErrorClass cls = RetryPolicy::classify(httpCode);
+  if (httpCode == 403 || cls == RetryPolicy::ERROR_PERMANENT) {
+    session->registrationRefused = true;
+    LOG_ERROR("✗ Registracija uređaja odbijena - HTTP kod: %d, do ponovnog pokretanja", httpCode);
+    Logger::event(EVENT_REGISTER_FAILED, SEVERITY_ERROR, httpCode);
+    return;
+  }
+  session->registration.onFailure(cls);
+  LOG_WARN("Registracija uređaja neuspješna - HTTP kod: %d, ponovno za %lu s", httpCode,
+           session->registration.retryInMs() / 1000);
+  Logger::event(EVENT_REGISTER_FAILED, SEVERITY_WARN, httpCode);
+}
+
+// Record fields, shared by the new layout and the legacy mirror
+static void fillRecord(JsonObject json, const TelemetryRecord& record, time_t sampleTime) {
+  json["voltage"]   = record.voltage;
+  json["rawValue"]  = record.rawValue;
+  json["adcRange"]  = AdcRanging::rangeInfo(record.adcRange).name;
+  json["device"]    = deviceId();
+  json["suppressed"] = record.suppressed;  // windows before this one within the dead-band
+
+  // Statistics over the reporting window the voltage is the mean of
+  JsonObject w = json.createNestedObject("window");
+  w["count"]  = record.summary.count;
+  w["stddev"] = record.summary.stddev;
+  w["min"]    = record.summary.min;
+  w["max"]    = record.summary.max;
+  w["p1"]     = record.summary.p1;
+  w["p50"]    = record.summary.p50;
+  w["p99"]    = record.summary.p99;
+
+  // UTC time the window closed (epoch) and ISO8601 string, mapped from
+  // the monotonic clock so records queued before the NTP sync get it too
+  if (sampleTime != 0) {
+    json["timestamp"] = (unsigned long)sampleTime;
+    struct tm *tminfo = gmtime(&sampleTime);
     char timebuf[32] = {0};
     if (tminfo != NULL) {
       strftime(timebuf, sizeof(timebuf), "%Y-%m-%dT%H:%M:%SZ", tminfo);
@@ -229,130 +231,254 @@ bool sendVoltageToFirebase(float voltage, int rawValue) {
     json["timestamp"] = 0; // marker that time is not synced
     json["utc_time"] = "unsynced";
   }
+}
 
-  String body;
-  if (serializeJson(json, body) == 0) {
-    Serial.println(F("✗ Greška pri serijalizaciji JSON-a"));
-    return false;
-  }
+// hourly/<day>/<hh>/<boot> entry of a batch
+static void addHourSummary(JsonObject updates, const FirebaseLayout::HourSummary& hour) {
+  char day[FirebaseLayout::DAY_LEN], hh[FirebaseLayout::HOUR_LEN], boot[9];
+  FirebaseLayout::dayKey(hour.hour, day);
+  FirebaseLayout::hourKey(hour.hour, hh);
+  snprintf(boot, sizeof(boot), "%08x", (unsigned)session->bootId);
+
+  char path[40];
+  snprintf(path, sizeof(path), "hourly/%s/%s/%s", day, hh, boot);
+  JsonObject s = updates.createNestedObject(path);
+  s["records"]   = hour.records;
+  s["samples"]   = hour.samples;
+  s["mean"]      = hour.samples ? hour.sum / hour.samples : 0.0;
+  s["min"]       = hour.min;
+  s["max"]       = hour.max;
+  s["first"]     = (unsigned long)hour.first;
+  s["last"]      = (unsigned long)hour.last;
+  s["timestamp"] = (unsigned long)hour.hour;
+}
 
-  // Use sequential number as child key (1-20 loop)
-  String url = String(FIREBASE_DATABASE_URL) + FIREBASE_PATH + "/" + String(recordCounter) + ".json?auth=" + idToken;
+#if FIREBASE_LEGACY_MIRROR
+// Old layout: FIREBASE_PATH/<1..20>, overwritten in turn. Best effort, a
+// failure here does not hold the record back.
+static void mirrorLegacy(const TelemetryRecord& record, time_t sampleTime) {
+  session->recordCounter = session->recordCounter % 20 + 1;
 
+  StaticJsonDocument<512> json;
+  fillRecord(json.to<JsonObject>(), record, sampleTime);
+  json["recordNumber"] = session->recordCounter;
+  String body;
+  serializeJson(json, body);
+
+  String url = String(FIREBASE_DATABASE_URL) + FIREBASE_PATH + "/" + String(session->recordCounter) + ".json?auth=" + session->idToken;
   HTTPClient http;
   http.begin(url);
   http.addHeader("Content-Type", "application/json");
-
   int httpCode = http.PUT(body);
+  http.end();
+  if (httpCode != 200) LOG_DEBUG("Legacy zapis neuspješan - HTTP kod: %d", httpCode);
+}
+#endif
+
+bool expiredDays(const String& listing, const char* cutoff, ExpiredDayFn fn, void* ctx) {
+  DynamicJsonDocument doc(2048);
+  if (deserializeJson(doc, listing) || !doc.is<JsonObject>()) return false;
+  for (JsonPair p : doc.as<JsonObject>()) {
+    // "yyyy-mm-dd" compares like the date; "unsynced" is left alone
+    const char* day = p.key().c_str();
+    if (strlen(day) != FirebaseLayout::DAY_LEN - 1 || strcmp(day, cutoff) >= 0) continue;
+    fn(day, ctx);
+  }
+  return true;
+}
+
+static void deleteRawDay(const char* day, void*) {
+  HTTPClient del;
+  del.begin(deviceUrl(String("/raw/") + day));
+  if (del.sendRequest("DELETE") == 200) LOG_INFO("Obrisan stari dan: %s", day);
+  del.end();
+}
+
+// Once a UTC day: drop raw/<day> nodes past the retentionDays setting
+// (default FIREBASE_RETENTION_DAYS). A shallow GET lists the days (keys
+// only), so days missed while the device was off go too.
+static void pruneRawDays(time_t newest) {
+  uint32_t retentionDays = Settings::get().retentionDays;
+  long today = (long)(newest / 86400);
+  if (retentionDays == 0 || newest == 0 || today == session->prunedDay) return;
+  session->prunedDay = today;
+  TRACE_SCOPE("firebase_prune");
+
+  char cutoff[FirebaseLayout::DAY_LEN];
+  FirebaseLayout::dayKey(newest - (time_t)retentionDays * 86400, cutoff);
+
+  HTTPClient http;
+  http.begin(deviceUrl("/raw", "shallow=true&"));
+  int httpCode = http.GET();
   String response = http.getString();
+  http.end();
+  if (httpCode != 200 || response == "null") return;
 
-  if (httpCode == 200) {
-    Serial.println(F("✓ Podaci uspješno poslani na Firebase!"));
-    
-    // Now delete old entries - keep only the last 20 (every 10th entry)
-    static unsigned long lastCleanup = 0;
-    if (millis() - lastCleanup > 30000) {  // Clean every 30 seconds
-      deleteOldEntries();
-      lastCleanup = millis();
+  expiredDays(response, cutoff, deleteRawDay, nullptr);
+}
+
+// A shorter window takes effect with the next upload, not the next day
+static void onRetentionChanged(uint32_t) {
+  if (session) session->prunedDay = -1;
+}
+
+bool buildRecordsUpdate(const TelemetryRecord* records, size_t count, FirebaseLayout::HourSummary& hour,
+                        time_t& newest, String& body) {
+  // One multi-path update on the device node: every record under its own
+  // key plus the roll-up of each hour it touches
+  DynamicJsonDocument doc(512 * (count + 2));
+  JsonObject updates = doc.to<JsonObject>();
+  bool hourTouched = false;
+  newest = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    const TelemetryRecord& record = records[i];
+    time_t sampleTime = TimeService::utcFromMillis(record.readTime);
+
+    char day[FirebaseLayout::DAY_LEN], hh[FirebaseLayout::HOUR_LEN], key[FirebaseLayout::KEY_LEN];
+    FirebaseLayout::dayKey(sampleTime, day);
+    FirebaseLayout::hourKey(sampleTime, hh);
+    uint64_t utcMs = sampleTime ? (uint64_t)sampleTime * 1000 + record.readTime % 1000 : 0;
+    FirebaseLayout::recordKey(utcMs, session->bootId, record.readTime, key);
+
+    char path[48];
+    if (hh[0]) snprintf(path, sizeof(path), "raw/%s/%s/%s", day, hh, key);
+    else snprintf(path, sizeof(path), "raw/%s/%s", day, key);
+    fillRecord(updates.createNestedObject(path), record, sampleTime);
+
+    if (sampleTime != 0) {
+      if (hourTouched && sampleTime - sampleTime % 3600 > hour.hour) {
+        addHourSummary(updates, hour);
+        hourTouched = false;
+      }
+      if (hour.add(record, sampleTime)) hourTouched = true;
+      if (sampleTime > newest) newest = sampleTime;
     }
-    
-    http.end();
-    return true;
-  } else {
-    Serial.print(F("✗ Firebase greška - HTTP kod: "));
-    Serial.println(httpCode);
-    Serial.print(F("Odgovor: "));
-    Serial.println(response);
-    
-    // If 401, try to obtain token again
+  }
+  if (hourTouched) addHourSummary(updates, hour);
+
+  return !doc.overflowed() && serializeJson(doc, body) > 0;
+}
+
+bool sendRecordsToFirebase(const TelemetryRecord* records, size_t count, int* httpCodeOut) {
+  TRACE_SCOPE("firebase_patch");
+  if (!session->initialized) {
+    LOG_WARN("Firebase nije inicijaliziran");
+    return false;
+  }
+  if (count == 0) return true;
+  if (!ensureToken()) return false;
+  if (session->bootId == 0) session->bootId = esp_random() | 1;
+  tryRegister();
+
+  // The roll-up is kept in a copy and only taken over once the write
+  // went through
+  FirebaseLayout::HourSummary hour = session->hour;
+  time_t newest = 0;
+  String body;
+  if (!buildRecordsUpdate(records, count, hour, newest, body)) {
+    LOG_ERROR("✗ Greška pri serijalizaciji JSON-a");
+    return false;
+  }
+
+  HTTPClient http;
+  http.begin(deviceUrl(""));
+  http.addHeader("Content-Type", "application/json");
+
+  unsigned long uploadStart = millis();
+  int httpCode = http.PATCH(body);
+  String response = http.getString();
+  Metrics::recordUpload(httpCode, millis() - uploadStart);
+  http.end();
+
+  if (httpCode != 200) {
+    LOG_ERROR("✗ Firebase greška - HTTP kod: %d", httpCode);
+    LOG_DEBUG("Odgovor: %s", response.c_str());
+
+    // 401: the token was revoked or expired early. Drop it so the next
+    // attempt signs in again; the retry policy brings that attempt forward.
     if (httpCode == 401) {
-      Serial.println(F("Neautoriziran pristup, ponovno autentifikacija..."));
-      if (getIdToken()) {
-        // Retry request with new token
-        String newUrl = String(FIREBASE_DATABASE_URL) + FIREBASE_PATH + "/" + String(recordCounter) + ".json?auth=" + idToken;
-        HTTPClient retryHttp;
-        retryHttp.begin(newUrl);
-        retryHttp.addHeader("Content-Type", "application/json");
-        int retryCode = retryHttp.PUT(body);
-        
-        if (retryCode == 200) {
-          Serial.println(F("✓ Retry uspješan!"));
-          retryHttp.end();
-          return true;
-        }
-        retryHttp.end();
-      }
+      LOG_WARN("Neautoriziran pristup, token odbačen");
+      session->tokenExpiryTime = 0;
     }
-    
-    http.end();
+    if (httpCodeOut) *httpCodeOut = httpCode;
     return false;
   }
+
+  LOG_INFO("✓ Podaci uspješno poslani na Firebase! (%u zapisa)", (unsigned)count);
+  session->hour = hour;
+
+#if FIREBASE_LEGACY_MIRROR
+  for (size_t i = 0; i < count; i++) {
+    mirrorLegacy(records[i], TimeService::utcFromMillis(records[i].readTime));
+  }
+#endif
+  pruneRawDays(newest);
+  return true;
 }
 
 bool checkFirebaseConnection() {
-  return firebaseInitialized && !idToken.isEmpty();
+  return session->initialized && !session->idToken.isEmpty();
 }
 
 bool sendLogsToFirebase() {
-  if (!firebaseInitialized) {
-    Serial.println(F("Firebase nije inicijaliziran za slanje logova"));
+  if (!session->initialized) {
+    LOG_WARN("Firebase nije inicijaliziran za slanje logova");
     return false;
   }
 
   // Provjeri ima li logova za slanje
   if (!Logger::hasPendingLogs()) {
-    Serial.println(F("Nema logova za slanje"));
+    LOG_DEBUG("Nema logova za slanje");
     return true;
   }
 
-  // Check if token expired
-  if (millis() > tokenExpiryTime) {
-    Serial.println(F("ID Token istekao, ponovno se autentificiram..."));
-    if (!getIdToken()) {
-      return false;
-    }
-  }
+  if (!ensureToken()) return false;
 
-  // Dohvati logove kao JSON
+  // Dohvati logove kao kompaktne nizove (v2: fields + events)
   String logsJSON = Logger::getLogsAsJSON();
   
-  Serial.print(F("Slanje logova na Firebase: "));
-  Serial.println(logsJSON);
+  LOG_INFO("Slanje logova na Firebase (%u B)", (unsigned)logsJSON.length());
 
-  // URL za slanje logova (u drugoj bazi ili path-u)
-  String url = String(FIREBASE_DATABASE_URL) + "/logs.json?auth=" + idToken;
+  // Pod čvorom uređaja, po UTC danu slanja
+  char day[FirebaseLayout::DAY_LEN];
+  FirebaseLayout::dayKey(TimeService::now(), day);
+  String logsPath = String("/logs/") + day;
+  String url = deviceUrl(logsPath);
 
   HTTPClient http;
   http.begin(url);
   http.addHeader("Content-Type", "application/json");
 
+  unsigned long uploadStart = millis();
   int httpCode = http.POST(logsJSON);
   String response = http.getString();
+  Metrics::recordUpload(httpCode, millis() - uploadStart);
 
   if (httpCode == 200) {
-    Serial.println(F("✓ Logovi uspješno poslani na Firebase!"));
+    LOG_INFO("✓ Logovi uspješno poslani na Firebase!");
     Logger::clearLogs();  // Obriši logove nakon uspješnog slanja
     http.end();
     return true;
   } else {
-    Serial.print(F("✗ Greška pri slanju logova - HTTP kod: "));
-    Serial.println(httpCode);
-    Serial.print(F("Odgovor: "));
-    Serial.println(response);
+    LOG_ERROR("✗ Greška pri slanju logova - HTTP kod: %d", httpCode);
+    LOG_DEBUG("Odgovor: %s", response.c_str());
     
     // Ako je 401, pokušaj ponovno autentifikaciju
     if (httpCode == 401) {
-      Serial.println(F("Neautoriziran pristup, ponovno autentifikacija..."));
+      LOG_WARN("Neautoriziran pristup, ponovno autentifikacija...");
       if (getIdToken()) {
         // Pokušaj ponovno
-        String newUrl = String(FIREBASE_DATABASE_URL) + "/logs.json?auth=" + idToken;
+        String newUrl = deviceUrl(logsPath);
         HTTPClient retryHttp;
         retryHttp.begin(newUrl);
         retryHttp.addHeader("Content-Type", "application/json");
+        unsigned long retryStart = millis();
         int retryCode = retryHttp.POST(logsJSON);
+        Metrics::recordUpload(retryCode, millis() - retryStart);
         
         if (retryCode == 200) {
-          Serial.println(F("✓ Slanje logova uspješno nakon ponovne autentifikacije!"));
+          LOG_INFO("✓ Slanje logova uspješno nakon ponovne autentifikacije!");
           Logger::clearLogs();
           retryHttp.end();
           return true;
@@ -5,11 +5,49 @@
 #include <HTTPClient.h>
 #include <ArduinoJson.h>
 #include "firebase_config.h"
+#include "telemetry_sink.h"
+#include "firebase_layout.h"
+#include "retry_policy.h"
 
-extern bool firebaseInitialized;
+// Client state of one device. The firmware has a single one; the fleet
+// simulator (fleet_sim.cpp) switches between one per virtual device.
+struct FirebaseSession {
+  const char* deviceId = nullptr;     // DeviceIdentity::id() if not set
+  const char* tags = nullptr;         // DeviceIdentity::tags() if not set
+  bool registered = false;            // info and groups written this boot
+  bool registrationRefused = false;   // permanent error: not tried again this boot
+  RetryPolicy registration;           // backoff between registration attempts
+  bool initialized = false;
+  String idToken;
+  unsigned long tokenExpiryTime = 0;  // millis()
+  uint32_t bootId = 0;                // record keys and roll-up node, 0 = not picked yet
+  FirebaseLayout::HourSummary hour;   // roll-up of the current UTC hour, as uploaded
+  long prunedDay = -1;                // UTC day (epoch / 86400) of the last retention check
+  int recordCounter = 0;              // legacy mirror key, loops 1..20
+};
+
+// Calls below act on this session; nullptr goes back to the built-in one
+void useFirebaseSession(FirebaseSession* session);
 
 void initFirebase();
-bool sendVoltageToFirebase(float voltage, int rawValue);
+bool isFirebaseInitialized();
+// Writes the records (oldest first) and their hourly roll-up in one
+// request, see firebase_layout.h. All or nothing; on failure *httpCodeOut
+// gets the HTTP code (or is left alone if it never got that far).
+bool sendRecordsToFirebase(const TelemetryRecord* records, size_t count, int* httpCodeOut = nullptr);
+
+// Body of that request. hour is the session's roll-up and gets the records
+// added; newest is the latest record time (0 if none is synced). False if
+// the batch did not fit.
+bool buildRecordsUpdate(const TelemetryRecord* records, size_t count, FirebaseLayout::HourSummary& hour,
+                        time_t& newest, String& body);
+
+// Calls fn for each day of a shallow raw/ listing older than cutoff
+// ("yyyy-mm-dd"), the ones the retention check deletes. False if the
+// listing is not a JSON object.
+typedef void (*ExpiredDayFn)(const char* day, void* ctx);
+bool expiredDays(const String& listing, const char* cutoff, ExpiredDayFn fn, void* ctx);
+
 bool checkFirebaseConnection();
 bool sendLogsToFirebase();  // Nova funkcija za slanje logova
 
@@ -0,0 +1,70 @@
+#include "firebase_layout.h"
+#include <string.h>
+
+namespace {
+  // Firebase push ID alphabet, in ASCII order so keys sort like the numbers
+  const char PUSH_CHARS[] = "-0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_abcdefghijklmnopqrstuvwxyz";
+
+  // Writes len base-64 digits of value, most significant first
+  void encode(uint64_t value, char* out, size_t len) {
+    for (size_t i = len; i-- > 0;) {
+      out[i] = PUSH_CHARS[value & 0x3F];
+      value >>= 6;
+    }
+  }
+}
+
+namespace FirebaseLayout {
+
+String devicePath(const char* device) {
+  return String(FIREBASE_DATA_ROOT) + "/devices/" + device;
+}
+
+void dayKey(time_t utc, char* day) {
+  struct tm t;
+  if (utc == 0 || gmtime_r(&utc, &t) == NULL) {
+    strcpy(day, "unsynced");
+    return;
+  }
+  strftime(day, DAY_LEN, "%Y-%m-%d", &t);
+}
+
+void hourKey(time_t utc, char* hour) {
+  if (utc == 0) {
+    hour[0] = '\0';
+    return;
+  }
+  int h = (int)((utc / 3600) % 24);
+  hour[0] = '0' + h / 10;
+  hour[1] = '0' + h % 10;
+  hour[2] = '\0';
+}
+
+void recordKey(uint64_t utcMs, uint32_t bootId, uint32_t uptimeMs, char* key) {
+  encode(utcMs, key, 8);
+  encode(((uint64_t)bootId << 32) | uptimeMs, key + 8, 12);
+  key[20] = '\0';
+}
+
+bool HourSummary::add(const TelemetryRecord& record, time_t utc) {
+  time_t start = utc - utc % 3600;
+  if (records == 0 || start != hour) {
+    if (records > 0 && start < hour) return false;
+    *this = HourSummary();
+    hour = start;
+  }
+
+  uint32_t n = record.summary.count ? record.summary.count : 1;
+  float lo = record.summary.count ? record.summary.min : record.voltage;
+  float hi = record.summary.count ? record.summary.max : record.voltage;
+  if (records == 0 || lo < min) min = lo;
+  if (records == 0 || hi > max) max = hi;
+  if (records == 0 || utc < first) first = utc;
+  if (records == 0 || utc > last) last = utc;
+  records++;
+  samples += n;
+  sum += (double)record.voltage * n;
+  return true;
+}
+
+}  // namespace FirebaseLayout
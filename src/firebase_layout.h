@@ -0,0 +1,83 @@
+#ifndef FIREBASE_LAYOUT_H
+#define FIREBASE_LAYOUT_H
+
+#include <Arduino.h>
+#include <time.h>
+#include "telemetry_sink.h"
+
+// Where uploads go in the Realtime Database. Everything a device writes
+// sits under its own node, bucketed by UTC day and hour, and is never
+// overwritten:
+//
+//   <FIREBASE_DATA_ROOT>/devices/<device id>/
+//     info                             tags, first seen, boot ID (once a boot)
+//     raw/<yyyy-mm-dd>/<hh>/<key>      one record per key
+//     raw/unsynced/<key>               records that never got a UTC time
+//     hourly/<yyyy-mm-dd>/<hh>/<boot>  roll-up of that hour's records
+//     logs/<yyyy-mm-dd>/<push id>      log dumps
+//   <FIREBASE_DATA_ROOT>/groups/<tag>/<device id>: true
+//
+// The device ID comes from the MAC (device_identity.h), so no two boards
+// share a node and thousands can write at once without contending.
+// Keys sort like Firebase push IDs: 8 characters of the record's UTC time
+// in ms, then 12 from the boot ID and uptime, so a retried upload writes
+// the same key again instead of a duplicate. Every record carries a
+// numeric "timestamp" (epoch s) for orderBy queries. The hourly node is
+// rewritten with each batch and is per boot, so a reboot in the middle of
+// an hour starts a second roll-up instead of clobbering the first.
+//
+// A batch (records plus roll-up) goes out as one multi-path PATCH on the
+// device node. A dashboard reads hourly/<day> (about 24 x 200 B); an
+// analytics job reads raw/<day>/<hh> for one device.
+
+#ifndef FIREBASE_DATA_ROOT
+#define FIREBASE_DATA_ROOT "/voltagelog"
+#endif
+
+// raw/<day> nodes older than this are deleted by the device, one request
+// per day (0 = keep everything). Roll-ups stay. Default of the
+// retentionDays setting.
+#ifndef FIREBASE_RETENTION_DAYS
+#define FIREBASE_RETENTION_DAYS 30
+#endif
+
+// Migration: also keep writing the old FIREBASE_PATH/<1..20> keys, so
+// consumers of the old layout work until they are switched over
+#ifndef FIREBASE_LEGACY_MIRROR
+#define FIREBASE_LEGACY_MIRROR 0
+#endif
+
+namespace FirebaseLayout {
+
+static const size_t DAY_LEN = 11;   // "yyyy-mm-dd" + NUL
+static const size_t HOUR_LEN = 3;   // "hh" + NUL
+static const size_t KEY_LEN = 21;   // 20 characters + NUL
+
+// "<root>/devices/<device>"
+String devicePath(const char* device);
+
+// Bucket of a UTC time; "unsynced" and "" for 0
+void dayKey(time_t utc, char* day);
+void hourKey(time_t utc, char* hour);
+
+// Push-style key for a record
+void recordKey(uint64_t utcMs, uint32_t bootId, uint32_t uptimeMs, char* key);
+
+// Roll-up of the records of one UTC hour written by one boot
+struct HourSummary {
+  time_t hour = 0;        // start of the hour, 0 = empty
+  uint32_t records = 0;
+  uint32_t samples = 0;   // readings behind the records
+  double sum = 0;         // of the readings, for the mean
+  float min = 0;
+  float max = 0;
+  time_t first = 0;
+  time_t last = 0;
+
+  // false if the record is from an earlier hour than this one
+  bool add(const TelemetryRecord& record, time_t utc);
+};
+
+}  // namespace FirebaseLayout
+
+#endif
@@ -0,0 +1,17 @@
+#include "firebase_sink.h"
+#include <WiFi.h>
+#include "firebase_handler.h"
+
+bool FirebaseSink::isReady() {
+  return WiFi.status() == WL_CONNECTED && isFirebaseInitialized();
+}
+
+size_t FirebaseSink::sendBatch(const TelemetryRecord* records, size_t count) {
+  // One multi-path PATCH per batch, it lands whole or not at all
+  int httpCode = -1;
+  if (!sendRecordsToFirebase(records, count, &httpCode)) {
+    setResultCode(httpCode);
+    return 0;
+  }
+  return count;
+}
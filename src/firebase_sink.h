@@ -0,0 +1,17 @@
+#ifndef FIREBASE_SINK_H
+#define FIREBASE_SINK_H
+
+#include "telemetry_sink.h"
+
+// Firebase Realtime Database sink - wraps the REST calls in firebase_handler
+class FirebaseSink : public TelemetrySink {
+public:
+  FirebaseSink() : TelemetrySink("firebase") {}
+
+protected:
+  size_t sendBatch(const TelemetryRecord* records, size_t count) override;
+  size_t maxBatchSize() const override { return 4; }
+  bool isReady() override;
+};
+
+#endif
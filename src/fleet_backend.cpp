@@ -0,0 +1,280 @@
+#include "fleet_backend.h"
+#include <algorithm>
+#include <ArduinoJson.h>
+#include <string.h>
+#include "hal.h"
+
+namespace {
+  // Value of one query parameter, "" if missing
+  std::string param(const std::string& query, const char* name) {
+    size_t len = strlen(name);
+    size_t pos = 0;
+    while (pos < query.size()) {
+      size_t end = query.find('&', pos);
+      if (end == std::string::npos) end = query.size();
+      if (query.compare(pos, len, name) == 0 && pos + len < end && query[pos + len] == '=') {
+        return query.substr(pos + len + 1, end - pos - len - 1);
+      }
+      pos = end + 1;
+    }
+    return "";
+  }
+
+  bool isIndex(const std::string& key) {
+    if (key.empty() || key.size() > 9) return false;
+    for (char c : key) {
+      if (c < '0' || c > '9') return false;
+    }
+    return true;
+  }
+
+  // RTDB orderBy="$key": integer keys first, numerically, then the rest
+  bool keyBefore(const std::string& a, const std::string& b) {
+    bool ai = isIndex(a), bi = isIndex(b);
+    if (ai != bi) return ai;
+    if (ai) return atol(a.c_str()) < atol(b.c_str());
+    return a < b;
+  }
+
+  typedef std::vector<std::pair<std::string, const std::string*>> Entries;  // relative path, value
+
+  // Nested JSON of entries below one node. An entry with an empty path is
+  // the node's own value.
+  std::string render(const Entries& entries, size_t limit, bool shallow) {
+    if (entries.size() == 1 && entries[0].first.empty()) return *entries[0].second;
+
+    std::map<std::string, Entries> groups;
+    for (const auto& e : entries) {
+      size_t slash = e.first.find('/');
+      std::string head = e.first.substr(0, slash);
+      std::string rest = slash == std::string::npos ? "" : e.first.substr(slash + 1);
+      groups[head].emplace_back(rest, e.second);
+    }
+    std::vector<const std::string*> keys;
+    for (const auto& g : groups) keys.push_back(&g.first);
+    std::sort(keys.begin(), keys.end(),
+              [](const std::string* a, const std::string* b) { return keyBefore(*a, *b); });
+    if (keys.size() > limit) keys.resize(limit);
+
+    std::string out = "{";
+    for (size_t i = 0; i < keys.size(); i++) {
+      const Entries& child = groups[*keys[i]];
+      bool leaf = child.size() == 1 && child[0].first.empty() && (*child[0].second)[0] != '{';
+      if (i) out += ",";
+      out += "\"" + *keys[i] + "\":" + (shallow && !leaf ? "true" : render(child, SIZE_MAX, false));
+    }
+    return out + "}";
+  }
+}
+
+FleetBackend::FleetBackend(const FleetBackendConfig& config)
+    : config(config), dbBytes(0), workerFree(config.workers ? config.workers : 1, 0),
+      latenciesSorted(true), caller(0), pushCounter(0), sums{} {}
+
+const char* FleetBackend::kindName(Kind kind) {
+  static const char* const NAMES[KIND_COUNT] = {"sign-in", "PUT", "GET", "DELETE", "POST", "PATCH"};
+  return NAMES[kind];
+}
+
+uint64_t FleetBackend::requests() const {
+  uint64_t n = 0;
+  for (size_t k = 0; k < KIND_COUNT; k++) n += sums.requests[k];
+  return n;
+}
+
+int FleetBackend::handle(const char* method, const String& url, const String& body,
+                         String& response) {
+  // Drop scheme and host, split off the query
+  const std::string& u = url.std();
+  size_t scheme = u.find("://");
+  size_t pathStart = u.find('/', scheme == std::string::npos ? 0 : scheme + 3);
+  std::string target = pathStart == std::string::npos ? "/" : u.substr(pathStart);
+  size_t q = target.find('?');
+  std::string path = target.substr(0, q);
+  std::string query = q == std::string::npos ? "" : target.substr(q + 1);
+
+  Kind kind;
+  if (strcmp(method, "PUT") == 0) kind = KIND_PUT;
+  else if (strcmp(method, "GET") == 0) kind = KIND_GET;
+  else if (strcmp(method, "DELETE") == 0) kind = KIND_DELETE;
+  else if (strcmp(method, "PATCH") == 0) kind = KIND_PATCH;
+  else if (path.find("signInWithPassword") != std::string::npos) kind = KIND_SIGN_IN;
+  else kind = KIND_POST;
+
+  uint64_t now = hal::nowMicros();
+  int code;
+  if (now >= config.outageStart && now < config.outageEnd) {
+    response = "{\"error\":\"Service Unavailable\"}";
+    code = 503;
+  } else {
+    code = route(path, query, body, response, kind);
+  }
+
+  sums.requests[kind]++;
+  if (code < 200 || code >= 300) sums.errors++;
+  size_t in = strlen(method) + 1 + target.size() + body.length() + FLEET_REQUEST_HEADER_BYTES;
+  size_t out = response.length() + FLEET_RESPONSE_HEADER_BYTES;
+  sums.bytesIn += in;
+  sums.bytesOut += out;
+  observe(in + out);
+  return code;
+}
+
+int FleetBackend::route(const std::string& path, const std::string& query, const String& body, String& response,
+                        Kind kind) {
+  if (kind == KIND_SIGN_IN) {
+    std::string token = "fleet-token-" + std::to_string(tokens.size() + 1);
+    tokens[token] = hal::nowMicros() + (uint64_t)config.tokenTtlS * 1000000ULL;
+    // Firebase sends expiresIn as a string
+    response = String(("{\"idToken\":\"" + token + "\",\"refreshToken\":\"r\",\"expiresIn\":\"" +
+                       std::to_string(config.tokenTtlS) + "\"}").c_str());
+    return 200;
+  }
+
+  if (!authorized(query)) {
+    response = "{\"error\":\"Permission denied\"}";
+    return 401;
+  }
+  const std::string suffix = ".json";
+  if (path.size() < suffix.size() || path.compare(path.size() - suffix.size(), suffix.size(), suffix) != 0) {
+    response = "{\"error\":\"Invalid path\"}";
+    return 400;
+  }
+  std::string node = path.substr(0, path.size() - suffix.size());
+
+  switch (kind) {
+    case KIND_PUT:
+      put(node, body.std());
+      response = body;
+      return 200;
+
+    case KIND_POST: {
+      char key[16];
+      snprintf(key, sizeof(key), "-N%08u", (unsigned)++pushCounter);
+      put(node + "/" + key, body.std());
+      response = String((std::string("{\"name\":\"") + key + "\"}").c_str());
+      return 200;
+    }
+
+    case KIND_PATCH: {
+      DynamicJsonDocument doc(body.length() * 4 + 1024);
+      if (deserializeJson(doc, body.c_str()) || !doc.is<JsonObject>()) {
+        response = "{\"error\":\"Invalid data; couldn't parse JSON object\"}";
+        return 400;
+      }
+      for (JsonPair p : doc.as<JsonObject>()) {
+        String value;
+        serializeJson(p.value(), value);
+        if (value == "null") erase(node + "/" + p.key().c_str());
+        else put(node + "/" + p.key().c_str(), value.std());
+      }
+      response = body;
+      return 200;
+    }
+
+    case KIND_GET: {
+      std::string limit = param(query, "limitToFirst");
+      response = String(get(node, limit.empty() ? SIZE_MAX : (size_t)atol(limit.c_str()),
+                            param(query, "shallow") == "true").c_str());
+      return 200;
+    }
+
+    case KIND_DELETE:
+      erase(node);
+      response = "null";
+      return 200;
+
+    default:
+      response = "{\"error\":\"Bad request\"}";
+      return 400;
+  }
+}
+
+bool FleetBackend::authorized(const std::string& query) {
+  auto it = tokens.find(param(query, "auth"));
+  return it != tokens.end() && hal::nowMicros() < it->second;
+}
+
+void FleetBackend::erase(const std::string& path) {
+  std::string prefix = path + "/";
+  auto it = db.lower_bound(path);
+  while (it != db.end() && (it->first == path || it->first.compare(0, prefix.size(), prefix) == 0)) {
+    dbBytes -= it->first.size() + it->second.value.size();
+    it = db.erase(it);
+  }
+}
+
+void FleetBackend::put(const std::string& path, const std::string& value) {
+  auto it = db.find(path);
+  if (it != db.end() && it->second.writer != caller) sums.overwrites++;
+  erase(path);
+  db[path] = Node{value, caller};
+  dbBytes += path.size() + value.size();
+}
+
+std::string FleetBackend::get(const std::string& path, size_t limit, bool shallow) const {
+  std::string prefix = path + "/";
+  Entries found;
+  for (auto it = db.lower_bound(path); it != db.end(); ++it) {
+    if (it->first == path) {
+      found.emplace_back("", &it->second.value);
+    } else if (it->first.compare(0, prefix.size(), prefix) == 0) {
+      found.emplace_back(it->first.substr(prefix.size()), &it->second.value);
+    } else if (it->first.compare(0, path.size(), path) != 0) {
+      break;
+    }
+  }
+  if (found.empty()) return below(path);
+  return render(found, limit, shallow);
+}
+
+std::string FleetBackend::below(const std::string& path) const {
+  // A path inside a value stored further up: descend into its JSON
+  for (size_t slash = path.rfind('/'); slash != std::string::npos && slash > 0;
+       slash = path.rfind('/', slash - 1)) {
+    auto it = db.find(path.substr(0, slash));
+    if (it == db.end()) continue;
+
+    DynamicJsonDocument doc(it->second.value.size() * 4 + 1024);
+    if (deserializeJson(doc, it->second.value.c_str())) return "null";
+    JsonVariantConst v = doc.as<JsonVariantConst>();
+    size_t start = slash + 1;
+    while (start <= path.size()) {
+      size_t end = path.find('/', start);
+      if (end == std::string::npos) end = path.size();
+      v = v[path.substr(start, end - start).c_str()];
+      start = end + 1;
+    }
+    if (v.isNull()) return "null";
+    String out;
+    serializeJson(v, out);
+    return out.std();
+  }
+  return "null";
+}
+
+void FleetBackend::observe(size_t bytes) {
+  uint64_t now = hal::nowMicros();
+  auto worker = std::min_element(workerFree.begin(), workerFree.end());
+  uint64_t start = *worker > now ? *worker : now;
+  uint64_t service = config.serviceUs + (uint64_t)config.usPerKb * bytes / 1024;
+  *worker = start + service;
+  uint64_t latency = (start - now) + service + (uint64_t)config.rttMs * 1000;
+  latencies.push_back(latency > UINT32_MAX ? UINT32_MAX : (uint32_t)latency);
+  latenciesSorted = false;
+}
+
+double FleetBackend::latencyPercentile(double p) {
+  if (latencies.empty()) return 0;
+  if (!latenciesSorted) {
+    std::sort(latencies.begin(), latencies.end());
+    latenciesSorted = true;
+  }
+  size_t i = (size_t)(p / 100.0 * latencies.size());
+  if (i >= latencies.size()) i = latencies.size() - 1;
+  return latencies[i] / 1000.0;
+}
+
+double FleetBackend::latencyMax() {
+  return latencyPercentile(100);
+}
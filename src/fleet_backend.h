@@ -0,0 +1,108 @@
+#ifndef FLEET_BACKEND_H
+#define FLEET_BACKEND_H
+
+#include <Arduino.h>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// In-process stand-in for Firebase Auth and the Realtime Database REST
+// API, used by the fleet simulator (fleet_sim.cpp). It is plugged into the
+// NativeHAL HTTP client, so the firmware's own request code runs unchanged.
+//
+// The database is a flat path -> JSON map; a GET of a node above the
+// stored paths puts the subtree back together. PATCH takes a multi-path
+// update ({"a/b": ..., "c": ...} relative to the URL node). Latency is modelled in virtual
+// time as a pool of server workers: every request costs a fixed service
+// time plus a cost per KB, waits for a free worker, and gets a network
+// round trip added on top. Devices don't wait for it (their requests
+// return at once), it is only reported.
+
+// Header bytes per request / response, on top of URL and body. Roughly
+// what the ESP HTTP client and Firebase send; TLS records not counted.
+#ifndef FLEET_REQUEST_HEADER_BYTES
+#define FLEET_REQUEST_HEADER_BYTES 200
+#endif
+#ifndef FLEET_RESPONSE_HEADER_BYTES
+#define FLEET_RESPONSE_HEADER_BYTES 250
+#endif
+
+struct FleetBackendConfig {
+  uint32_t workers = 4;
+  uint32_t serviceUs = 2000;   // per request
+  uint32_t usPerKb = 200;      // per KB received plus sent
+  uint32_t rttMs = 40;
+  uint32_t tokenTtlS = 3600;   // expiresIn handed out by sign-in
+  uint64_t outageStart = 0;    // every request gets a 503 in [start, end), micros
+  uint64_t outageEnd = 0;
+};
+
+class FleetBackend {
+public:
+  enum Kind : uint8_t {
+    KIND_SIGN_IN,
+    KIND_PUT,
+    KIND_GET,
+    KIND_DELETE,
+    KIND_POST,
+    KIND_PATCH,
+    KIND_COUNT
+  };
+
+  struct Totals {
+    uint64_t requests[KIND_COUNT];
+    uint64_t errors;       // non-2xx answers
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    uint64_t overwrites;   // PUTs that replaced another device's record
+  };
+
+  explicit FleetBackend(const FleetBackendConfig& config);
+
+  // hal::HttpHandler
+  int handle(const char* method, const String& url, const String& body, String& response);
+
+  // Device making the next requests; only used to count overwrites
+  void setCaller(uint32_t device) { caller = device; }
+
+  static const char* kindName(Kind kind);
+  const Totals& totals() const { return sums; }
+  uint64_t requests() const;
+  size_t nodes() const { return db.size(); }
+  uint64_t storedBytes() const { return dbBytes; }
+
+  // What a GET of path would return, without counting it: limit applies
+  // to the first level in $key order, shallow gives true for subtrees
+  std::string get(const std::string& path, size_t limit = SIZE_MAX, bool shallow = false) const;
+
+  // Over all requests so far, in ms
+  double latencyPercentile(double p);
+  double latencyMax();
+
+private:
+  struct Node {
+    std::string value;
+    uint32_t writer;
+  };
+
+  int route(const std::string& path, const std::string& query, const String& body, String& response, Kind kind);
+  bool authorized(const std::string& query);
+  void erase(const std::string& path);
+  void put(const std::string& path, const std::string& value);
+  std::string below(const std::string& path) const;
+  void observe(size_t bytes);
+
+  FleetBackendConfig config;
+  std::map<std::string, Node> db;
+  uint64_t dbBytes;
+  std::map<std::string, uint64_t> tokens;  // token -> expiry, micros
+  std::vector<uint64_t> workerFree;        // micros each worker is busy until
+  std::vector<uint32_t> latencies;         // micros, one per request
+  bool latenciesSorted;
+  uint32_t caller;
+  uint32_t pushCounter;
+  Totals sums;
+};
+
+#endif
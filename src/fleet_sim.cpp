@@ -0,0 +1,313 @@
+// Fleet simulator (native only, pio run -e fleet): N virtual devices run
+// the firmware's Firebase upload and auth code (firebase_handler.cpp behind
+// a FirebaseSink, with its queue and retry policy) against the in-process
+// backend stand-in, on one virtual clock. Reports what the backend sees:
+// requests/s by kind, bytes/s, latency percentiles and how the database
+// grows, to size the backend and compare protocol changes before they ship.
+//
+// Every device has its own ID (from a made-up MAC, as DeviceIdentity does
+// from the eFuse) and group tag, so it writes only below its own node.
+// Each device boots at a random point within the first record interval,
+// signs in, and hands a record to its sink every record interval; the sink
+// flushes and retries exactly as on the board. Devices are woken from a
+// timer queue in virtual time, so a day of a large fleet takes seconds.
+//
+// Knobs (environment):
+//   FLEET_DEVICES            virtual devices (default 100)
+//   FLEET_HOURS              virtual time to run (default 24)
+//   FLEET_RECORD_INTERVAL_S  time between records (default 70: the firmware
+//                            checks "> 60 s" once per 10 s reading)
+//   FLEET_BOOT_SPREAD_S      boots are spread over this (default one interval)
+//   FLEET_REPORT_S           timeline line every this much (default 3600)
+//   FLEET_SEED               for boot times and readings (default 1)
+//   FLEET_WORKERS            backend workers (default 4)
+//   FLEET_SERVICE_US         backend cost per request (default 2000)
+//   FLEET_US_PER_KB          backend cost per KB in + out (default 200)
+//   FLEET_RTT_MS             network round trip (default 40)
+//   FLEET_TOKEN_TTL_S        ID token lifetime (default 3600)
+//   FLEET_OUTAGE             "start_s,length_s": backend answers 503 meanwhile
+//   FLEET_GROUPS             device i is tagged "site-<i % groups>" (default 10)
+//   FLEET_DUMP               file to write the final database to, as JSON
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <chrono>
+#include <functional>
+#include <queue>
+#include <random>
+#include <vector>
+#include "hal.h"
+#include "boot.h"
+#include "fleet_backend.h"
+#include "firebase_handler.h"
+#include "firebase_sink.h"
+#include "firebase_layout.h"
+#include "time_service.h"
+#include "device_identity.h"
+
+// Defined by main.cpp in the firmware; boot.cpp comes in with metrics.cpp
+bool wifiConnected = true;
+
+namespace {
+  struct Device {
+    char id[DeviceIdentity::ID_LEN];
+    char tags[DeviceIdentity::TAG_LEN];
+    FirebaseSession session;
+    FirebaseSink sink;
+    uint64_t nextRecord = 0;  // micros
+    uint64_t nextAuth = 0;
+    float voltage = 12.0f;
+  };
+
+  struct Settings {
+    uint32_t devices;
+    double hours;
+    uint64_t recordInterval;  // micros
+    uint64_t bootSpread;
+    uint64_t reportInterval;
+    uint32_t seed;
+    uint32_t groups;
+  };
+
+  typedef std::pair<uint64_t, uint32_t> Wake;  // micros, device
+
+  const uint64_t US = 1000000ULL;
+
+  double envNumber(const char* name, double fallback) {
+    const char* v = getenv(name);
+    return (v && *v) ? atof(v) : fallback;
+  }
+
+  // 02:c0:ff:<i>, a locally administered MAC in eFuse byte order
+  uint64_t fakeMac(uint32_t i) {
+    uint64_t mac = 0x02 | 0xC0 << 8 | 0xFF << 16;
+    for (int b = 0; b < 3; b++) mac |= (uint64_t)((i >> (8 * (2 - b))) & 0xFF) << (24 + 8 * b);
+    return mac;
+  }
+
+  TelemetryRecord makeRecord(Device& d, std::mt19937& rng) {
+    std::normal_distribution<float> noise(0.0f, 0.02f);
+    d.voltage += noise(rng);
+    TelemetryRecord r = {};
+    r.voltage = d.voltage;
+    r.rawValue = (int)(d.voltage / 16.0f * 4095);
+    r.adcRange = 0;
+    r.readTime = millis();
+    r.summary.count = 7;
+    r.summary.mean = d.voltage;
+    r.summary.stddev = 0.02f;
+    r.summary.min = r.summary.p1 = d.voltage - 0.05f;
+    r.summary.max = r.summary.p99 = d.voltage + 0.05f;
+    r.summary.p50 = d.voltage;
+    return r;
+  }
+
+  // One wake-up: sign in if needed, close a record if due, let the sink
+  // send. Returns when the device wants to run next.
+  uint64_t wake(Device& d, const Settings& s, std::mt19937& rng) {
+    uint64_t now = hal::nowMicros();
+    useFirebaseSession(&d.session);
+
+    if (!d.session.initialized && now >= d.nextAuth) {
+      initFirebase();
+      if (!d.session.initialized) d.nextAuth = now + BOOT_AUTH_RETRY_MS * 1000ULL;
+    }
+    if (now >= d.nextRecord) {
+      d.sink.enqueue(makeRecord(d, rng));
+      d.nextRecord += s.recordInterval;
+    }
+    d.sink.process();
+
+    uint64_t next = d.nextRecord;
+    if (!d.session.initialized && d.nextAuth < next) next = d.nextAuth;
+    const RetryPolicy& retry = d.sink.retryPolicy();
+    if (d.sink.pending() > 0 && retry.consecutiveFailures() > 0) {
+      uint64_t due = now + (retry.retryInMs() ? retry.retryInMs() : 1) * 1000ULL;
+      if (due < next) next = due;
+    }
+    return next;
+  }
+
+  void printTimeline(FleetBackend& backend, uint64_t now, const FleetBackend::Totals& last,
+                     uint64_t lastRequests, double seconds) {
+    const FleetBackend::Totals& t = backend.totals();
+    printf("%7.2f h  %8.2f req/s  %9.0f B/s in  %9.0f B/s out  %6llu errors  %5u nodes  %8.1f KB stored\n",
+           now / 3600e6, (backend.requests() - lastRequests) / seconds,
+           (t.bytesIn - last.bytesIn) / seconds, (t.bytesOut - last.bytesOut) / seconds,
+           (unsigned long long)(t.errors - last.errors), (unsigned)backend.nodes(),
+           backend.storedBytes() / 1024.0);
+  }
+
+  // Response size of the reads a consumer of the layout would make, for
+  // the last full hour of the run
+  void printQueryCost(const FleetBackend& backend, const Device& device) {
+    time_t hour = TimeService::now() - 3600;
+    char day[FirebaseLayout::DAY_LEN], hh[FirebaseLayout::HOUR_LEN];
+    FirebaseLayout::dayKey(hour, day);
+    FirebaseLayout::hourKey(hour, hh);
+    std::string node = FirebaseLayout::devicePath(device.id).c_str();
+    std::string root = FIREBASE_DATA_ROOT;
+
+    struct Query {
+      const char* what;
+      std::string path;
+      bool shallow;
+    };
+    const Query queries[] = {
+      {"roll-ups of a day", node + "/hourly/" + day, false},
+      {"raw records of an hour", node + "/raw/" + day + "/" + hh, false},
+      {"days kept (shallow)", node + "/raw", true},
+      {"whole device node", node, false},
+      {"members of a group", root + "/groups/" + device.tags, false},
+      {"device list (shallow)", root + "/devices", true},
+      {"legacy " FIREBASE_PATH, FIREBASE_PATH, false},
+    };
+    printf("Query cost (device %s, %s %s:00 UTC)\n", device.id, day, hh);
+    for (const Query& q : queries) {
+      std::string body = backend.get(q.path, SIZE_MAX, q.shallow);
+      printf("  %-24s %10.1f KB  GET %s.json%s\n", q.what, body.size() / 1024.0, q.path.c_str(),
+             q.shallow ? "?shallow=true" : "");
+    }
+  }
+
+  void run() {
+    Settings s;
+    s.devices = (uint32_t)envNumber("FLEET_DEVICES", 100);
+    s.hours = envNumber("FLEET_HOURS", 24);
+    s.recordInterval = (uint64_t)(envNumber("FLEET_RECORD_INTERVAL_S", 70) * US);
+    s.bootSpread = (uint64_t)(envNumber("FLEET_BOOT_SPREAD_S", s.recordInterval / (double)US) * US);
+    s.reportInterval = (uint64_t)(envNumber("FLEET_REPORT_S", 3600) * US);
+    s.seed = (uint32_t)envNumber("FLEET_SEED", 1);
+    s.groups = (uint32_t)envNumber("FLEET_GROUPS", 10);
+    if (s.devices == 0 || s.recordInterval == 0) return;
+
+    FleetBackendConfig bc;
+    bc.workers = (uint32_t)envNumber("FLEET_WORKERS", bc.workers);
+    bc.serviceUs = (uint32_t)envNumber("FLEET_SERVICE_US", bc.serviceUs);
+    bc.usPerKb = (uint32_t)envNumber("FLEET_US_PER_KB", bc.usPerKb);
+    bc.rttMs = (uint32_t)envNumber("FLEET_RTT_MS", bc.rttMs);
+    bc.tokenTtlS = (uint32_t)envNumber("FLEET_TOKEN_TTL_S", bc.tokenTtlS);
+
+    // Virtual clock only moves when told to; WiFi is up at once
+    hal::setTimeScale(0);
+    hal::setWiFiConnectDelay(0);
+    uint64_t t0 = hal::nowMicros();
+
+    if (const char* v = getenv("FLEET_OUTAGE")) {
+      double start = 0, length = 0;
+      if (sscanf(v, "%lf,%lf", &start, &length) == 2) {
+        bc.outageStart = t0 + (uint64_t)(start * US);
+        bc.outageEnd = bc.outageStart + (uint64_t)(length * US);
+      }
+    }
+
+    FleetBackend backend(bc);
+    hal::setHttpHandler([&backend](const char* method, const String& url, const String& body,
+                                   String& response) {
+      return backend.handle(method, url, body, response);
+    });
+
+    WiFi.mode(WIFI_STA);
+    WiFi.begin("fleet", "fleet");
+    TimeService::begin();
+
+    std::mt19937 rng(s.seed);
+    std::vector<Device> devices(s.devices);
+    std::priority_queue<Wake, std::vector<Wake>, std::greater<Wake>> timers;
+    std::uniform_real_distribution<double> bootAt(0.0, 1.0);
+    for (uint32_t i = 0; i < s.devices; i++) {
+      Device& d = devices[i];
+      DeviceIdentity::formatId(fakeMac(i), d.id);
+      snprintf(d.tags, sizeof(d.tags), "site-%u", (unsigned)(s.groups ? i % s.groups : 0));
+      d.session.deviceId = d.id;
+      d.session.tags = d.tags;
+      d.session.bootId = rng() | 1;
+      uint64_t boot = t0 + (uint64_t)(bootAt(rng) * s.bootSpread);
+      devices[i].nextRecord = boot;
+      devices[i].nextAuth = boot;
+      timers.push(Wake(boot, i));
+    }
+
+    printf("Fleet: %u devices, %.1f h, record every %.0f s, backend %u workers\n\n",
+           (unsigned)s.devices, s.hours, s.recordInterval / 1e6, (unsigned)bc.workers);
+
+    uint64_t end = t0 + (uint64_t)(s.hours * 3600.0 * US);
+    uint64_t nextReport = t0 + s.reportInterval;
+    FleetBackend::Totals last = backend.totals();
+    uint64_t lastRequests = 0;
+    uint64_t wakes = 0;
+    auto wallStart = std::chrono::steady_clock::now();
+
+    while (!timers.empty() && timers.top().first < end) {
+      Wake w = timers.top();
+      timers.pop();
+
+      while (nextReport <= w.first) {
+        hal::sleepMicros(nextReport - hal::nowMicros());
+        printTimeline(backend, nextReport - t0, last, lastRequests, s.reportInterval / 1e6);
+        last = backend.totals();
+        lastRequests = backend.requests();
+        nextReport += s.reportInterval;
+      }
+
+      uint64_t now = hal::nowMicros();
+      if (w.first > now) hal::sleepMicros(w.first - now);
+      TimeService::loop();
+
+      backend.setCaller(w.second);
+      timers.push(Wake(wake(devices[w.second], s, rng), w.second));
+      wakes++;
+    }
+    useFirebaseSession(nullptr);
+
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    double seconds = s.hours * 3600.0;
+    const FleetBackend::Totals& t = backend.totals();
+
+    uint64_t published = 0, dropped = 0, rejected = 0, failed = 0, opens = 0;
+    for (const Device& d : devices) {
+      published += d.sink.stats().published;
+      dropped += d.sink.stats().dropped;
+      rejected += d.sink.stats().rejected;
+      failed += d.sink.stats().failedBatches;
+      opens += d.sink.retryPolicy().breakerOpens();
+    }
+
+    printf("\nBackend requests      total      per s   per device-hour\n");
+    for (size_t k = 0; k < FleetBackend::KIND_COUNT; k++) {
+      FleetBackend::Kind kind = (FleetBackend::Kind)k;
+      printf("  %-10s %13llu %10.2f %12.1f\n", FleetBackend::kindName(kind),
+             (unsigned long long)t.requests[k], t.requests[k] / seconds,
+             t.requests[k] / (s.devices * s.hours));
+    }
+    printf("  %-10s %13llu %10.2f %12.1f\n", "all", (unsigned long long)backend.requests(),
+           backend.requests() / seconds, backend.requests() / (s.devices * s.hours));
+    printf("  errors     %13llu\n", (unsigned long long)t.errors);
+    printf("Traffic          %10.0f B/s in  %10.0f B/s out  (%.1f MB/day total)\n",
+           t.bytesIn / seconds, t.bytesOut / seconds, (t.bytesIn + t.bytesOut) / seconds * 86400 / 1e6);
+    printf("Latency          p50 %.1f ms  p99 %.1f ms  max %.1f ms\n",
+           backend.latencyPercentile(50), backend.latencyPercentile(99), backend.latencyMax());
+    printf("Database         %u nodes, %.1f KB, %llu records overwritten by another device\n",
+           (unsigned)backend.nodes(), backend.storedBytes() / 1024.0, (unsigned long long)t.overwrites);
+    printf("Devices          %llu records delivered, %llu dropped, %llu rejected, %llu failed batches, %llu breaker opens\n",
+           (unsigned long long)published, (unsigned long long)dropped, (unsigned long long)rejected,
+           (unsigned long long)failed, (unsigned long long)opens);
+    printQueryCost(backend, devices[0]);
+    printf("Simulated in %.2f s wall (%llu wake-ups)\n", wall, (unsigned long long)wakes);
+
+    if (const char* path = getenv("FLEET_DUMP")) {
+      if (FILE* f = fopen(path, "w")) {
+        fputs(backend.get("").c_str(), f);
+        fclose(f);
+      }
+    }
+  }
+}
+
+void setup() {
+  run();
+  fflush(stdout);
+  exit(0);
+}
+
+void loop() {}
@@ -0,0 +1,20 @@
+#ifndef HTTP_SINK_H
+#define HTTP_SINK_H
+
+#include "telemetry_sink.h"
+
+// Generic HTTP POST sink, sends a JSON array of records to a plain URL
+class HttpPostSink : public TelemetrySink {
+public:
+  explicit HttpPostSink(const char* url) : TelemetrySink("http"), url(url) {}
+
+protected:
+  size_t sendBatch(const TelemetryRecord* records, size_t count) override;
+  size_t maxBatchSize() const override { return HTTP_SINK_BATCH_SIZE; }
+  bool isReady() override;
+
+private:
+  const char* url;
+};
+
+#endif
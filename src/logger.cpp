@@ -2,112 +2,247 @@
 #include <EEPROM.h>
 #include <time.h>
 #include <ArduinoJson.h>
+#include "serial_log.h"
+#include "time_service.h"
+#include "config.h"
 
-// Struktura za pohranu broja logova i flaga
+// Razlikuje unose ovog boota od starijih (njihov millis() nema veze s ovim)
+static const uint32_t bootId = esp_random();
+
+// Struktura za pohranu broja logova i flaga. Magic razlikuje ovaj format
+// od starog (tekstualni unosi od 320 B), koji se pri init() odbacuje.
 struct LoggerHeader {
-  int entryCount;
-  bool hasUnsent;
+  uint16_t magic;
+  uint8_t entryCount;
+  uint8_t hasUnsent;
+  uint32_t dropped;  // događaji odbačeni jer je memorija bila puna
 };
 
 // Memorijska mapa:
-// EEPROM 128-131: LoggerHeader (4 bytes)
-// EEPROM 132-3327: Log unosi (10 * 320 bytes)
+// EEPROM 128-135: LoggerHeader (8 bytes)
+// EEPROM 136-2183: Log unosi (64 * 32 bytes)
+// EEPROM se pokreće jednom, s EEPROM_SIZE (config.h); manja veličina bi
+// na uređaju odrezala unose iznad nje
 
 const int HEADER_ADDR = 128;
-const int LOGS_START_ADDR = 132;
-const int ENTRY_SIZE = 320;  // sizeof(unsigned long) + 256 char
-const int MAX_ENTRIES = 10;
+const int LOGS_START_ADDR = 136;
+const int ENTRY_SIZE = sizeof(LogEntry);
+const uint16_t LOG_MAGIC = 0x4C32;  // "L2"
 
-void Logger::init() {
-  EEPROM.begin(4096);
-  
-  // Provjeri je li header inicijaliziran
-  LoggerHeader header;
+static_assert(sizeof(LogEntry) == 32, "LogEntry je fiksni zapis od 32 B");
+static_assert(LOGS_START_ADDR + Logger::MAX_ENTRIES * sizeof(LogEntry) <= EEPROM_SIZE, "logovi ne stanu u EEPROM");
+
+static const char* const EVENT_NAMES[EVENT_COUNT] = {
+  "message", "wifi_disconnect", "wifi_reconnect", "upload_failed",
+  "upload_rejected", "auth_failed", "ota_failed", "ota_rollback",
+  "register_failed"
+};
+
+static bool pendingCommit = false;
+static unsigned long lastCommit = 0;
+
+static void readHeader(LoggerHeader& header) {
   EEPROM.get(HEADER_ADDR, header);
-  
-  // Ako je prvi put, inicijalizira
-  if (header.entryCount < 0 || header.entryCount > MAX_ENTRIES) {
+  if (header.magic != LOG_MAGIC || header.entryCount > Logger::MAX_ENTRIES) {
+    header.magic = LOG_MAGIC;
     header.entryCount = 0;
     header.hasUnsent = false;
+    header.dropped = 0;
+  }
+}
+
+static int entryAddr(int i) {
+  return LOGS_START_ADDR + i * ENTRY_SIZE;
+}
+
+static void commitNow() {
+  EEPROM.commit();
+  pendingCommit = false;
+  lastCommit = millis();
+}
+
+const char* Logger::eventName(uint8_t code) {
+  return code < EVENT_COUNT ? EVENT_NAMES[code] : "unknown";
+}
+
+void Logger::init() {
+  // Provjeri je li header inicijaliziran
+  LoggerHeader header{};
+  EEPROM.get(HEADER_ADDR, header);
+
+  // Ako je prvi put (ili stari format), inicijalizira
+  if (header.magic != LOG_MAGIC || header.entryCount > MAX_ENTRIES) {
+    readHeader(header);
     EEPROM.put(HEADER_ADDR, header);
     EEPROM.commit();
-    Serial.println("[Logger] Inicijalizacija logera");
+    LOG_INFO("[Logger] Inicijalizacija logera");
   } else if (header.entryCount > 0) {
-    Serial.print("[Logger] Pronađeno ");
-    Serial.print(header.entryCount);
-    Serial.println(" nedoslanih logova");
+    LOG_INFO("[Logger] Pronađeno %d nedoslanih logova", header.entryCount);
   }
 }
 
-void Logger::logWiFiDisconnect() {
-  logError("WiFi disconnect");
+void Logger::loop() {
+  if (pendingCommit && millis() - lastCommit >= LOG_COMMIT_INTERVAL_MS) {
+    commitNow();
+  }
 }
 
-void Logger::logError(const char* message) {
-  LoggerHeader header;
-  EEPROM.get(HEADER_ADDR, header);
+void Logger::event(LogEvent code, LogSeverity severity, int32_t value, uint32_t durationMs) {
+  LoggerHeader header{};
+  readHeader(header);
 
-  // Ne dodaj ako je pun
-  if (header.entryCount >= MAX_ENTRIES) {
-    Serial.println("[Logger] Log memorija puna!");
+  uint32_t now = (uint32_t)TimeService::now();
+  uint32_t uptime = millis();
+
+  // Ponavljanje: spoji s postojećim unosom istog koda iz ovog boota
+  for (int i = header.entryCount - 1; i >= 0; i--) {
+    LogEntry entry{};
+    EEPROM.get(entryAddr(i), entry);
+    if (entry.code != code || entry.severity != severity || entry.bootId != bootId) continue;
+
+    if (entry.count < 0xFFFF) entry.count++;
+    entry.lastUtc = now;
+    entry.lastUptimeMs = uptime;
+    entry.value = value;
+    entry.durationMs += durationMs;
+    EEPROM.put(entryAddr(i), entry);
+    pendingCommit = true;
+    LOG_DEBUG("[Logger] %s x%u", eventName(code), entry.count);
     return;
   }
 
-  // Kreiraj novi unos
-  LogEntry entry;
-  entry.timestamp = time(nullptr);
-  if (entry.timestamp < 100000) {
-    entry.timestamp = millis() / 1000;  // Fallback na millis ako vrijeme nije sinkronizirano
+  int slot = header.entryCount;
+  if (slot >= MAX_ENTRIES) {
+    // Puna memorija: istisni najstariji unos najniže razine, ako nije
+    // važniji od novog
+    int victim = -1;
+    uint8_t lowest = 0xFF;
+    for (int i = 0; i < header.entryCount; i++) {
+      LogEntry entry{};
+      EEPROM.get(entryAddr(i), entry);
+      if (entry.severity < lowest) {
+        lowest = entry.severity;
+        victim = i;
+      }
+    }
+    header.dropped++;
+    if (victim < 0 || lowest > severity) {
+      EEPROM.put(HEADER_ADDR, header);
+      pendingCommit = true;
+      LOG_WARN("[Logger] Log memorija puna, %s odbačen", eventName(code));
+      return;
+    }
+    // Pomakni ostale da redoslijed ostane kronološki
+    for (int i = victim; i < header.entryCount - 1; i++) {
+      LogEntry entry{};
+      EEPROM.get(entryAddr(i + 1), entry);
+      EEPROM.put(entryAddr(i), entry);
+    }
+    slot = header.entryCount - 1;
+  } else {
+    header.entryCount++;
   }
-  
-  strncpy(entry.message, message, 255);
-  entry.message[255] = '\0';
-
-  // Spremi u EEPROM
-  int addr = LOGS_START_ADDR + (header.entryCount * ENTRY_SIZE);
-  EEPROM.put(addr, entry);
-  
+
+  // Kreiraj novi unos; samo UTC ili 0, bez miješanja s millis()
+  LogEntry entry{};
+  entry.code = code;
+  entry.severity = severity;
+  entry.count = 1;
+  entry.bootId = bootId;
+  entry.firstUtc = entry.lastUtc = now;
+  entry.firstUptimeMs = entry.lastUptimeMs = uptime;
+  entry.value = value;
+  entry.durationMs = durationMs;
+  EEPROM.put(entryAddr(slot), entry);
+
   // Ažurira header
-  header.entryCount++;
   header.hasUnsent = true;
   EEPROM.put(HEADER_ADDR, header);
-  EEPROM.commit();
+  commitNow();
+
+  LOG_WARN("[Logger] Logiran događaj: %s (%ld)", eventName(code), (long)value);
+}
+
+void Logger::logError(const char* message) {
+  (void)message;  // unused when LOG_WARN is compiled out
+  LOG_WARN("[Logger] %s", message);
+  event(EVENT_MESSAGE, SEVERITY_ERROR);
+}
+
+void Logger::resolveTimestamps() {
+  LoggerHeader header{};
+  readHeader(header);
+
+  int resolved = 0;
+  for (int i = 0; i < header.entryCount; i++) {
+    LogEntry entry{};
+    EEPROM.get(entryAddr(i), entry);
+    if (entry.bootId != bootId || (entry.firstUtc != 0 && entry.lastUtc != 0)) continue;
+
+    if (entry.firstUtc == 0) entry.firstUtc = (uint32_t)TimeService::utcFromMillis(entry.firstUptimeMs);
+    if (entry.lastUtc == 0) entry.lastUtc = (uint32_t)TimeService::utcFromMillis(entry.lastUptimeMs);
+    EEPROM.put(entryAddr(i), entry);
+    resolved++;
+  }
 
-  Serial.print("[Logger] Logirana greška: ");
-  Serial.println(message);
+  if (resolved > 0) {
+    commitNow();
+    LOG_INFO("[Logger] UTC vrijeme upisano u %d unosa", resolved);
+  }
 }
 
 void Logger::clearLogs() {
-  LoggerHeader header;
+  LoggerHeader header{};
+  readHeader(header);
   header.entryCount = 0;
   header.hasUnsent = false;
-  
+  header.dropped = 0;
+
   EEPROM.put(HEADER_ADDR, header);
-  EEPROM.commit();
-  
-  Serial.println("[Logger] Svi logovi obrisani");
+  commitNow();
+
+  LOG_INFO("[Logger] Svi logovi obrisani");
 }
 
 String Logger::getLogsAsJSON() {
-  LoggerHeader header;
-  EEPROM.get(HEADER_ADDR, header);
+  LoggerHeader header{};
+  readHeader(header);
+
+  // ~60 B po redu u JSON-u, plus legenda
+  DynamicJsonDocument doc(1024 + header.entryCount * 160);
+  doc["v"] = 2;
+  JsonArray fields = doc.createNestedArray("fields");
+  static const char* const FIELDS[] = {
+    "code", "severity", "count", "first", "last", "lastUptimeMs", "value", "durationMs"
+  };
+  for (const char* f : FIELDS) fields.add(f);
 
-  DynamicJsonDocument doc(4096);
-  JsonArray logsArray = doc.createNestedArray("logs");
+  JsonObject names = doc.createNestedObject("codes");
+  JsonArray events = doc.createNestedArray("events");
 
-  // Pročitaj sve logove
+  // Pročitaj sve logove; UTC 0 = nepoznato (prije NTP-a, stariji boot)
   for (int i = 0; i < header.entryCount; i++) {
-    int addr = LOGS_START_ADDR + (i * ENTRY_SIZE);
-    LogEntry entry;
-    EEPROM.get(addr, entry);
+    LogEntry entry{};
+    EEPROM.get(entryAddr(i), entry);
 
-    JsonObject logObj = logsArray.createNestedObject();
-    logObj["timestamp"] = entry.timestamp;
-    logObj["message"] = entry.message;
+    JsonArray row = events.createNestedArray();
+    row.add(entry.code);
+    row.add(entry.severity);
+    row.add(entry.count);
+    row.add(entry.firstUtc);
+    row.add(entry.lastUtc);
+    row.add(entry.lastUptimeMs);
+    row.add(entry.value);
+    row.add(entry.durationMs);
+
+    // Legenda samo za kodove koji se pojavljuju
+    char code[4];
+    snprintf(code, sizeof(code), "%u", entry.code);
+    names[code] = eventName(entry.code);
   }
 
-  doc["count"] = header.entryCount;
-  doc["timestamp"] = time(nullptr);
+  doc["dropped"] = header.dropped;
+  doc["timestamp"] = TimeService::now();
 
   String jsonStr;
   serializeJson(doc, jsonStr);
@@ -115,13 +250,13 @@ String Logger::getLogsAsJSON() {
 }
 
 bool Logger::hasPendingLogs() {
-  LoggerHeader header;
-  EEPROM.get(HEADER_ADDR, header);
+  LoggerHeader header{};
+  readHeader(header);
   return header.hasUnsent && header.entryCount > 0;
 }
 
 int Logger::getLogCount() {
-  LoggerHeader header;
-  EEPROM.get(HEADER_ADDR, header);
+  LoggerHeader header{};
+  readHeader(header);
   return header.entryCount;
 }
@@ -3,39 +3,91 @@
 
 #include <Arduino.h>
 
-#define MAX_LOG_SIZE 4096  // Max 4KB za logove
+// Dnevnik događaja u EEPROM-u, šalje se na Firebase pri sljedećoj prijavi.
+//
+// Svaki unos je strukturirani događaj od 32 B: kod, razina, brojač i dva
+// tipizirana polja (value, durationMs) čije značenje ovisi o kodu. Ponovljeni
+// događaj (isti kod i razina, isti boot) ne zauzima novi unos nego se
+// spoji s postojećim: poveća se count, pomakne last-seen, value postaje
+// zadnja vrijednost, a durationMs se zbraja. Tako WiFi koji "flapa" cijelu
+// noć zauzme jedan unos umjesto cijele memorije.
+//
+// Novi unos se odmah commita u flash; spajanje u postojeći samo označi
+// promjenu, a loop() je commita najviše jednom u LOG_COMMIT_INTERVAL_MS
+// (svaki commit briše i piše cijeli sektor). Nestanak napajanja tako može
+// izgubiti samo brojač ponavljanja, nikad prvo pojavljivanje događaja.
+
+#ifndef LOG_COMMIT_INTERVAL_MS
+#define LOG_COMMIT_INTERVAL_MS (15 * 60000UL)
+#endif
+
+enum LogEvent : uint8_t {
+  EVENT_MESSAGE = 0,          // logError(); value/duration neiskorišteni
+  EVENT_WIFI_DISCONNECT = 1,  // value: zadnji RSSI prije prekida (dBm)
+  EVENT_WIFI_RECONNECT = 2,   // value: RSSI nakon spajanja, duration: trajanje prekida
+  EVENT_UPLOAD_FAILED = 3,    // value: HTTP kod (<0 = greška veze), duration: breaker otvoren
+  EVENT_UPLOAD_REJECTED = 4,  // value: HTTP kod, zapis odbačen
+  EVENT_AUTH_FAILED = 5,      // value: HTTP kod prijave
+  EVENT_OTA_FAILED = 6,       // value: primljeni bajtovi
+  EVENT_OTA_ROLLBACK = 7,     // health check nije prošao
+  EVENT_REGISTER_FAILED = 8,  // value: HTTP kod registracije uređaja
+  EVENT_COUNT
+};
+
+enum LogSeverity : uint8_t {
+  SEVERITY_INFO = 0,
+  SEVERITY_WARN = 1,
+  SEVERITY_ERROR = 2
+};
 
 struct LogEntry {
-  unsigned long timestamp;  // Unix timestamp ili millis
-  char message[256];        // Log poruka
+  uint8_t code;           // LogEvent
+  uint8_t severity;       // LogSeverity
+  uint16_t count;         // koliko puta se dogodio (zasićuje na 65535)
+  uint32_t bootId;        // boot u kojem je unos nastao
+  uint32_t firstUtc;      // UTC prvog / zadnjeg pojavljivanja, 0 = još nepoznato
+  uint32_t lastUtc;
+  uint32_t firstUptimeMs; // millis() prvog / zadnjeg pojavljivanja
+  uint32_t lastUptimeMs;
+  int32_t value;          // zadnja vrijednost, značenje po kodu
+  uint32_t durationMs;    // zbroj trajanja
 };
 
 class Logger {
-private:
-  static const int EEPROM_LOG_START = 128;  // Početek logova u EEPROM (nakon WiFi config)
-  static const int MAX_ENTRIES = 10;        // Max 10 log unosa
-
 public:
-  // Inicijalizacija logger-a
+  static const int MAX_ENTRIES = 64;
+
+  // Inicijalizacija logger-a; EEPROM mora već biti pokrenut (initEEPROM())
   static void init();
 
-  // Logira grešku WiFi prekida
-  static void logWiFiDisconnect();
+  // Commit spojenih ponavljanja, najviše jednom u LOG_COMMIT_INTERVAL_MS
+  static void loop();
+
+  // Zabilježi događaj. Kad je memorija puna, novi događaj istisne
+  // najstariji unos iste ili niže razine; inače se samo broji kao odbačen.
+  static void event(LogEvent code, LogSeverity severity, int32_t value = 0, uint32_t durationMs = 0);
 
-  // Logira custom poruku
+  // Logira custom poruku (tekst ide samo na serijski izlaz)
   static void logError(const char* message);
 
+  // Nakon prve NTP sinkronizacije: upiše UTC vrijeme unosima iz ovog
+  // boota koji su nastali prije nje
+  static void resolveTimestamps();
+
   // Očisti sve logove
   static void clearLogs();
 
-  // Dohvati sve logove kao JSON string
+  // Svi unosi kao kompaktan JSON: imena stupaca jednom, zatim jedan niz
+  // brojeva po unosu
   static String getLogsAsJSON();
 
   // Provjeri ima li nedoslanih logova
   static bool hasPendingLogs();
 
-  // Broj logiranih grešaka
+  // Broj unosa (spojena ponavljanja su jedan unos)
   static int getLogCount();
+
+  static const char* eventName(uint8_t code);
 };
 
 #endif
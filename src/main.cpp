@@ -4,175 +4,268 @@
 #include "firebase_handler.h"
 #include "webserver.h"
 #include "logger.h"
+#include "telemetry_sink.h"
+#include "firebase_sink.h"
+#include "telemetry_config.h"
+#if TELEMETRY_MQTT_ENABLED
+#include "mqtt_sink.h"
+#endif
+#include "http_sink.h"
+#include "metrics.h"
+#include "trace.h"
+#include "serial_log.h"
+#include "stream_stats.h"
+#include "adc_filter.h"
+#include "measurement.h"
+#include "adc_range.h"
+#include "time_service.h"
+#include "ota.h"
+#include "sample_store.h"
+#include "boot.h"
+#include "device_identity.h"
+#include "settings.h"
 
 // Pin connected to the signal pin (S/OUT) of the module
 // ESP32-C3: GPIO5 is on ADC2 (not supported). Use GPIO4 (ADC1, channel 4)
 const int voltageSensorPin = 4;
 
-// Scaling factor for 5:1 module
-// (5V input gives 1V output on S pin, 15V input gives 3V output)
-const float voltageDividerFactor = 5.0;
+// Divider factor, sample/send/WiFi check intervals: run-time settings,
+// defaults in settings.h
 
-// Reference voltage of ESP32 ADC (typically 3.3 V on C3)
-const float adcReferenceVoltage = 3.3;
+// ADC reference and calibration per attenuation range: see adc_range.cpp
 
-// ADC resolution on ESP32 is 12 bits (0 to 4095)
-const float adcResolution = 4095.0;
-
-// Calibration factor
-const float calibrationFactor = 0.91;
+// Voltage channel filter (VoltageFilter): see measurement.h
 
 bool wifiConnected = false;
 unsigned long lastWiFiCheck = 0;
-const unsigned long WIFI_CHECK_INTERVAL = 10000;    // check connection every 10 s
-
-unsigned long lastFirebaseSend = 0;
-const unsigned long FIREBASE_SEND_INTERVAL = 60000;  // send to Firebase every 60 s
-
-// Status tracking variables (for /status endpoint)
-DeviceStatus deviceStatus;
-
-void connectToWiFi(const char* ssid, const char* password) {
-  Serial.println("\nAttempting to connect to WiFi...");
-  Serial.print("SSID: ");
-  Serial.println(ssid);
-
-  WiFi.mode(WIFI_STA);
-  WiFi.persistent(false);       // do not save automatically to flash
-  WiFi.setAutoReconnect(true);  // auto reconnect
-  WiFi.begin(ssid, password);
-
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-    delay(500);
-    Serial.print(".");
-    attempts++;
+unsigned long wifiLostTime = 0;  // when the last outage started
+int32_t lastRssi = 0;            // signal at the last check, logged with a drop
+
+#ifndef FIRMWARE_VERSION
+#define FIRMWARE_VERSION "1.0.0"
+#endif
+
+// Status tracking variables (for /status endpoint); currentStatus is loop()'s
+// working copy, published to deviceStatus after each update
+SeqLock<DeviceStatus> deviceStatus;
+static DeviceStatus currentStatus = {};
+
+// Statistics per send interval and for the whole run
+VoltageStats voltageStats;
+
+// Compressed history of every reading
+SampleStore sampleStore;
+
+// Holds back send windows that match the last record (dead_band.h)
+DeadBand deadBand;
+
+// Voltage channel, composed at compile time (measurement.h): burst ->
+// volts -> serial log -> window stats -> history -> sinks every send
+// interval unless within the dead-band -> /status
+typedef Pipeline<AdcBurst<voltageSensorPin, VoltageFilter>, Calibrate, SerialReport, Accumulate, Store,
+                 Publish, StatusUpdate> VoltagePipeline;
+VoltagePipeline voltagePipeline{AdcBurst<voltageSensorPin, VoltageFilter>(), Calibrate(), SerialReport(),
+                                Accumulate(voltageStats), Store(sampleStore), Publish(voltageStats, deadBand),
+                                StatusUpdate(currentStatus, voltageStats)};
+
+// Unit tests (pio test -e native) build this file for the globals above and
+// bring their own setup() and loop()
+#ifndef PIO_UNIT_TESTING
+
+// Readings so far went through the old divider: send them as a window of
+// their own so no window mixes two scales, and the first window on the
+// new scale goes out too
+static void onDividerChanged(uint32_t) {
+  if (publishWindow(voltageStats, deadBand, currentStatus.lastRawValue, currentStatus.lastAdcRange, false)) {
+    currentStatus.recordNumber++;
   }
+  StatusUpdate::copyStats(currentStatus, voltageStats);
+  deviceStatus.write(currentStatus);
+  deadBand.restart();
+}
 
-  if (WiFi.status() == WL_CONNECTED) {
-    wifiConnected = true;
-    Serial.println("\n✓ Connected to WiFi!");
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
-
-    // Initialize Firebase when WiFi is up
-    initFirebase();
-    
-    // Slanje logova ako postoje
-    if (Logger::hasPendingLogs()) {
-      Serial.println("Slanje spremljenih logova na Firebase...");
-      delay(2000);  // Čekaj da se Firebase inicijalizira
-      sendLogsToFirebase();
-    }
-  } else {
-    wifiConnected = false;
-    Serial.println("\n✗ Unable to connect to WiFi!");
-  }
+// Upload backends, enabled in telemetry_config.h / build_flags
+#if TELEMETRY_FIREBASE_ENABLED
+FirebaseSink firebaseSink;
+#endif
+#if TELEMETRY_MQTT_ENABLED
+MqttSink mqttSink(MQTT_BROKER_HOST, MQTT_BROKER_PORT, MQTT_CLIENT_ID, MQTT_TOPIC);
+#endif
+#if TELEMETRY_HTTP_ENABLED
+HttpPostSink httpSink(HTTP_SINK_URL);
+#endif
+
+void setupTelemetry() {
+#if TELEMETRY_FIREBASE_ENABLED
+  Telemetry::addSink(&firebaseSink);
+#endif
+#if TELEMETRY_MQTT_ENABLED
+  Telemetry::addSink(&mqttSink);
+#endif
+#if TELEMETRY_HTTP_ENABLED
+  Telemetry::addSink(&httpSink);
+#endif
+  Telemetry::begin();
 }
 
 void setupAccessPoint() {
-  Serial.println("Starting Access Point mode...");
+  LOG_INFO("Starting Access Point mode...");
 
   // AP + STA mode so we can scan networks
+  WiFi.setHostname(DeviceIdentity::hostname());
   WiFi.mode(WIFI_AP_STA);
 
   IPAddress apIP(192, 168, 4, 1);
   IPAddress netmask(255, 255, 255, 0);
   WiFi.softAPConfig(apIP, apIP, netmask);
 
-  bool apStarted = WiFi.softAP("ESP32-VoltageLog", "12345678", 1, false, 4);
+  // SSID per board, so several can be set up side by side
+  bool apStarted = WiFi.softAP(DeviceIdentity::name(), "12345678", 1, false, 4);
 
-  Serial.print("Access Point Status: ");
-  Serial.println(apStarted ? "STARTED" : "FAILED");
-
-  Serial.print("Access Point IP: ");
-  Serial.println(WiFi.softAPIP());
+  LOG_INFO("Access Point %s: %s, IP: %s", DeviceIdentity::name(), apStarted ? "STARTED" : "FAILED",
+           WiFi.softAPIP().toString().c_str());
+  if (apStarted) DeviceIdentity::announce();
 }
 
 void setup() {
+  // No waiting for a serial monitor or the network here: sampling and the
+  // web server come up at once, WiFi and sign-in follow in Boot::loop()
   Serial.begin(115200);
-  delay(2000);
-  Serial.println("\n\n=== ESP32 VoltageLog - Startup ===");
+  SerialLog::begin();
+  Boot::mark(Boot::PHASE_SETUP);
+  LOG_INFO("=== ESP32 VoltageLog - Startup ===");
+  DeviceIdentity::begin();
+
+  // EEPROM once, at its full size, before any region is read
+  initEEPROM();
+  Settings::begin();
+  Settings::subscribe(Settings::bit(Settings::DIVIDER_FACTOR), onDividerChanged);
 
   // Inicijalizacija loggera
   Logger::init();
 
-  // Initialize EEPROM
-  initEEPROM();
-
   // ADC settings for better precision
   analogReadResolution(12);
-  analogSetAttenuation(ADC_11db);
   pinMode(voltageSensorPin, INPUT);
+  AdcRanging::begin(voltageSensorPin);  // 11 dB; auto-ranges while the adcAutoRange setting is 1
+  Boot::mark(Boot::PHASE_SAMPLING);
+
+  setupTelemetry();
+
+  // First boot after an update: the image has to pass its health check
+  Ota::begin();
+
+  currentStatus.version = FIRMWARE_VERSION;
+  deviceStatus.write(currentStatus);
 
   // Check if WiFi configuration is stored
   if (hasValidWiFiConfig()) {
     WiFiConfig config;
     loadWiFiConfig(config);
-    connectToWiFi(config.ssid, config.password);
+    Boot::connect(config.ssid, config.password);  // doesn't wait
   } else {
-    Serial.println("No stored WiFi credentials!");
-    Serial.println("Creating Access Point for configuration...");
+    LOG_WARN("No stored WiFi credentials! Creating Access Point for configuration...");
     setupAccessPoint();
   }
 
   // Setup web server (routes added only once)
   setupWebServer();
+  Boot::mark(Boot::PHASE_WEB);
+}
+
+// Sleep until the next reading is due, running the start-up stages,
+// upload retries and a pull update in the meantime. The period is counted
+// from the start of the reading.
+static void waitForNextReading(unsigned long loopStart) {
+  while (millis() - loopStart < Settings::get().sampleIntervalMs) {
+    // Uplink just came up, or a backoff ran out: send what queued right
+    // away instead of at the next reading
+    if (Boot::loop() || Telemetry::retryDue()) {
+      Telemetry::loop();
+      Boot::loop();
+    }
+    // A pull download goes on a slice at a time, without the nap
+    if (Ota::pulling()) Ota::loop();
+    // A new interval counts from the same start
+    Settings::loop();
+    unsigned long left = Settings::get().sampleIntervalMs - (millis() - loopStart);
+    if ((long)left <= 0) break;
+    unsigned long nap = Ota::pulling() ? 1 : BOOT_POLL_MS;
+    delay(left < nap ? left : nap);
+  }
 }
 
 void loop() {
+  unsigned long loopStart = millis();
+  TRACE_BEGIN("loop");
+
   // Check WiFi connection if currently connected
-  if (wifiConnected && millis() - lastWiFiCheck > WIFI_CHECK_INTERVAL) {
+  TRACE_BEGIN("wifi_check");
+  if (wifiConnected && millis() - lastWiFiCheck > Settings::get().wifiCheckIntervalMs) {
     if (WiFi.status() != WL_CONNECTED) {
       wifiConnected = false;
-      Serial.println("WiFi connection lost!");
-      Logger::logWiFiDisconnect();  // Logira WiFi prekid
+      wifiLostTime = millis();
+      Metrics::inc(Metrics::wifiDisconnects);
+      LOG_WARN("WiFi connection lost!");
+      Logger::event(EVENT_WIFI_DISCONNECT, SEVERITY_WARN, lastRssi);
       setupAccessPoint();
       setupWebServer();  // won't register routes twice
+    } else {
+      lastRssi = WiFi.RSSI();
     }
     lastWiFiCheck = millis();
+  } else if (!wifiConnected && wifiLostTime != 0 && WiFi.status() == WL_CONNECTED) {
+    // STA side came back on its own (auto reconnect in AP_STA mode)
+    wifiConnected = true;
+    Metrics::inc(Metrics::wifiReconnects);
+    Metrics::wifiOutageSeconds.observe((millis() - wifiLostTime) / 1000);
+    lastRssi = WiFi.RSSI();
+    Logger::event(EVENT_WIFI_RECONNECT, SEVERITY_INFO, lastRssi, millis() - wifiLostTime);
+    wifiLostTime = 0;
+    LOG_INFO("WiFi reconnected!");
+    TimeService::begin();  // no-op if it already runs
   }
+  TRACE_END("wifi_check");
+
+  // Start-up stages and SNTP events; also run while waiting for the next
+  // reading. The first sync gives earlier log entries their UTC time.
+  Boot::loop();
+  Logger::loop();  // coalesced repeats reach flash every LOG_COMMIT_INTERVAL_MS
+  Settings::loop();  // PATCHed settings take effect from this reading on
 
   // If not connected to WiFi and not yet in AP/AP_STA mode, start AP
-  if (!wifiConnected && WiFi.getMode() == WIFI_STA) {
+  // (a station still connecting after boot gets its timeout first)
+  if (!wifiConnected && !Boot::connecting() && WiFi.getMode() == WIFI_STA) {
     setupAccessPoint();
   }
 
   // AsyncWebServer handles itself, but leaving hook for clarity
   handleWebServer();
 
-  // 1. Read analog value (0 to 4095)
-  int rawValue = analogRead(voltageSensorPin);
-
-  // 2. Calculate voltage on module's S pin
-  float measuredVoltageADC =
-      (rawValue * (adcReferenceVoltage / adcResolution)) * calibrationFactor;
-
-  // 3. Calculate actual input voltage using divider factor
-  float actualInputVoltage = measuredVoltageADC * voltageDividerFactor;
-
-  // Print results to serial monitor
-  Serial.print("Raw value read: ");
-  Serial.print(rawValue);
-  Serial.print(" -> ADC voltage: ");
-  Serial.print(measuredVoltageADC);
-  Serial.print(" V -> Measured voltage: ");
-  Serial.print(actualInputVoltage);
-  Serial.println(" V");
-
-  // Update device status for /status endpoint
-  deviceStatus.lastVoltage = actualInputVoltage;
-  deviceStatus.lastRawValue = rawValue;
-  deviceStatus.lastReadTime = millis();
-  deviceStatus.firebaseConnected = checkFirebaseConnection();
-
-  // Send to Firebase if WiFi connected
-  if (wifiConnected && (millis() - lastFirebaseSend > FIREBASE_SEND_INTERVAL)) {
-    if (sendVoltageToFirebase(actualInputVoltage, rawValue)) {
-      lastFirebaseSend = millis();
-      deviceStatus.lastSendTime = millis();
-    }
-  }
+  // Read, convert, log, aggregate, store and publish one reading
+  voltagePipeline.step();
+
+  TRACE_BEGIN("firebase_check");
+  currentStatus.firebaseConnected = checkFirebaseConnection();
+  TRACE_END("firebase_check");
+  deviceStatus.write(currentStatus);  // before the upload, which can take a while
+  Boot::mark(Boot::PHASE_FIRST_SAMPLE);
 
-  delay(10000); // Read every 10 seconds
+  TRACE_BEGIN("upload");
+  Telemetry::loop();
+  TRACE_END("upload");
+  currentStatus.lastSendTime = Telemetry::lastSuccessTime();
+  deviceStatus.write(currentStatus);
+
+  // Pull downloads, restart after an update, health check of a new image
+  TRACE_BEGIN("ota");
+  Ota::loop();
+  TRACE_END("ota");
+
+  Metrics::recordLoop(millis() - loopStart);
+  TRACE_END("loop");
+
+  waitForNextReading(loopStart);
 }
+
+#endif  // PIO_UNIT_TESTING
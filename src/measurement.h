@@ -0,0 +1,225 @@
+#ifndef MEASUREMENT_H
+#define MEASUREMENT_H
+
+#include <Arduino.h>
+#include "pipeline.h"
+#include "adc_range.h"
+#include "metrics.h"
+#include "trace.h"
+#include "serial_log.h"
+#include "stream_stats.h"
+#include "sample_store.h"
+#include "telemetry_sink.h"
+#include "webserver.h"
+#include "settings.h"
+#include "dead_band.h"
+#include "adc_filter.h"
+
+// Stages of the voltage channel (see pipeline.h), composed in main.cpp:
+//
+//   AdcBurst -> Calibrate -> SerialReport -> Accumulate -> Store -> Publish -> StatusUpdate
+//
+// They are the same on the board and in the native build; only
+// analogRead() and millis() underneath differ.
+
+// Voltage channel filter: median-of-3 spike rejection, 8-sample moving
+// average, EMA with alpha 1/4, then one output per burst. The decimation
+// sets the burst length: 16 ADC reads per loop.
+typedef FilterChain<MedianFilter<3>, MovingAverage<8>, EmaFilter<2>, Decimator<16>> VoltageFilter;
+
+// One burst of ADC reads through Filter. The burst is as long as the
+// filter's decimation, so each read gives exactly one filtered code.
+template <int PIN, typename Filter>
+class AdcBurst {
+public:
+  static constexpr size_t BURST = Filter::DECIMATION;
+
+  bool read(Reading& r) {
+    TRACE_BEGIN("adc_read");
+    unsigned long start = micros();
+    if (AdcRanging::prepare()) {
+      // New attenuation: codes are on another scale, and the first
+      // conversion after the switch is not reliable
+      filter.reset();
+      analogRead(PIN);
+    }
+    r.adcRange = AdcRanging::range();
+    int32_t raw = 0;
+    int32_t peak = 0;
+    bool filtered = false;
+    for (size_t i = 0; i < BURST; i++) {
+      int sample = analogRead(PIN);
+      if (sample > peak) peak = sample;
+      int32_t out;
+      if (filter.process(sample, out)) {
+        raw = out;
+        filtered = true;
+      }
+    }
+    r.raw = raw;
+    r.peak = peak;
+    Metrics::adcReadMicros.observe(micros() - start);
+    TRACE_END("adc_read");
+    Metrics::inc(Metrics::samplesTotal, BURST);
+    r.timeMs = millis();
+    return filtered;
+  }
+
+  void reset() { filter.reset(); }
+
+private:
+  Filter filter;
+};
+
+// Code -> volts at the S pin with the range's calibration -> volts at the
+// input through the divider (a setting); then picks the range for the
+// next burst
+class Calibrate {
+public:
+  bool process(Reading& r) {
+    r.adcVolts = AdcRanging::toMilliVolts(r.raw) / 1000.0f;
+    AdcRanging::update(r.raw, r.peak);
+    r.volts = r.adcVolts * Settings::get().dividerFactor;
+    return true;
+  }
+
+  void reset() {}
+};
+
+// Serial line per reading (queued, drained in the background)
+class SerialReport {
+public:
+  bool process(Reading& r) {
+    (void)r;  // unused when LOG_INFO is compiled out
+    TRACE_BEGIN("log");
+    LOG_INFO("Filtered raw value: %d (%s) -> ADC voltage: %.3f V -> Measured voltage: %.2f V",
+             (int)r.raw, AdcRanging::rangeInfo(r.adcRange).name, r.adcVolts, r.volts);
+    TRACE_END("log");
+    return true;
+  }
+
+  void reset() {}
+};
+
+// Window and whole-run statistics
+class Accumulate {
+public:
+  explicit Accumulate(VoltageStats& s) : stats(s) {}
+
+  bool process(Reading& r) {
+    stats.add(r.volts);
+    return true;
+  }
+
+  void reset() {}
+
+private:
+  VoltageStats& stats;
+};
+
+// Compressed history, in millivolts
+class Store {
+public:
+  explicit Store(SampleStore& s) : store(s) {}
+
+  bool process(Reading& r) {
+    store.append(r.timeMs, lroundf(r.volts * 1000.0f));
+    return true;
+  }
+
+  void reset() {}
+
+private:
+  SampleStore& store;
+};
+
+// Dead-band limits from the settings
+inline DeadBand::Limits deadBandLimits() {
+  const Settings::Values& s = Settings::get();
+  DeadBand::Limits limits = {s.deadBandMv / 1000.0f, s.deadBandPct / 100.0f, s.heartbeatMs};
+  return limits;
+}
+
+// Closes the statistics window and hands its summary to the sinks; they
+// queue it while offline and upload when they can. With filter, a window
+// within the dead-band is only counted. False if nothing was handed over.
+inline bool publishWindow(VoltageStats& stats, DeadBand& deadBand, int raw, uint8_t adcRange, bool filter) {
+  VoltageSummary window = stats.closeWindow();
+  if (window.count == 0) return false;
+  unsigned long now = millis();
+  if (filter && !deadBand.due(window, now, deadBandLimits())) {
+    deadBand.suppress();
+    Metrics::inc(Metrics::windowsSuppressed);
+    return false;
+  }
+  TelemetryRecord record = {window.mean, raw, adcRange, now, window, deadBand.published(window.mean, now)};
+  Telemetry::publish(record);
+  return true;
+}
+
+// publishWindow() every send interval (a setting), through the dead-band
+class Publish {
+public:
+  Publish(VoltageStats& s, DeadBand& d) : stats(s), deadBand(d) {}
+
+  bool process(Reading& r) {
+    r.published = false;
+    r.windowStartMs = lastSend;
+    if (lastSend != 0 && millis() - lastSend <= Settings::get().sendIntervalMs) return true;
+    r.published = publishWindow(stats, deadBand, r.raw, r.adcRange, true);
+    lastSend = millis();
+    r.windowStartMs = lastSend;
+    return true;
+  }
+
+  // The next reading closes a window again, and it goes out
+  void reset() {
+    lastSend = 0;
+    deadBand.restart();
+  }
+
+private:
+  VoltageStats& stats;
+  DeadBand& deadBand;
+  unsigned long lastSend = 0;
+};
+
+// loop()'s working copy of the /status fields
+class StatusUpdate {
+public:
+  StatusUpdate(DeviceStatus& s, const VoltageStats& v) : status(s), stats(v) {}
+
+  bool process(Reading& r) {
+    status.lastVoltage = r.volts;
+    status.lastRawValue = r.raw;
+    status.lastAdcRange = r.adcRange;
+    status.lastReadTime = r.timeMs;
+    status.windowStart = r.windowStartMs;
+    if (r.published) status.recordNumber++;
+    copyStats(status, stats);
+    return true;
+  }
+
+  void reset() {}
+
+  // Statistics part of the status, from the loop task
+  static void copyStats(DeviceStatus& s, const VoltageStats& v) {
+    s.window = v.window();
+    s.lastWindow = v.lastWindow();
+    s.total = v.total();
+    s.windows = v.windowsClosed();
+    s.rangeSwitches = AdcRanging::switches();
+    const FixedHistogram& h = v.lastHistogram();
+    s.histogramMin = h.lower();
+    s.histogramBinWidth = h.binWidth();
+    s.histogramUnder = h.underflow();
+    s.histogramOver = h.overflow();
+    for (size_t i = 0; i < h.bins(); i++) s.histogram[i] = h.bin(i);
+  }
+
+private:
+  DeviceStatus& status;
+  const VoltageStats& stats;
+};
+
+#endif
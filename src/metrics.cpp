@@ -0,0 +1,322 @@
+#include "metrics.h"
+#include <stdarg.h>
+#include "serial_log.h"
+#include "time_service.h"
+#include "ota.h"
+#include "admission.h"
+
+namespace Metrics {
+
+static const uint32_t ADC_BOUNDS[] = {10, 20, 50, 100, 200, 500, 1000, 5000};
+static const uint32_t UPLOAD_BOUNDS[] = {100, 250, 500, 1000, 2000, 5000, 10000, 20000};
+static const uint32_t OUTAGE_BOUNDS[] = {1, 5, 10, 30, 60, 300, 1800, 3600};
+static const uint32_t LOOP_BOUNDS[] = {5, 20, 50, 100, 500, 1000, 2000, 5000, 10000};
+static const uint32_t LOG_BOUNDS[] = {250, 500, 1000, 2000, 5000, 10000, 50000, 200000};
+
+#define BOUNDS(b) b, sizeof(b) / sizeof(b[0])
+
+Counter samplesTotal(0);
+Histogram adcReadMicros(BOUNDS(ADC_BOUNDS));
+Counter windowsSuppressed(0);
+
+Histogram uploadMillis(BOUNDS(UPLOAD_BOUNDS));
+Counter uploadResponses[CODE_COUNT] = {};
+
+Counter tokenRefreshes(0);
+Counter tokenRefreshFailures(0);
+
+Counter wifiDisconnects(0);
+Counter wifiReconnects(0);
+Histogram wifiOutageSeconds(BOUNDS(OUTAGE_BOUNDS));
+
+Histogram loopMillis(BOUNDS(LOOP_BOUNDS));
+Counter loopOverruns(0);
+
+Counter webRequests[ROUTE_COUNT] = {};
+Counter webRejections[ROUTE_COUNT][REJECT_COUNT] = {};
+
+Histogram logCallCycles(BOUNDS(LOG_BOUNDS));
+
+static const char* const ROUTE_LABELS[ROUTE_COUNT] = {
+  "/", "/status", "/config", "/scan", "/metrics", "/trace", "/ota", "/chart", "/settings", "/export", "not_found"
+};
+
+static const char* const REJECT_LABELS[REJECT_COUNT] = {"busy", "memory", "rate"};
+
+static const char* const CODE_LABELS[CODE_COUNT] = {
+  "transport_error", "200", "401", "403", "404", "429", "4xx", "500", "503", "5xx", "other"
+};
+
+void Histogram::observe(uint32_t value) {
+  size_t i = 0;
+  while (i < numBounds && value > bounds[i]) {
+    i++;
+  }
+  inc(buckets[i]);
+  inc(sum, value);
+  inc(count);
+}
+
+static UploadCode codeSlot(int httpCode) {
+  if (httpCode < 0) return CODE_TRANSPORT;
+  switch (httpCode) {
+    case 200: return CODE_200;
+    case 401: return CODE_401;
+    case 403: return CODE_403;
+    case 404: return CODE_404;
+    case 429: return CODE_429;
+    case 500: return CODE_500;
+    case 503: return CODE_503;
+  }
+  if (httpCode >= 400 && httpCode < 500) return CODE_OTHER_4XX;
+  if (httpCode >= 500 && httpCode < 600) return CODE_OTHER_5XX;
+  return CODE_OTHER;
+}
+
+void recordUpload(int httpCode, uint32_t durationMs) {
+  uploadMillis.observe(durationMs);
+  inc(uploadResponses[codeSlot(httpCode)]);
+}
+
+void recordLoop(uint32_t durationMs) {
+  loopMillis.observe(durationMs);
+  if (durationMs > LOOP_BUDGET_MS) {
+    inc(loopOverruns);
+  }
+}
+
+static void copyHistogram(const Histogram& h, HistogramSnapshot& out) {
+  for (size_t i = 0; i <= MAX_BUCKETS; i++) {
+    out.buckets[i] = h.buckets[i].load(std::memory_order_relaxed);
+  }
+  out.sum = h.sum.load(std::memory_order_relaxed);
+  out.count = h.count.load(std::memory_order_relaxed);
+}
+
+void takeSnapshot(Snapshot& snap) {
+  snap.uptimeSeconds = millis() / 1000;
+  snap.samplesTotal = samplesTotal.load(std::memory_order_relaxed);
+  copyHistogram(adcReadMicros, snap.adcReadMicros);
+  snap.windowsSuppressed = windowsSuppressed.load(std::memory_order_relaxed);
+  snap.adcRange = AdcRanging::range();
+  snap.adcRangeSwitches = AdcRanging::switches();
+  for (uint8_t i = 0; i < ADC_RANGE_COUNT; i++) {
+    snap.adcRangeWindows[i] = AdcRanging::windows(i);
+  }
+  copyHistogram(uploadMillis, snap.uploadMillis);
+  for (size_t i = 0; i < CODE_COUNT; i++) {
+    snap.uploadResponses[i] = uploadResponses[i].load(std::memory_order_relaxed);
+  }
+  snap.tokenRefreshes = tokenRefreshes.load(std::memory_order_relaxed);
+  snap.tokenRefreshFailures = tokenRefreshFailures.load(std::memory_order_relaxed);
+  snap.wifiDisconnects = wifiDisconnects.load(std::memory_order_relaxed);
+  snap.wifiReconnects = wifiReconnects.load(std::memory_order_relaxed);
+  copyHistogram(wifiOutageSeconds, snap.wifiOutageSeconds);
+  snap.timeSynced = TimeService::isSynced();
+  snap.timeSyncs = TimeService::syncCount();
+  snap.clockDriftPpb = (int32_t)(TimeService::driftPpm() * 1000.0f);
+  snap.clockCorrectionMicros = TimeService::lastCorrectionMicros();
+  const Ota::Report& ota = Ota::lastReport();
+  snap.otaPendingVerify = Ota::pendingVerify();
+  snap.otaDurationMs = ota.durationMs;
+  snap.otaRadioOnMs = ota.radioOnMs;
+  snap.otaBytesIn = ota.bytesIn;
+  snap.otaBytesOut = ota.bytesOut;
+  for (uint8_t i = 0; i < Boot::PHASE_COUNT; i++) {
+    snap.bootPhaseReached[i] = Boot::reached((Boot::Phase)i);
+    snap.bootPhaseMs[i] = Boot::at((Boot::Phase)i);
+  }
+  copyHistogram(loopMillis, snap.loopMillis);
+  snap.loopOverruns = loopOverruns.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < ROUTE_COUNT; i++) {
+    snap.webRequests[i] = webRequests[i].load(std::memory_order_relaxed);
+    for (size_t r = 0; r < REJECT_COUNT; r++) {
+      snap.webRejections[i][r] = webRejections[i][r].load(std::memory_order_relaxed);
+    }
+  }
+  snap.webInFlightBytes = Admission::inFlightBytes();
+  snap.webInFlightPeakBytes = Admission::peakBytes();
+  copyHistogram(logCallCycles, snap.logCallCycles);
+  snap.logDropped = SerialLog::dropped();
+  snap.logRateLimited = SerialLog::rateLimited();
+  snap.freeHeap = ESP.getFreeHeap();
+  snap.minFreeHeap = ESP.getMinFreeHeap();
+  snap.largestFreeBlock = ESP.getMaxAllocHeap();
+}
+
+// Formats the output line by line and keeps only the bytes that fall
+// into the requested window of the response
+class WindowWriter {
+public:
+  WindowWriter(uint8_t* out, size_t maxLen, size_t start)
+      : out(out), maxLen(maxLen), start(start), pos(0), written(0) {}
+
+  bool full() const { return written >= maxLen; }
+  size_t length() const { return written; }
+
+  void line(const char* fmt, ...) {
+    if (full()) return;
+    char buf[128];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n < 0) return;
+    if ((size_t)n >= sizeof(buf)) n = sizeof(buf) - 1;
+
+    for (int i = 0; i < n; i++, pos++) {
+      if (pos >= start && written < maxLen) {
+        out[written++] = buf[i];
+      }
+    }
+    if (pos >= start && written < maxLen) {
+      out[written++] = '\n';
+    }
+    pos++;
+  }
+
+private:
+  uint8_t* out;
+  size_t maxLen;
+  size_t start;
+  size_t pos;
+  size_t written;
+};
+
+static void header(WindowWriter& w, const char* name, const char* type, const char* help) {
+  w.line("# HELP %s %s", name, help);
+  w.line("# TYPE %s %s", name, type);
+}
+
+static void counter(WindowWriter& w, const char* name, const char* help, uint32_t value) {
+  header(w, name, "counter", help);
+  w.line("%s %lu", name, (unsigned long)value);
+}
+
+static void gauge(WindowWriter& w, const char* name, const char* help, uint32_t value) {
+  header(w, name, "gauge", help);
+  w.line("%s %lu", name, (unsigned long)value);
+}
+
+static void histogram(WindowWriter& w, const char* name, const char* help,
+                      const Histogram& def, const HistogramSnapshot& h) {
+  header(w, name, "histogram", help);
+  uint32_t cumulative = 0;
+  for (size_t i = 0; i < def.numBounds; i++) {
+    cumulative += h.buckets[i];
+    w.line("%s_bucket{le=\"%lu\"} %lu", name, (unsigned long)def.bounds[i],
+           (unsigned long)cumulative);
+  }
+  cumulative += h.buckets[def.numBounds];
+  w.line("%s_bucket{le=\"+Inf\"} %lu", name, (unsigned long)cumulative);
+  w.line("%s_sum %lu", name, (unsigned long)h.sum);
+  w.line("%s_count %lu", name, (unsigned long)h.count);
+}
+
+size_t render(const Snapshot& s, uint8_t* buf, size_t maxLen, size_t index) {
+  WindowWriter w(buf, maxLen, index);
+
+  gauge(w, "voltagelog_uptime_seconds", "Seconds since boot.", s.uptimeSeconds);
+  counter(w, "voltagelog_samples_total", "ADC samples taken.", s.samplesTotal);
+  histogram(w, "voltagelog_adc_read_microseconds", "Duration of one filtered ADC burst.",
+            adcReadMicros, s.adcReadMicros);
+  header(w, "voltagelog_adc_range_info", "gauge", "ADC attenuation range in use (1 = active).");
+  for (uint8_t i = 0; i < ADC_RANGE_COUNT; i++) {
+    w.line("voltagelog_adc_range_info{range=\"%s\"} %d", AdcRanging::rangeInfo(i).name,
+           s.adcRange == i ? 1 : 0);
+  }
+  header(w, "voltagelog_adc_range_windows_total", "counter", "Measurement windows per ADC range.");
+  for (uint8_t i = 0; i < ADC_RANGE_COUNT; i++) {
+    w.line("voltagelog_adc_range_windows_total{range=\"%s\"} %lu", AdcRanging::rangeInfo(i).name,
+           (unsigned long)s.adcRangeWindows[i]);
+  }
+  counter(w, "voltagelog_adc_range_switches_total", "ADC attenuation changes.",
+          s.adcRangeSwitches);
+
+  counter(w, "voltagelog_windows_suppressed_total",
+          "Send windows within the dead-band of the last record, not uploaded.", s.windowsSuppressed);
+  histogram(w, "voltagelog_upload_duration_milliseconds",
+            "Duration of upload requests.", uploadMillis, s.uploadMillis);
+  header(w, "voltagelog_upload_responses_total", "counter", "Upload requests by HTTP result.");
+  for (size_t i = 0; i < CODE_COUNT; i++) {
+    w.line("voltagelog_upload_responses_total{code=\"%s\"} %lu", CODE_LABELS[i],
+           (unsigned long)s.uploadResponses[i]);
+  }
+
+  counter(w, "voltagelog_token_refreshes_total", "ID token sign-in attempts.", s.tokenRefreshes);
+  counter(w, "voltagelog_token_refresh_failures_total", "Failed ID token sign-ins.",
+          s.tokenRefreshFailures);
+
+  counter(w, "voltagelog_wifi_disconnects_total", "Detected WiFi connection losses.",
+          s.wifiDisconnects);
+  counter(w, "voltagelog_wifi_reconnects_total", "WiFi reconnections after a loss.",
+          s.wifiReconnects);
+  histogram(w, "voltagelog_wifi_outage_seconds", "Duration of WiFi outages.",
+            wifiOutageSeconds, s.wifiOutageSeconds);
+
+  gauge(w, "voltagelog_time_synced", "1 once SNTP has synced since boot.", s.timeSynced ? 1 : 0);
+  counter(w, "voltagelog_time_syncs_total", "SNTP syncs since boot.", s.timeSyncs);
+  header(w, "voltagelog_clock_drift_ppb", "gauge", "Estimated local clock rate error (+ = fast).");
+  w.line("voltagelog_clock_drift_ppb %ld", (long)s.clockDriftPpb);
+  header(w, "voltagelog_clock_correction_microseconds", "gauge",
+         "Timestamp error found at the last SNTP resync.");
+  w.line("voltagelog_clock_correction_microseconds %ld", (long)s.clockCorrectionMicros);
+
+  gauge(w, "voltagelog_ota_pending_verify", "1 while a new image waits for its health check.",
+        s.otaPendingVerify ? 1 : 0);
+  gauge(w, "voltagelog_ota_last_duration_milliseconds",
+        "Time the last firmware update took, first byte to verified image.", s.otaDurationMs);
+  gauge(w, "voltagelog_ota_last_radio_on_milliseconds",
+        "Time the last firmware download kept the radio awake.", s.otaRadioOnMs);
+  gauge(w, "voltagelog_ota_last_received_bytes", "Image bytes received in the last update.",
+        s.otaBytesIn);
+  gauge(w, "voltagelog_ota_last_written_bytes", "Firmware bytes written in the last update.",
+        s.otaBytesOut);
+
+  header(w, "voltagelog_boot_phase_milliseconds", "gauge",
+         "Time after boot each start-up phase was reached.");
+  for (uint8_t i = 0; i < Boot::PHASE_COUNT; i++) {
+    if (!s.bootPhaseReached[i]) continue;
+    w.line("voltagelog_boot_phase_milliseconds{phase=\"%s\"} %lu", Boot::phaseName((Boot::Phase)i),
+           (unsigned long)s.bootPhaseMs[i]);
+  }
+
+  histogram(w, "voltagelog_loop_duration_milliseconds",
+            "Busy time of one loop() iteration.", loopMillis, s.loopMillis);
+  counter(w, "voltagelog_loop_overruns_total", "loop() iterations over the cycle budget.",
+          s.loopOverruns);
+
+  histogram(w, "voltagelog_log_call_cycles", "CPU cycles spent in one LOG_* call.",
+            logCallCycles, s.logCallCycles);
+  counter(w, "voltagelog_log_dropped_total", "Log messages dropped, ring buffer full.",
+          s.logDropped);
+  counter(w, "voltagelog_log_rate_limited_total", "Log messages dropped by the rate limit.",
+          s.logRateLimited);
+
+  gauge(w, "voltagelog_heap_free_bytes", "Free heap.", s.freeHeap);
+  gauge(w, "voltagelog_heap_min_free_bytes", "Lowest free heap since boot.", s.minFreeHeap);
+  gauge(w, "voltagelog_heap_largest_free_block_bytes", "Largest allocatable heap block.",
+        s.largestFreeBlock);
+
+  header(w, "voltagelog_http_requests_total", "counter", "Web server requests by route.");
+  for (size_t i = 0; i < ROUTE_COUNT; i++) {
+    w.line("voltagelog_http_requests_total{route=\"%s\"} %lu", ROUTE_LABELS[i],
+           (unsigned long)s.webRequests[i]);
+  }
+  header(w, "voltagelog_http_rejected_total", "counter",
+         "Web requests answered 503 by admission control.");
+  for (size_t i = 0; i < ROUTE_COUNT; i++) {
+    for (size_t r = 0; r < REJECT_COUNT; r++) {
+      w.line("voltagelog_http_rejected_total{route=\"%s\",reason=\"%s\"} %lu", ROUTE_LABELS[i],
+             REJECT_LABELS[r], (unsigned long)s.webRejections[i][r]);
+    }
+  }
+  gauge(w, "voltagelog_http_inflight_bytes", "Estimated heap held by admitted web requests.",
+        s.webInFlightBytes);
+  gauge(w, "voltagelog_http_inflight_peak_bytes", "Highest in-flight estimate since boot.",
+        s.webInFlightPeakBytes);
+
+  return w.length();
+}
+
+}  // namespace Metrics
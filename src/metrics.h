@@ -0,0 +1,182 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "adc_range.h"
+#include "boot.h"
+
+// Performance counters exported on /metrics in Prometheus text format.
+// All counters are relaxed atomics so hot paths can update them from
+// loop() and from the AsyncTCP task without locks.
+
+// A loop() iteration (excluding the sample delay) longer than this counts as an overrun
+#ifndef LOOP_BUDGET_MS
+#define LOOP_BUDGET_MS 2000
+#endif
+
+namespace Metrics {
+
+typedef std::atomic<uint32_t> Counter;
+
+inline void inc(Counter& c, uint32_t n = 1) {
+  c.fetch_add(n, std::memory_order_relaxed);
+}
+
+static const size_t MAX_BUCKETS = 10;
+
+// Fixed-bucket histogram. bounds are upper bucket limits ("le"), ascending.
+struct Histogram {
+  Histogram(const uint32_t* bounds, size_t numBounds)
+      : bounds(bounds), numBounds(numBounds), buckets(), sum(0), count(0) {}
+
+  const uint32_t* bounds;
+  size_t numBounds;
+  Counter buckets[MAX_BUCKETS + 1];  // last one is +Inf
+  Counter sum;
+  Counter count;
+
+  void observe(uint32_t value);
+};
+
+// Web routes counted separately on /metrics
+enum Route : uint8_t {
+  ROUTE_ROOT,
+  ROUTE_STATUS,
+  ROUTE_CONFIG,
+  ROUTE_SCAN,
+  ROUTE_METRICS,
+  ROUTE_TRACE,
+  ROUTE_OTA,
+  ROUTE_CHART,
+  ROUTE_SETTINGS,
+  ROUTE_EXPORT,
+  ROUTE_NOT_FOUND,
+  ROUTE_COUNT
+};
+
+// Why a web request was turned away with 503 (label "reason")
+enum RejectReason : uint8_t {
+  REJECT_BUSY,    // route at its concurrency cap
+  REJECT_MEMORY,  // in-flight budget or free heap exhausted
+  REJECT_RATE,    // too soon after the previous one (/scan)
+  REJECT_COUNT
+};
+
+// HTTP result slots for uploads (label "code")
+enum UploadCode : uint8_t {
+  CODE_TRANSPORT,  // negative HTTPClient codes (connect/timeout/...)
+  CODE_200,
+  CODE_401,
+  CODE_403,
+  CODE_404,
+  CODE_429,
+  CODE_OTHER_4XX,
+  CODE_500,
+  CODE_503,
+  CODE_OTHER_5XX,
+  CODE_OTHER,
+  CODE_COUNT
+};
+
+// Sampling
+extern Counter samplesTotal;
+extern Histogram adcReadMicros;
+extern Counter windowsSuppressed;  // held back by the dead-band
+
+// Uploads (Firebase PUT/POST)
+extern Histogram uploadMillis;
+extern Counter uploadResponses[CODE_COUNT];
+
+// Auth
+extern Counter tokenRefreshes;
+extern Counter tokenRefreshFailures;
+
+// WiFi
+extern Counter wifiDisconnects;
+extern Counter wifiReconnects;
+extern Histogram wifiOutageSeconds;
+
+// Main loop
+extern Histogram loopMillis;
+extern Counter loopOverruns;
+
+// Web server
+extern Counter webRequests[ROUTE_COUNT];
+extern Counter webRejections[ROUTE_COUNT][REJECT_COUNT];
+
+// Serial logging cost per LOG_* call, in CPU cycles
+extern Histogram logCallCycles;
+
+// Record one upload attempt with its HTTP code and duration
+void recordUpload(int httpCode, uint32_t durationMs);
+
+// Record one loop() iteration, counting an overrun if over budget
+void recordLoop(uint32_t durationMs);
+
+inline void countRequest(Route route) {
+  inc(webRequests[route]);
+}
+
+inline void countRejection(Route route, RejectReason reason) {
+  inc(webRejections[route][reason]);
+}
+
+// Plain-value copy of all metrics taken at the start of a scrape so every
+// chunk of the response renders the same numbers
+struct HistogramSnapshot {
+  uint32_t buckets[MAX_BUCKETS + 1];
+  uint32_t sum;
+  uint32_t count;
+};
+
+struct Snapshot {
+  uint32_t uptimeSeconds;
+  uint32_t samplesTotal;
+  HistogramSnapshot adcReadMicros;
+  uint32_t windowsSuppressed;
+  uint8_t adcRange;
+  uint32_t adcRangeSwitches;
+  uint32_t adcRangeWindows[ADC_RANGE_COUNT];
+  HistogramSnapshot uploadMillis;
+  uint32_t uploadResponses[CODE_COUNT];
+  uint32_t tokenRefreshes;
+  uint32_t tokenRefreshFailures;
+  uint32_t wifiDisconnects;
+  uint32_t wifiReconnects;
+  HistogramSnapshot wifiOutageSeconds;
+  bool timeSynced;
+  uint32_t timeSyncs;
+  int32_t clockDriftPpb;
+  int32_t clockCorrectionMicros;
+  bool otaPendingVerify;
+  uint32_t otaDurationMs;
+  uint32_t otaRadioOnMs;
+  uint32_t otaBytesIn;
+  uint32_t otaBytesOut;
+  uint32_t bootPhaseMs[Boot::PHASE_COUNT];
+  bool bootPhaseReached[Boot::PHASE_COUNT];
+  HistogramSnapshot loopMillis;
+  uint32_t loopOverruns;
+  uint32_t webRequests[ROUTE_COUNT];
+  uint32_t webRejections[ROUTE_COUNT][REJECT_COUNT];
+  uint32_t webInFlightBytes;
+  uint32_t webInFlightPeakBytes;
+  HistogramSnapshot logCallCycles;
+  uint32_t logDropped;
+  uint32_t logRateLimited;
+  uint32_t freeHeap;
+  uint32_t minFreeHeap;
+  uint32_t largestFreeBlock;
+};
+
+void takeSnapshot(Snapshot& snap);
+
+// Render the exposition text and copy the bytes [index, index + maxLen)
+// into buf. Returns the number of bytes copied, 0 once past the end.
+// Uses only a small stack line buffer, suitable for chunked responses.
+size_t render(const Snapshot& snap, uint8_t* buf, size_t maxLen, size_t index);
+
+}  // namespace Metrics
+
+#endif
@@ -0,0 +1,69 @@
+#include "mqtt_sink.h"
+#include <WiFi.h>
+#include "serial_log.h"
+#include "device_identity.h"
+
+// Payload buffer, one JSON array per batch
+static const size_t MQTT_PAYLOAD_SIZE = TELEMETRY_RECORD_JSON_MAX * MQTT_BATCH_SIZE;
+static const unsigned long MQTT_RECONNECT_INTERVAL = 5000;
+
+MqttSink::MqttSink(const char* host, uint16_t port, const char* clientId, const char* topic)
+    : TelemetrySink("mqtt"), host(host), port(port), clientIdFormat(clientId),
+      topicFormat(topic), clientId{}, topic{}, client(MQTT_PAYLOAD_SIZE + 64), lastConnectAttempt(0) {}
+
+void MqttSink::begin() {
+  snprintf(clientId, sizeof(clientId), clientIdFormat, DeviceIdentity::id());
+  snprintf(topic, sizeof(topic), topicFormat, DeviceIdentity::id());
+  client.begin(host, port, net);
+  client.setCleanSession(false);  // persistent session, broker keeps QoS1 state
+  client.setKeepAlive(30);
+  client.setTimeout(2000);
+}
+
+bool MqttSink::reconnect() {
+  if (client.connected()) return true;
+  if (WiFi.status() != WL_CONNECTED) return false;
+  if (lastConnectAttempt != 0 && millis() - lastConnectAttempt < MQTT_RECONNECT_INTERVAL) {
+    return false;
+  }
+  lastConnectAttempt = millis();
+
+  LOG_INFO("[MQTT] Connecting to %s:%u as %s", host, port, clientId);
+
+  if (!client.connect(clientId)) {
+    LOG_WARN("[MQTT] Connect failed, error: %d", (int)client.lastError());
+    return false;
+  }
+  LOG_INFO("[MQTT] Connected, session present: %s", client.sessionPresent() ? "yes" : "no");
+  return true;
+}
+
+void MqttSink::poll() {
+  if (client.connected()) {
+    client.loop();
+  } else {
+    reconnect();
+  }
+}
+
+bool MqttSink::isReady() {
+  return client.connected();
+}
+
+size_t MqttSink::sendBatch(const TelemetryRecord* records, size_t count) {
+  char payload[MQTT_PAYLOAD_SIZE];
+  size_t len = serializeTelemetryRecords(records, count, payload, sizeof(payload));
+  if (len == 0) {
+    // Should not happen with the sized buffer, send one record at a time
+    len = serializeTelemetryRecords(records, 1, payload, sizeof(payload));
+    count = 1;
+  }
+
+  // QoS1: publish() blocks until PUBACK or timeout
+  if (!client.publish(topic, payload, (int)len, false, 1)) {
+    LOG_WARN("[MQTT] Publish failed, error: %d", (int)client.lastError());
+    return 0;
+  }
+  addBytesSent(len);
+  return count;
+}
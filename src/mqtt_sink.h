@@ -0,0 +1,37 @@
+#ifndef MQTT_SINK_H
+#define MQTT_SINK_H
+
+#include <WiFiClient.h>
+#include <MQTT.h>
+#include "telemetry_sink.h"
+
+// Local MQTT broker sink. Publishes with QoS1 on a persistent session
+// (cleanSession = false) so the broker keeps our state across reconnects.
+class MqttSink : public TelemetrySink {
+public:
+  MqttSink(const char* host, uint16_t port, const char* clientId, const char* topic);
+
+  void begin() override;
+
+protected:
+  size_t sendBatch(const TelemetryRecord* records, size_t count) override;
+  size_t maxBatchSize() const override { return MQTT_BATCH_SIZE; }
+  bool isReady() override;
+  void poll() override;
+
+private:
+  bool reconnect();
+
+  const char* host;
+  uint16_t port;
+  const char* clientIdFormat;
+  const char* topicFormat;
+  char clientId[64];  // formats with the device ID filled in
+  char topic[96];
+
+  WiFiClient net;
+  MQTTClient client;
+  unsigned long lastConnectAttempt;
+};
+
+#endif
@@ -0,0 +1,424 @@
+#include "ota.h"
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <Update.h>
+#include <esp_ota_ops.h>
+#include <atomic>
+#include <mutex>
+#include "ota_stream.h"
+#include "telemetry_sink.h"
+#include "serial_log.h"
+#include "logger.h"
+
+static const uint32_t REPORT_MAGIC = 0x4F544131;  // "OTA1"
+
+// Time for the HTTP reply to go out before the restart
+static const unsigned long REBOOT_DELAY_MS = 1000;
+
+// Survives the restart into the new image (not a power cycle)
+RTC_NOINIT_ATTR static uint32_t reportMagic;
+RTC_NOINIT_ATTR static Ota::Report report;
+
+// The Arduino core confirms a new image right at boot unless the sketch
+// takes over; the health check in Ota::loop() decides instead
+extern "C" bool verifyRollbackLater() {
+  return true;
+}
+
+namespace {
+  // Push pieces arrive on the AsyncTCP task and the pull job runs in
+  // loop(). owner says whose session it is; the mutex covers the short
+  // push-side operations and the timeout check, not a whole download.
+  std::mutex sessionMutex;
+  std::atomic<uint8_t> owner(Ota::SOURCE_NONE);
+  std::atomic<uint8_t> sessionState(Ota::IDLE);
+
+  OtaStream stream;
+  size_t receivedBytes = 0;
+  unsigned long startMs = 0;
+  unsigned long lastDataMs = 0;
+  uint16_t resumeCount = 0;
+  const char* lastError = nullptr;
+  unsigned long rebootAt = 0;
+
+  // Pull request handed from the web handler to loop()
+  char pullUrl[160];
+  std::atomic<bool> pullRequested(false);
+  uint8_t pullBuffer[1460];  // one TCP segment
+
+  // The download in progress, moved on a slice per Ota::loop()
+  enum PullStep : uint8_t { STEP_IDLE, STEP_CONNECT, STEP_READ, STEP_WAIT };
+  PullStep pullStep = STEP_IDLE;
+  HTTPClient pullHttp;
+  int pullAttempt = 0;
+  unsigned long pullRetryAt = 0;
+  int pullSize = -1;  // rest of the body, -1 if unknown
+  long pullRemaining = 0;
+  size_t pullSkip = 0;
+  unsigned long pullLastData = 0;
+  unsigned long radioStart = 0;
+  bool sleepWas = false;
+
+  bool verifyPending = false;
+  std::atomic<size_t> failedAtBytes(0);  // bytes + 1 of a failed session not yet logged
+
+  enum PullResult { PULL_MORE, PULL_DONE, PULL_DROPPED, PULL_FAILED };
+
+  bool writeFlash(const uint8_t* data, size_t len, void*) {
+    return Update.write((uint8_t*)data, len) == len;
+  }
+
+  bool failSession(const char* message) {
+    lastError = message;
+    stream.end();
+    if (Update.isRunning()) Update.abort();
+    sessionState = Ota::FAILED;
+    owner = Ota::SOURCE_NONE;
+    LOG_ERROR("[OTA] Update failed after %lu bytes: %s", (unsigned long)receivedBytes, message);
+    failedAtBytes = receivedBytes + 1;  // logged from loop(), EEPROM is not for the AsyncTCP task
+    return false;
+  }
+
+  // owner is already set to the session's source
+  bool startSession() {
+    if (Update.isRunning()) Update.abort();
+    stream.begin(writeFlash, nullptr);
+    receivedBytes = 0;
+    resumeCount = 0;
+    lastError = nullptr;
+    startMs = millis();
+    lastDataMs = startMs;
+    sessionState = Ota::RECEIVING;
+    if (!Update.begin(UPDATE_SIZE_UNKNOWN)) return failSession(Update.errorString());
+    LOG_INFO("[OTA] %s update into %s", owner == Ota::SOURCE_PUSH ? "Push" : "Pull",
+             Ota::updatePartition());
+    return true;
+  }
+
+  bool feed(const uint8_t* data, size_t len) {
+    if (!stream.write(data, len)) {
+      return failSession(Update.hasError() ? Update.errorString() : stream.error());
+    }
+    receivedBytes += len;
+    lastDataMs = millis();
+    return true;
+  }
+
+  bool finishSession(Ota::Source src, unsigned long radioOnMs) {
+    if (!stream.finish()) return failSession(stream.error());
+    if (!Update.end(true)) return failSession(Update.errorString());
+
+    report.durationMs = millis() - startMs;
+    report.radioOnMs = radioOnMs;
+    report.bytesIn = receivedBytes;
+    report.bytesOut = stream.bytesOut();
+    report.resumes = resumeCount;
+    report.source = src;
+    report.compressed = stream.format() == OtaStream::FORMAT_GZIP;
+    reportMagic = REPORT_MAGIC;
+    stream.end();
+
+    sessionState = Ota::REBOOTING;
+    rebootAt = millis() + REBOOT_DELAY_MS;
+    LOG_INFO("[OTA] Image verified: %lu -> %lu bytes in %lu ms (radio on %lu ms), restarting",
+             (unsigned long)report.bytesIn, (unsigned long)report.bytesOut,
+             (unsigned long)report.durationMs, (unsigned long)report.radioOnMs);
+    return true;
+  }
+
+  // One GET from the current offset. A server that ignores Range sends the
+  // whole image again and the part already written is skipped.
+  PullResult connectPull() {
+    pullHttp.setTimeout(OTA_PULL_STALL_MS);
+    if (!pullHttp.begin(pullUrl)) {
+      failSession("bad URL");
+      return PULL_FAILED;
+    }
+    if (receivedBytes > 0) {
+      pullHttp.addHeader("Range", "bytes=" + String((unsigned long)receivedBytes) + "-");
+    }
+
+    int code = pullHttp.GET();
+    pullSkip = 0;
+    if (code == 200) {
+      pullSkip = receivedBytes;
+    } else if (code != 206) {
+      pullHttp.end();
+      if (code < 0) return PULL_DROPPED;
+      LOG_WARN("[OTA] Image server answered HTTP %d", code);
+      failSession("image server error");
+      return PULL_FAILED;
+    }
+
+    pullSize = pullHttp.getSize();
+    pullRemaining = pullSize;
+    pullLastData = millis();
+    return PULL_MORE;
+  }
+
+  // Body bytes for up to OTA_PULL_SLICE_MS; PULL_MORE if the body goes on
+  PullResult readPull() {
+    WiFiClient* client = pullHttp.getStreamPtr();
+    unsigned long sliceStart = millis();
+
+    while (pullSize < 0 || pullRemaining > 0) {
+      if (millis() - sliceStart >= OTA_PULL_SLICE_MS) return PULL_MORE;
+      int avail = client->available();
+      if (avail <= 0) {
+        if (!pullHttp.connected() || millis() - pullLastData > OTA_PULL_STALL_MS) break;
+        delay(1);
+        continue;
+      }
+      int n = client->read(pullBuffer, (size_t)avail < sizeof(pullBuffer) ? avail : sizeof(pullBuffer));
+      if (n <= 0) break;
+      pullLastData = millis();
+      pullRemaining -= n;
+
+      const uint8_t* data = pullBuffer;
+      size_t len = n;
+      if (pullSkip > 0) {
+        size_t k = pullSkip < len ? pullSkip : len;
+        data += k;
+        len -= k;
+        pullSkip -= k;
+      }
+      if (len > 0 && !feed(data, len)) {
+        pullHttp.end();
+        return PULL_FAILED;
+      }
+      if (stream.done()) break;
+    }
+    pullHttp.end();
+
+    // Without a length only a gzip trailer proves the image is all there;
+    // for a plain image Update.end() checks the image digest
+    if (stream.done() || (pullSize >= 0 && pullRemaining == 0) ||
+        (pullSize < 0 && stream.format() == OtaStream::FORMAT_RAW)) {
+      return PULL_DONE;
+    }
+    return PULL_DROPPED;
+  }
+
+  void startPull() {
+    pullRequested = false;
+    if (!startSession()) return;
+
+    // Modem sleep off for the transfer: more throughput, so the radio is
+    // on for less time overall
+    sleepWas = WiFi.getSleep();
+    WiFi.setSleep(false);
+    radioStart = millis();
+    pullAttempt = 0;
+    pullStep = STEP_CONNECT;
+  }
+
+  // One step of the download: the GET, a slice of the body, or nothing
+  // while the pause before a reconnect runs
+  void advancePull() {
+    if (pullStep == STEP_WAIT) {
+      if ((long)(millis() - pullRetryAt) < 0) return;
+      pullStep = STEP_CONNECT;
+    }
+
+    PullResult result;
+    if (pullStep == STEP_CONNECT) {
+      result = connectPull();
+      if (result == PULL_MORE) pullStep = STEP_READ;
+    } else if (pullStep == STEP_READ) {
+      result = readPull();
+    } else {
+      return;
+    }
+    if (result == PULL_MORE) return;
+
+    if (result == PULL_DROPPED && pullAttempt < OTA_PULL_RETRIES) {
+      pullAttempt++;
+      resumeCount++;
+      LOG_WARN("[OTA] Download interrupted at %lu bytes, resuming (%d/%d)",
+               (unsigned long)receivedBytes, pullAttempt, OTA_PULL_RETRIES);
+      pullRetryAt = millis() + 1000UL * pullAttempt;
+      pullStep = STEP_WAIT;
+      return;
+    }
+
+    unsigned long radioOnMs = millis() - radioStart;
+    WiFi.setSleep(sleepWas);
+    pullStep = STEP_IDLE;
+
+    if (result == PULL_DONE) {
+      finishSession(Ota::SOURCE_PULL, radioOnMs);
+    } else if (sessionState == Ota::RECEIVING) {
+      failSession("download interrupted");
+    }
+  }
+
+  // The new image is good once it is back on the network and has got data
+  // out; a crash before that is rolled back by the bootloader itself
+  bool healthy() {
+    if (WiFi.status() != WL_CONNECTED) return false;
+    return Telemetry::sinkCount() == 0 || Telemetry::lastSuccessTime() != 0;
+  }
+}
+
+namespace Ota {
+
+void begin() {
+  if (reportMagic != REPORT_MAGIC) {
+    memset(&report, 0, sizeof(report));
+  }
+
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  esp_ota_img_states_t imageState;
+  if (running && esp_ota_get_state_partition(running, &imageState) == ESP_OK &&
+      imageState == ESP_OTA_IMG_PENDING_VERIFY) {
+    verifyPending = true;
+    LOG_WARN("[OTA] First boot of the image in %s, health check running", running->label);
+  }
+}
+
+void loop() {
+  if (verifyPending) {
+    if (healthy()) {
+      esp_ota_mark_app_valid_cancel_rollback();
+      verifyPending = false;
+      LOG_INFO("[OTA] Health check passed, image in %s confirmed", runningPartition());
+    } else if (millis() > OTA_HEALTH_TIMEOUT_MS) {
+      LOG_ERROR("[OTA] Health check failed, rolling back to the previous image");
+      Logger::event(EVENT_OTA_ROLLBACK, SEVERITY_ERROR);  // committed before the reboot
+      delay(200);  // let the log drain
+      esp_ota_mark_app_invalid_rollback_and_reboot();
+    }
+  }
+
+  if (pullRequested) startPull();
+  if (pullStep != STEP_IDLE) advancePull();
+
+  size_t failedAt = failedAtBytes.exchange(0);
+  if (failedAt > 0) {
+    Logger::event(EVENT_OTA_FAILED, SEVERITY_ERROR, (int32_t)(failedAt - 1));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(sessionMutex);
+    if (owner == SOURCE_PUSH && sessionState == RECEIVING &&
+        millis() - lastDataMs > OTA_SESSION_TIMEOUT_MS) {
+      failSession("upload timed out");
+    }
+  }
+
+  if (sessionState == REBOOTING && (long)(millis() - rebootAt) >= 0) {
+    LOG_INFO("[OTA] Restarting into %s", updatePartition());
+    delay(200);
+    ESP.restart();
+  }
+}
+
+bool pulling() {
+  return pullRequested || pullStep != STEP_IDLE;
+}
+
+bool authorized(const char* token) {
+  static const char expected[] = OTA_TOKEN;
+  size_t len = strlen(expected);
+  if (len == 0 || !token || strlen(token) != len) return false;
+
+  // Constant time, so the token can't be guessed byte by byte
+  uint8_t diff = 0;
+  for (size_t i = 0; i < len; i++) diff |= expected[i] ^ token[i];
+  return diff == 0;
+}
+
+Result upload(size_t offset, const uint8_t* data, size_t len, bool firstPiece) {
+  std::lock_guard<std::mutex> lock(sessionMutex);
+  if (sessionState == REBOOTING) return RESULT_BUSY;
+
+  if (offset == 0) {
+    uint8_t expected = SOURCE_NONE;
+    if (!owner.compare_exchange_strong(expected, SOURCE_PUSH) && expected != SOURCE_PUSH) {
+      return RESULT_BUSY;
+    }
+    if (sessionState == RECEIVING) {
+      LOG_WARN("[OTA] Upload restarted from 0 (had %lu bytes)", (unsigned long)receivedBytes);
+    }
+    if (!startSession()) return RESULT_FAILED;
+  } else {
+    if (owner == SOURCE_PULL) return RESULT_BUSY;
+    if (owner != SOURCE_PUSH || sessionState != RECEIVING || offset != receivedBytes) {
+      return RESULT_BAD_OFFSET;
+    }
+    if (firstPiece) resumeCount++;
+  }
+
+  return feed(data, len) ? RESULT_OK : RESULT_FAILED;
+}
+
+Result finishUpload() {
+  std::lock_guard<std::mutex> lock(sessionMutex);
+  if (owner != SOURCE_PUSH || sessionState != RECEIVING) return RESULT_FAILED;
+  return finishSession(SOURCE_PUSH, lastDataMs - startMs) ? RESULT_OK : RESULT_FAILED;
+}
+
+Result requestPull(const char* url) {
+  std::lock_guard<std::mutex> lock(sessionMutex);
+  if (sessionState == REBOOTING) return RESULT_BUSY;
+  if (strncmp(url, "http://", 7) != 0 || strlen(url) >= sizeof(pullUrl)) return RESULT_FAILED;
+
+  uint8_t expected = SOURCE_NONE;
+  if (!owner.compare_exchange_strong(expected, SOURCE_PULL)) return RESULT_BUSY;
+  strcpy(pullUrl, url);
+  pullRequested = true;
+  return RESULT_OK;
+}
+
+State state() {
+  return (State)sessionState.load();
+}
+
+const char* stateName() {
+  static const char* const NAMES[] = {"idle", "receiving", "rebooting", "failed"};
+  return NAMES[sessionState.load()];
+}
+
+Source source() {
+  return (Source)owner.load();
+}
+
+size_t received() {
+  return receivedBytes;
+}
+
+size_t written() {
+  return stream.bytesOut();
+}
+
+bool complete() {
+  return stream.done();
+}
+
+const char* error() {
+  return lastError;
+}
+
+bool hasReport() {
+  return reportMagic == REPORT_MAGIC;
+}
+
+const Report& lastReport() {
+  return report;
+}
+
+bool pendingVerify() {
+  return verifyPending;
+}
+
+const char* runningPartition() {
+  const esp_partition_t* p = esp_ota_get_running_partition();
+  return p ? p->label : "";
+}
+
+const char* updatePartition() {
+  const esp_partition_t* p = esp_ota_get_next_update_partition(nullptr);
+  return p ? p->label : "";
+}
+
+}  // namespace Ota
@@ -0,0 +1,116 @@
+#ifndef OTA_H
+#define OTA_H
+
+#include <Arduino.h>
+
+// Over-the-air firmware update into the inactive app partition (A/B slots).
+// Two ways in, both feeding the same OtaStream -> Update pipeline:
+//   push  POST /ota with the image as the request body, in one request or
+//         in pieces (?offset=N); after an interruption the client carries
+//         on from the "received" count on /ota/status
+//   pull  POST /ota/pull?url=http://... and the device downloads the image
+//         from a local HTTP server, continuing with a Range request when
+//         the connection drops
+// gzip images are inflated on the fly. The new image boots in
+// pending-verify state and is either confirmed by the health check or
+// rolled back to the previous slot.
+
+// Shared secret for the OTA routes, sent as the X-OTA-Token header.
+// Empty = OTA disabled.
+#ifndef OTA_TOKEN
+#define OTA_TOKEN ""
+#endif
+
+// An unfinished upload is dropped after this long without data
+#ifndef OTA_SESSION_TIMEOUT_MS
+#define OTA_SESSION_TIMEOUT_MS 600000
+#endif
+
+// Pull mode: reconnects after a dropped download, and how long a stalled
+// connection is given before it counts as dropped
+#ifndef OTA_PULL_RETRIES
+#define OTA_PULL_RETRIES 5
+#endif
+#ifndef OTA_PULL_STALL_MS
+#define OTA_PULL_STALL_MS 10000
+#endif
+
+// Pull mode runs from loop() a slice at a time: at most this long reading
+// the body per Ota::loop() call, so readings and the other loop() work go
+// on during a download
+#ifndef OTA_PULL_SLICE_MS
+#define OTA_PULL_SLICE_MS 40
+#endif
+
+// A new image must reach WiFi and get one upload through within this time
+// after its first boot, otherwise it is rolled back
+#ifndef OTA_HEALTH_TIMEOUT_MS
+#define OTA_HEALTH_TIMEOUT_MS 300000
+#endif
+
+namespace Ota {
+
+enum State : uint8_t {
+  IDLE,       // nothing in progress
+  RECEIVING,  // session open, image coming in
+  REBOOTING,  // image verified, restarting into it
+  FAILED      // last session failed, see error()
+};
+
+enum Source : uint8_t { SOURCE_NONE, SOURCE_PUSH, SOURCE_PULL };
+
+enum Result : uint8_t {
+  RESULT_OK,
+  RESULT_BAD_OFFSET,  // piece does not continue the session, see received()
+  RESULT_BUSY,        // other session in progress
+  RESULT_FAILED
+};
+
+// Timing of the last update. Kept in RTC memory over the restart, so the
+// new image can report how its own installation went.
+struct Report {
+  uint32_t durationMs;  // first byte until the image was verified
+  uint32_t radioOnMs;   // time the transfer kept the radio awake
+  uint32_t bytesIn;     // image bytes received (compressed)
+  uint32_t bytesOut;    // firmware bytes written to flash
+  uint16_t resumes;     // requests that continued at an offset
+  uint8_t source;       // Source
+  bool compressed;
+};
+
+void begin();  // setup(): check whether this boot is a new image on probation
+void loop();   // pull downloads, the restart after an update, health check
+
+// A pull download is in progress: call loop() often, it does one slice
+bool pulling();
+
+bool authorized(const char* token);
+
+// Push mode: piece of the image starting at byte offset. Offset 0 starts a
+// new session (dropping an unfinished one); firstPiece marks the start of
+// a request body.
+Result upload(size_t offset, const uint8_t* data, size_t len, bool firstPiece);
+// The image is complete: verify it and switch the boot partition
+Result finishUpload();
+
+// Pull mode: schedule a download, run from loop()
+Result requestPull(const char* url);
+
+State state();
+const char* stateName();
+Source source();
+size_t received();   // session bytes in
+size_t written();    // session bytes out
+bool complete();     // compressed image fully received and verified
+const char* error();
+
+bool hasReport();
+const Report& lastReport();
+
+bool pendingVerify();          // running image still on probation
+const char* runningPartition();
+const char* updatePartition();
+
+}  // namespace Ota
+
+#endif
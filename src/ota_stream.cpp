@@ -0,0 +1,226 @@
+#include "ota_stream.h"
+#include <stdlib.h>
+
+static const uint8_t ESP_IMAGE_MAGIC = 0xE9;
+static const uint8_t GZIP_ID1 = 0x1F;
+static const uint8_t GZIP_ID2 = 0x8B;
+static const uint8_t GZIP_DEFLATE = 8;
+
+// gzip header flags
+static const uint8_t FHCRC = 0x02;
+static const uint8_t FEXTRA = 0x04;
+static const uint8_t FNAME = 0x08;
+static const uint8_t FCOMMENT = 0x10;
+static const uint8_t FRESERVED = 0xE0;
+
+// CRC-32 (IEEE, reflected) with a 16-entry table, two steps per byte.
+// Slower than a 1 KB table but plenty against flash write speed.
+static const uint32_t CRC_NIBBLE[16] = {
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len) {
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ CRC_NIBBLE[crc & 0x0F];
+    crc = (crc >> 4) ^ CRC_NIBBLE[crc & 0x0F];
+  }
+  return ~crc;
+}
+
+static uint32_t readLe32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void OtaStream::begin(OtaOutputFn outFn, void* outCtx) {
+  end();
+  out = outFn;
+  ctx = outCtx;
+  state = ST_START;
+  fmt = FORMAT_UNKNOWN;
+  err = nullptr;
+  fieldPos = 0;
+  flags = 0;
+  skip = 0;
+  windowPos = 0;
+  crc = 0;
+  consumed = 0;
+  produced = 0;
+}
+
+void OtaStream::end() {
+  free(inflater);
+  free(window);
+  inflater = nullptr;
+  window = nullptr;
+}
+
+bool OtaStream::fail(const char* message) {
+  if (state != ST_FAILED) err = message;
+  state = ST_FAILED;
+  end();
+  return false;
+}
+
+bool OtaStream::emit(const uint8_t* data, size_t len) {
+  produced += len;
+  if (!out(data, len, ctx)) return fail("write failed");
+  return true;
+}
+
+bool OtaStream::write(const uint8_t* data, size_t len) {
+  if (state == ST_FAILED) return false;
+  consumed += len;
+
+  if (state == ST_START && len > 0) {
+    if (data[0] == ESP_IMAGE_MAGIC) {
+      fmt = FORMAT_RAW;
+      state = ST_RAW;
+    } else if (data[0] == GZIP_ID1) {
+      fmt = FORMAT_GZIP;
+      state = ST_HEADER;
+      // The whole RAM budget of an update, taken once up front
+      inflater = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+      window = (uint8_t*)malloc(WINDOW_SIZE);
+      if (!inflater || !window) return fail("out of memory");
+      tinfl_init(inflater);
+    } else {
+      return fail("unknown image format");
+    }
+  }
+
+  if (state == ST_RAW) {
+    return len == 0 || emit(data, len);
+  }
+
+  size_t pos = 0;
+  while (pos < len) {
+    if (state < ST_BODY) {
+      pos += parseHeader(data + pos, len - pos);
+    } else if (state == ST_BODY) {
+      pos += inflate(data + pos, len - pos);
+    } else if (state == ST_TRAILER) {
+      pos += parseTrailer(data + pos, len - pos);
+    } else if (state == ST_DONE) {
+      return fail("data after end of image");
+    }
+    if (state == ST_FAILED) return false;
+  }
+  return true;
+}
+
+// Header fields are only a few bytes, so they go byte by byte; a piece
+// boundary can fall anywhere in them
+size_t OtaStream::parseHeader(const uint8_t* data, size_t len) {
+  size_t i = 0;
+  while (i < len && state < ST_BODY) {
+    uint8_t b = data[i++];
+    switch (state) {
+      case ST_HEADER:
+        field[fieldPos++] = b;
+        if (fieldPos < 10) break;
+        if (field[1] != GZIP_ID2 || field[2] != GZIP_DEFLATE || (field[3] & FRESERVED)) {
+          fail("bad gzip header");
+          return i;
+        }
+        flags = field[3];
+        nextHeaderField();
+        break;
+      case ST_EXTRA_LEN:
+        field[fieldPos++] = b;
+        if (fieldPos < 2) break;
+        skip = field[0] | (field[1] << 8);
+        if (skip > 0) state = ST_SKIP;
+        else nextHeaderField();
+        break;
+      case ST_SKIP:
+        if (--skip == 0) nextHeaderField();
+        break;
+      case ST_NAME:
+      case ST_COMMENT:
+        if (b == 0) nextHeaderField();
+        break;
+      default:
+        break;
+    }
+  }
+  return i;
+}
+
+void OtaStream::nextHeaderField() {
+  fieldPos = 0;
+  if (flags & FEXTRA) {
+    flags &= ~FEXTRA;
+    state = ST_EXTRA_LEN;
+  } else if (flags & FNAME) {
+    flags &= ~FNAME;
+    state = ST_NAME;
+  } else if (flags & FCOMMENT) {
+    flags &= ~FCOMMENT;
+    state = ST_COMMENT;
+  } else if (flags & FHCRC) {
+    flags &= ~FHCRC;
+    skip = 2;
+    state = ST_SKIP;
+  } else {
+    state = ST_BODY;
+  }
+}
+
+size_t OtaStream::inflate(const uint8_t* data, size_t len) {
+  size_t used = 0;
+  for (;;) {
+    size_t inBytes = len - used;
+    size_t outBytes = WINDOW_SIZE - windowPos;
+    tinfl_status status = tinfl_decompress(inflater, data + used, &inBytes, window,
+                                           window + windowPos, &outBytes,
+                                           TINFL_FLAG_HAS_MORE_INPUT);
+    used += inBytes;
+
+    if (outBytes > 0) {
+      crc = crc32Update(crc, window + windowPos, outBytes);
+      if (!emit(window + windowPos, outBytes)) return used;
+      windowPos = (windowPos + outBytes) & (WINDOW_SIZE - 1);
+    }
+
+    if (status == TINFL_STATUS_DONE) {
+      // Deflate data ends here; what is left of the input is the trailer
+      end();
+      state = ST_TRAILER;
+      fieldPos = 0;
+      return used;
+    }
+    if (status < 0) {
+      fail("corrupt deflate data");
+      return used;
+    }
+    if (status == TINFL_STATUS_NEEDS_MORE_INPUT) return used;
+    // TINFL_STATUS_HAS_MORE_OUTPUT: window full, go round again
+  }
+}
+
+size_t OtaStream::parseTrailer(const uint8_t* data, size_t len) {
+  size_t n = 8 - fieldPos;
+  if (n > len) n = len;
+  memcpy(field + fieldPos, data, n);
+  fieldPos += n;
+  if (fieldPos == 8) {
+    if (readLe32(field) != crc) {
+      fail("CRC mismatch");
+    } else if (readLe32(field + 4) != (uint32_t)produced) {
+      fail("length mismatch");
+    } else {
+      state = ST_DONE;
+    }
+  }
+  return n;
+}
+
+bool OtaStream::finish() {
+  if (state == ST_FAILED) return false;
+  if (state == ST_RAW && produced > 0) return true;
+  if (state == ST_DONE) return true;
+  return fail("image truncated");
+}
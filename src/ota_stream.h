@@ -0,0 +1,78 @@
+#ifndef OTA_STREAM_H
+#define OTA_STREAM_H
+
+#include <Arduino.h>
+#include <rom/miniz.h>
+
+// Decompress-and-verify stage of the OTA pipeline. The image goes in as it
+// arrives from the network, in pieces of any size; firmware bytes come out
+// through a callback. gzip images (RFC 1952) are inflated with the ROM
+// inflater through a fixed 32 KB window and checked against their CRC-32
+// and length trailer. Plain .bin images (magic 0xE9) pass straight through.
+// No flash or network access in here, so it runs unchanged on the host.
+
+// Receives the decompressed image in order. Return false to abort.
+typedef bool (*OtaOutputFn)(const uint8_t* data, size_t len, void* ctx);
+
+class OtaStream {
+public:
+  enum Format : uint8_t { FORMAT_UNKNOWN, FORMAT_RAW, FORMAT_GZIP };
+
+  // Inflate dictionary; also the largest piece handed to the output
+  static const size_t WINDOW_SIZE = TINFL_LZ_DICT_SIZE;
+
+  OtaStream() {}
+  ~OtaStream() { end(); }
+
+  void begin(OtaOutputFn out, void* ctx);
+
+  // Next bytes of the image. false once the stream has failed.
+  bool write(const uint8_t* data, size_t len);
+
+  // All input given: true if a complete, intact image came out
+  bool finish();
+
+  // Releases the window; safe to call more than once
+  void end();
+
+  Format format() const { return fmt; }
+  bool failed() const { return state == ST_FAILED; }
+  bool done() const { return state == ST_DONE; }  // gzip trailer checked
+  size_t bytesIn() const { return consumed; }
+  size_t bytesOut() const { return produced; }
+  const char* error() const { return err; }
+
+private:
+  enum State : uint8_t {
+    ST_START, ST_HEADER, ST_EXTRA_LEN, ST_SKIP, ST_NAME, ST_COMMENT,
+    ST_BODY, ST_TRAILER, ST_DONE, ST_RAW, ST_FAILED
+  };
+
+  bool fail(const char* message);
+  size_t parseHeader(const uint8_t* data, size_t len);
+  void nextHeaderField();
+  size_t inflate(const uint8_t* data, size_t len);
+  size_t parseTrailer(const uint8_t* data, size_t len);
+  bool emit(const uint8_t* data, size_t len);
+
+  OtaOutputFn out = nullptr;
+  void* ctx = nullptr;
+  State state = ST_START;
+  Format fmt = FORMAT_UNKNOWN;
+  const char* err = nullptr;
+
+  uint8_t field[10];    // gzip header / trailer bytes being collected
+  uint8_t fieldPos = 0;
+  uint8_t flags = 0;    // header fields still to skip
+  uint16_t skip = 0;
+
+  tinfl_decompressor* inflater = nullptr;
+  uint8_t* window = nullptr;
+  size_t windowPos = 0;
+
+  uint32_t crc = 0;
+  size_t consumed = 0;
+  size_t produced = 0;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <Arduino.h>
+
+// Compile-time measurement pipeline: a source produces one Reading, then
+// every stage sees it in order. Like FilterChain in adc_filter.h, stages
+// are stored inline and called directly (no virtual calls, no heap), so
+// the compiler can inline the whole chain into the caller.
+//
+// A source is any class with
+//   bool read(Reading& r);     // false = nothing this time
+//   void reset();
+// and a stage any class with
+//   bool process(Reading& r);  // false = stop here for this reading
+//   void reset();
+// Sinks are stages that always return true, so the ones after them still
+// see the reading. Stages only pass data through the Reading, and each
+// one sets every field it owns on every call (the Reading is not cleared
+// in between); swapping, adding or reordering them is a change to the
+// Pipeline<...> type.
+
+// One reading as it moves through the pipeline
+struct Reading {
+  uint32_t timeMs;  // millis() at the end of the burst
+  int32_t raw;      // filtered ADC code
+  int32_t peak;     // highest code of the burst
+  uint8_t adcRange;
+  float adcVolts;   // at the S pin
+  float volts;      // at the module input
+  bool published;   // a window was closed and handed to the sinks
+  uint32_t windowStartMs;  // millis() when the send window in progress began
+};
+
+// Stages applied left to right
+template <typename... Stages>
+class StageList;
+
+template <>
+class StageList<> {
+public:
+  static constexpr size_t COUNT = 0;
+
+  bool process(Reading&) { return true; }
+  void reset() {}
+};
+
+template <typename First, typename... Rest>
+class StageList<First, Rest...> {
+public:
+  static constexpr size_t COUNT = 1 + sizeof...(Rest);
+
+  StageList() {}
+  StageList(const First& f, const Rest&... r) : first(f), rest(r...) {}
+
+  bool process(Reading& r) {
+    if (!first.process(r)) return false;
+    return rest.process(r);
+  }
+
+  void reset() {
+    first.reset();
+    rest.reset();
+  }
+
+  First& head() { return first; }
+  StageList<Rest...>& tail() { return rest; }
+
+private:
+  First first;
+  StageList<Rest...> rest;
+};
+
+template <typename Source, typename... Stages>
+class Pipeline {
+public:
+  static constexpr size_t STAGES = sizeof...(Stages);
+
+  Pipeline() {}
+  Pipeline(const Source& src, const Stages&... st) : source(src), stages(st...) {}
+
+  // One reading from the source through every stage. Returns true if it
+  // made it past the last one.
+  bool step(Reading& r) {
+    if (!source.read(r)) return false;
+    return stages.process(r);
+  }
+
+  bool step() {
+    Reading r = Reading();
+    return step(r);
+  }
+
+  // Clears filter windows and counters in place, e.g. after a
+  // configuration change; nothing is allocated or freed
+  void reset() {
+    source.reset();
+    stages.reset();
+  }
+
+  Source& input() { return source; }
+  StageList<Stages...>& chain() { return stages; }
+
+private:
+  Source source;
+  StageList<Stages...> stages;
+};
+
+#endif
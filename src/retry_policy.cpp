@@ -0,0 +1,88 @@
+#include "retry_policy.h"
+
+RetryPolicy::RetryPolicy()
+    : breaker(BREAKER_CLOSED), probing(false), lastDelay(TELEMETRY_RETRY_MIN_MS),
+      openFor(TELEMETRY_BREAKER_OPEN_MS), nextAttempt(0), failures(0), opens(0), blocked(0) {}
+
+RetryPolicy::ErrorClass RetryPolicy::classify(int httpCode) {
+  if (httpCode >= 200 && httpCode < 300) return ERROR_NONE;
+  if (httpCode == 401 || httpCode == 403) return ERROR_AUTH;
+  if (httpCode == 408 || httpCode == 425 || httpCode == 429) return ERROR_TRANSIENT;
+  if (httpCode >= 400 && httpCode < 500) return ERROR_PERMANENT;
+  return ERROR_TRANSIENT;  // transport errors (< 0), 5xx, anything odd
+}
+
+const char* RetryPolicy::className(ErrorClass cls) {
+  static const char* const NAMES[] = {"none", "transient", "auth", "permanent"};
+  return NAMES[cls];
+}
+
+const char* RetryPolicy::stateName() const {
+  static const char* const NAMES[] = {"closed", "open", "half-open"};
+  return NAMES[breaker];
+}
+
+unsigned long RetryPolicy::jitter(unsigned long low, unsigned long high) {
+  if (high <= low) return low;
+  return low + esp_random() % (high - low + 1);
+}
+
+unsigned long RetryPolicy::retryInMs() const {
+  if (nextAttempt == 0) return 0;
+  long left = (long)(nextAttempt - millis());
+  return left > 0 ? left : 0;
+}
+
+bool RetryPolicy::allow() {
+  if (nextAttempt != 0 && (long)(millis() - nextAttempt) < 0) {
+    if (breaker == BREAKER_OPEN) blocked++;
+    return false;
+  }
+  if (breaker == BREAKER_OPEN) {
+    breaker = BREAKER_HALF_OPEN;
+    probing = false;
+  }
+  if (breaker == BREAKER_HALF_OPEN) {
+    if (probing) return false;
+    probing = true;
+  }
+  return true;
+}
+
+void RetryPolicy::onSuccess() {
+  breaker = BREAKER_CLOSED;
+  probing = false;
+  failures = 0;
+  lastDelay = TELEMETRY_RETRY_MIN_MS;
+  openFor = TELEMETRY_BREAKER_OPEN_MS;
+  nextAttempt = 0;
+}
+
+void RetryPolicy::onFailure(ErrorClass cls) {
+  failures++;
+  unsigned long wait;
+
+  if (breaker == BREAKER_HALF_OPEN) {
+    // Probe failed: back to open, for longer
+    openFor *= 2;
+    if (openFor > TELEMETRY_BREAKER_OPEN_MAX_MS) openFor = TELEMETRY_BREAKER_OPEN_MAX_MS;
+    breaker = BREAKER_OPEN;
+    probing = false;
+    opens++;
+    wait = jitter(openFor / 2, openFor);
+  } else if (failures >= TELEMETRY_BREAKER_THRESHOLD) {
+    breaker = BREAKER_OPEN;
+    opens++;
+    wait = jitter(openFor / 2, openFor);
+  } else if (cls == ERROR_AUTH && failures == 1) {
+    // A fresh token usually fixes it; don't make the data wait
+    wait = jitter(TELEMETRY_RETRY_MIN_MS / 5, TELEMETRY_RETRY_MIN_MS);
+  } else {
+    wait = jitter(TELEMETRY_RETRY_MIN_MS, lastDelay * 3);
+    if (wait > TELEMETRY_RETRY_MAX_MS) wait = TELEMETRY_RETRY_MAX_MS;
+    lastDelay = wait;
+  }
+
+  nextAttempt = millis() + wait;
+  if (nextAttempt == 0) nextAttempt = 1;
+}
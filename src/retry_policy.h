@@ -0,0 +1,58 @@
+#ifndef RETRY_POLICY_H
+#define RETRY_POLICY_H
+
+#include <Arduino.h>
+#include "telemetry_config.h"
+
+// When to try an upload again. Failures are classified by their HTTP code;
+// transient ones back off with decorrelated jitter (AWS style: the next
+// delay is random between the base and 3x the last one), so a fleet that
+// lost its backend at the same moment does not come back in lockstep.
+// After TELEMETRY_BREAKER_THRESHOLD failures in a row the circuit breaker
+// opens and no attempts are made at all; when the open period is over a
+// single probe is let through (half-open), which either closes the breaker
+// or opens it again for twice as long.
+class RetryPolicy {
+public:
+  enum ErrorClass : uint8_t {
+    ERROR_NONE,       // 2xx
+    ERROR_TRANSIENT,  // transport errors, 408, 429, 5xx: back off and retry
+    ERROR_AUTH,       // 401/403: sign in again, retry soon
+    ERROR_PERMANENT   // other 4xx: the request itself is bad, retrying won't help
+  };
+
+  enum BreakerState : uint8_t { BREAKER_CLOSED, BREAKER_OPEN, BREAKER_HALF_OPEN };
+
+  RetryPolicy();
+
+  static ErrorClass classify(int httpCode);
+  static const char* className(ErrorClass cls);
+
+  // May an attempt be made now? In half-open state only the first caller
+  // gets the probe. Counts short-circuited calls while open.
+  bool allow();
+
+  void onSuccess();
+  void onFailure(ErrorClass cls);
+
+  BreakerState state() const { return breaker; }
+  const char* stateName() const;
+  unsigned long retryInMs() const;  // 0 if an attempt is allowed now
+  uint32_t consecutiveFailures() const { return failures; }
+  uint32_t breakerOpens() const { return opens; }
+  uint32_t shortCircuits() const { return blocked; }
+
+private:
+  unsigned long jitter(unsigned long low, unsigned long high);
+
+  BreakerState breaker;
+  bool probing;               // half-open probe in flight
+  unsigned long lastDelay;    // previous backoff, for the decorrelated jitter
+  unsigned long openFor;      // current open period
+  unsigned long nextAttempt;  // millis(); 0 = no wait
+  uint32_t failures;
+  uint32_t opens;
+  uint32_t blocked;
+};
+
+#endif
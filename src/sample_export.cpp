@@ -0,0 +1,208 @@
+#include "sample_export.h"
+#include <stdlib.h>
+#include "time_service.h"
+
+namespace {
+  const char CSV_HEADER[] = "uptime_ms,utc,mv\n";
+  const size_t CSV_HEADER_BYTES = sizeof(CSV_HEADER) - 1;
+  const size_t CSV_LINE_BYTES = 29;  // 10 + 1 + 10 + 1 + 6 + 1
+  const size_t BINARY_HEADER_BYTES = 16;
+  const size_t BINARY_RECORD_BYTES = 8;
+  const int32_t CSV_MAX_MV = 99999;
+
+  size_t headerBytes(SampleExport::Format format) {
+    return format == SampleExport::FORMAT_CSV ? CSV_HEADER_BYTES : BINARY_HEADER_BYTES;
+  }
+
+  size_t recordBytes(SampleExport::Format format) {
+    return format == SampleExport::FORMAT_CSV ? CSV_LINE_BYTES : BINARY_RECORD_BYTES;
+  }
+
+  // time in [from, to], also across a millis() wrap
+  bool within(uint32_t time, uint32_t from, uint32_t to) {
+    return time - from <= to - from;
+  }
+
+  void putWord(uint8_t* out, uint32_t word) {
+    for (int i = 0; i < 4; i++) out[i] = (uint8_t)(word >> (8 * i));
+  }
+
+  bool hexField(const char* s, uint32_t& out) {
+    out = 0;
+    for (int i = 0; i < 8; i++) {
+      char c = s[i];
+      uint32_t d;
+      if (c >= '0' && c <= '9') d = c - '0';
+      else if (c >= 'a' && c <= 'f') d = c - 'a' + 10;
+      else return false;
+      out = (out << 4) | d;
+    }
+    return true;
+  }
+
+  // Samples of the plan still stored; false if the store recycled blocks
+  // while they were being counted
+  bool countStored(const SampleStore& store, const SampleExport::Plan& plan, uint32_t& count) {
+    SampleStore::Iterator it = store.from(plan.fromMs);
+    Sample s;
+    count = 0;
+    while (it.next(s) && within(s.time, plan.fromMs, plan.toMs)) count++;
+    return !it.gap();
+  }
+}
+
+namespace SampleExport {
+
+Plan plan(const SampleStore& store, Format format, uint32_t fromMs, uint32_t toMs) {
+  Plan p = {format, fromMs, toMs, 0, 0};
+  SampleStore::Iterator it = store.from(fromMs);
+  Sample s;
+  while (it.next(s) && within(s.time, fromMs, toMs)) {
+    if (p.count == 0) p.fromMs = s.time;
+    p.toMs = s.time;
+    p.count++;
+  }
+  if (p.count > 0) p.anchorUtc = (uint32_t)TimeService::utcFromMillis(p.toMs);
+  return p;
+}
+
+size_t totalBytes(const Plan& plan) {
+  return headerBytes(plan.format) + (size_t)plan.count * recordBytes(plan.format);
+}
+
+void token(const Plan& plan, char* out) {
+  snprintf(out, TOKEN_LEN + 1, "%c%08lx%08lx%08lx%08lx", plan.format == FORMAT_CSV ? 'c' : 'b',
+           (unsigned long)plan.fromMs, (unsigned long)plan.toMs, (unsigned long)plan.count,
+           (unsigned long)plan.anchorUtc);
+}
+
+bool parseToken(const char* s, Plan& out) {
+  if (strlen(s) != TOKEN_LEN || (s[0] != 'c' && s[0] != 'b')) return false;
+  out.format = s[0] == 'c' ? FORMAT_CSV : FORMAT_BINARY;
+  return hexField(s + 1, out.fromMs) && hexField(s + 9, out.toMs) && hexField(s + 17, out.count) &&
+         hexField(s + 25, out.anchorUtc);
+}
+
+bool parseRange(const char* header, size_t total, size_t& start, size_t& end) {
+  if (strncmp(header, "bytes=", 6) != 0 || total == 0) return false;
+  const char* p = header + 6;
+  char* e;
+
+  if (*p == '-') {
+    // Last n bytes
+    unsigned long n = strtoul(p + 1, &e, 10);
+    if (e == p + 1 || *e || n == 0) return false;
+    start = n >= total ? 0 : total - n;
+    end = total;
+    return true;
+  }
+
+  unsigned long first = strtoul(p, &e, 10);
+  if (e == p || *e != '-' || first >= total) return false;
+  p = e + 1;
+  unsigned long last = total - 1;
+  if (*p) {
+    last = strtoul(p, &e, 10);
+    if (e == p || *e || last < first) return false;
+    if (last >= total) last = total - 1;
+  }
+  start = first;
+  end = last + 1;
+  return true;
+}
+
+bool Reader::seek(const SampleStore& store, const Plan& plan, size_t start, size_t endByte) {
+  exported = plan;
+  pos = start;
+  end = endByte;
+  batched = 0;
+  cut = false;
+
+  // Blocks only ever go from the old end, so samples missing now are the
+  // first ones of the plan
+  uint32_t stored;
+  if (!countStored(store, plan, stored) || stored > plan.count) return false;
+  size_t missing = plan.count - stored;
+
+  const size_t header = headerBytes(plan.format);
+  size_t record = start < header ? 0 : (start - header) / recordBytes(plan.format);
+  if (start < end && end > header && record < missing) return false;
+
+  it = store.from(plan.fromMs);
+  first = missing;
+  while (first < record) {
+    size_t skip = record - first < BATCH ? record - first : BATCH;
+    size_t n = it.read(batch, skip);
+    if (n == 0 || it.gap()) return false;
+    first += n;
+  }
+  return true;
+}
+
+bool Reader::fill() {
+  first += batched;
+  batched = it.read(batch, BATCH);
+  if (it.gap()) batched = 0;
+  // Samples that came in after the export started are not part of it
+  for (size_t i = 0; i < batched; i++) {
+    if (!within(batch[i].time, exported.fromMs, exported.toMs)) batched = i;
+  }
+  if (batched == 0) {
+    // Nothing more can be sent right
+    cut = pos < end;
+    end = pos;
+  }
+  return batched > 0;
+}
+
+size_t Reader::render(size_t record, uint8_t* out) {
+  const Sample& s = batch[record - first];
+  if (exported.format == FORMAT_BINARY) {
+    putWord(out, s.time);
+    putWord(out + 4, (uint32_t)s.value);
+    return BINARY_RECORD_BYTES;
+  }
+  uint32_t utc = exported.anchorUtc ? exported.anchorUtc - (exported.toMs - s.time) / 1000 : 0;
+  int32_t mv = s.value > CSV_MAX_MV ? CSV_MAX_MV : s.value < -CSV_MAX_MV ? -CSV_MAX_MV : s.value;
+  char line[CSV_LINE_BYTES + 1];
+  snprintf(line, sizeof(line), "%010lu,%010lu,%+06ld\n", (unsigned long)s.time, (unsigned long)utc, (long)mv);
+  memcpy(out, line, CSV_LINE_BYTES);
+  return CSV_LINE_BYTES;
+}
+
+size_t Reader::read(uint8_t* buf, size_t maxLen) {
+  const size_t header = headerBytes(exported.format);
+  const size_t width = recordBytes(exported.format);
+  size_t written = 0;
+
+  while (written < maxLen && pos < end) {
+    uint8_t piece[CSV_LINE_BYTES];
+    size_t len, offset;
+    if (pos < header) {
+      if (exported.format == FORMAT_CSV) {
+        memcpy(piece, CSV_HEADER, CSV_HEADER_BYTES);
+      } else {
+        memcpy(piece, "VLX1", 4);
+        putWord(piece + 4, exported.count);
+        putWord(piece + 8, exported.anchorUtc);
+        putWord(piece + 12, exported.toMs);
+      }
+      len = header;
+      offset = pos;
+    } else {
+      size_t record = (pos - header) / width;
+      if (record >= first + batched && !fill()) break;
+      len = render(record, piece);
+      offset = (pos - header) % width;
+    }
+    size_t take = len - offset;
+    if (take > end - pos) take = end - pos;
+    if (take > maxLen - written) take = maxLen - written;
+    memcpy(buf + written, piece + offset, take);
+    written += take;
+    pos += take;
+  }
+  return written;
+}
+
+}  // namespace SampleExport
@@ -0,0 +1,100 @@
+#ifndef SAMPLE_EXPORT_H
+#define SAMPLE_EXPORT_H
+
+#include <Arduino.h>
+#include "sample_store.h"
+
+// Bulk export of the sample history (/export), for pulling the readings
+// over the AP link when the uplink has been down. The export is rendered
+// straight from the compressed store into the response buffer, a few
+// samples at a time, so RAM use does not depend on its length.
+//
+// Every record has the same width, so the byte length is known before the
+// first byte goes out and a byte offset maps to one record: that is what
+// makes HTTP Range work. The range of samples and the UTC mapping are
+// fixed when an export starts and returned as a token; asking again with
+// the token and a Range gives exactly the bytes the first response would
+// have had there, however many samples came in since.
+//
+// CSV: header line, then one line per sample
+//   uptime_ms,utc,mv
+//   0000012345,1760000000,+12340
+// Binary, little endian:
+//   offset  size  content
+//   0       4     "VLX1"
+//   4       4     uint32 n, samples that follow
+//   8       4     uint32 UTC of the last sample, epoch s (0 = not synced)
+//   12      4     uint32 uptime of the last sample, ms
+//   16      8n    uint32 uptime ms, int32 mV of each sample
+// In both, the UTC of a sample is the last sample's UTC minus its age
+// relative to it, in whole seconds. The ms and mV fields carry the store's
+// values, not the readings: within half a SAMPLE_STORE_TIME_RES_MS (1 s)
+// and SAMPLE_STORE_VALUE_RES_MV (10 mV) step of them, the first sample of
+// each block exact.
+
+namespace SampleExport {
+
+enum Format : uint8_t {
+  FORMAT_CSV,
+  FORMAT_BINARY
+};
+
+// What an export covers, fixed at its start
+struct Plan {
+  Format format;
+  uint32_t fromMs;     // first and last sample, millis()
+  uint32_t toMs;
+  uint32_t count;      // samples in between, both included
+  uint32_t anchorUtc;  // UTC of the last sample, 0 = not synced
+};
+
+// "c" or "b" and four 8-digit hex fields
+static const size_t TOKEN_LEN = 33;
+
+// Samples now stored at or after fromMs and at or before toMs
+Plan plan(const SampleStore& store, Format format, uint32_t fromMs, uint32_t toMs);
+
+size_t totalBytes(const Plan& plan);
+
+// out gets TOKEN_LEN characters and a NUL
+void token(const Plan& plan, char* out);
+bool parseToken(const char* s, Plan& out);
+
+// One "bytes=first-last" / "bytes=first-" / "bytes=-suffix" range of a
+// body of total bytes, as [start, end). False if it can't be satisfied.
+bool parseRange(const char* header, size_t total, size_t& start, size_t& end);
+
+// Renders bytes [start, end) of an export
+class Reader {
+public:
+  // False if samples in the requested part have been recycled since the
+  // export started
+  bool seek(const SampleStore& store, const Plan& plan, size_t start, size_t end);
+
+  // Next bytes; 0 at the end, and also when samples still to be sent get
+  // recycled under the reader (the response then ends short and the
+  // client resumes, or finds that part gone)
+  size_t read(uint8_t* buf, size_t maxLen);
+
+  // read() stopped before the end passed to seek()
+  bool cutShort() const { return cut; }
+
+private:
+  static const size_t BATCH = 16;
+
+  bool fill();
+  size_t render(size_t record, uint8_t* out);
+
+  Plan exported;
+  SampleStore::Iterator it;
+  size_t pos = 0;        // byte of the export read() continues at
+  size_t end = 0;
+  size_t first = 0;      // record of batch[0]
+  size_t batched = 0;
+  bool cut = false;
+  Sample batch[BATCH];
+};
+
+}  // namespace SampleExport
+
+#endif
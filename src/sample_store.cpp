@@ -0,0 +1,267 @@
+#include "sample_store.h"
+
+static const uint32_t BLOCK_BITS = SAMPLE_STORE_BLOCK_BYTES * 8;
+static_assert(BLOCK_BITS <= UINT16_MAX, "block bit count must fit SampleBlock::bits");
+
+// Field widths of the variable-length codes. A zero is the single bit 0;
+// otherwise '10', '110', '1110' or '1111' pick one of the widths, and the
+// zigzagged value follows. In resolution steps, the delta-of-delta of a
+// steady reading period is 0 or +-1 and the filtered voltage mostly moves
+// by a step or two.
+#ifndef SAMPLE_STORE_TIME_WIDTHS
+#define SAMPLE_STORE_TIME_WIDTHS {2, 6, 16, 32}
+#endif
+#ifndef SAMPLE_STORE_VALUE_WIDTHS
+#define SAMPLE_STORE_VALUE_WIDTHS {2, 5, 12, 32}
+#endif
+static const uint8_t TIME_WIDTHS[4] = SAMPLE_STORE_TIME_WIDTHS;
+static const uint8_t VALUE_WIDTHS[4] = SAMPLE_STORE_VALUE_WIDTHS;
+
+static inline uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t z) {
+  return (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+}
+
+// Deltas are rounded to the resolution against the reconstructed previous
+// sample, so the error stays within half a step instead of adding up
+static inline int32_t steps(int32_t diff, int32_t resolution) {
+  return diff >= 0 ? (diff + resolution / 2) / resolution : -((-diff + resolution / 2) / resolution);
+}
+
+static uint8_t codeBits(const uint8_t* widths, uint32_t z) {
+  if (z == 0) return 1;
+  for (uint8_t k = 0; k < 3; k++) {
+    if (z < (1UL << widths[k])) return k + 2 + widths[k];
+  }
+  return 4 + widths[3];
+}
+
+// MSB first; the block is zeroed when it is started, so bits are OR'ed in
+static void putBits(uint8_t* data, uint16_t& pos, uint32_t value, uint8_t n) {
+  while (n > 0) {
+    uint8_t space = 8 - (pos & 7);
+    uint8_t take = n < space ? n : space;
+    uint8_t chunk = (value >> (n - take)) & ((1U << take) - 1);
+    data[pos >> 3] |= chunk << (space - take);
+    pos += take;
+    n -= take;
+  }
+}
+
+static uint32_t getBits(const uint8_t* data, uint16_t& pos, uint8_t n) {
+  uint32_t value = 0;
+  while (n > 0) {
+    uint8_t avail = 8 - (pos & 7);
+    uint8_t take = n < avail ? n : avail;
+    uint8_t chunk = (data[pos >> 3] >> (avail - take)) & ((1U << take) - 1);
+    value = (value << take) | chunk;
+    pos += take;
+    n -= take;
+  }
+  return value;
+}
+
+static void putCode(uint8_t* data, uint16_t& pos, const uint8_t* widths, uint32_t z) {
+  if (z == 0) {
+    putBits(data, pos, 0, 1);
+    return;
+  }
+  for (uint8_t k = 0; k < 3; k++) {
+    if (z < (1UL << widths[k])) {
+      putBits(data, pos, ((1U << (k + 1)) - 1) << 1, k + 2);
+      putBits(data, pos, z, widths[k]);
+      return;
+    }
+  }
+  putBits(data, pos, 0x0F, 4);
+  putBits(data, pos, z, widths[3]);
+}
+
+static uint32_t getCode(const uint8_t* data, uint16_t& pos, const uint8_t* widths) {
+  if (!getBits(data, pos, 1)) return 0;
+  for (uint8_t k = 0; k < 3; k++) {
+    if (!getBits(data, pos, 1)) return getBits(data, pos, widths[k]);
+  }
+  return getBits(data, pos, widths[3]);
+}
+
+void SampleStore::clear() {
+  std::lock_guard<std::mutex> guard(lock);
+  nextId = 0;
+  used = 0;
+  sampleCount = 0;
+  totalBits = 0;
+  droppedCount = 0;
+  prevTime = 0;
+  prevDelta = 0;
+  prevValue = 0;
+}
+
+SampleBlock& SampleStore::startBlock() {
+  SampleBlock& b = slot(nextId);
+  if (used == SAMPLE_STORE_BLOCKS) {
+    // Ring full: the oldest block goes
+    sampleCount -= b.count;
+    totalBits -= HEADER_BYTES * 8 + b.bits;
+    droppedCount += b.count;
+  } else {
+    used++;
+  }
+  b.id = nextId++;
+  b.count = 0;
+  b.bits = 0;
+  memset(b.data, 0, sizeof(b.data));
+  totalBits += HEADER_BYTES * 8;
+  return b;
+}
+
+void SampleStore::append(uint32_t time, int32_t value) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  if (used > 0) {
+    SampleBlock& b = slot(nextId - 1);
+    int32_t delta = steps((int32_t)(time - prevTime), SAMPLE_STORE_TIME_RES_MS);
+    int32_t change = steps(value - prevValue, SAMPLE_STORE_VALUE_RES_MV);
+    uint32_t zt = zigzag(delta - prevDelta);
+    uint32_t zv = zigzag(change);
+    uint32_t need = codeBits(TIME_WIDTHS, zt) + codeBits(VALUE_WIDTHS, zv);
+    if (b.bits + need <= BLOCK_BITS && b.count < UINT16_MAX) {
+      putCode(b.data, b.bits, TIME_WIDTHS, zt);
+      putCode(b.data, b.bits, VALUE_WIDTHS, zv);
+      b.count++;
+      prevTime += delta * SAMPLE_STORE_TIME_RES_MS;
+      prevDelta = delta;
+      prevValue += change * SAMPLE_STORE_VALUE_RES_MV;
+      b.lastTime = prevTime;
+      sampleCount++;
+      totalBits += need;
+      return;
+    }
+  }
+
+  // First sample of a new block, stored in the header
+  SampleBlock& b = startBlock();
+  b.firstTime = time;
+  b.lastTime = time;
+  b.firstValue = value;
+  b.count = 1;
+  prevTime = time;
+  prevDelta = 0;
+  prevValue = value;
+  sampleCount++;
+}
+
+SampleStore::Iterator SampleStore::begin() const {
+  std::lock_guard<std::mutex> guard(lock);
+  Iterator it;
+  it.store = this;
+  it.blockId = oldestId();
+  return it;
+}
+
+SampleStore::Iterator SampleStore::from(uint32_t time) const {
+  std::lock_guard<std::mutex> guard(lock);
+  Iterator it;
+  it.store = this;
+  it.blockId = oldestId();
+  it.skipping = true;
+  it.skipUntil = time;
+  if (used == 0) return it;
+
+  // Last block starting at or before time; times relative to the oldest
+  // block so a millis() wrap inside the ring still sorts right
+  uint32_t base = slot(oldestId()).firstTime;
+  if ((int32_t)(time - base) < 0) return it;  // before the oldest: all of it
+  uint32_t key = time - base;
+  size_t lo = 0, hi = used;
+  while (hi - lo > 1) {
+    size_t mid = (lo + hi) / 2;
+    if (slot(oldestId() + mid).firstTime - base <= key) lo = mid;
+    else hi = mid;
+  }
+  it.blockId = oldestId() + lo;
+  return it;
+}
+
+size_t SampleStore::Iterator::read(Sample* out, size_t max) {
+  if (!store) return 0;
+  std::lock_guard<std::mutex> guard(store->lock);
+
+  size_t n = 0;
+  while (n < max && store->used > 0) {
+    if ((int32_t)(blockId - store->oldestId()) < 0) {
+      // Recycled while we were away
+      blockId = store->oldestId();
+      index = 0;
+      skipped = true;
+    }
+    const SampleBlock& b = store->slot(blockId);
+    if (index >= b.count) {
+      if (blockId + 1 == store->nextId) break;  // caught up with the newest block
+      blockId++;
+      index = 0;
+      continue;
+    }
+
+    uint32_t t;
+    int32_t v;
+    if (index == 0) {
+      t = b.firstTime;
+      v = b.firstValue;
+      bitPos = 0;
+      prevDelta = 0;
+    } else {
+      prevDelta += unzigzag(getCode(b.data, bitPos, TIME_WIDTHS));
+      t = prevTime + prevDelta * SAMPLE_STORE_TIME_RES_MS;
+      v = prevValue + unzigzag(getCode(b.data, bitPos, VALUE_WIDTHS)) * SAMPLE_STORE_VALUE_RES_MV;
+    }
+    prevTime = t;
+    prevValue = v;
+    index++;
+
+    if (skipping) {
+      if ((int32_t)(t - skipUntil) < 0) continue;
+      skipping = false;
+    }
+    out[n].time = t;
+    out[n].value = v;
+    n++;
+  }
+  return n;
+}
+
+size_t SampleStore::samples() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return sampleCount;
+}
+
+size_t SampleStore::blocks() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return used;
+}
+
+size_t SampleStore::bitsUsed() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return totalBits;
+}
+
+float SampleStore::bitsPerSample() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return sampleCount ? (float)totalBits / sampleCount : 0.0f;
+}
+
+uint32_t SampleStore::dropped() const {
+  std::lock_guard<std::mutex> guard(lock);
+  return droppedCount;
+}
+
+bool SampleStore::span(uint32_t& oldest, uint32_t& newest) const {
+  std::lock_guard<std::mutex> guard(lock);
+  if (used == 0) return false;
+  oldest = slot(oldestId()).firstTime;
+  newest = slot(nextId - 1).lastTime;
+  return true;
+}
@@ -0,0 +1,115 @@
+#ifndef SAMPLE_STORE_H
+#define SAMPLE_STORE_H
+
+#include <Arduino.h>
+#include <mutex>
+
+// Compressed in-RAM history of readings, Gorilla style. Samples go into
+// fixed-size blocks; each block starts with its first sample in the clear
+// and codes the rest as delta-of-delta timestamps and value deltas in
+// variable-length bit fields. Regular readings of a slowly moving voltage
+// cost a few bits each instead of 8 bytes. Blocks decode independently,
+// so a scan can start at any block, and the oldest block is recycled when
+// the ring is full.
+
+// Stored resolution. Samples come back within half a step of what went
+// in; the first sample of each block is exact.
+#ifndef SAMPLE_STORE_TIME_RES_MS
+#define SAMPLE_STORE_TIME_RES_MS 1000
+#endif
+#ifndef SAMPLE_STORE_VALUE_RES_MV
+#define SAMPLE_STORE_VALUE_RES_MV 10
+#endif
+
+// Payload bytes per block
+#ifndef SAMPLE_STORE_BLOCK_BYTES
+#define SAMPLE_STORE_BLOCK_BYTES 256
+#endif
+
+// Blocks in the ring; RAM use is about (BLOCK_BYTES + 20) * BLOCKS
+#ifndef SAMPLE_STORE_BLOCKS
+#define SAMPLE_STORE_BLOCKS 32
+#endif
+
+struct Sample {
+  uint32_t time;  // millis()
+  int32_t value;  // mV
+};
+
+struct SampleBlock {
+  uint32_t id;          // sequence number, tells a recycled slot apart
+  uint32_t firstTime;
+  uint32_t lastTime;
+  int32_t firstValue;
+  uint16_t count;       // samples, including the first
+  uint16_t bits;        // payload bits used
+  uint8_t data[SAMPLE_STORE_BLOCK_BYTES];
+};
+
+class SampleStore {
+public:
+  // Forward scan from a position in the store. Copies are independent.
+  // An iterator whose block gets recycled under it continues at the
+  // oldest sample still stored and reports it with gap(); at the end it
+  // picks up new samples on the next read().
+  class Iterator {
+  public:
+    // Up to max samples in time order; 0 when there are no more (yet)
+    size_t read(Sample* out, size_t max);
+    bool next(Sample& out) { return read(&out, 1) == 1; }
+
+    // Samples may have been skipped because their block was recycled
+    bool gap() const { return skipped; }
+
+  private:
+    friend class SampleStore;
+    const SampleStore* store = nullptr;
+    uint32_t blockId = 0;
+    uint16_t index = 0;      // next sample in the block
+    uint16_t bitPos = 0;
+    uint32_t prevTime = 0;
+    int32_t prevDelta = 0;
+    int32_t prevValue = 0;
+    bool skipping = false;   // drop samples before skipUntil
+    uint32_t skipUntil = 0;
+    bool skipped = false;
+  };
+
+  static const size_t HEADER_BYTES = sizeof(SampleBlock) - SAMPLE_STORE_BLOCK_BYTES;
+
+  SampleStore() { clear(); }
+
+  void append(uint32_t time, int32_t value);
+  void clear();
+
+  Iterator begin() const;              // oldest sample
+  Iterator from(uint32_t time) const;  // first sample at or after time
+
+  size_t samples() const;
+  size_t blocks() const;        // blocks in use
+  size_t bitsUsed() const;      // payload plus block headers
+  float bitsPerSample() const;
+  uint32_t dropped() const;     // samples lost to block recycling
+  bool span(uint32_t& oldest, uint32_t& newest) const;  // false if empty
+
+private:
+  SampleBlock& slot(uint32_t id) { return ring[id % SAMPLE_STORE_BLOCKS]; }
+  const SampleBlock& slot(uint32_t id) const { return ring[id % SAMPLE_STORE_BLOCKS]; }
+  uint32_t oldestId() const { return nextId - used; }
+  SampleBlock& startBlock();
+
+  mutable std::mutex lock;
+  SampleBlock ring[SAMPLE_STORE_BLOCKS];
+  uint32_t nextId;
+  size_t used;
+  size_t sampleCount;
+  size_t totalBits;
+  uint32_t droppedCount;
+
+  // Encoder state of the newest block
+  uint32_t prevTime;
+  int32_t prevDelta;
+  int32_t prevValue;
+};
+
+#endif
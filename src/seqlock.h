@@ -0,0 +1,65 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <string.h>
+#include <type_traits>
+
+// Single-writer sequence lock around a plain struct. The writer publishes
+// a whole new value without taking a lock; readers copy it out and retry
+// if a write overlapped, so they always get one consistent version.
+//
+// The value lives in 32-bit atomic words (native on the C3), which keeps
+// the concurrent copy well-defined. On a single core a reader can preempt
+// the writer half way through a write; after a few spins it sleeps for a
+// tick so the (lower priority) writer gets to finish.
+template <typename T>
+class SeqLock {
+  static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs a trivially copyable type");
+
+public:
+  SeqLock() : seq(0) {
+    for (size_t i = 0; i < WORDS; i++) words[i].store(0, std::memory_order_relaxed);
+  }
+
+  // Only one thread may write
+  void write(const T& value) {
+    uint32_t buf[WORDS] = {};
+    memcpy(buf, &value, sizeof(T));
+
+    uint32_t s = seq.load(std::memory_order_relaxed);
+    seq.store(s + 1, std::memory_order_relaxed);  // odd: write in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WORDS; i++) words[i].store(buf[i], std::memory_order_relaxed);
+    seq.store(s + 2, std::memory_order_release);
+  }
+
+  T read() const {
+    uint32_t buf[WORDS];
+    for (uint32_t attempt = 1;; attempt++) {
+      uint32_t before = seq.load(std::memory_order_acquire);
+      if ((before & 1) == 0) {
+        for (size_t i = 0; i < WORDS; i++) buf[i] = words[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq.load(std::memory_order_relaxed) == before) break;
+      }
+      if (attempt % SPINS == 0) delay(1);
+    }
+    T value;
+    memcpy(&value, buf, sizeof(T));
+    return value;
+  }
+
+  // Writes so far
+  uint32_t version() const { return seq.load(std::memory_order_acquire) / 2; }
+
+private:
+  static const size_t WORDS = (sizeof(T) + 3) / 4;
+  static const uint32_t SPINS = 16;
+
+  std::atomic<uint32_t> seq;
+  std::atomic<uint32_t> words[WORDS];
+};
+
+#endif
@@ -0,0 +1,209 @@
+#include "serial_log.h"
+#include <atomic>
+#include <stdarg.h>
+#include "metrics.h"
+
+#ifndef ARDUINO
+#include <chrono>
+#include <thread>
+#endif
+
+namespace SerialLog {
+
+namespace {
+  // Bounded MPMC queue (Vyukov): each slot carries a sequence number that
+  // tells producers and the consumer whose turn it is. No locks, producers
+  // on loop() and on the AsyncTCP task can log at the same time.
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    uint32_t timestamp;
+    uint8_t level;
+    char message[SERIAL_LOG_MSG_LEN];
+  };
+
+  Slot slots[SERIAL_LOG_SLOTS];
+  std::atomic<uint32_t> enqueuePos(0);
+  uint32_t dequeuePos = 0;  // only touched by the drain task
+  bool started = false;
+
+  std::atomic<uint32_t> droppedCount(0);
+  std::atomic<uint32_t> rateLimitedCount(0);
+
+  std::atomic<uint32_t> tokens(SERIAL_LOG_BURST);
+  std::atomic<uint32_t> lastRefill(0);
+
+  const char LEVEL_CHARS[] = {'-', 'E', 'W', 'I', 'D'};
+
+  // Secret-bearing keys; the value after them is masked
+  const char* const SECRET_KEYS[] = {
+    "key=", "auth=", "\"idToken\":", "\"refreshToken\":", "\"password\":", "password="
+  };
+}
+
+static inline uint32_t cycleCount() {
+#ifdef ARDUINO
+  return ESP.getCycleCount();
+#else
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static void initSlots() {
+  static bool initialized = false;
+  if (initialized) return;
+  for (uint32_t i = 0; i < SERIAL_LOG_SLOTS; i++) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  initialized = true;
+}
+
+static bool takeToken() {
+  const uint32_t interval = 1000 / SERIAL_LOG_RATE;
+  uint32_t now = millis();
+  uint32_t last = lastRefill.load(std::memory_order_relaxed);
+  uint32_t elapsed = now - last;
+  if (elapsed >= interval) {
+    uint32_t add = elapsed / interval;
+    if (lastRefill.compare_exchange_strong(last, last + add * interval)) {
+      uint32_t t = tokens.load(std::memory_order_relaxed);
+      uint32_t refilled;
+      do {
+        refilled = t + add > SERIAL_LOG_BURST ? SERIAL_LOG_BURST : t + add;
+      } while (!tokens.compare_exchange_weak(t, refilled));
+    }
+  }
+
+  uint32_t t = tokens.load(std::memory_order_relaxed);
+  while (t > 0) {
+    if (tokens.compare_exchange_weak(t, t - 1)) return true;
+  }
+  return false;
+}
+
+void write(uint8_t level, const char* fmt, ...) {
+  uint32_t start = cycleCount();
+  initSlots();
+
+  if (level != LOG_LEVEL_ERROR && !takeToken()) {
+    rateLimitedCount.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  // Claim a slot
+  Slot* slot;
+  uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+  for (;;) {
+    slot = &slots[pos % SERIAL_LOG_SLOTS];
+    uint32_t seq = slot->sequence.load(std::memory_order_acquire);
+    int32_t diff = (int32_t)(seq - pos);
+    if (diff == 0) {
+      if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      droppedCount.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->timestamp = millis();
+  slot->level = level;
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(slot->message, sizeof(slot->message), fmt, args);
+  va_end(args);
+  slot->sequence.store(pos + 1, std::memory_order_release);
+
+  Metrics::logCallCycles.observe(cycleCount() - start);
+}
+
+void redact(char* msg) {
+  for (const char* key : SECRET_KEYS) {
+    size_t keyLen = strlen(key);
+    char* p = msg;
+    while ((p = strstr(p, key)) != nullptr) {
+      p += keyLen;
+      if (*p == '"') p++;
+      char* valueStart = p;
+      while (*p && *p != '&' && *p != '"' && *p != ',' && *p != ' ' && *p != '}') {
+        *p++ = '*';
+      }
+      // Collapse the mask so the secret length is not revealed either
+      if (p - valueStart > 3) {
+        memmove(valueStart + 3, p, strlen(p) + 1);
+        p = valueStart + 3;
+      }
+    }
+  }
+}
+
+// Write one message to Serial if there is one and the port can take it.
+// Returns false when there is nothing to do right now.
+static bool drainOne() {
+  Slot& slot = slots[dequeuePos % SERIAL_LOG_SLOTS];
+  uint32_t seq = slot.sequence.load(std::memory_order_acquire);
+  if ((int32_t)(seq - (dequeuePos + 1)) != 0) return false;
+
+  char line[SERIAL_LOG_MSG_LEN + 24];
+  redact(slot.message);
+  int n = snprintf(line, sizeof(line), "[%lu.%03lu] %c %s\n",
+                   (unsigned long)(slot.timestamp / 1000), (unsigned long)(slot.timestamp % 1000),
+                   LEVEL_CHARS[slot.level <= LOG_LEVEL_DEBUG ? slot.level : 0], slot.message);
+  if (n < 0) n = 0;
+  if ((size_t)n >= sizeof(line)) n = sizeof(line) - 1;
+
+#ifdef ARDUINO
+  // Don't block on a USB-CDC console nobody is reading; keep the message
+  // and let the ring absorb (and count) the overflow instead
+  if (Serial.availableForWrite() < n) return false;
+#endif
+  Serial.write((const uint8_t*)line, n);
+
+  slot.sequence.store(dequeuePos + SERIAL_LOG_SLOTS, std::memory_order_release);
+  dequeuePos++;
+  return true;
+}
+
+#ifdef ARDUINO
+static void drainTask(void*) {
+  for (;;) {
+    if (!drainOne()) {
+      vTaskDelay(pdMS_TO_TICKS(10));
+    }
+  }
+}
+#endif
+
+void begin() {
+  if (started) return;
+  initSlots();
+  started = true;
+#ifdef ARDUINO
+  // Lowest application priority (same as loopTask, below AsyncTCP)
+  xTaskCreate(drainTask, "serial_log", 3072, nullptr, tskIDLE_PRIORITY + 1, nullptr);
+#else
+  std::thread([] {
+    for (;;) {
+      if (!drainOne()) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }).detach();
+#endif
+}
+
+void flush() {
+  if (started) return;
+  initSlots();
+  while (drainOne()) {
+  }
+}
+
+uint32_t dropped() {
+  return droppedCount.load(std::memory_order_relaxed);
+}
+
+uint32_t rateLimited() {
+  return rateLimitedCount.load(std::memory_order_relaxed);
+}
+
+}  // namespace SerialLog
@@ -0,0 +1,84 @@
+#ifndef SERIAL_LOG_H
+#define SERIAL_LOG_H
+
+#include <Arduino.h>
+
+// Levelled, asynchronous serial logging.
+// LOG_* calls format into a lock-free ring buffer and return immediately;
+// a low-priority task drains the ring to Serial only as fast as the host
+// reads it. When the ring is full (no host attached, log burst) messages
+// are dropped and counted instead of stalling the caller.
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+// Messages above this level are removed at compile time
+#ifndef SERIAL_LOG_LEVEL
+#define SERIAL_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Ring size in messages and max length of one formatted message
+#ifndef SERIAL_LOG_SLOTS
+#define SERIAL_LOG_SLOTS 32
+#endif
+#ifndef SERIAL_LOG_MSG_LEN
+#define SERIAL_LOG_MSG_LEN 120
+#endif
+
+// Token bucket for WARN/INFO/DEBUG: sustained messages per second and
+// burst size. Errors are never rate limited.
+#ifndef SERIAL_LOG_RATE
+#define SERIAL_LOG_RATE 20
+#endif
+#ifndef SERIAL_LOG_BURST
+#define SERIAL_LOG_BURST 40
+#endif
+
+namespace SerialLog {
+
+// Start the drain task. Messages logged before begin() are buffered.
+void begin();
+
+void write(uint8_t level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Writes out what is queued from the caller. Only without the drain task
+// (before begin(), native tools): the ring has a single consumer.
+void flush();
+
+// Mask secrets in place (API keys, tokens, passwords) - applied by the
+// drain task before anything reaches the console
+void redact(char* msg);
+
+uint32_t dropped();      // ring full
+uint32_t rateLimited();  // over the token bucket
+
+}  // namespace SerialLog
+
+#if SERIAL_LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) SerialLog::write(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
+
+#if SERIAL_LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) SerialLog::write(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+
+#if SERIAL_LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) SerialLog::write(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if SERIAL_LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) SerialLog::write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,279 @@
+#include "settings.h"
+#include <EEPROM.h>
+#include <ArduinoJson.h>
+#include <math.h>
+#include <stddef.h>
+#include <mutex>
+#include "seqlock.h"
+#include "serial_log.h"
+#include "firebase_layout.h"
+#include "adc_range.h"
+#include "config.h"
+
+namespace {
+  enum Type : uint8_t { TYPE_UINT, TYPE_FLOAT };
+
+  struct Descriptor {
+    const char* name;
+    Type type;
+    uint8_t offset;
+    double min;
+    double max;
+  };
+
+  // Names are the JSON keys; the index is the key ID stored in EEPROM, so
+  // new keys go at the end
+  const Descriptor KEYS[Settings::KEY_COUNT] = {
+    {"sampleIntervalMs", TYPE_UINT, offsetof(Settings::Values, sampleIntervalMs), 1000, 3600000},
+    {"sendIntervalMs", TYPE_UINT, offsetof(Settings::Values, sendIntervalMs), 10000, 86400000},
+    {"wifiCheckIntervalMs", TYPE_UINT, offsetof(Settings::Values, wifiCheckIntervalMs), 1000, 600000},
+    {"dividerFactor", TYPE_FLOAT, offsetof(Settings::Values, dividerFactor), 0.1, 100},
+    {"retentionDays", TYPE_UINT, offsetof(Settings::Values, retentionDays), 0, 3650},
+    {"deadBandMv", TYPE_UINT, offsetof(Settings::Values, deadBandMv), 0, 25000},
+    {"deadBandPct", TYPE_FLOAT, offsetof(Settings::Values, deadBandPct), 0, 50},
+    {"heartbeatMs", TYPE_UINT, offsetof(Settings::Values, heartbeatMs), 10000, 86400000},
+    {"adcAutoRange", TYPE_UINT, offsetof(Settings::Values, adcAutoRange), 0, 1},
+  };
+
+  const Settings::Values DEFAULTS = {
+    SETTINGS_SAMPLE_INTERVAL_MS,
+    SETTINGS_SEND_INTERVAL_MS,
+    SETTINGS_WIFI_CHECK_INTERVAL_MS,
+    SETTINGS_DIVIDER_FACTOR,
+    FIREBASE_RETENTION_DAYS,
+    SETTINGS_DEAD_BAND_MV,
+    SETTINGS_DEAD_BAND_PCT,
+    SETTINGS_HEARTBEAT_MS,
+    ADC_AUTO_RANGE,
+  };
+
+  // Every field is one 32-bit word, addressed by the descriptor's offset
+  static_assert(sizeof(Settings::Values) == Settings::KEY_COUNT * sizeof(uint32_t),
+                "Settings::Values holds one 32-bit word per key");
+
+  // EEPROM: header, then count x (key ID, 32-bit value), defaults left out
+  struct StoredHeader {
+    uint16_t magic;
+    uint8_t count;
+    uint8_t check;  // ~sum of the pair bytes
+  };
+  const uint16_t STORED_MAGIC = 0x5331;  // "S1"
+  const int PAIR_SIZE = 1 + sizeof(uint32_t);
+  const int STORED_SIZE = sizeof(StoredHeader) + Settings::KEY_COUNT * PAIR_SIZE;
+
+  // What the web task sees, published by loop()
+  SeqLock<Settings::Values> snapshot;
+
+  // PATCHed values waiting for loop(); several PATCHes merge key by key
+  std::mutex stagedMutex;
+  Settings::Values staged;
+  uint32_t stagedMask = 0;
+
+  struct Subscriber {
+    uint32_t mask;
+    Settings::Callback callback;
+  };
+  Subscriber subscribers[Settings::MAX_SUBSCRIBERS];
+  size_t subscriberCount = 0;
+
+  uint32_t rawValue(const Settings::Values& v, uint8_t key) {
+    uint32_t raw;
+    memcpy(&raw, (const uint8_t*)&v + KEYS[key].offset, sizeof(raw));
+    return raw;
+  }
+
+  void setRaw(Settings::Values& v, uint8_t key, uint32_t raw) {
+    memcpy((uint8_t*)&v + KEYS[key].offset, &raw, sizeof(raw));
+  }
+
+  double number(const Settings::Values& v, uint8_t key) {
+    if (KEYS[key].type == TYPE_FLOAT) {
+      float f;
+      memcpy(&f, (const uint8_t*)&v + KEYS[key].offset, sizeof(f));
+      return f;
+    }
+    return rawValue(v, key);
+  }
+
+  bool inRange(uint8_t key, double value) {
+    if (isnan(value) || value < KEYS[key].min || value > KEYS[key].max) return false;
+    return KEYS[key].type == TYPE_FLOAT || value == floor(value);
+  }
+
+  // value -> raw word of the key's type
+  uint32_t encode(uint8_t key, double value) {
+    if (KEYS[key].type == TYPE_FLOAT) {
+      float f = (float)value;
+      uint32_t raw;
+      memcpy(&raw, &f, sizeof(raw));
+      return raw;
+    }
+    return (uint32_t)value;
+  }
+
+  void load() {
+    StoredHeader header;
+    EEPROM.get(SETTINGS_EEPROM_ADDR, header);
+    if (header.magic != STORED_MAGIC || header.count > Settings::KEY_COUNT) return;
+
+    uint8_t sum = 0;
+    for (int i = 0; i < header.count * PAIR_SIZE; i++) {
+      sum += EEPROM.read(SETTINGS_EEPROM_ADDR + sizeof(StoredHeader) + i);
+    }
+    if ((uint8_t)~sum != header.check) {
+      LOG_WARN("[Settings] Stored settings damaged, using defaults");
+      return;
+    }
+
+    for (int i = 0; i < header.count; i++) {
+      int addr = SETTINGS_EEPROM_ADDR + sizeof(StoredHeader) + i * PAIR_SIZE;
+      uint8_t key = EEPROM.read(addr);
+      uint32_t raw = 0;
+      EEPROM.get(addr + 1, raw);
+      if (key >= Settings::KEY_COUNT) continue;  // from a newer firmware
+      Settings::Values v = Settings::live;
+      setRaw(v, key, raw);
+      if (!inRange(key, number(v, key))) continue;  // limits got tighter since
+      Settings::live = v;
+      LOG_INFO("[Settings] %s = %g (stored)", KEYS[key].name, number(v, key));
+    }
+  }
+
+  void store() {
+    StoredHeader header = {STORED_MAGIC, 0, 0};
+    uint8_t sum = 0;
+    for (uint8_t key = 0; key < Settings::KEY_COUNT; key++) {
+      uint32_t raw = rawValue(Settings::live, key);
+      if (raw == rawValue(DEFAULTS, key)) continue;
+      int addr = SETTINGS_EEPROM_ADDR + sizeof(StoredHeader) + header.count * PAIR_SIZE;
+      EEPROM.write(addr, key);
+      EEPROM.put(addr + 1, raw);
+      for (int i = 0; i < PAIR_SIZE; i++) sum += EEPROM.read(addr + i);
+      header.count++;
+    }
+    header.check = ~sum;
+    EEPROM.put(SETTINGS_EEPROM_ADDR, header);
+    EEPROM.commit();
+  }
+
+  // Published values with the staged ones on top
+  Settings::Values pending() {
+    Settings::Values v = snapshot.read();
+    std::lock_guard<std::mutex> lock(stagedMutex);
+    for (uint8_t key = 0; key < Settings::KEY_COUNT; key++) {
+      if (stagedMask & (1UL << key)) setRaw(v, key, rawValue(staged, key));
+    }
+    return v;
+  }
+}
+
+static_assert(SETTINGS_EEPROM_ADDR + STORED_SIZE <= EEPROM_SIZE, "settings don't fit in EEPROM");
+
+namespace Settings {
+
+Values live = DEFAULTS;
+
+void begin() {
+  load();
+  snapshot.write(live);
+}
+
+void loop() {
+  Values next;
+  uint32_t mask;
+  {
+    std::lock_guard<std::mutex> lock(stagedMutex);
+    if (stagedMask == 0) return;
+    next = staged;
+    mask = stagedMask;
+    stagedMask = 0;
+  }
+
+  uint32_t changed = 0;
+  for (uint8_t key = 0; key < KEY_COUNT; key++) {
+    if (!(mask & (1UL << key)) || rawValue(next, key) == rawValue(live, key)) continue;
+    LOG_INFO("[Settings] %s: %g -> %g", KEYS[key].name, number(live, key), number(next, key));
+    setRaw(live, key, rawValue(next, key));
+    changed |= 1UL << key;
+  }
+  if (changed == 0) return;
+
+  store();
+  snapshot.write(live);
+  for (size_t i = 0; i < subscriberCount; i++) {
+    if (subscribers[i].mask & changed) subscribers[i].callback(subscribers[i].mask & changed);
+  }
+}
+
+bool subscribe(uint32_t mask, Callback callback) {
+  if (subscriberCount >= MAX_SUBSCRIBERS || !callback) return false;
+  subscribers[subscriberCount++] = {mask, callback};
+  return true;
+}
+
+String toJson(bool schema) {
+  Values v = pending();
+  DynamicJsonDocument doc(schema ? 1536 : 512);
+  JsonObject values = schema ? doc.createNestedObject("values") : doc.to<JsonObject>();
+  for (uint8_t key = 0; key < KEY_COUNT; key++) {
+    values[KEYS[key].name] = number(v, key);
+  }
+  if (schema) {
+    JsonObject keys = doc.createNestedObject("schema");
+    for (uint8_t key = 0; key < KEY_COUNT; key++) {
+      JsonObject k = keys.createNestedObject(KEYS[key].name);
+      k["type"] = KEYS[key].type == TYPE_FLOAT ? "float" : "uint";
+      k["min"] = KEYS[key].min;
+      k["max"] = KEYS[key].max;
+      k["default"] = number(DEFAULTS, key);
+    }
+  }
+  String out;
+  serializeJson(doc, out);
+  return out;
+}
+
+bool patch(const char* json, size_t len, char* error, size_t errorSize) {
+  DynamicJsonDocument doc(512 + 2 * len);
+  if (deserializeJson(doc, json, len) || !doc.is<JsonObject>()) {
+    snprintf(error, errorSize, "body must be a JSON object");
+    return false;
+  }
+
+  Values next = pending();
+  uint32_t mask = 0;
+  for (JsonPair p : doc.as<JsonObject>()) {
+    const char* name = p.key().c_str();
+    uint8_t key = 0;
+    while (key < KEY_COUNT && strcmp(KEYS[key].name, name) != 0) key++;
+    if (key == KEY_COUNT) {
+      snprintf(error, errorSize, "unknown setting: %s", name);
+      return false;
+    }
+
+    JsonVariant value = p.value();
+    if (value.isNull()) {
+      setRaw(next, key, rawValue(DEFAULTS, key));
+    } else if (value.is<double>() && inRange(key, value.as<double>())) {
+      setRaw(next, key, encode(key, value.as<double>()));
+    } else {
+      snprintf(error, errorSize, "%s must be %s in %g..%g", name,
+               KEYS[key].type == TYPE_FLOAT ? "a number" : "an integer", KEYS[key].min, KEYS[key].max);
+      return false;
+    }
+    mask |= 1UL << key;
+  }
+
+  std::lock_guard<std::mutex> lock(stagedMutex);
+  for (uint8_t key = 0; key < KEY_COUNT; key++) {
+    if (mask & (1UL << key)) setRaw(staged, key, rawValue(next, key));
+  }
+  stagedMask |= mask;
+  return true;
+}
+
+const char* keyName(Key key) {
+  return key < KEY_COUNT ? KEYS[key].name : "unknown";
+}
+
+}  // namespace Settings
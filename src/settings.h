@@ -0,0 +1,107 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <Arduino.h>
+
+// Operational parameters that can be changed at run time through
+// /settings, without reflashing or rebooting.
+//
+// The live values are one plain struct. Code in the loop task reads a
+// field directly (Settings::get().sampleIntervalMs), which compiles to the
+// same single load as reading a global variable. Changes come in on the
+// web task: patch() checks every key against its type and range and
+// stages the whole set, loop() applies it between readings, writes the
+// values that differ from the defaults to EEPROM and calls the
+// subscribers of the keys that changed.
+
+// Defaults, also what a key goes back to when PATCHed with null
+#ifndef SETTINGS_SAMPLE_INTERVAL_MS
+#define SETTINGS_SAMPLE_INTERVAL_MS 10000     // read every 10 s
+#endif
+#ifndef SETTINGS_SEND_INTERVAL_MS
+#define SETTINGS_SEND_INTERVAL_MS 60000       // close a window for the sinks every 60 s
+#endif
+#ifndef SETTINGS_WIFI_CHECK_INTERVAL_MS
+#define SETTINGS_WIFI_CHECK_INTERVAL_MS 10000 // check the connection every 10 s
+#endif
+#ifndef SETTINGS_DIVIDER_FACTOR
+#define SETTINGS_DIVIDER_FACTOR 5.0f          // 5:1 module: 5 V in gives 1 V on S
+#endif
+// Dead-band of the send windows (dead_band.h); both 0 = every window goes out
+#ifndef SETTINGS_DEAD_BAND_MV
+#define SETTINGS_DEAD_BAND_MV 0
+#endif
+#ifndef SETTINGS_DEAD_BAND_PCT
+#define SETTINGS_DEAD_BAND_PCT 0.0f
+#endif
+#ifndef SETTINGS_HEARTBEAT_MS
+#define SETTINGS_HEARTBEAT_MS 900000          // a record at least every 15 min
+#endif
+
+// Stored after the logger (EEPROM 128-2183): header + 5 B per changed key
+#ifndef SETTINGS_EEPROM_ADDR
+#define SETTINGS_EEPROM_ADDR 2304
+#endif
+
+namespace Settings {
+
+enum Key : uint8_t {
+  SAMPLE_INTERVAL,
+  SEND_INTERVAL,
+  WIFI_CHECK_INTERVAL,
+  DIVIDER_FACTOR,
+  RETENTION_DAYS,
+  DEAD_BAND_MV,
+  DEAD_BAND_PCT,
+  HEARTBEAT_MS,
+  AUTO_RANGE,
+  KEY_COUNT
+};
+
+struct Values {
+  uint32_t sampleIntervalMs;
+  uint32_t sendIntervalMs;
+  uint32_t wifiCheckIntervalMs;
+  float dividerFactor;
+  uint32_t retentionDays;  // raw days kept in Firebase, 0 = keep all
+  uint32_t deadBandMv;     // send windows within the band of the last
+  float deadBandPct;       // record are held back (dead_band.h)
+  uint32_t heartbeatMs;
+  uint32_t adcAutoRange;   // 1 = pick the attenuation per reading (adc_range.h)
+};
+
+static const size_t MAX_SUBSCRIBERS = 8;
+
+// Bit of a key in subscription and change masks
+inline uint32_t bit(Key key) { return 1UL << key; }
+
+// Gets the changed keys as a mask of bit(Key)
+typedef void (*Callback)(uint32_t changed);
+
+// Written by loop() only
+extern Values live;
+
+inline const Values& get() { return live; }
+
+// Stored values over the defaults; EEPROM has to be begun (initEEPROM())
+void begin();
+
+// Applies staged changes; loop task only
+void loop();
+
+// callback runs from loop() when one of the keys in mask changed
+bool subscribe(uint32_t mask, Callback callback);
+
+// Current values (with anything staged but not yet applied) as a JSON
+// object; with schema, also type, range and default of every key
+String toJson(bool schema);
+
+// Body of a PATCH: an object of key -> value, null = default. Nothing is
+// staged unless every key is known and in range; error says which isn't.
+bool patch(const char* json, size_t len, char* error, size_t errorSize);
+
+const char* keyName(Key key);
+
+}  // namespace Settings
+
+#endif
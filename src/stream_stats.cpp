@@ -0,0 +1,193 @@
+#include "stream_stats.h"
+#include <math.h>
+
+// --- RunningStats ---
+
+void RunningStats::reset() {
+  n = 0;
+  m = 0.0;
+  m2 = 0.0;
+  lo = 0.0f;
+  hi = 0.0f;
+}
+
+void RunningStats::add(float x) {
+  n++;
+  double delta = x - m;
+  m += delta / n;
+  m2 += delta * (x - m);
+  if (n == 1 || x < lo) lo = x;
+  if (n == 1 || x > hi) hi = x;
+}
+
+float RunningStats::stddev() const {
+  return sqrtf(variance());
+}
+
+// --- P2Quantile ---
+
+void P2Quantile::reset() {
+  n = 0;
+  for (int i = 0; i < 5; i++) {
+    q[i] = 0.0f;
+    pos[i] = i;
+  }
+  want[0] = 0.0f;
+  want[1] = 2.0f * p;
+  want[2] = 4.0f * p;
+  want[3] = 2.0f + 2.0f * p;
+  want[4] = 4.0f;
+}
+
+float P2Quantile::parabolic(int i, int d) const {
+  float a = (float)(pos[i] - pos[i - 1] + d) * (q[i + 1] - q[i]) / (pos[i + 1] - pos[i]);
+  float b = (float)(pos[i + 1] - pos[i] - d) * (q[i] - q[i - 1]) / (pos[i] - pos[i - 1]);
+  return q[i] + (float)d / (pos[i + 1] - pos[i - 1]) * (a + b);
+}
+
+float P2Quantile::linear(int i, int d) const {
+  return q[i] + d * (q[i + d] - q[i]) / (pos[i + d] - pos[i]);
+}
+
+void P2Quantile::add(float x) {
+  // First five samples are kept as-is and become the initial markers
+  if (n < 5) {
+    q[n++] = x;
+    if (n == 5) {
+      for (int i = 1; i < 5; i++) {
+        float v = q[i];
+        int j = i - 1;
+        while (j >= 0 && q[j] > v) {
+          q[j + 1] = q[j];
+          j--;
+        }
+        q[j + 1] = v;
+      }
+    }
+    return;
+  }
+  n++;
+
+  // Cell the sample falls into, extending the extremes if needed
+  int k;
+  if (x < q[0]) {
+    q[0] = x;
+    k = 0;
+  } else if (x >= q[4]) {
+    q[4] = x;
+    k = 3;
+  } else {
+    k = 0;
+    while (k < 3 && x >= q[k + 1]) k++;
+  }
+
+  for (int i = k + 1; i < 5; i++) pos[i]++;
+  want[1] += p / 2.0f;
+  want[2] += p;
+  want[3] += (1.0f + p) / 2.0f;
+  want[4] += 1.0f;
+
+  // Nudge the middle markers towards their desired positions
+  for (int i = 1; i < 4; i++) {
+    float off = want[i] - pos[i];
+    if ((off >= 1.0f && pos[i + 1] - pos[i] > 1) || (off <= -1.0f && pos[i - 1] - pos[i] < -1)) {
+      int d = off > 0 ? 1 : -1;
+      float h = parabolic(i, d);
+      q[i] = (q[i - 1] < h && h < q[i + 1]) ? h : linear(i, d);
+      pos[i] += d;
+    }
+  }
+}
+
+float P2Quantile::value() const {
+  if (n >= 5) return q[2];
+  if (n == 0) return 0.0f;
+
+  // Exact nearest-rank quantile of the few samples seen so far
+  float sorted[5];
+  for (uint32_t i = 0; i < n; i++) {
+    float v = q[i];
+    int j = (int)i - 1;
+    while (j >= 0 && sorted[j] > v) {
+      sorted[j + 1] = sorted[j];
+      j--;
+    }
+    sorted[j + 1] = v;
+  }
+  return sorted[(int)(p * (n - 1) + 0.5f)];
+}
+
+// --- FixedHistogram ---
+
+FixedHistogram::FixedHistogram(float lo, float hi)
+    : lo(lo), hi(hi), scale(STATS_HISTOGRAM_BINS / (hi - lo)) {
+  reset();
+}
+
+void FixedHistogram::reset() {
+  for (size_t i = 0; i < STATS_HISTOGRAM_BINS; i++) counts[i] = 0;
+  under = 0;
+  over = 0;
+}
+
+void FixedHistogram::add(float x) {
+  if (x < lo) {
+    under++;
+    return;
+  }
+  size_t i = (size_t)((x - lo) * scale);
+  if (i >= STATS_HISTOGRAM_BINS) {
+    over++;
+    return;
+  }
+  counts[i]++;
+}
+
+// --- SummaryAccumulator ---
+
+SummaryAccumulator::SummaryAccumulator()
+    : q1(0.01f), q50(0.5f), q99(0.99f), hist(STATS_HISTOGRAM_MIN_V, STATS_HISTOGRAM_MAX_V) {}
+
+void SummaryAccumulator::add(float x) {
+  moments.add(x);
+  q1.add(x);
+  q50.add(x);
+  q99.add(x);
+  hist.add(x);
+}
+
+void SummaryAccumulator::reset() {
+  moments.reset();
+  q1.reset();
+  q50.reset();
+  q99.reset();
+  hist.reset();
+}
+
+VoltageSummary SummaryAccumulator::summary() const {
+  VoltageSummary s;
+  s.count = moments.count();
+  s.mean = moments.mean();
+  s.stddev = moments.stddev();
+  s.min = moments.min();
+  s.max = moments.max();
+  s.p1 = q1.value();
+  s.p50 = q50.value();
+  s.p99 = q99.value();
+  return s;
+}
+
+// --- VoltageStats ---
+
+void VoltageStats::add(float voltage) {
+  current.add(voltage);
+  run.add(voltage);
+}
+
+VoltageSummary VoltageStats::closeWindow() {
+  last = current.summary();
+  lastHist = current.histogram();
+  current.reset();
+  windows++;
+  return last;
+}
@@ -0,0 +1,143 @@
+#ifndef STREAM_STATS_H
+#define STREAM_STATS_H
+
+#include <Arduino.h>
+
+// Constant-memory online statistics over the voltage samples.
+// Every add() is O(1) and nothing allocates, so this can sit behind
+// a high-rate ADC path.
+
+// Voltage histogram range (module range is 0-25 V)
+#ifndef STATS_HISTOGRAM_MIN_V
+#define STATS_HISTOGRAM_MIN_V 0.0f
+#endif
+#ifndef STATS_HISTOGRAM_MAX_V
+#define STATS_HISTOGRAM_MAX_V 25.0f
+#endif
+#ifndef STATS_HISTOGRAM_BINS
+#define STATS_HISTOGRAM_BINS 25
+#endif
+
+// Welford running mean / variance with min and max
+class RunningStats {
+public:
+  RunningStats() { reset(); }
+
+  void add(float x);
+  void reset();
+
+  uint32_t count() const { return n; }
+  float mean() const { return (float)m; }
+  float variance() const { return n > 1 ? (float)(m2 / (n - 1)) : 0.0f; }  // sample variance
+  float stddev() const;
+  float min() const { return n ? lo : 0.0f; }
+  float max() const { return n ? hi : 0.0f; }
+
+private:
+  uint32_t n;
+  double m;
+  double m2;
+  float lo;
+  float hi;
+};
+
+// P² single-quantile estimator (Jain & Chlamtac, 1985): five markers,
+// no sample storage. Exact while fewer than five samples have been seen.
+class P2Quantile {
+public:
+  explicit P2Quantile(float p) : p(p) { reset(); }
+
+  void add(float x);
+  void reset();
+  float value() const;
+
+private:
+  float parabolic(int i, int d) const;
+  float linear(int i, int d) const;
+
+  float p;
+  uint32_t n;
+  float q[5];      // marker heights
+  int32_t pos[5];  // marker positions
+  float want[5];   // desired positions
+};
+
+// Fixed-bin histogram with under/overflow counts
+class FixedHistogram {
+public:
+  FixedHistogram(float lo, float hi);
+
+  void add(float x);
+  void reset();
+
+  float lower() const { return lo; }
+  float upper() const { return hi; }
+  float binWidth() const { return (hi - lo) / STATS_HISTOGRAM_BINS; }
+  size_t bins() const { return STATS_HISTOGRAM_BINS; }
+  uint32_t bin(size_t i) const { return counts[i]; }
+  uint32_t underflow() const { return under; }
+  uint32_t overflow() const { return over; }
+
+private:
+  float lo;
+  float hi;
+  float scale;  // bins per volt
+  uint32_t counts[STATS_HISTOGRAM_BINS];
+  uint32_t under;
+  uint32_t over;
+};
+
+// Plain summary of one window (or the whole run), copied into records
+struct VoltageSummary {
+  uint32_t count;
+  float mean;
+  float stddev;
+  float min;
+  float max;
+  float p1;
+  float p50;
+  float p99;
+};
+
+// Everything tracked over one stream of samples
+class SummaryAccumulator {
+public:
+  SummaryAccumulator();
+
+  void add(float x);
+  void reset();
+  VoltageSummary summary() const;
+  const FixedHistogram& histogram() const { return hist; }
+
+private:
+  RunningStats moments;
+  P2Quantile q1;
+  P2Quantile q50;
+  P2Quantile q99;
+  FixedHistogram hist;
+};
+
+// Per reporting window statistics plus cumulative ones for the whole run
+class VoltageStats {
+public:
+  void add(float voltage);
+
+  // End the current window: its summary and histogram become lastWindow()
+  VoltageSummary closeWindow();
+
+  VoltageSummary window() const { return current.summary(); }  // in progress
+  const VoltageSummary& lastWindow() const { return last; }
+  const FixedHistogram& lastHistogram() const { return lastHist; }
+  VoltageSummary total() const { return run.summary(); }
+  const FixedHistogram& totalHistogram() const { return run.histogram(); }
+  uint32_t windowsClosed() const { return windows; }
+
+private:
+  SummaryAccumulator current;
+  SummaryAccumulator run;
+  VoltageSummary last = {};
+  FixedHistogram lastHist = FixedHistogram(STATS_HISTOGRAM_MIN_V, STATS_HISTOGRAM_MAX_V);
+  uint32_t windows = 0;
+};
+
+#endif
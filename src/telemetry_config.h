@@ -0,0 +1,84 @@
+#ifndef TELEMETRY_CONFIG_H
+#define TELEMETRY_CONFIG_H
+
+// Telemetry sink configuration
+// Every value can be overridden from platformio.ini build_flags,
+// e.g. -DTELEMETRY_MQTT_ENABLED=1 -DMQTT_BROKER_HOST=\"192.168.1.10\"
+
+// Records buffered per sink before the oldest ones are dropped
+#ifndef TELEMETRY_QUEUE_SIZE
+#define TELEMETRY_QUEUE_SIZE 16
+#endif
+
+// Max number of sinks that can run at the same time
+#ifndef TELEMETRY_MAX_SINKS
+#define TELEMETRY_MAX_SINKS 4
+#endif
+
+// Retry backoff after a failed batch: decorrelated jitter between the
+// min and 3x the previous delay, capped at the max (retry_policy.h)
+#ifndef TELEMETRY_RETRY_MIN_MS
+#define TELEMETRY_RETRY_MIN_MS 5000
+#endif
+#ifndef TELEMETRY_RETRY_MAX_MS
+#define TELEMETRY_RETRY_MAX_MS 300000
+#endif
+
+// Circuit breaker: opens after this many failures in a row, for a jittered
+// open period that doubles after every failed probe up to the max. Keep
+// the max well below the time it takes to fill the queue with records.
+#ifndef TELEMETRY_BREAKER_THRESHOLD
+#define TELEMETRY_BREAKER_THRESHOLD 5
+#endif
+#ifndef TELEMETRY_BREAKER_OPEN_MS
+#define TELEMETRY_BREAKER_OPEN_MS 60000
+#endif
+#ifndef TELEMETRY_BREAKER_OPEN_MAX_MS
+#define TELEMETRY_BREAKER_OPEN_MAX_MS 600000
+#endif
+
+// Batches sent back to back per loop() once the backend answers again,
+// so a backlog drains in one go instead of one batch per reading
+#ifndef TELEMETRY_FLUSH_BATCHES
+#define TELEMETRY_FLUSH_BATCHES 4
+#endif
+
+// Firebase REST sink (on by default, keeps existing behaviour)
+#ifndef TELEMETRY_FIREBASE_ENABLED
+#define TELEMETRY_FIREBASE_ENABLED 1
+#endif
+
+// Local MQTT broker sink (QoS1, persistent session)
+#ifndef TELEMETRY_MQTT_ENABLED
+#define TELEMETRY_MQTT_ENABLED 0
+#endif
+#ifndef MQTT_BROKER_HOST
+#define MQTT_BROKER_HOST "192.168.1.10"
+#endif
+#ifndef MQTT_BROKER_PORT
+#define MQTT_BROKER_PORT 1883
+#endif
+// %s is replaced with the device ID (device_identity.h): the broker drops
+// a client whose ID is already connected
+#ifndef MQTT_CLIENT_ID
+#define MQTT_CLIENT_ID "voltagelog-%s"
+#endif
+#ifndef MQTT_TOPIC
+#define MQTT_TOPIC "voltagelog/%s/readings"
+#endif
+#ifndef MQTT_BATCH_SIZE
+#define MQTT_BATCH_SIZE 8
+#endif
+
+// Generic HTTP POST sink (plain http://, JSON array body)
+#ifndef TELEMETRY_HTTP_ENABLED
+#define TELEMETRY_HTTP_ENABLED 0
+#endif
+#ifndef HTTP_SINK_URL
+#define HTTP_SINK_URL "http://192.168.1.10:8080/readings"
+#endif
+#ifndef HTTP_SINK_BATCH_SIZE
+#define HTTP_SINK_BATCH_SIZE 8
+#endif
+
+#endif
@@ -0,0 +1,196 @@
+#include "telemetry_sink.h"
+#include "serial_log.h"
+#include "logger.h"
+#include "adc_range.h"
+#include "time_service.h"
+
+TelemetrySink::TelemetrySink(const char* name)
+    : sinkName(name), head(0), count(0), resultCode(-1), sinkStats{} {}
+
+bool TelemetrySink::enqueue(const TelemetryRecord& record) {
+  bool accepted = true;
+  if (count >= TELEMETRY_QUEUE_SIZE) {
+    // Queue full - drop the oldest record so fresh data still gets through
+    pop(1);
+    sinkStats.dropped++;
+    accepted = false;
+  }
+  size_t tail = (head + count) % TELEMETRY_QUEUE_SIZE;
+  queue[tail] = record;
+  count++;
+  sinkStats.enqueued++;
+  return accepted;
+}
+
+void TelemetrySink::pop(size_t n) {
+  if (n > count) n = count;
+  head = (head + n) % TELEMETRY_QUEUE_SIZE;
+  count -= n;
+}
+
+float TelemetrySink::throughput() const {
+  unsigned long elapsed = millis() - sinkStats.startTime;
+  if (elapsed == 0) return 0.0f;
+  return sinkStats.published * 1000.0f / elapsed;
+}
+
+void TelemetrySink::process() {
+  if (sinkStats.startTime == 0) {
+    sinkStats.startTime = millis();
+  }
+
+  poll();
+
+  if (count == 0 || !isReady()) return;
+
+  // Give the first NTP sync a moment so records go out with real timestamps
+  if (TimeService::waitingForSync()) return;
+
+  // Backing off, or the breaker is open and no connection is even tried
+  if (!retry.allow()) return;
+
+  for (size_t b = 0; b < TELEMETRY_FLUSH_BATCHES && count > 0; b++) {
+    // Copy the batch out of the ring so the transport sees a flat array
+    size_t batchSize = maxBatchSize();
+    if (batchSize > TELEMETRY_QUEUE_SIZE) batchSize = TELEMETRY_QUEUE_SIZE;
+    if (batchSize > count) batchSize = count;
+
+    TelemetryRecord batch[TELEMETRY_QUEUE_SIZE];
+    for (size_t i = 0; i < batchSize; i++) {
+      batch[i] = queue[(head + i) % TELEMETRY_QUEUE_SIZE];
+    }
+
+    RetryPolicy::BreakerState before = retry.state();
+    resultCode = -1;
+    unsigned long start = millis();
+    size_t sent = sendBatch(batch, batchSize);
+    unsigned long latency = millis() - start;
+
+    if (sent > 0) {
+      if (before != RetryPolicy::BREAKER_CLOSED) {
+        LOG_INFO("[Telemetry] %s is back, flushing %u queued records", sinkName, (unsigned)count);
+      }
+      pop(sent);
+      sinkStats.published += sent;
+      sinkStats.batches++;
+      sinkStats.lastLatencyMs = latency;
+      sinkStats.totalLatencyMs += latency;
+      if (latency > sinkStats.maxLatencyMs) sinkStats.maxLatencyMs = latency;
+      sinkStats.lastSuccessTime = millis();
+      retry.onSuccess();
+      continue;
+    }
+
+    RetryPolicy::ErrorClass cls = RetryPolicy::classify(resultCode);
+    if (cls == RetryPolicy::ERROR_PERMANENT) {
+      // The backend refused this record and would do so again. It did
+      // answer though, so as far as the breaker goes this is a success.
+      pop(1);
+      retry.onSuccess();
+      sinkStats.rejected++;
+      LOG_WARN("[Telemetry] %s rejected a record (HTTP %d), dropped", sinkName, resultCode);
+      Logger::event(EVENT_UPLOAD_REJECTED, SEVERITY_ERROR, resultCode);
+      continue;
+    }
+
+    sinkStats.failedBatches++;
+    sinkStats.retries++;
+    retry.onFailure(cls);
+    if (retry.state() == RetryPolicy::BREAKER_OPEN) {
+      LOG_WARN("[Telemetry] %s %s (%s, HTTP %d), breaker open for %lu s, %u records queued",
+               sinkName, before == RetryPolicy::BREAKER_HALF_OPEN ? "probe failed" : "keeps failing",
+               RetryPolicy::className(cls), resultCode, retry.retryInMs() / 1000, (unsigned)count);
+      // Only breaker openings, not every failed attempt
+      Logger::event(EVENT_UPLOAD_FAILED, SEVERITY_WARN, resultCode, retry.retryInMs());
+    } else {
+      LOG_WARN("[Telemetry] %s batch failed (%s, HTTP %d), retry in %lu s", sinkName,
+               RetryPolicy::className(cls), resultCode, retry.retryInMs() / 1000);
+    }
+    break;
+  }
+}
+
+size_t serializeTelemetryRecords(const TelemetryRecord* records, size_t count,
+                                 char* buf, size_t bufSize) {
+  size_t len = 0;
+  if (bufSize < 3) return 0;
+  buf[len++] = '[';
+  for (size_t i = 0; i < count; i++) {
+    // Epoch of the sample via the monotonic->UTC mapping, 0 while unsynced
+    unsigned long timestamp = (unsigned long)TimeService::utcFromMillis(records[i].readTime);
+    const VoltageSummary& s = records[i].summary;
+    int n = snprintf(buf + len, bufSize - len,
+                     "%s{\"voltage\":%.3f,\"rawValue\":%d,\"adcRange\":\"%s\",\"timestamp\":%lu,\"readTime\":%lu,"
+                     "\"count\":%lu,\"stddev\":%.4f,\"min\":%.3f,\"max\":%.3f,"
+                     "\"p1\":%.3f,\"p50\":%.3f,\"p99\":%.3f,\"suppressed\":%u}",
+                     i > 0 ? "," : "", records[i].voltage, records[i].rawValue,
+                     AdcRanging::rangeInfo(records[i].adcRange).name, timestamp, records[i].readTime, (unsigned long)s.count, s.stddev,
+                     s.min, s.max, s.p1, s.p50, s.p99, (unsigned)records[i].suppressed);
+    if (n < 0 || (size_t)n >= bufSize - len) return 0;
+    len += n;
+  }
+  if (len + 2 > bufSize) return 0;
+  buf[len++] = ']';
+  buf[len] = '\0';
+  return len;
+}
+
+namespace {
+  TelemetrySink* sinks[TELEMETRY_MAX_SINKS];
+  size_t numSinks = 0;
+}
+
+namespace Telemetry {
+
+bool addSink(TelemetrySink* sink) {
+  if (sink == nullptr || numSinks >= TELEMETRY_MAX_SINKS) return false;
+  sinks[numSinks++] = sink;
+  return true;
+}
+
+void begin() {
+  for (size_t i = 0; i < numSinks; i++) {
+    LOG_INFO("[Telemetry] Sink enabled: %s", sinks[i]->name());
+    sinks[i]->begin();
+  }
+}
+
+void publish(const TelemetryRecord& record) {
+  for (size_t i = 0; i < numSinks; i++) {
+    if (!sinks[i]->enqueue(record)) {
+      LOG_WARN("[Telemetry] Queue full, dropped oldest record: %s", sinks[i]->name());
+    }
+  }
+}
+
+void loop() {
+  for (size_t i = 0; i < numSinks; i++) {
+    sinks[i]->process();
+  }
+}
+
+size_t sinkCount() {
+  return numSinks;
+}
+
+TelemetrySink* sink(size_t index) {
+  return index < numSinks ? sinks[index] : nullptr;
+}
+
+unsigned long lastSuccessTime() {
+  unsigned long latest = 0;
+  for (size_t i = 0; i < numSinks; i++) {
+    unsigned long t = sinks[i]->stats().lastSuccessTime;
+    if (t > latest) latest = t;
+  }
+  return latest;
+}
+
+bool retryDue() {
+  for (size_t i = 0; i < numSinks; i++) {
+    if (sinks[i]->retryDue()) return true;
+  }
+  return false;
+}
+
+}  // namespace Telemetry
@@ -0,0 +1,129 @@
+#ifndef TELEMETRY_SINK_H
+#define TELEMETRY_SINK_H
+
+#include <Arduino.h>
+#include "telemetry_config.h"
+#include "stream_stats.h"
+#include "retry_policy.h"
+
+// One reporting window handed to the sinks
+struct TelemetryRecord {
+  float voltage;           // window mean
+  int rawValue;            // last raw ADC value
+  uint8_t adcRange;        // AdcRanging range index rawValue was read in
+  unsigned long readTime;  // millis() when the window was closed
+  VoltageSummary summary;  // count, stddev, min/max, p1/p50/p99 over the window
+  uint16_t suppressed;     // windows held back by the dead-band since the previous record
+};
+
+// Upper bound of one serialized record, for sizing batch buffers
+#define TELEMETRY_RECORD_JSON_MAX 256
+
+// Per-sink throughput and latency counters
+struct SinkStats {
+  uint32_t enqueued;
+  uint32_t published;        // records delivered
+  uint32_t dropped;          // records lost because the queue was full
+  uint32_t rejected;         // records given up on after a permanent error
+  uint32_t failedBatches;
+  uint32_t retries;
+  uint32_t bytesSent;
+  uint32_t lastLatencyMs;    // duration of the last successful batch
+  uint32_t maxLatencyMs;
+  uint32_t totalLatencyMs;   // sum over successful batches
+  uint32_t batches;          // successful batches
+  unsigned long lastSuccessTime;
+  unsigned long startTime;
+};
+
+// Base class for every upload backend. Owns a fixed queue, batches records
+// and leaves retries to a RetryPolicy. Subclasses only implement the
+// transport.
+class TelemetrySink {
+public:
+  explicit TelemetrySink(const char* name);
+  virtual ~TelemetrySink() {}
+
+  const char* name() const { return sinkName; }
+
+  // Called once from setup()
+  virtual void begin() {}
+
+  // Queue a record. Returns false when the queue was full (backpressure),
+  // in which case the oldest record has been dropped to make room.
+  bool enqueue(const TelemetryRecord& record);
+
+  // Drive the sink from loop(): keeps the transport alive and, if the sink
+  // is ready and the retry policy allows, sends up to
+  // TELEMETRY_FLUSH_BATCHES batches.
+  void process();
+
+  size_t pending() const { return count; }
+  bool isBackpressured() const { return count >= TELEMETRY_QUEUE_SIZE; }
+  const SinkStats& stats() const { return sinkStats; }
+  const RetryPolicy& retryPolicy() const { return retry; }
+
+  // Records are waiting on a failed upload whose backoff has run out
+  bool retryDue() const {
+    return count > 0 && retry.consecutiveFailures() > 0 && retry.retryInMs() == 0;
+  }
+
+  // Records delivered per second since begin()
+  float throughput() const;
+
+protected:
+  // Deliver records[0..count). Returns how many leading records were
+  // delivered; 0 means the batch failed and will be retried.
+  virtual size_t sendBatch(const TelemetryRecord* records, size_t count) = 0;
+
+  // Largest batch the transport accepts
+  virtual size_t maxBatchSize() const { return 1; }
+
+  // False while the transport cannot send (e.g. no WiFi, no token)
+  virtual bool isReady() { return true; }
+
+  // Periodic housekeeping (keepalives, reconnects)
+  virtual void poll() {}
+
+  void addBytesSent(size_t bytes) { sinkStats.bytesSent += bytes; }
+
+  // HTTP code of a failed sendBatch(), for RetryPolicy::classify(); left
+  // unset the failure counts as a transport error
+  void setResultCode(int httpCode) { resultCode = httpCode; }
+
+private:
+  void pop(size_t n);
+
+  const char* sinkName;
+  TelemetryRecord queue[TELEMETRY_QUEUE_SIZE];
+  size_t head;
+  size_t count;
+
+  RetryPolicy retry;
+  int resultCode;
+  SinkStats sinkStats;
+};
+
+// Serialize records as a compact JSON array into buf (no heap).
+// Returns the length written, or 0 if buf was too small.
+size_t serializeTelemetryRecords(const TelemetryRecord* records, size_t count,
+                                 char* buf, size_t bufSize);
+
+// Fan-out registry: every published record goes to every registered sink
+namespace Telemetry {
+  bool addSink(TelemetrySink* sink);
+  void begin();
+  void publish(const TelemetryRecord& record);
+  void loop();
+
+  size_t sinkCount();
+  TelemetrySink* sink(size_t index);
+
+  // Latest successful delivery over all sinks (millis), 0 if none yet
+  unsigned long lastSuccessTime();
+
+  // Some sink should be retried now rather than at the next reading
+  bool retryDue();
+}
+
+#endif
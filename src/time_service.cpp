@@ -0,0 +1,149 @@
+#include "time_service.h"
+#include <sys/time.h>
+#include <esp_sntp.h>
+#include <esp_timer.h>
+#include <atomic>
+#include "serial_log.h"
+#include "seqlock.h"
+
+// The ESP clock starts at 1970 + uptime; anything before 2020 is unsynced
+static const time_t VALID_EPOCH = 1577836800;
+
+// Resyncs closer together than this are too noisy for a drift estimate
+static const int64_t MIN_DRIFT_SPAN_US = 600LL * 1000000;
+
+namespace {
+  // Filled by the SNTP callback on the lwIP task, consumed by loop()
+  std::atomic<bool> syncPending(false);
+  int64_t pendingMono = 0;
+  int64_t pendingUtc = 0;
+
+  bool started = false;
+  unsigned long beginMillis = 0;
+
+  // Monotonic -> UTC mapping. Written by loop() only, read from the web
+  // task too (/status, /chart, /export), so it is published as a whole
+  struct Mapping {
+    bool synced;
+    bool driftKnown;
+    int64_t refMono;  // last sync, monotonic us
+    int64_t refUtc;   // last sync, UTC us
+    double drift;     // ppm, + = local clock fast
+    int32_t correction;
+    uint32_t syncs;
+    unsigned long lastSync;
+  };
+  Mapping current = {};          // loop()'s copy
+  SeqLock<Mapping> published;
+
+  int64_t mapToUtc(const Mapping& m, int64_t monotonic) {
+    if (!m.synced) return 0;
+    int64_t elapsed = monotonic - m.refMono;
+    return m.refUtc + elapsed - (int64_t)(elapsed * m.drift * 1e-6);
+  }
+
+  void onSntpSync(struct timeval* tv) {
+    pendingMono = esp_timer_get_time();
+    pendingUtc = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+    syncPending.store(true, std::memory_order_release);
+  }
+
+  void recordSync(int64_t mono, int64_t utc) {
+    Mapping& m = current;
+    if (m.synced) {
+      // How far off the mapping had drifted since the last sync
+      int64_t err = utc - mapToUtc(m, mono);
+      if (err > INT32_MAX) err = INT32_MAX;
+      if (err < INT32_MIN) err = INT32_MIN;
+      m.correction = (int32_t)err;
+
+      int64_t localSpan = mono - m.refMono;
+      int64_t utcSpan = utc - m.refUtc;
+      if (localSpan >= MIN_DRIFT_SPAN_US && utcSpan > 0) {
+        double measured = (double)(localSpan - utcSpan) / utcSpan * 1e6;
+        m.drift = m.driftKnown ? m.drift + (measured - m.drift) / 4.0 : measured;
+        m.driftKnown = true;
+      }
+    }
+    m.refMono = mono;
+    m.refUtc = utc;
+    m.synced = true;
+    m.syncs++;
+    m.lastSync = millis();
+    published.write(m);
+    LOG_INFO("[Time] SNTP sync #%lu, correction %ld us, drift %.2f ppm",
+             (unsigned long)m.syncs, (long)m.correction, m.drift);
+  }
+}
+
+namespace TimeService {
+
+void begin() {
+  if (started) return;
+  sntp_set_time_sync_notification_cb(onSntpSync);
+  configTime(0, 0, NTP_SERVER_1, NTP_SERVER_2);
+  started = true;
+  beginMillis = millis();
+}
+
+bool loop() {
+  bool wasSynced = current.synced;
+
+  if (syncPending.exchange(false, std::memory_order_acquire)) {
+    recordSync(pendingMono, pendingUtc);
+  } else if (!current.synced && started) {
+    // The callback can be missed if SNTP synced before it was registered
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    if (tv.tv_sec >= VALID_EPOCH) {
+      recordSync(esp_timer_get_time(), (int64_t)tv.tv_sec * 1000000 + tv.tv_usec);
+    }
+  }
+
+  return current.synced && !wasSynced;
+}
+
+bool isSynced() {
+  return published.read().synced;
+}
+
+bool waitingForSync() {
+  return started && !isSynced() && millis() - beginMillis < TIME_SYNC_WAIT_MS;
+}
+
+int64_t monotonicMicros() {
+  return esp_timer_get_time();
+}
+
+int64_t toUtcMicros(int64_t monotonic) {
+  return mapToUtc(published.read(), monotonic);
+}
+
+time_t utcFromMillis(unsigned long ms) {
+  const Mapping m = published.read();
+  if (!m.synced) return 0;
+  unsigned long age = millis() - ms;  // wraps correctly
+  return (time_t)(mapToUtc(m, monotonicMicros() - (int64_t)age * 1000) / 1000000);
+}
+
+time_t now() {
+  return (time_t)(toUtcMicros(monotonicMicros()) / 1000000);
+}
+
+float driftPpm() {
+  return (float)published.read().drift;
+}
+
+int32_t lastCorrectionMicros() {
+  return published.read().correction;
+}
+
+uint32_t syncCount() {
+  return published.read().syncs;
+}
+
+unsigned long lastSyncMillis() {
+  return published.read().lastSync;
+}
+
+}  // namespace TimeService
@@ -0,0 +1,58 @@
+#ifndef TIME_SERVICE_H
+#define TIME_SERVICE_H
+
+#include <Arduino.h>
+#include <time.h>
+
+// Background time service. SNTP runs in the lwIP task; every sync is
+// recorded as a (monotonic, UTC) pair. Timestamps are taken on the
+// monotonic clock and mapped to UTC through the last sync's offset plus a
+// tracked drift estimate, so samples taken before the first sync get
+// their UTC time retroactively and nothing ever waits for NTP.
+// loop() is the only writer; the getters are safe from any task.
+
+#ifndef NTP_SERVER_1
+#define NTP_SERVER_1 "pool.ntp.org"
+#endif
+#ifndef NTP_SERVER_2
+#define NTP_SERVER_2 "time.google.com"
+#endif
+
+// How long uploads hold records back waiting for the first sync, so they
+// go out with real timestamps instead of none
+#ifndef TIME_SYNC_WAIT_MS
+#define TIME_SYNC_WAIT_MS 120000
+#endif
+
+namespace TimeService {
+  // Start SNTP in the background (once WiFi is up). Never blocks.
+  void begin();
+
+  // Consume sync events from loop(). Returns true on the first sync after
+  // boot, when pre-sync timestamps can be resolved.
+  bool loop();
+
+  bool isSynced();
+
+  // Still inside the TIME_SYNC_WAIT_MS grace period after begin()
+  bool waitingForSync();
+
+  // Microseconds since boot, never jumps
+  int64_t monotonicMicros();
+
+  // UTC in microseconds for a monotonic timestamp, 0 if not synced yet
+  int64_t toUtcMicros(int64_t monotonic);
+
+  // UTC seconds for a millis() timestamp from the past 49 days, 0 if not synced
+  time_t utcFromMillis(unsigned long ms);
+
+  // Current UTC seconds, 0 if not synced
+  time_t now();
+
+  float driftPpm();                 // local clock rate error, + = fast
+  int32_t lastCorrectionMicros();   // prediction error at the last resync
+  uint32_t syncCount();
+  unsigned long lastSyncMillis();   // 0 if never synced
+}
+
+#endif
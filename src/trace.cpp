@@ -0,0 +1,136 @@
+#include "trace.h"
+
+#if VOLTAGELOG_TRACE
+
+#include <atomic>
+
+#ifdef ARDUINO
+#include <esp_timer.h>
+#else
+#include <chrono>
+#endif
+
+namespace Trace {
+
+namespace {
+  // A slot is claimed with writeSeq and stamped with its sequence number + 1
+  // once written; 0 while a write is in progress. The fields are atomics so
+  // a reader copying a slot that is being rewritten stays well-defined.
+  struct Slot {
+    std::atomic<uint32_t> stamp;
+    std::atomic<const char*> name;
+    std::atomic<uint32_t> micros;      // low 32 bits
+    std::atomic<uint16_t> microsHigh;  // next 16 (~9 years)
+    std::atomic<char> phase;
+  };
+
+  struct Event {
+    const char* name;
+    uint64_t micros;
+    char phase;
+  };
+
+  Slot slots[TRACE_BUFFER_SIZE];
+  std::atomic<uint32_t> writeSeq(0);  // sequence number of the next event
+
+  const char HEADER[] = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  const char FOOTER[] = "]}\n";
+  const size_t HEADER_LEN = sizeof(HEADER) - 1;
+  const size_t FOOTER_LEN = sizeof(FOOTER) - 1;
+
+  // Consistent copy of event seq; false if its slot has been (or is being)
+  // rewritten by a later event
+  bool readEvent(uint32_t seq, Event& e) {
+    const Slot& s = slots[seq % TRACE_BUFFER_SIZE];
+    if (s.stamp.load(std::memory_order_acquire) != seq + 1) return false;
+    e.name = s.name.load(std::memory_order_relaxed);
+    e.micros = ((uint64_t)s.microsHigh.load(std::memory_order_relaxed) << 32) |
+               s.micros.load(std::memory_order_relaxed);
+    e.phase = s.phase.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return s.stamp.load(std::memory_order_relaxed) == seq + 1;
+  }
+}
+
+#ifdef ARDUINO
+static inline uint64_t readMicros() {
+  return esp_timer_get_time();
+}
+#else
+// Native build: the steady clock, so probes show host CPU time even when the
+// virtual clock stands still
+static inline uint64_t readMicros() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+void record(const char* name, char phase) {
+  uint64_t micros = readMicros();
+
+  uint32_t seq = writeSeq.fetch_add(1, std::memory_order_relaxed);
+  Slot& s = slots[seq % TRACE_BUFFER_SIZE];
+  s.stamp.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  s.name.store(name, std::memory_order_relaxed);
+  s.micros.store((uint32_t)micros, std::memory_order_relaxed);
+  s.microsHigh.store((uint16_t)(micros >> 32), std::memory_order_relaxed);
+  s.phase.store(phase, std::memory_order_relaxed);
+  s.stamp.store(seq + 1, std::memory_order_release);
+}
+
+void range(uint32_t& from, uint32_t& to) {
+  to = writeSeq.load(std::memory_order_acquire);
+  from = to > TRACE_BUFFER_SIZE ? to - TRACE_BUFFER_SIZE : 0;
+}
+
+// Format one event as a fixed-width JSON line (padded with spaces)
+static void formatEvent(uint32_t seq, uint32_t to, char* line) {
+  Event e;
+  int n;
+  if (!readEvent(seq, e)) {
+    // Overwritten while the export was running, or still being written
+    n = snprintf(line, LINE_LEN, "{\"name\":\"overwritten\",\"ph\":\"i\",\"ts\":0,\"pid\":1,\"tid\":1}");
+  } else {
+    n = snprintf(line, LINE_LEN, "{\"name\":\"%.32s\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":1,\"tid\":1}",
+                 e.name, e.phase, (unsigned long long)e.micros);
+  }
+  if (n < 0) n = 0;
+  if ((size_t)n > LINE_LEN - 2) n = LINE_LEN - 2;
+
+  // Separator and padding, last line has no comma
+  line[n++] = (seq + 1 < to) ? ',' : ' ';
+  while ((size_t)n < LINE_LEN - 1) line[n++] = ' ';
+  line[LINE_LEN - 1] = '\n';
+}
+
+size_t render(uint32_t from, uint32_t to, uint8_t* buf, size_t maxLen, size_t index) {
+  size_t eventsLen = (size_t)(to - from) * LINE_LEN;
+  size_t total = HEADER_LEN + eventsLen + FOOTER_LEN;
+  size_t written = 0;
+
+  while (written < maxLen && index < total) {
+    if (index < HEADER_LEN) {
+      buf[written++] = HEADER[index++];
+    } else if (index < HEADER_LEN + eventsLen) {
+      size_t offset = index - HEADER_LEN;
+      uint32_t seq = from + offset / LINE_LEN;
+      size_t col = offset % LINE_LEN;
+
+      char line[LINE_LEN + 1];
+      formatEvent(seq, to, line);
+      while (col < LINE_LEN && written < maxLen) {
+        buf[written++] = line[col++];
+        index++;
+      }
+    } else {
+      buf[written++] = FOOTER[index - HEADER_LEN - eventsLen];
+      index++;
+    }
+  }
+  return written;
+}
+
+}  // namespace Trace
+
+#endif  // VOLTAGELOG_TRACE
@@ -0,0 +1,62 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+
+// Lightweight scoped tracing probes. Begin/end events are timestamped with
+// esp_timer (64-bit microseconds, never wraps) and written into a fixed RAM
+// ring buffer, which is exported on /trace in Chrome trace-event JSON
+// (chrome://tracing, Perfetto). Probes may fire from any task.
+//
+// Build with -DVOLTAGELOG_TRACE=0 to compile every probe out completely.
+
+#ifndef VOLTAGELOG_TRACE
+#define VOLTAGELOG_TRACE 1
+#endif
+
+// Number of events kept in RAM (16 bytes each)
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE 256
+#endif
+
+namespace Trace {
+
+// Every exported event line is padded to this width so a chunked response
+// can seek straight to any byte offset without re-rendering from the start
+static const size_t LINE_LEN = 96;
+
+// name must point to a string literal, phase is 'B' or 'E'
+void record(const char* name, char phase);
+
+// Freeze the current contents for export: returns the event sequence range
+void range(uint32_t& from, uint32_t& to);
+
+// Render events [from, to) as Chrome trace JSON and copy the bytes
+// [index, index + maxLen) into buf. Returns bytes copied, 0 at the end.
+size_t render(uint32_t from, uint32_t to, uint8_t* buf, size_t maxLen, size_t index);
+
+class Scope {
+public:
+  explicit Scope(const char* name) : name(name) { record(name, 'B'); }
+  ~Scope() { record(name, 'E'); }
+
+private:
+  const char* name;
+};
+
+}  // namespace Trace
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#if VOLTAGELOG_TRACE
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#define TRACE_BEGIN(name) Trace::record(name, 'B')
+#define TRACE_END(name) Trace::record(name, 'E')
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#endif
+
+#endif
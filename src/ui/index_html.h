@@ -35,6 +35,11 @@ const char indexHtml[] PROGMEM = R"HTML(<!DOCTYPE html>
       <ul class="network-list" id="networkList"></ul>
       <p class="small">Dodirni mrežu da automatski upiše SSID u polje iznad.</p>
     </div>
+    <div class="chart">
+      <h2>Napon</h2>
+      <canvas id="chart"></canvas>
+      <p class="small" id="chartInfo">učitavam...</p>
+    </div>
   </div>
   <script>
 <!--JS_PLACEHOLDER-->
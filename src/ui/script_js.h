@@ -64,6 +64,77 @@ scanBtn.addEventListener("click", () => {
       setStatus("greška pri skeniranju: " + err.message);
     });
 });
+
+// Voltage chart. /chart sends at most one point per canvas pixel:
+// uint32 n, UTC of the first point, its age in ms; then n uint32 ms after
+// the first point and n int16 values in 10 mV (little endian).
+const chartEl = document.getElementById("chart");
+const chartInfo = document.getElementById("chartInfo");
+
+function drawChart(buf) {
+  const head = new Uint32Array(buf, 0, 3);
+  const n = head[0];
+  const t = new Uint32Array(buf, 12, n);
+  const v = new Int16Array(buf, 12 + 4 * n, n);
+  const ctx = chartEl.getContext("2d");
+  const w = chartEl.width, h = chartEl.height;
+  const dpr = window.devicePixelRatio || 1;
+  ctx.clearRect(0, 0, w, h);
+
+  if (n === 0) {
+    chartInfo.textContent = "još nema mjerenja.";
+    return;
+  }
+
+  let lo = v[0], hi = v[0];
+  for (let i = 1; i < n; i++) {
+    if (v[i] < lo) lo = v[i];
+    if (v[i] > hi) hi = v[i];
+  }
+  if (hi - lo < 10) {  // keep a flat line off the edges
+    lo -= 5;
+    hi += 5;
+  }
+
+  const pad = 6 * dpr;
+  const span = t[n - 1] || 1;
+  ctx.strokeStyle = "#2563eb";
+  ctx.lineWidth = 1.5 * dpr;
+  ctx.beginPath();
+  for (let i = 0; i < n; i++) {
+    const x = pad + (w - 2 * pad) * t[i] / span;
+    const y = h - pad - (h - 2 * pad) * (v[i] - lo) / (hi - lo);
+    if (i === 0) ctx.moveTo(x, y); else ctx.lineTo(x, y);
+  }
+  ctx.stroke();
+
+  ctx.fillStyle = "#6b7280";
+  ctx.font = (11 * dpr) + "px sans-serif";
+  ctx.fillText((hi / 100).toFixed(2) + " V", pad, pad + 11 * dpr);
+  ctx.fillText((lo / 100).toFixed(2) + " V", pad, h - pad);
+
+  const since = head[1] ? "od " + new Date(head[1] * 1000).toLocaleString()
+                        : "zadnjih " + (head[2] / 3600000).toFixed(1) + " h";
+  chartInfo.textContent = since + ", " + n + " točaka, zadnje " + (v[n - 1] / 100).toFixed(2) + " V";
+}
+
+function loadChart() {
+  const dpr = window.devicePixelRatio || 1;
+  chartEl.width = Math.round(chartEl.clientWidth * dpr);
+  chartEl.height = Math.round(chartEl.clientHeight * dpr);
+  fetch("/chart?points=" + chartEl.width)
+    .then(r => {
+      if (!r.ok) throw new Error("HTTP " + r.status);
+      return r.arrayBuffer();
+    })
+    .then(drawChart)
+    .catch(err => {
+      chartInfo.textContent = "graf nije dostupan: " + err.message;
+    });
+}
+
+loadChart();
+setInterval(loadChart, 30000);
 )JS";
 
 #endif // SCRIPT_JS_H
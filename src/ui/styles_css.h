@@ -133,6 +133,25 @@ button {
   color: #6b7280;
 }
 
+.chart {
+  margin-top: 20px;
+  border-top: 1px solid #e5e7eb;
+  padding-top: 16px;
+}
+
+.chart h2 {
+  font-size: 1rem;
+  margin: 0 0 8px;
+}
+
+.chart canvas {
+  display: block;
+  width: 100%;
+  height: 160px;
+  border-radius: 8px;
+  background: #f9fafb;
+}
+
 .small {
   font-size: 0.8rem;
   color: #9ca3af;
@@ -2,8 +2,22 @@
 #include <WiFi.h>
 #include <ESPAsyncWebServer.h>
 #include <ArduinoJson.h>
+#include <memory>
 #include "webserver.h"
+#include "device_identity.h"
 #include "config.h"
+#include "telemetry_sink.h"
+#include "metrics.h"
+#include "trace.h"
+#include "serial_log.h"
+#include "adc_range.h"
+#include "time_service.h"
+#include "ota.h"
+#include "admission.h"
+#include "boot.h"
+#include "chart.h"
+#include "sample_export.h"
+#include "settings.h"
 #include "ui/index_html.h"
 #include "ui/styles_css.h"
 #include "ui/script_js.h"
@@ -14,9 +28,24 @@ AsyncWebServer server(80);
 // Flag to start routes and server only once
 static bool serverSetup = false;
 
+// Admission cost of the small routes: what the response holds until sent
+static const size_t STATUS_COST = 2048;
+static const size_t SCAN_COST = 1024;
+static const size_t SMALL_COST = 256;
+static const size_t SETTINGS_COST = 1536;
+
+// Largest /settings PATCH body taken
+static const size_t SETTINGS_MAX_BODY = 512;
+
+// Upper bound of the page size, placeholders included
+static size_t htmlPageBytes() {
+  return strlen_P(indexHtml) + strlen_P(stylesCss) + strlen_P(scriptJs);
+}
+
 // HTML builder function - combines HTML template with CSS and JS from PROGMEM
 String buildHtmlPage() {
   String html = "";
+  html.reserve(htmlPageBytes());  // one allocation instead of one per growth step
   
   // Read entire HTML from PROGMEM
   int htmlLen = strlen_P(indexHtml);
@@ -49,70 +78,217 @@ String buildHtmlPage() {
   return html;
 }
 
+// Window statistics as a JSON object
+static void addSummary(JsonObject obj, const VoltageSummary& s) {
+  obj["count"] = s.count;
+  obj["mean"] = s.mean;
+  obj["stddev"] = s.stddev;
+  obj["min"] = s.min;
+  obj["max"] = s.max;
+  obj["p1"] = s.p1;
+  obj["p50"] = s.p50;
+  obj["p99"] = s.p99;
+}
+
+// ms until the reading that closes the send window in progress: the first
+// one more than a send interval after it began
+static unsigned long nextSendIn(const DeviceStatus& s, unsigned long now) {
+  const Settings::Values& cfg = Settings::get();
+  unsigned long due = s.windowStart + cfg.sendIntervalMs;
+  unsigned long next = s.lastReadTime + cfg.sampleIntervalMs;
+  if ((long)(due - next) >= 0) next += ((due - next) / cfg.sampleIntervalMs + 1) * cfg.sampleIntervalMs;
+  return (long)(next - now) > 0 ? next - now : 0;
+}
+
+// /status body
+String buildStatusJson() {
+  // One consistent copy, loop() may publish meanwhile
+  const DeviceStatus status = deviceStatus.read();
+
+  DynamicJsonDocument doc(3072);
+  doc["device"] = DeviceIdentity::id();
+  doc["name"] = DeviceIdentity::name();
+  doc["hostname"] = DeviceIdentity::hostname();
+  doc["tags"] = DeviceIdentity::tags();
+  doc["version"] = status.version;
+  doc["uptime"] = millis() / 1000;  // uptime in seconds
+  
+  // Voltage readings
+  JsonObject voltage = doc.createNestedObject("voltage");
+  voltage["current"] = status.lastVoltage;
+  voltage["raw"] = status.lastRawValue;
+  voltage["adcRange"] = AdcRanging::rangeInfo(status.lastAdcRange).name;
+  voltage["rangeSwitches"] = status.rangeSwitches;
+  voltage["unit"] = "V";
+
+  // Window / run statistics
+  JsonObject stats = doc.createNestedObject("stats");
+  addSummary(stats.createNestedObject("window"), status.window);
+  addSummary(stats.createNestedObject("lastWindow"), status.lastWindow);
+  addSummary(stats.createNestedObject("total"), status.total);
+  stats["windows"] = status.windows;
+  JsonObject histogram = stats.createNestedObject("histogram");
+  histogram["min"] = status.histogramMin;
+  histogram["binWidth"] = status.histogramBinWidth;
+  histogram["under"] = status.histogramUnder;
+  histogram["over"] = status.histogramOver;
+  JsonArray bins = histogram.createNestedArray("bins");
+  for (size_t i = 0; i < STATS_HISTOGRAM_BINS; i++) bins.add(status.histogram[i]);
+
+  // Stored history
+  JsonObject store = doc.createNestedObject("store");
+  store["samples"] = sampleStore.samples();
+  store["blocks"] = sampleStore.blocks();
+  store["bitsPerSample"] = sampleStore.bitsPerSample();
+  store["dropped"] = sampleStore.dropped();
+  uint32_t oldest, newest;
+  if (sampleStore.span(oldest, newest)) {
+    store["oldest"] = oldest;
+    store["newest"] = newest;
+  }
+  
+  // WiFi status
+  JsonObject wifi = doc.createNestedObject("wifi");
+  wifi["connected"] = wifiConnected;
+  wifi["ssid"] = wifiConnected ? WiFi.SSID().c_str() : "";
+  wifi["ip"] = wifiConnected ? WiFi.localIP().toString().c_str() : "";
+  wifi["rssi"] = wifiConnected ? WiFi.RSSI() : 0;
+  
+  // Firebase status
+  JsonObject firebase = doc.createNestedObject("firebase");
+  firebase["connected"] = status.firebaseConnected;
+  firebase["lastSend"] = status.lastSendTime;
+  
+  // Clock
+  JsonObject clock = doc.createNestedObject("time");
+  clock["synced"] = TimeService::isSynced();
+  clock["utc"] = (unsigned long)TimeService::now();
+  clock["driftPpm"] = TimeService::driftPpm();
+  clock["lastCorrectionUs"] = TimeService::lastCorrectionMicros();
+  clock["syncs"] = TimeService::syncCount();
+  clock["lastSync"] = TimeService::lastSyncMillis();
+
+  // Readings timing
+  JsonObject timing = doc.createNestedObject("timing");
+  timing["lastRead"] = status.lastReadTime;
+  timing["lastSend"] = status.lastSendTime;
+  timing["sendIntervalMs"] = Settings::get().sendIntervalMs;
+  timing["nextSendInMs"] = nextSendIn(status, millis());  // the dead-band may still hold the record back
+  timing["records"] = status.recordNumber;
+
+  // Start-up phases reached so far, ms since boot
+  JsonObject boot = doc.createNestedObject("boot");
+  for (uint8_t i = 0; i < Boot::PHASE_COUNT; i++) {
+    Boot::Phase phase = (Boot::Phase)i;
+    if (Boot::reached(phase)) boot[Boot::phaseName(phase)] = Boot::at(phase);
+  }
+
+  // Per-sink upload metrics
+  JsonArray sinks = doc.createNestedArray("sinks");
+  for (size_t i = 0; i < Telemetry::sinkCount(); i++) {
+    TelemetrySink* sink = Telemetry::sink(i);
+    const SinkStats& st = sink->stats();
+    JsonObject s = sinks.createNestedObject();
+    s["name"] = sink->name();
+    s["pending"] = sink->pending();
+    s["published"] = st.published;
+    s["dropped"] = st.dropped;
+    s["failedBatches"] = st.failedBatches;
+    s["rejected"] = st.rejected;
+    const RetryPolicy& retry = sink->retryPolicy();
+    s["breaker"] = retry.stateName();
+    s["retryInMs"] = retry.retryInMs();
+    s["failures"] = retry.consecutiveFailures();
+    s["breakerOpens"] = retry.breakerOpens();
+    s["bytesSent"] = st.bytesSent;
+    s["throughput"] = sink->throughput();
+    s["lastLatencyMs"] = st.lastLatencyMs;
+    s["maxLatencyMs"] = st.maxLatencyMs;
+    s["avgLatencyMs"] = st.batches ? st.totalLatencyMs / st.batches : 0;
+  }
+  
+  String response;
+  serializeJson(doc, response);
+  return response;
+}
+
+// /ota request state between its body pieces and its handler (_tempObject)
+struct OtaUpload {
+  bool admitted;
+  Ota::Result result;
+};
+
+static bool otaAuthorized(AsyncWebServerRequest *request) {
+  AsyncWebHeader *token = request->getHeader("X-OTA-Token");
+  return token && Ota::authorized(token->value().c_str());
+}
+
+// Settings changes need the OTA token when one is set; without one they
+// are as open as /config
+static bool settingsAuthorized(AsyncWebServerRequest *request) {
+  return strlen(OTA_TOKEN) == 0 || otaAuthorized(request);
+}
+
+// Session state as JSON, for every OTA reply
+static void sendOtaStatus(AsyncWebServerRequest *request, int code) {
+  DynamicJsonDocument doc(768);
+  doc["state"] = Ota::stateName();
+  doc["received"] = Ota::received();
+  doc["written"] = Ota::written();
+  if (Ota::error()) doc["error"] = Ota::error();
+  doc["running"] = Ota::runningPartition();
+  doc["target"] = Ota::updatePartition();
+  doc["pendingVerify"] = Ota::pendingVerify();
+
+  if (Ota::hasReport()) {
+    const Ota::Report& r = Ota::lastReport();
+    JsonObject last = doc.createNestedObject("lastUpdate");
+    last["source"] = r.source == Ota::SOURCE_PULL ? "pull" : "push";
+    last["compressed"] = r.compressed;
+    last["durationMs"] = r.durationMs;
+    last["radioOnMs"] = r.radioOnMs;
+    last["bytesIn"] = r.bytesIn;
+    last["bytesOut"] = r.bytesOut;
+    last["resumes"] = r.resumes;
+  }
+
+  String response;
+  serializeJson(doc, response);
+  request->send(code, "application/json", response);
+}
+
 void setupWebServer() {
-  Serial.println("Setting up web server...");
+  LOG_INFO("Setting up web server...");
 
   if (!serverSetup) {
     // Main page - any method (GET, HEAD...)
     server.on("/", [](AsyncWebServerRequest *request) {
-      Serial.print("Request: ");
-      Serial.println(request->url());
+      Metrics::countRequest(Metrics::ROUTE_ROOT);
+      if (!Admission::admit(request, Metrics::ROUTE_ROOT, htmlPageBytes())) return;
+      LOG_DEBUG("Request: %s", request->url().c_str());
       String htmlContent = buildHtmlPage();
       request->send(200, "text/html", htmlContent);
     });
 
     // /status - JSON status endpoint
     server.on("/status", [](AsyncWebServerRequest *request) {
-      Serial.println("Request /status");
-      
-      // Create JSON status response
-      DynamicJsonDocument doc(512);
-      doc["device"] = "ESP32-C3-VoltageLog";
-      doc["version"] = deviceStatus.version;
-      doc["uptime"] = millis() / 1000;  // uptime in seconds
-      
-      // Voltage readings
-      JsonObject voltage = doc.createNestedObject("voltage");
-      voltage["current"] = deviceStatus.lastVoltage;
-      voltage["raw"] = deviceStatus.lastRawValue;
-      voltage["unit"] = "V";
-      
-      // WiFi status
-      JsonObject wifi = doc.createNestedObject("wifi");
-      wifi["connected"] = wifiConnected;
-      wifi["ssid"] = wifiConnected ? WiFi.SSID().c_str() : "";
-      wifi["ip"] = wifiConnected ? WiFi.localIP().toString().c_str() : "";
-      wifi["rssi"] = wifiConnected ? WiFi.RSSI() : 0;
-      
-      // Firebase status
-      JsonObject firebase = doc.createNestedObject("firebase");
-      firebase["connected"] = deviceStatus.firebaseConnected;
-      firebase["lastSend"] = deviceStatus.lastSendTime;
-      
-      // Readings timing
-      JsonObject timing = doc.createNestedObject("timing");
-      timing["lastRead"] = deviceStatus.lastReadTime;
-      timing["lastSend"] = deviceStatus.lastSendTime;
-      timing["nextSendIn"] = "60s";  // hardcoded for now
-      
-      String response;
-      serializeJson(doc, response);
-      
-      request->send(200, "application/json", response);
+      LOG_DEBUG("Request /status");
+      Metrics::countRequest(Metrics::ROUTE_STATUS);
+      if (!Admission::admit(request, Metrics::ROUTE_STATUS, STATUS_COST)) return;
+      request->send(200, "application/json", buildStatusJson());
     });
 
     // /config – save SSID / password, accepts any method (form sends POST)
     server.on("/config", [](AsyncWebServerRequest *request) {
-      Serial.println("\n=== POST /config ===");
+      LOG_INFO("=== POST /config ===");
+      Metrics::countRequest(Metrics::ROUTE_CONFIG);
+      if (!Admission::admit(request, Metrics::ROUTE_CONFIG, SMALL_COST)) return;
 
       if (request->hasParam("ssid", true) && request->hasParam("password", true)) {
         String ssid = request->getParam("ssid", true)->value();
         String password = request->getParam("password", true)->value();
 
-        Serial.print("SSID: ");
-        Serial.println(ssid);
-        Serial.print("Password length: ");
-        Serial.println(password.length());
+        LOG_INFO("SSID: %s, password length: %u", ssid.c_str(), (unsigned)password.length());
 
         // Save to EEPROM
         saveWiFiConfig(ssid.c_str(), password.c_str());
@@ -120,8 +296,7 @@ void setupWebServer() {
         // Verify if saved correctly
         WiFiConfig testConfig;
         loadWiFiConfig(testConfig);
-        Serial.print("Verification - SSID from EEPROM: ");
-        Serial.println(testConfig.ssid);
+        LOG_INFO("Verification - SSID from EEPROM: %s", testConfig.ssid);
 
         // Send response
         request->send(200, "text/plain", "OK! Rebooting...");
@@ -130,14 +305,16 @@ void setupWebServer() {
         delay(2000);
         ESP.restart();
       } else {
-        Serial.println("Missing SSID or password");
+        LOG_WARN("Missing SSID or password");
         request->send(400, "text/plain", "Missing params");
       }
     });
 
     // /scan – network scanning
     server.on("/scan", [](AsyncWebServerRequest *request) {
-      Serial.println("Request /scan");
+      LOG_DEBUG("Request /scan");
+      Metrics::countRequest(Metrics::ROUTE_SCAN);
+      if (!Admission::admit(request, Metrics::ROUTE_SCAN, SCAN_COST)) return;
 
       int n = WiFi.scanNetworks(false, false);  // blocking scan
 
@@ -154,19 +331,278 @@ void setupWebServer() {
       }
       json += "]";
 
-      Serial.print("Networks found: ");
-      Serial.println(n);
+      LOG_INFO("Networks found: %d", n);
 
       request->send(200, "application/json", json);
       WiFi.scanDelete();
     });
 
+    // /chart?points=N - LTTB-downsampled history as binary (chart.h). The
+    // page asks for as many points as its canvas is wide.
+    server.on("/chart", HTTP_GET, [](AsyncWebServerRequest *request) {
+      Metrics::countRequest(Metrics::ROUTE_CHART);
+      long points = request->hasParam("points") ? request->getParam("points")->value().toInt()
+                                                : CHART_DEFAULT_POINTS;
+      if (points < 3) points = 3;
+      if (points > CHART_MAX_POINTS) points = CHART_MAX_POINTS;
+      if (!Admission::admit(request, Metrics::ROUTE_CHART, points * sizeof(Sample))) return;
+
+      std::shared_ptr<Sample> buf(new (std::nothrow) Sample[points], std::default_delete<Sample[]>());
+      if (!buf) {
+        request->send(503, "text/plain", "Out of memory");
+        return;
+      }
+      size_t n = Chart::downsample(sampleStore, buf.get(), points);
+      uint32_t firstUtc = n ? (uint32_t)TimeService::utcFromMillis(buf.get()[0].time) : 0;
+      uint32_t firstAge = n ? millis() - buf.get()[0].time : 0;
+
+      AsyncWebServerResponse *response = request->beginResponse(
+          "application/octet-stream", Chart::payloadBytes(n),
+          [buf, n, firstUtc, firstAge](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            return Chart::render(buf.get(), n, firstUtc, firstAge, buffer, maxLen, index);
+          });
+      response->addHeader("Cache-Control", "no-store");
+      request->send(response);
+    });
+
+    // /export?format=csv|bin&from=ms&to=ms - the stored history in bulk
+    // (sample_export.h), whole or one Range of it. The X-Export-Token of
+    // the first response, sent back as ?token=, resumes the same export.
+    server.on("/export", HTTP_GET, [](AsyncWebServerRequest *request) {
+      Metrics::countRequest(Metrics::ROUTE_EXPORT);
+      if (!Admission::admit(request, Metrics::ROUTE_EXPORT, sizeof(SampleExport::Reader))) return;
+
+      SampleExport::Plan plan;
+      if (request->hasParam("token")) {
+        if (!SampleExport::parseToken(request->getParam("token")->value().c_str(), plan)) {
+          request->send(400, "text/plain", "Invalid token");
+          return;
+        }
+      } else {
+        String format = request->hasParam("format") ? request->getParam("format")->value() : "csv";
+        if (format != "csv" && format != "bin") {
+          request->send(400, "text/plain", "format must be csv or bin");
+          return;
+        }
+        uint32_t from = request->hasParam("from") ? strtoul(request->getParam("from")->value().c_str(), nullptr, 10) : 0;
+        uint32_t to = request->hasParam("to") ? strtoul(request->getParam("to")->value().c_str(), nullptr, 10)
+                                              : millis();
+        plan = SampleExport::plan(sampleStore, format == "csv" ? SampleExport::FORMAT_CSV : SampleExport::FORMAT_BINARY,
+                                  from, to);
+      }
+
+      size_t total = SampleExport::totalBytes(plan);
+      size_t start = 0, end = total;
+      AsyncWebHeader *range = request->getHeader("Range");
+      // More than one range is not supported; the whole body is sent instead
+      bool partial = range && !strchr(range->value().c_str(), ',');
+      if (partial && !SampleExport::parseRange(range->value().c_str(), total, start, end)) {
+        AsyncWebServerResponse *response = request->beginResponse(416, "text/plain", "Range not satisfiable");
+        response->addHeader("Content-Range", "bytes */" + String((unsigned long)total));
+        request->send(response);
+        return;
+      }
+
+      std::shared_ptr<SampleExport::Reader> reader(new (std::nothrow) SampleExport::Reader());
+      if (!reader) {
+        request->send(503, "text/plain", "Out of memory");
+        return;
+      }
+      if (!reader->seek(sampleStore, plan, start, end)) {
+        request->send(410, "text/plain", "Samples no longer stored, start a new export");
+        return;
+      }
+
+      char token[SampleExport::TOKEN_LEN + 1];
+      SampleExport::token(plan, token);
+      bool csv = plan.format == SampleExport::FORMAT_CSV;
+      AsyncWebServerResponse *response = request->beginResponse(
+          csv ? "text/csv" : "application/octet-stream", end - start,
+          [reader, request](uint8_t *buffer, size_t maxLen, size_t) -> size_t {
+            size_t n = reader->read(buffer, maxLen);
+            // Cut short by recycling: the library would keep waiting for the
+            // rest of the Content-Length, so reset the connection and let
+            // the client see the cut and resume
+            if (n == 0 && reader->cutShort()) request->client()->abort();
+            return n;
+          });
+      if (partial) {
+        response->setCode(206);
+        response->addHeader("Content-Range", "bytes " + String((unsigned long)start) + "-" +
+                                             String((unsigned long)(end - 1)) + "/" + String((unsigned long)total));
+      }
+      response->addHeader("Accept-Ranges", "bytes");
+      response->addHeader("ETag", String("\"") + token + "\"");
+      response->addHeader("X-Export-Token", token);
+      response->addHeader("Content-Disposition", "attachment; filename=\"" + String(DeviceIdentity::id()) + "-" +
+                                                 String((unsigned long)plan.fromMs) + (csv ? ".csv\"" : ".bin\""));
+      response->addHeader("Cache-Control", "no-store");
+      request->send(response);
+    });
+
+    // /settings - run-time settings (settings.h). GET gives the values,
+    // ?schema=1 adds type, range and default of each; PATCH takes an
+    // object of the keys to change and they apply before the next reading
+    server.on("/settings", HTTP_GET, [](AsyncWebServerRequest *request) {
+      Metrics::countRequest(Metrics::ROUTE_SETTINGS);
+      if (!Admission::admit(request, Metrics::ROUTE_SETTINGS, SETTINGS_COST)) return;
+      request->send(200, "application/json", Settings::toJson(request->hasParam("schema")));
+    });
+
+    server.on("/settings", HTTP_PATCH,
+      [](AsyncWebServerRequest *request) {
+        Metrics::countRequest(Metrics::ROUTE_SETTINGS);
+        if (!Admission::admit(request, Metrics::ROUTE_SETTINGS, SETTINGS_COST)) return;
+        if (!settingsAuthorized(request)) {
+          request->send(401, "text/plain", "Unauthorized");
+          return;
+        }
+        const char *body = (const char *)request->_tempObject;
+        if (!body) {
+          request->send(400, "text/plain", "Missing or oversized body");
+          return;
+        }
+        char error[96];
+        if (!Settings::patch(body, strlen(body), error, sizeof(error))) {
+          request->send(400, "text/plain", error);
+          return;
+        }
+        request->send(200, "application/json", Settings::toJson(false));
+      },
+      nullptr,
+      [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        if (total > SETTINGS_MAX_BODY) return;
+        if (index == 0) {
+          // NUL-terminated copy, freed with the request
+          request->_tempObject = calloc(total + 1, 1);
+        }
+        if (!request->_tempObject || index + len > total) return;
+        memcpy((char *)request->_tempObject + index, data, len);
+      });
+
+    // /metrics - Prometheus text exposition, streamed in chunks from a
+    // snapshot so the page is never built in one String
+    server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request) {
+      Metrics::countRequest(Metrics::ROUTE_METRICS);
+      if (!Admission::admit(request, Metrics::ROUTE_METRICS, sizeof(Metrics::Snapshot))) return;
+
+      Metrics::Snapshot snap;
+      Metrics::takeSnapshot(snap);
+      AsyncWebServerResponse *response = request->beginChunkedResponse(
+          "text/plain; version=0.0.4",
+          [snap](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            return Metrics::render(snap, buffer, maxLen, index);
+          });
+      request->send(response);
+    });
+
+#if VOLTAGELOG_TRACE
+    // /trace - ring buffer of loop() probes as Chrome trace-event JSON.
+    // Lines are fixed width, so each chunk is rendered straight from the ring.
+    server.on("/trace", HTTP_GET, [](AsyncWebServerRequest *request) {
+      Metrics::countRequest(Metrics::ROUTE_TRACE);
+      if (!Admission::admit(request, Metrics::ROUTE_TRACE, SMALL_COST)) return;
+
+      uint32_t from, to;
+      Trace::range(from, to);
+      AsyncWebServerResponse *response = request->beginChunkedResponse(
+          "application/json",
+          [from, to](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            return Trace::render(from, to, buffer, maxLen, index);
+          });
+      request->send(response);
+    });
+#endif
+
+    // /ota/status - progress of the current update and timing of the last one
+    server.on("/ota/status", HTTP_GET, [](AsyncWebServerRequest *request) {
+      Metrics::countRequest(Metrics::ROUTE_OTA);
+      if (!Admission::admit(request, Metrics::ROUTE_OTA, SMALL_COST)) return;
+      sendOtaStatus(request, 200);
+    });
+
+    // /ota/pull?url=http://... - download the image from a local server
+    server.on("/ota/pull", HTTP_POST, [](AsyncWebServerRequest *request) {
+      Metrics::countRequest(Metrics::ROUTE_OTA);
+      if (!Admission::admit(request, Metrics::ROUTE_OTA, SMALL_COST)) return;
+      if (!otaAuthorized(request)) {
+        request->send(401, "text/plain", "Unauthorized");
+        return;
+      }
+      AsyncWebParameter *url = request->hasParam("url", true) ? request->getParam("url", true)
+                                                               : request->getParam("url");
+      if (!url) {
+        request->send(400, "text/plain", "Missing url");
+        return;
+      }
+      Ota::Result result = Ota::requestPull(url->value().c_str());
+      if (result == Ota::RESULT_FAILED) {
+        request->send(400, "text/plain", "Bad url (plain http:// only)");
+        return;
+      }
+      sendOtaStatus(request, result == Ota::RESULT_BUSY ? 409 : 202);
+    });
+
+    // /ota - push update, the image is the request body (octet-stream,
+    // gzip or plain .bin). ?offset=N continues a session at byte N;
+    // ?final=1 ends a plain image (gzip ends itself with its trailer).
+    // The body arrives before the request handler runs, so a request with
+    // one is admitted on its first piece.
+    server.on("/ota", HTTP_POST,
+      [](AsyncWebServerRequest *request) {
+        Metrics::countRequest(Metrics::ROUTE_OTA);
+        OtaUpload *upload = (OtaUpload *)request->_tempObject;
+        if (upload && !upload->admitted) return;  // 503 sent with the first piece
+        if (!upload && !Admission::admit(request, Metrics::ROUTE_OTA, SMALL_COST)) return;
+        if (!otaAuthorized(request)) {
+          request->send(401, "text/plain", "Unauthorized");
+          return;
+        }
+        if (!upload) {
+          request->send(400, "text/plain", "No image data");
+          return;
+        }
+        Ota::Result result = upload->result;
+        if (result == Ota::RESULT_OK && (Ota::complete() || request->hasParam("final"))) {
+          result = Ota::finishUpload();
+        }
+        switch (result) {
+          case Ota::RESULT_OK:
+            sendOtaStatus(request, Ota::state() == Ota::REBOOTING ? 200 : 202);
+            break;
+          case Ota::RESULT_BAD_OFFSET:  // "received" says where to continue
+          case Ota::RESULT_BUSY:
+            sendOtaStatus(request, 409);
+            break;
+          default:
+            sendOtaStatus(request, 500);
+        }
+      },
+      nullptr,
+      [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t) {
+        if (!otaAuthorized(request)) return;
+        if (index == 0) {
+          // Freed with the request
+          OtaUpload *upload = (OtaUpload *)malloc(sizeof(OtaUpload));
+          request->_tempObject = upload;
+          if (!upload) return;
+          upload->result = Ota::RESULT_OK;
+          upload->admitted = Admission::admit(request, Metrics::ROUTE_OTA, SMALL_COST);
+        }
+        OtaUpload *upload = (OtaUpload *)request->_tempObject;
+        if (!upload || !upload->admitted || upload->result != Ota::RESULT_OK) return;  // rest of a rejected body
+
+        size_t offset = request->hasParam("offset") ? request->getParam("offset")->value().toInt() : 0;
+        upload->result = Ota::upload(offset + index, data, len, index == 0);
+      });
+
     // 404 handler – if root or /index.html, return main page
     server.onNotFound([](AsyncWebServerRequest *request) {
-      Serial.print("Not found: ");
-      Serial.println(request->url());
+      LOG_DEBUG("Not found: %s", request->url().c_str());
+      Metrics::countRequest(Metrics::ROUTE_NOT_FOUND);
 
       if (request->url() == "/" || request->url() == "/index.html") {
+        if (!Admission::admit(request, Metrics::ROUTE_NOT_FOUND, htmlPageBytes())) return;
         String htmlContent = buildHtmlPage();
         request->send(200, "text/html", htmlContent);
       } else {
@@ -176,9 +612,9 @@ void setupWebServer() {
 
     server.begin();
     serverSetup = true;
-    Serial.println("Web server started on port 80");
+    LOG_INFO("Web server started on port 80");
   } else {
-    Serial.println("Web server already running");
+    LOG_DEBUG("Web server already running");
   }
 }
 
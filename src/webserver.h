@@ -14,23 +14,48 @@
 #define HTTP_ANY     0xFF
 
 #include <ESPAsyncWebServer.h>
+#include "stream_stats.h"
+#include "sample_store.h"
+#include "seqlock.h"
 
-// Device status structure
+// Device status structure. loop() fills in its own copy and publishes it
+// whole; the /status handler reads a consistent snapshot.
 struct DeviceStatus {
   float lastVoltage;
   int lastRawValue;
+  uint8_t lastAdcRange;
   unsigned long lastReadTime;
   unsigned long lastSendTime;
+  unsigned long windowStart;  // send window in progress began (Publish)
   bool firebaseConnected;
-  int recordNumber;
-  const char* version;
+  int recordNumber;     // records handed to the sinks since boot
+  const char* version;  // FIRMWARE_VERSION
+
+  // Copied from voltageStats and AdcRanging after each reading; those are
+  // loop()'s and change under a reader on the web task
+  VoltageSummary window;      // in progress
+  VoltageSummary lastWindow;
+  VoltageSummary total;
+  uint32_t windows;           // closed so far
+  uint32_t rangeSwitches;
+  float histogramMin;         // of the last window
+  float histogramBinWidth;
+  uint32_t histogramUnder;
+  uint32_t histogramOver;
+  uint32_t histogram[STATS_HISTOGRAM_BINS];
 };
 
 extern AsyncWebServer server;
-extern DeviceStatus deviceStatus;
+extern SeqLock<DeviceStatus> deviceStatus;
+extern VoltageStats voltageStats;
+extern SampleStore sampleStore;
 extern bool wifiConnected;
 
 void setupWebServer();
 void handleWebServer();
 
+// Bodies of / and /status (also run by the benchmarks, bench_main.cpp)
+String buildHtmlPage();
+String buildStatusJson();
+
 #endif
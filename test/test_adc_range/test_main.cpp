@@ -0,0 +1,191 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "hal.h"
+#include "config.h"
+#include "measurement.h"
+#include "serial_log.h"
+#include "settings.h"
+
+// Auto-ranging over a 0-3 V ramp at the pin, up and down, through AdcBurst
+// and Calibrate on the NativeHAL ADC (ideal, so what is left of the error
+// after the calibration's straight line is quantization). The same ramp on fixed 11 dB is the reference: the RMS
+// error of the readings taken on each range is printed next to what 11 dB
+// gives for the same voltages. Asserted: the finer ranges gain what their
+// full scale says, the ramp switches exactly where the limits and the
+// hysteresis put it, and every window still gives its reading, a switch
+// costing one thrown-away conversion.
+
+static const int PIN = 4;
+static const size_t STEPS = 8000;  // per direction, 0.375 mV apart
+static const float TOP_MV = 3000.0f;
+
+struct Pass {
+  float pinMv[2 * STEPS];
+  float errorMv[2 * STEPS];
+  uint8_t range[2 * STEPS];
+  uint32_t reads[2 * STEPS];  // ADC conversions of the window
+  bool gotReading[2 * STEPS];
+  uint32_t switches;
+};
+
+static Pass fixed, autoRanged;
+
+// value: 0, 1 or null (the default)
+static void setAutoRange(const char* value) {
+  char body[32], error[64];
+  snprintf(body, sizeof(body), "{\"adcAutoRange\":%s}", value);
+  TEST_ASSERT_TRUE(Settings::patch(body, strlen(body), error, sizeof(error)));
+  Settings::loop();
+}
+
+static float rampMv(size_t i) {
+  size_t k = i < STEPS ? i : 2 * STEPS - 1 - i;
+  return TOP_MV * k / (STEPS - 1);
+}
+
+static void runRamp(Pass& pass, bool on) {
+  setAutoRange(on ? "1" : "0");
+  AdcRanging::begin(PIN);
+  Pipeline<AdcBurst<PIN, VoltageFilter>, Calibrate> reading;
+  uint32_t switchesBefore = AdcRanging::switches();
+  for (size_t i = 0; i < 2 * STEPS; i++) {
+    float mv = rampMv(i);
+    hal::setAdcMilliVolts(mv);
+    uint32_t readsBefore = hal::adcReads();
+    Reading r = Reading();
+    pass.gotReading[i] = reading.step(r);
+    pass.reads[i] = hal::adcReads() - readsBefore;
+    pass.pinMv[i] = mv;
+    pass.range[i] = r.adcRange;
+    pass.errorMv[i] = r.adcVolts * 1000.0f - mv;
+  }
+  pass.switches = AdcRanging::switches() - switchesBefore;
+}
+
+// RMS quantization error of pass over the readings by took on range, in mV
+// at the pin: the error left after a straight-line fit, which takes out the
+// calibration's gain and offset (0.91 board factor, the eFuse line through
+// whole mV)
+static float rms(const Pass& pass, int range, const Pass& by) {
+  double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (size_t i = 0; i < 2 * STEPS; i++) {
+    if (by.range[i] != range) continue;
+    double x = pass.pinMv[i], y = pass.errorMv[i];
+    n++;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  if (n < 2) return 0;
+  double slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+  double offset = (sy - slope * sx) / n;
+  double sum = 0;
+  for (size_t i = 0; i < 2 * STEPS; i++) {
+    if (by.range[i] != range) continue;
+    double e = pass.errorMv[i] - (offset + slope * pass.pinMv[i]);
+    sum += e * e;
+  }
+  return sqrt(sum / n) / (1 + slope);
+}
+
+static size_t count(const Pass& pass, int range) {
+  size_t n = 0;
+  for (size_t i = 0; i < 2 * STEPS; i++) n += pass.range[i] == range;
+  return n;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_fixed_range_stays_on_11db() {
+  runRamp(fixed, false);
+  TEST_ASSERT_FALSE(AdcRanging::autoRanging());
+  TEST_ASSERT_EQUAL_UINT32(0, fixed.switches);
+  TEST_ASSERT_EQUAL_size_t(2 * STEPS, count(fixed, ADC_RANGE_COUNT - 1));
+}
+
+void test_resolution_gain_per_range() {
+  runRamp(autoRanged, true);
+  TEST_ASSERT_TRUE(AdcRanging::autoRanging());
+
+  const float lsb11 = AdcRanging::rangeInfo(ADC_RANGE_COUNT - 1).fullScaleMv / 4095.0f;
+  for (int range = 0; range < ADC_RANGE_COUNT; range++) {
+    const AdcRange& info = AdcRanging::rangeInfo(range);
+    float onRange = rms(autoRanged, range, autoRanged);
+    float on11 = rms(fixed, range, autoRanged);
+    char line[120];
+    snprintf(line, sizeof(line), "%-5s %5u readings: %.3f mV RMS, fixed 11 dB %.3f mV RMS (%.1fx)", info.name,
+             (unsigned)count(autoRanged, range), onRange, on11, on11 / onRange);
+    TEST_MESSAGE(line);
+
+    TEST_ASSERT_TRUE(count(autoRanged, range) > 0);
+    // Uniform quantization error is LSB / sqrt(12); the ranges gain by
+    // their full scale against 11 dB's
+    const float lsb = info.fullScaleMv / 4095.0f;
+    TEST_ASSERT_FLOAT_WITHIN(0.15f * lsb / sqrtf(12), lsb / sqrtf(12), onRange);
+    TEST_ASSERT_FLOAT_WITHIN(0.15f * lsb11 / sqrtf(12), lsb11 / sqrtf(12), on11);
+    if (range < ADC_RANGE_COUNT - 1) TEST_ASSERT_TRUE(on11 / onRange > 0.85f * lsb11 / lsb);
+  }
+  // 0 dB: about 3.5x finer than 11 dB
+  TEST_ASSERT_TRUE(rms(fixed, 0, autoRanged) / rms(autoRanged, 0, autoRanged) > 3.0f);
+}
+
+void test_switches_at_limits_with_hysteresis() {
+  // 11 dB -> 0 dB on the first window, one step up at each range's limit
+  // on the way up, one step down at 85 % of the lower range's limit on the
+  // way down
+  TEST_ASSERT_EQUAL_UINT32(1 + 3 + 3, autoRanged.switches);
+  TEST_ASSERT_EQUAL_UINT8(0, autoRanged.range[1]);
+  for (size_t i = 2; i < 2 * STEPS; i++) {
+    uint8_t from = autoRanged.range[i - 1], to = autoRanged.range[i];
+    if (from == to) continue;
+    float mv = autoRanged.pinMv[i - 1];  // the window that chose the range
+    if (i < STEPS) {
+      TEST_ASSERT_EQUAL_UINT8(from + 1, to);
+      TEST_ASSERT_TRUE(mv > AdcRanging::rangeInfo(from).usableMaxMv);
+      TEST_ASSERT_TRUE(mv < AdcRanging::rangeInfo(from).usableMaxMv + 1.0f);
+    } else {
+      TEST_ASSERT_EQUAL_UINT8(from - 1, to);
+      float limit = AdcRanging::rangeInfo(to).usableMaxMv * ADC_RANGE_HYSTERESIS_PCT / 100.0f;
+      TEST_ASSERT_TRUE(mv < limit);
+      TEST_ASSERT_TRUE(mv > limit - 1.0f);
+    }
+  }
+}
+
+void test_switch_does_not_delay_readings() {
+  const uint32_t burst = AdcBurst<PIN, VoltageFilter>::BURST;
+  uint32_t switchWindows = 0;
+  for (size_t i = 0; i < 2 * STEPS; i++) {
+    // A reading every window, the one after a switch included
+    TEST_ASSERT_TRUE(autoRanged.gotReading[i]);
+    bool switched = i > 0 && autoRanged.range[i] != autoRanged.range[i - 1];
+    if (i == 0) switched = autoRanged.range[0] != ADC_RANGE_COUNT - 1;
+    // The switch window throws one conversion away, nothing more
+    TEST_ASSERT_EQUAL_UINT32(burst + (switched ? 1 : 0), autoRanged.reads[i]);
+    switchWindows += switched;
+  }
+  TEST_ASSERT_EQUAL_UINT32(autoRanged.switches, switchWindows);
+}
+
+void setup() {
+  hal::setTimeScale(0);
+  SerialLog::begin();
+  initEEPROM();
+  Settings::begin();
+  analogReadResolution(12);
+  UNITY_BEGIN();
+  RUN_TEST(test_fixed_range_stays_on_11db);
+  RUN_TEST(test_resolution_gain_per_range);
+  RUN_TEST(test_switches_at_limits_with_hysteresis);
+  RUN_TEST(test_switch_does_not_delay_readings);
+  setAutoRange("null");  // stored settings back to the defaults
+  exit(UNITY_END());
+}
+
+void loop() {}
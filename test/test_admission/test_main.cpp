@@ -0,0 +1,210 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "hal.h"
+#include "admission.h"
+#include "config.h"
+#include "logger.h"
+#include "metrics.h"
+#include "serial_log.h"
+#include "settings.h"
+#include "webserver.h"
+
+// Admission control under load, through the NativeHAL web server and real
+// sockets: clients hammer / and /status, half of them reading slowly so
+// responses pile up the way they do on the device. Every answer is a 200
+// or a 503 with Retry-After, no route goes over its cap, the in-flight
+// bytes stay within the budget and are all given back once the clients
+// are gone; /scan is held to one per interval. Latencies, peak bytes and
+// the lowest free heap are printed for comparison.
+
+static const uint16_t PORT = 18093;
+static const int CLIENTS = 16;
+static const int REQUESTS = 10;
+static const uint8_t LIMITS[Metrics::ROUTE_COUNT] = ADMISSION_ROUTE_LIMITS;
+
+struct Answer {
+  int code;
+  bool retryAfter;
+  int retrySeconds;
+  double ms;
+};
+
+// One request on its own connection. A slow client has a small receive
+// buffer and takes 1 KB every 10 ms, so the server's send blocks on it.
+static Answer get(const char* path, bool slow) {
+  Answer a = {0, false, 0, 0};
+  auto start = std::chrono::steady_clock::now();
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (slow) {
+    int rcvbuf = 2048;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  }
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(PORT);
+  if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return a;
+  }
+  std::string request = std::string("GET ") + path + " HTTP/1.1\r\nHost: device\r\nConnection: close\r\n\r\n";
+  send(fd, request.data(), request.size(), 0);
+
+  std::string response;
+  char buf[1024];
+  ssize_t n;
+  while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+    response.append(buf, n);
+    if (slow) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  close(fd);
+  a.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  if (response.compare(0, 9, "HTTP/1.1 ") == 0) a.code = atoi(response.c_str() + 9);
+  size_t retry = response.find("Retry-After: ");
+  if (retry != std::string::npos && retry < response.find("\r\n\r\n")) {
+    a.retryAfter = true;
+    a.retrySeconds = atoi(response.c_str() + retry + 13);
+  }
+  return a;
+}
+
+static double median(std::vector<double> v) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[v.size() / 2];
+}
+
+static uint32_t rejections(Metrics::Route route, Metrics::RejectReason reason) {
+  Metrics::Snapshot snap;
+  Metrics::takeSnapshot(snap);
+  return snap.webRejections[route][reason];
+}
+
+// The disconnect callbacks run after the client has closed
+static bool drained() {
+  for (int i = 0; i < 200; i++) {
+    if (Admission::inFlightBytes() == 0) return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return false;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_load_stays_within_limits() {
+  std::mutex answersMutex;
+  std::vector<Answer> answers;
+  std::atomic<bool> running(true);
+  uint8_t maxRoot = 0, maxStatus = 0;
+  size_t maxBytes = 0;
+
+  // Watches the gauges while the clients run
+  std::thread monitor([&]() {
+    while (running) {
+      maxRoot = std::max(maxRoot, Admission::inFlight(Metrics::ROUTE_ROOT));
+      maxStatus = std::max(maxStatus, Admission::inFlight(Metrics::ROUTE_STATUS));
+      maxBytes = std::max(maxBytes, Admission::inFlightBytes());
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  });
+
+  std::vector<std::thread> clients;
+  for (int c = 0; c < CLIENTS; c++) {
+    clients.emplace_back([&, c]() {
+      for (int i = 0; i < REQUESTS; i++) {
+        Answer a = get((c + i) % 2 ? "/status" : "/", c % 2 == 0);
+        std::lock_guard<std::mutex> lock(answersMutex);
+        answers.push_back(a);
+      }
+    });
+  }
+  for (std::thread& t : clients) t.join();
+  running = false;
+  monitor.join();
+
+  size_t ok = 0, busy = 0;
+  std::vector<double> okMs, busyMs;
+  for (const Answer& a : answers) {
+    if (a.code == 200) {
+      ok++;
+      okMs.push_back(a.ms);
+    } else {
+      TEST_ASSERT_EQUAL_INT(503, a.code);
+      TEST_ASSERT_TRUE(a.retryAfter);
+      TEST_ASSERT_EQUAL_INT(ADMISSION_RETRY_AFTER_S, a.retrySeconds);
+      busy++;
+      busyMs.push_back(a.ms);
+    }
+  }
+  TEST_ASSERT_EQUAL_size_t(CLIENTS * REQUESTS, answers.size());
+  TEST_ASSERT_GREATER_THAN_UINT32(0, ok);
+  TEST_ASSERT_GREATER_THAN_UINT32(0, busy);
+
+  TEST_ASSERT_TRUE(maxRoot <= LIMITS[Metrics::ROUTE_ROOT]);
+  TEST_ASSERT_TRUE(maxStatus <= LIMITS[Metrics::ROUTE_STATUS]);
+  TEST_ASSERT_TRUE(maxBytes <= ADMISSION_BUDGET_BYTES);
+  TEST_ASSERT_TRUE(Admission::peakBytes() <= ADMISSION_BUDGET_BYTES);
+
+  uint32_t counted = 0;
+  for (int r = 0; r < Metrics::REJECT_COUNT; r++) {
+    counted += rejections(Metrics::ROUTE_ROOT, (Metrics::RejectReason)r);
+    counted += rejections(Metrics::ROUTE_STATUS, (Metrics::RejectReason)r);
+  }
+  TEST_ASSERT_EQUAL_UINT32(busy, counted);
+
+  TEST_ASSERT_TRUE(drained());
+  TEST_ASSERT_EQUAL_UINT8(0, Admission::inFlight(Metrics::ROUTE_ROOT));
+  TEST_ASSERT_EQUAL_UINT8(0, Admission::inFlight(Metrics::ROUTE_STATUS));
+
+  char line[160];
+  snprintf(line, sizeof(line), "%u x 200 (p50 %.1f ms), %u x 503 (p50 %.1f ms), in-flight peak %u B, min free heap %u B",
+           (unsigned)ok, median(okMs), (unsigned)busy, median(busyMs), (unsigned)Admission::peakBytes(),
+           (unsigned)ESP.getMinFreeHeap());
+  TEST_MESSAGE(line);
+}
+
+void test_scan_once_per_interval() {
+  TEST_ASSERT_EQUAL_INT(200, get("/scan", false).code);
+  // The scan took 2 s of the interval
+  Answer again = get("/scan", false);
+  TEST_ASSERT_EQUAL_INT(503, again.code);
+  TEST_ASSERT_EQUAL_INT((ADMISSION_SCAN_INTERVAL_MS - 2000 + 999) / 1000, again.retrySeconds);
+  TEST_ASSERT_EQUAL_UINT32(1, rejections(Metrics::ROUTE_SCAN, Metrics::REJECT_RATE));
+
+  hal::sleepMicros((uint64_t)again.retrySeconds * 1000000);
+  TEST_ASSERT_EQUAL_INT(200, get("/scan", false).code);
+  TEST_ASSERT_TRUE(drained());
+}
+
+void setup() {
+  char port[8];
+  snprintf(port, sizeof(port), "%u", PORT);
+  setenv("VOLTAGELOG_HTTP_PORT", port, 1);
+  hal::setTimeScale(0);
+  SerialLog::begin();
+  initEEPROM();
+  Settings::begin();
+  Logger::init();
+  setupWebServer();
+  UNITY_BEGIN();
+  RUN_TEST(test_load_stays_within_limits);
+  RUN_TEST(test_scan_once_per_interval);
+  exit(UNITY_END());
+}
+
+void loop() {}
@@ -0,0 +1,160 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <WiFi.h>
+#include <stdio.h>
+#include <vector>
+#include "hal.h"
+#include "boot.h"
+#include "config.h"
+#include "firebase_handler.h"
+#include "firebase_sink.h"
+#include "logger.h"
+#include "measurement.h"
+#include "serial_log.h"
+#include "settings.h"
+#include "telemetry_sink.h"
+#include "webserver.h"
+
+// Staged boot against the NativeHAL stand-ins: the station takes 3 s to
+// join, every Firebase request takes 300 ms, SNTP answers 1.5 s after it
+// is started. Readings start at once and go on while the uplink comes up;
+// the phases are reached in order, the first upload follows the first
+// sync and carries the reading from before WiFi. A refused sign-in is
+// retried after BOOT_AUTH_RETRY_MS, not before, with readings going on.
+// The loop is main.cpp's loop() without the WiFi watchdog and OTA.
+
+static const uint32_t FIREBASE_MS = 300;
+
+static FirebaseSink sink;
+static DeadBand bootDeadBand;
+static DeviceStatus status = {};
+static Pipeline<AdcBurst<4, VoltageFilter>, Calibrate, SerialReport, Accumulate, Store, Publish, StatusUpdate>
+    pipeline{AdcBurst<4, VoltageFilter>(), Calibrate(), SerialReport(), Accumulate(voltageStats), Store(sampleStore),
+             Publish(voltageStats, bootDeadBand), StatusUpdate(status, voltageStats)};
+static bool refuseSignIn = false;
+static std::vector<unsigned long> signIns;
+static size_t readings = 0;
+
+static int firebase(const char*, const String& url, const String&, String& response) {
+  delay(FIREBASE_MS);
+  if (url.indexOf("signInWithPassword") >= 0) {
+    signIns.push_back(millis());
+    if (refuseSignIn) {
+      response = "{\"error\":{\"code\":400,\"message\":\"INVALID_PASSWORD\"}}";
+      return 400;
+    }
+    response = "{\"idToken\":\"token\",\"expiresIn\":\"3600\"}";
+    return 200;
+  }
+  response = "{}";
+  return 200;
+}
+
+// loop()'s reading, upload and wait for the next reading
+static void loopOnce() {
+  unsigned long loopStart = millis();
+  Boot::loop();
+  pipeline.step();
+  readings++;
+  Boot::mark(Boot::PHASE_FIRST_SAMPLE);
+  Telemetry::loop();
+  while (millis() - loopStart < Settings::get().sampleIntervalMs) {
+    if (Boot::loop() || Telemetry::retryDue()) {
+      Telemetry::loop();
+      Boot::loop();
+    }
+    unsigned long left = Settings::get().sampleIntervalMs - (millis() - loopStart);
+    if ((long)left <= 0) break;
+    delay(left < BOOT_POLL_MS ? left : BOOT_POLL_MS);
+  }
+}
+
+static void runFor(unsigned long ms) {
+  unsigned long start = millis();
+  while (millis() - start < ms) loopOnce();
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_phases_in_order_first_upload_after_sync() {
+  unsigned long boot = millis();
+  Boot::mark(Boot::PHASE_SETUP);
+  Boot::mark(Boot::PHASE_SAMPLING);
+  Boot::connect("plant-floor", "secret");
+  Boot::mark(Boot::PHASE_WEB);
+  runFor(3 * Settings::get().sampleIntervalMs);
+
+  for (int p = 0; p < Boot::PHASE_COUNT; p++) {
+    TEST_ASSERT_TRUE_MESSAGE(Boot::reached((Boot::Phase)p), Boot::phaseName((Boot::Phase)p));
+  }
+  char line[200];
+  snprintf(line, sizeof(line), "first sample %lu ms, wifi %lu, auth %lu, time %lu, first upload %lu",
+           Boot::at(Boot::PHASE_FIRST_SAMPLE) - boot, Boot::at(Boot::PHASE_WIFI) - boot,
+           Boot::at(Boot::PHASE_AUTH) - boot, Boot::at(Boot::PHASE_TIME) - boot,
+           Boot::at(Boot::PHASE_FIRST_UPLOAD) - boot);
+  TEST_MESSAGE(line);
+
+  // Sampling does not wait for the network
+  TEST_ASSERT_TRUE(Boot::at(Boot::PHASE_FIRST_SAMPLE) - boot < 100);
+  TEST_ASSERT_TRUE(Boot::at(Boot::PHASE_FIRST_SAMPLE) < Boot::at(Boot::PHASE_WIFI));
+  // Each stage starts when the one before is done, not at a fixed delay
+  uint32_t join = hal::wifiConnectDelay();
+  TEST_ASSERT_TRUE(Boot::at(Boot::PHASE_WIFI) - boot >= join);
+  TEST_ASSERT_TRUE(Boot::at(Boot::PHASE_WIFI) - boot <= join + BOOT_POLL_MS);
+  TEST_ASSERT_TRUE(Boot::at(Boot::PHASE_AUTH) - Boot::at(Boot::PHASE_WIFI) <= FIREBASE_MS + BOOT_POLL_MS);
+  TEST_ASSERT_TRUE(Boot::at(Boot::PHASE_TIME) > Boot::at(Boot::PHASE_WIFI));
+  TEST_ASSERT_TRUE(Boot::at(Boot::PHASE_FIRST_UPLOAD) >= Boot::at(Boot::PHASE_TIME));
+  // Queued records go out on the sync, not at the next reading
+  TEST_ASSERT_TRUE(Boot::at(Boot::PHASE_FIRST_UPLOAD) - Boot::at(Boot::PHASE_TIME) < Settings::get().sampleIntervalMs);
+  TEST_ASSERT_EQUAL_size_t(1, signIns.size());
+
+  // The first window was closed on the first reading, long before WiFi
+  TEST_ASSERT_EQUAL_size_t(0, sink.pending());
+  TEST_ASSERT_EQUAL_UINT32(3, readings);
+}
+
+void test_refused_sign_in_retried_later() {
+  // The station drops and joins again; this time the sign-in is refused
+  WiFi.disconnect();
+  refuseSignIn = true;
+  signIns.clear();
+  readings = 0;
+  Boot::connect("plant-floor", "secret");
+  unsigned long start = millis();
+  runFor(BOOT_AUTH_RETRY_MS + 2 * Settings::get().sampleIntervalMs);
+
+  TEST_ASSERT_EQUAL_size_t(2, signIns.size());
+  TEST_ASSERT_TRUE(signIns[1] - signIns[0] >= BOOT_AUTH_RETRY_MS);
+  TEST_ASSERT_TRUE(signIns[1] - signIns[0] <= BOOT_AUTH_RETRY_MS + BOOT_POLL_MS + FIREBASE_MS);
+  // Readings went on at their interval meanwhile
+  TEST_ASSERT_EQUAL_UINT32((millis() - start + Settings::get().sampleIntervalMs - 1) / Settings::get().sampleIntervalMs,
+                           readings);
+
+  // Accepted on the next attempt
+  refuseSignIn = false;
+  runFor(BOOT_AUTH_RETRY_MS + Settings::get().sampleIntervalMs);
+  TEST_ASSERT_EQUAL_size_t(3, signIns.size());
+  TEST_ASSERT_TRUE(isFirebaseInitialized());
+}
+
+void setup() {
+  hal::setTimeScale(0);
+  hal::setWiFiUp(true);
+  hal::setWiFiConnectDelay(3000);
+  hal::setHttpHandler(firebase);
+  SerialLog::begin();
+  initEEPROM();
+  Settings::begin();
+  Logger::init();
+  AdcRanging::begin(4);
+  Telemetry::addSink(&sink);
+  Telemetry::begin();
+  UNITY_BEGIN();
+  RUN_TEST(test_phases_in_order_first_upload_after_sync);
+  RUN_TEST(test_refused_sign_in_retried_later);
+  exit(UNITY_END());
+}
+
+void loop() {}
@@ -0,0 +1,190 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <random>
+#include <vector>
+#include "hal.h"
+#include "chart.h"
+
+// /chart: the two-pass LTTB against a textbook one over 100k points, and
+// the binary payload, its size (12 + 6 bytes a point) against the same
+// points as JSON, rendered in any chunking with the same bytes and
+// decoding back to the picked points at 10 mV. Sizes are printed.
+
+class VectorSeries : public Chart::Series {
+public:
+  explicit VectorSeries(const std::vector<Sample>& points) : points(points) {}
+  void rewind() override { pos = 0; }
+  bool next(Sample& out) override {
+    if (pos >= points.size()) return false;
+    out = points[pos++];
+    return true;
+  }
+
+private:
+  const std::vector<Sample>& points;
+  size_t pos = 0;
+};
+
+// Random walk every ~10 s with the odd 2 V step
+static std::vector<Sample> walk(size_t count, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> step(-20, 20);
+  std::uniform_int_distribution<int> event(0, 499);
+  std::uniform_int_distribution<int> jitter(-200, 200);
+  std::vector<Sample> out;
+  uint32_t t = 0;
+  int32_t mv = 12000;
+  for (size_t i = 0; i < count; i++) {
+    t += 10000 + jitter(rng);
+    int e = event(rng);
+    mv += step(rng) + (e == 0 ? 2000 : e == 1 ? -2000 : 0);
+    out.push_back({t, mv});
+  }
+  return out;
+}
+
+// Steinarsson's LTTB with the whole series in memory, exact bucket means
+static std::vector<Sample> textbook(const std::vector<Sample>& data, size_t threshold) {
+  std::vector<Sample> out;
+  const size_t n = data.size();
+  const double every = (double)(n - 2) / (threshold - 2);
+  size_t a = 0;
+  out.push_back(data[0]);
+  for (size_t b = 0; b < threshold - 2; b++) {
+    size_t nextStart = (size_t)floor((b + 1) * every) + 1;
+    size_t nextEnd = std::min((size_t)floor((b + 2) * every) + 1, n);
+    if (b == threshold - 3) nextStart = n - 1, nextEnd = n;
+    double avgT = 0, avgV = 0;
+    for (size_t j = nextStart; j < nextEnd; j++) {
+      avgT += (double)data[j].time;
+      avgV += data[j].value;
+    }
+    avgT /= (nextEnd - nextStart);
+    avgV /= (nextEnd - nextStart);
+
+    size_t start = (size_t)floor(b * every) + 1;
+    size_t end = (size_t)floor((b + 1) * every) + 1;
+    double best = -1;
+    size_t chosen = start;
+    for (size_t j = start; j < end; j++) {
+      double area = fabs(((double)data[a].time - avgT) * ((double)data[j].value - data[a].value) -
+                         ((double)data[a].time - data[j].time) * (avgV - data[a].value));
+      if (area > best) {
+        best = area;
+        chosen = j;
+      }
+    }
+    out.push_back(data[chosen]);
+    a = chosen;
+  }
+  out.push_back(data[n - 1]);
+  return out;
+}
+
+static size_t same(const std::vector<Sample>& expected, const Sample* got, size_t n) {
+  size_t k = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (expected[i].time == got[i].time && expected[i].value == got[i].value) k++;
+  }
+  return k;
+}
+
+// [[t,V],...] as a JSON response would carry the same points
+static size_t jsonBytes(const Sample* points, size_t n) {
+  size_t bytes = 2;
+  char item[48];
+  for (size_t i = 0; i < n; i++) {
+    bytes += snprintf(item, sizeof(item), "[%lu,%.2f]", (unsigned long)points[i].time, points[i].value / 1000.0);
+    if (i > 0) bytes++;
+  }
+  return bytes;
+}
+
+static uint32_t le32(const uint8_t* p) {
+  return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static const std::vector<Sample> input = walk(100000, 1);
+static Sample picks[CHART_MAX_POINTS];
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_lttb_matches_textbook() {
+  const size_t sizes[] = {CHART_MAX_POINTS, CHART_DEFAULT_POINTS};
+  for (size_t maxPoints : sizes) {
+    VectorSeries series(input);
+    TEST_ASSERT_EQUAL_size_t(maxPoints, Chart::lttb(series, input.size(), picks, maxPoints));
+    std::vector<Sample> expected = textbook(input, maxPoints);
+    size_t k = same(expected, picks, maxPoints);
+    char line[80];
+    snprintf(line, sizeof(line), "100k -> %u: %u picks as the textbook LTTB", (unsigned)maxPoints, (unsigned)k);
+    TEST_MESSAGE(line);
+    // Near ties may go the other way: bucket means are kept at 1 ms / 1 mV
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(maxPoints * 99 / 100, k);
+    TEST_ASSERT_EQUAL_UINT32(input.front().time, picks[0].time);
+    TEST_ASSERT_EQUAL_UINT32(input.back().time, picks[maxPoints - 1].time);
+  }
+}
+
+void test_short_series_passes_through() {
+  std::vector<Sample> few(input.begin(), input.begin() + 10);
+  VectorSeries series(few);
+  TEST_ASSERT_EQUAL_size_t(10, Chart::lttb(series, few.size(), picks, CHART_DEFAULT_POINTS));
+  TEST_ASSERT_EQUAL_size_t(10, same(few, picks, 10));
+  // Claimed more points than the series has
+  TEST_ASSERT_EQUAL_size_t(0, Chart::lttb(series, 5000, picks, CHART_DEFAULT_POINTS));
+}
+
+void test_payload_size_and_decode() {
+  const size_t sizes[] = {CHART_DEFAULT_POINTS, CHART_MAX_POINTS};
+  for (size_t n : sizes) {
+    VectorSeries series(input);
+    Chart::lttb(series, input.size(), picks, n);
+    const size_t total = Chart::payloadBytes(n);
+    TEST_ASSERT_EQUAL_size_t(12 + 6 * n, total);
+
+    // Whole, and in odd chunks as the filler response asks for them
+    std::vector<uint8_t> whole(total + 16), chunked;
+    TEST_ASSERT_EQUAL_size_t(total, Chart::render(picks, n, 1760000000, 1234, whole.data(), whole.size(), 0));
+    uint8_t buf[97];
+    size_t got;
+    while ((got = Chart::render(picks, n, 1760000000, 1234, buf, sizeof(buf), chunked.size())) > 0) {
+      chunked.insert(chunked.end(), buf, buf + got);
+    }
+    TEST_ASSERT_EQUAL_size_t(total, chunked.size());
+    TEST_ASSERT_EQUAL_MEMORY(whole.data(), chunked.data(), total);
+
+    const uint8_t* p = whole.data();
+    TEST_ASSERT_EQUAL_UINT32(n, le32(p));
+    TEST_ASSERT_EQUAL_UINT32(1760000000, le32(p + 4));
+    TEST_ASSERT_EQUAL_UINT32(1234, le32(p + 8));
+    for (size_t i = 0; i < n; i++) {
+      TEST_ASSERT_EQUAL_UINT32(picks[i].time - picks[0].time, le32(p + 12 + 4 * i));
+      int16_t units = (int16_t)(p[12 + 4 * n + 2 * i] | p[13 + 4 * n + 2 * i] << 8);
+      TEST_ASSERT_INT_WITHIN(Chart::VALUE_UNIT_MV / 2, picks[i].value, units * Chart::VALUE_UNIT_MV);
+    }
+
+    size_t json = jsonBytes(picks, n);
+    char line[80];
+    snprintf(line, sizeof(line), "%u points: %u B binary, %u B as JSON", (unsigned)n, (unsigned)total,
+             (unsigned)json);
+    TEST_MESSAGE(line);
+    TEST_ASSERT_LESS_THAN_UINT32(json / 2, total);
+  }
+}
+
+void setup() {
+  hal::setTimeScale(0);
+  UNITY_BEGIN();
+  RUN_TEST(test_lttb_matches_textbook);
+  RUN_TEST(test_short_series_passes_through);
+  RUN_TEST(test_payload_size_and_decode);
+  exit(UNITY_END());
+}
+
+void loop() {}
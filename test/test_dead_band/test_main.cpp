@@ -0,0 +1,177 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <random>
+#include <vector>
+#include "hal.h"
+#include "dead_band.h"
+#include "stream_stats.h"
+
+// Two days of a 12 V rail replayed through VoltageStats and DeadBand the
+// way Publish uses them (a reading every 10 s, 60 s windows): how many
+// windows go out, that the held-back ones stay within the band of the
+// last record, that "suppressed" counts them, and that the heartbeat
+// bounds the time between records. The traces come from a fixed seed so
+// the ratios are the same on every run; they are printed for comparison.
+
+static const uint32_t READING_MS = 10000;
+static const uint32_t WINDOW_MS = 60000;
+static const uint32_t HEARTBEAT_MS = 15 * 60000;
+static const size_t READINGS = 2 * 86400000UL / READING_MS;
+
+// Battery with a solar charger: resting voltage, charge during the day,
+// a load switched on now and then for 20-40 min, 8 mV of noise
+static std::vector<float> solarTrace(uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> noise(0.0f, 0.008f);
+  std::uniform_int_distribution<int> loadStart(0, 359);
+  std::uniform_int_distribution<int> loadLength(120, 240);
+  std::vector<float> out;
+  int loadLeft = 0;
+  for (size_t i = 0; i < READINGS; i++) {
+    float hour = fmodf(i * READING_MS / 3600000.0f, 24.0f);
+    float charge = hour > 8 && hour < 17 ? 1.2f * sinf((hour - 8) / 9 * (float)M_PI) : 0;
+    if (loadLeft == 0 && loadStart(rng) == 0) loadLeft = loadLength(rng);
+    float load = loadLeft > 0 ? -0.3f : 0;
+    if (loadLeft > 0) loadLeft--;
+    out.push_back(12.4f + charge + load + noise(rng));
+  }
+  return out;
+}
+
+// Nothing happening: 12 V and the noise
+static std::vector<float> flatTrace(uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> noise(0.0f, 0.008f);
+  std::vector<float> out;
+  for (size_t i = 0; i < READINGS; i++) out.push_back(12.0f + noise(rng));
+  return out;
+}
+
+struct Replay {
+  size_t windows;
+  size_t records;
+  float maxError;         // V, a held-back sample against the last record
+  uint32_t longestGapMs;  // between records
+};
+
+// Publish's loop: a window closes every WINDOW_MS and is uploaded or held
+// back. Checks the held-back samples and "suppressed" along the way.
+static Replay replay(const std::vector<float>& trace, const DeadBand::Limits& limits) {
+  VoltageStats stats;
+  DeadBand deadBand;
+  Replay r = {0, 0, 0, 0};
+  float reference = 0;
+  uint32_t lastRecord = 0;
+  uint16_t held = 0;
+  std::vector<float> window;
+  for (size_t i = 0; i < trace.size(); i++) {
+    stats.add(trace[i]);
+    window.push_back(trace[i]);
+    uint32_t now = (uint32_t)(i + 1) * READING_MS;
+    if (now % WINDOW_MS != 0) continue;
+
+    VoltageSummary summary = stats.closeWindow();
+    r.windows++;
+    if (deadBand.due(summary, now, limits)) {
+      TEST_ASSERT_EQUAL_UINT32(held, deadBand.published(summary.mean, now));
+      if (r.records > 0 && now - lastRecord > r.longestGapMs) r.longestGapMs = now - lastRecord;
+      r.records++;
+      reference = summary.mean;
+      lastRecord = now;
+      held = 0;
+    } else {
+      deadBand.suppress();
+      held++;
+      for (float v : window) {
+        if (fabsf(v - reference) > r.maxError) r.maxError = fabsf(v - reference);
+      }
+    }
+    window.clear();
+  }
+  return r;
+}
+
+static void report(const char* name, const Replay& r) {
+  char line[120];
+  snprintf(line, sizeof(line), "%s: %u of %u windows uploaded (%.1f %%), max error %.1f mV, longest gap %u s", name,
+           (unsigned)r.records, (unsigned)r.windows, 100.0 * r.records / r.windows, r.maxError * 1000,
+           (unsigned)(r.longestGapMs / 1000));
+  TEST_MESSAGE(line);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_filter_off_uploads_every_window() {
+  DeadBand::Limits off = {0, 0, HEARTBEAT_MS};
+  Replay r = replay(solarTrace(1), off);
+  TEST_ASSERT_EQUAL_size_t(READINGS * READING_MS / WINDOW_MS, r.windows);
+  TEST_ASSERT_EQUAL_size_t(r.windows, r.records);
+}
+
+void test_absolute_band_on_solar_trace() {
+  DeadBand::Limits limits = {0.05f, 0, HEARTBEAT_MS};
+  Replay r = replay(solarTrace(1), limits);
+  report("solar, 50 mV", r);
+  TEST_ASSERT_LESS_THAN_FLOAT(0.15f, (float)r.records / r.windows);
+  TEST_ASSERT_TRUE(r.maxError <= 0.05f + 1e-4f);
+  TEST_ASSERT_TRUE(r.longestGapMs <= HEARTBEAT_MS + WINDOW_MS);
+}
+
+void test_relative_band_on_solar_trace() {
+  DeadBand::Limits limits = {0, 0.005f, HEARTBEAT_MS};
+  Replay r = replay(solarTrace(1), limits);
+  report("solar, 0.5 %", r);
+  TEST_ASSERT_LESS_THAN_FLOAT(0.15f, (float)r.records / r.windows);
+  // The band follows the reference: 0.5 % of at most 13.6 V
+  TEST_ASSERT_TRUE(r.maxError <= 0.005f * 13.7f + 1e-4f);
+  TEST_ASSERT_TRUE(r.longestGapMs <= HEARTBEAT_MS + WINDOW_MS);
+}
+
+void test_flat_rail_is_heartbeats_only() {
+  DeadBand::Limits limits = {0.05f, 0, HEARTBEAT_MS};
+  Replay r = replay(flatTrace(2), limits);
+  report("flat, 50 mV", r);
+  // Noise never leaves the band: one record per heartbeat, to the window
+  TEST_ASSERT_EQUAL_UINT32(HEARTBEAT_MS, r.longestGapMs);
+  TEST_ASSERT_EQUAL_size_t(READINGS * READING_MS / HEARTBEAT_MS, r.records);
+  TEST_ASSERT_TRUE(r.maxError <= 0.05f);
+}
+
+void test_longer_heartbeat_sends_less() {
+  DeadBand::Limits limits = {0.05f, 0, 60 * 60000};
+  Replay r = replay(flatTrace(2), limits);
+  report("flat, 50 mV, 60 min heartbeat", r);
+  TEST_ASSERT_EQUAL_UINT32(60 * 60000, r.longestGapMs);
+  TEST_ASSERT_EQUAL_size_t(READINGS * READING_MS / (60 * 60000), r.records);
+}
+
+void test_restart_sends_next_window() {
+  DeadBand deadBand;
+  DeadBand::Limits limits = {0.05f, 0, HEARTBEAT_MS};
+  VoltageSummary steady = {6, 12.0f, 0, 11.99f, 12.01f, 11.99f, 12.0f, 12.01f};
+  TEST_ASSERT_TRUE(deadBand.due(steady, 60000, limits));
+  deadBand.published(steady.mean, 60000);
+  TEST_ASSERT_FALSE(deadBand.due(steady, 120000, limits));
+  deadBand.suppress();
+  deadBand.restart();
+  TEST_ASSERT_TRUE(deadBand.due(steady, 180000, limits));
+  TEST_ASSERT_EQUAL_UINT32(1, deadBand.published(steady.mean, 180000));
+}
+
+void setup() {
+  hal::setTimeScale(0);
+  UNITY_BEGIN();
+  RUN_TEST(test_filter_off_uploads_every_window);
+  RUN_TEST(test_absolute_band_on_solar_trace);
+  RUN_TEST(test_relative_band_on_solar_trace);
+  RUN_TEST(test_flat_rail_is_heartbeats_only);
+  RUN_TEST(test_longer_heartbeat_sends_less);
+  RUN_TEST(test_restart_sends_next_window);
+  exit(UNITY_END());
+}
+
+void loop() {}
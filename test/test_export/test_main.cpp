@@ -0,0 +1,222 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+#include "hal.h"
+#include "sample_export.h"
+
+// /export building blocks: Range and token parsing, and Reader giving the
+// same bytes whether an export is read in one go, in odd pieces or resumed
+// at any offset, also after new samples came in; a part recycled out of
+// the ring is refused on seek, and a reader overtaken by recycling stops
+// short and says so.
+
+using namespace SampleExport;
+
+static SampleStore store;
+static uint32_t nextTime;
+
+static void append(size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    nextTime += 1000;
+    store.append(nextTime, 12000 + (int32_t)((nextTime / 1000 * 37) % 400));
+  }
+}
+
+// Bytes [start, end) of an export, read maxLen at a time; empty if seek fails
+static bool readPart(const Plan& plan, size_t start, size_t end, size_t maxLen, std::string& out) {
+  Reader reader;
+  out.clear();
+  if (!reader.seek(store, plan, start, end)) return false;
+  uint8_t buf[512];
+  size_t n;
+  while ((n = reader.read(buf, maxLen < sizeof(buf) ? maxLen : sizeof(buf))) > 0) out.append((char*)buf, n);
+  return true;
+}
+
+static std::string readAll(const Plan& plan) {
+  std::string out;
+  readPart(plan, 0, totalBytes(plan), 512, out);
+  return out;
+}
+
+void setUp() {
+  store.clear();
+  nextTime = 100000;
+}
+
+void tearDown() {}
+
+void test_parse_range() {
+  size_t start, end;
+  TEST_ASSERT_TRUE(parseRange("bytes=0-99", 1000, start, end));
+  TEST_ASSERT_EQUAL_size_t(0, start);
+  TEST_ASSERT_EQUAL_size_t(100, end);
+  TEST_ASSERT_TRUE(parseRange("bytes=100-", 1000, start, end));
+  TEST_ASSERT_EQUAL_size_t(100, start);
+  TEST_ASSERT_EQUAL_size_t(1000, end);
+  TEST_ASSERT_TRUE(parseRange("bytes=-100", 1000, start, end));
+  TEST_ASSERT_EQUAL_size_t(900, start);
+  TEST_ASSERT_EQUAL_size_t(1000, end);
+  TEST_ASSERT_TRUE(parseRange("bytes=-5000", 1000, start, end));  // whole body
+  TEST_ASSERT_EQUAL_size_t(0, start);
+  TEST_ASSERT_TRUE(parseRange("bytes=990-5000", 1000, start, end));  // clamped
+  TEST_ASSERT_EQUAL_size_t(990, start);
+  TEST_ASSERT_EQUAL_size_t(1000, end);
+  TEST_ASSERT_TRUE(parseRange("bytes=999-999", 1000, start, end));
+  TEST_ASSERT_EQUAL_size_t(1, end - start);
+
+  TEST_ASSERT_FALSE(parseRange("bytes=1000-", 1000, start, end));
+  TEST_ASSERT_FALSE(parseRange("bytes=5-2", 1000, start, end));
+  TEST_ASSERT_FALSE(parseRange("bytes=-0", 1000, start, end));
+  TEST_ASSERT_FALSE(parseRange("bytes=a-b", 1000, start, end));
+  TEST_ASSERT_FALSE(parseRange("bytes=1-2x", 1000, start, end));
+  TEST_ASSERT_FALSE(parseRange("items=0-1", 1000, start, end));
+  TEST_ASSERT_FALSE(parseRange("bytes=0-", 0, start, end));
+}
+
+void test_token_round_trip() {
+  append(50);
+  Plan plan = SampleExport::plan(store, FORMAT_BINARY, 0, nextTime);
+  plan.anchorUtc = 1760000000;
+  char token[TOKEN_LEN + 1];
+  SampleExport::token(plan, token);
+  TEST_ASSERT_EQUAL_size_t(TOKEN_LEN, strlen(token));
+
+  Plan parsed;
+  TEST_ASSERT_TRUE(parseToken(token, parsed));
+  TEST_ASSERT_EQUAL(FORMAT_BINARY, parsed.format);
+  TEST_ASSERT_EQUAL_UINT32(plan.fromMs, parsed.fromMs);
+  TEST_ASSERT_EQUAL_UINT32(plan.toMs, parsed.toMs);
+  TEST_ASSERT_EQUAL_UINT32(50, parsed.count);
+  TEST_ASSERT_EQUAL_UINT32(1760000000, parsed.anchorUtc);
+
+  std::string bad = token;
+  TEST_ASSERT_FALSE(parseToken(bad.substr(1).c_str(), parsed));  // short
+  TEST_ASSERT_FALSE(parseToken((bad + "0").c_str(), parsed));    // long
+  bad[0] = 'x';
+  TEST_ASSERT_FALSE(parseToken(bad.c_str(), parsed));
+  bad = token;
+  bad[12] = 'G';
+  TEST_ASSERT_FALSE(parseToken(bad.c_str(), parsed));
+  bad[12] = 'A';  // upper case is not what token() writes
+  TEST_ASSERT_FALSE(parseToken(bad.c_str(), parsed));
+}
+
+void test_formats() {
+  append(3);
+  Plan csv = SampleExport::plan(store, FORMAT_CSV, 0, nextTime);
+  std::string text = readAll(csv);
+  TEST_ASSERT_EQUAL_size_t(totalBytes(csv), text.size());
+  // 12137, 12174, 12211 mV went in: the first is exact, the others come
+  // back on the store's 10 mV steps from it; utc 0 = not synced
+  TEST_ASSERT_EQUAL_STRING("uptime_ms,utc,mv\n"
+                           "0000101000,0000000000,+12137\n"
+                           "0000102000,0000000000,+12177\n"
+                           "0000103000,0000000000,+12207\n",
+                           text.c_str());
+
+  Plan bin = SampleExport::plan(store, FORMAT_BINARY, 0, nextTime);
+  std::string data = readAll(bin);
+  TEST_ASSERT_EQUAL_size_t(16 + 3 * 8, data.size());
+  const uint8_t expected[16] = {'V', 'L', 'X', '1', 3, 0, 0, 0, 0, 0, 0, 0, 0x58, 0x92, 0x01, 0};
+  TEST_ASSERT_EQUAL_MEMORY(expected, data.data(), 16);
+}
+
+void test_pieces_and_resume_are_byte_exact() {
+  append(2000);
+  for (int f = 0; f < 2; f++) {
+    Plan plan = SampleExport::plan(store, f ? FORMAT_BINARY : FORMAT_CSV, 0, nextTime);
+    const std::string full = readAll(plan);
+    const size_t total = totalBytes(plan);
+    TEST_ASSERT_EQUAL_size_t(total, full.size());
+
+    // Odd piece sizes, as a slow client's window gives them
+    std::string pieces;
+    TEST_ASSERT_TRUE(readPart(plan, 0, total, 37, pieces));
+    TEST_ASSERT_TRUE(full == pieces);
+
+    // More readings meanwhile: not part of this export
+    append(100);
+
+    // Resume anywhere, including mid-record and inside the header
+    const size_t offsets[] = {1, 7, 16, 17, 100, 1001, total / 2, total - 29, total - 1};
+    for (size_t offset : offsets) {
+      std::string rest;
+      TEST_ASSERT_TRUE(readPart(plan, offset, total, 512, rest));
+      TEST_ASSERT_TRUE(full.compare(offset, std::string::npos, rest) == 0);
+    }
+    // And a middle part
+    std::string middle;
+    TEST_ASSERT_TRUE(readPart(plan, 40, 4000, 512, middle));
+    TEST_ASSERT_TRUE(full.compare(40, 3960, middle) == 0);
+  }
+}
+
+void test_seek_into_recycled_block_fails() {
+  append(500);
+  Plan plan = SampleExport::plan(store, FORMAT_CSV, 0, nextTime);
+  const std::string full = readAll(plan);
+  const size_t total = totalBytes(plan);
+
+  // Keep recording until the export's first block is recycled
+  while (store.dropped() == 0) append(100);
+
+  std::string part;
+  TEST_ASSERT_FALSE(readPart(plan, 0, total, 512, part));
+  TEST_ASSERT_FALSE(readPart(plan, 17, 17 + 29, 512, part));
+
+  // What is still stored resumes byte-exact
+  if (store.dropped() < plan.count) {
+    size_t tail = total - 29;
+    TEST_ASSERT_TRUE(readPart(plan, tail, total, 512, part));
+    TEST_ASSERT_TRUE(full.compare(tail, std::string::npos, part) == 0);
+  }
+}
+
+void test_reader_overtaken_by_recycling_stops_short() {
+  append(500);
+  Plan plan = SampleExport::plan(store, FORMAT_CSV, 0, nextTime);
+  const std::string full = readAll(plan);
+  const size_t total = totalBytes(plan);
+
+  Reader reader;
+  TEST_ASSERT_TRUE(reader.seek(store, plan, 0, total));
+  uint8_t buf[64];
+  std::string got;
+  size_t n = reader.read(buf, sizeof(buf));
+  got.append((char*)buf, n);
+  TEST_ASSERT_FALSE(reader.cutShort());
+
+  while (store.dropped() == 0) append(100);
+  while ((n = reader.read(buf, sizeof(buf))) > 0) got.append((char*)buf, n);
+
+  TEST_ASSERT_TRUE(reader.cutShort());
+  TEST_ASSERT_LESS_THAN(total, got.size());
+  TEST_ASSERT_TRUE(full.compare(0, got.size(), got) == 0);  // what went out was right
+}
+
+void test_complete_read_is_not_cut() {
+  append(100);
+  Plan plan = SampleExport::plan(store, FORMAT_BINARY, 0, nextTime);
+  Reader reader;
+  TEST_ASSERT_TRUE(reader.seek(store, plan, 0, totalBytes(plan)));
+  uint8_t buf[256];
+  while (reader.read(buf, sizeof(buf)) > 0) {
+  }
+  TEST_ASSERT_FALSE(reader.cutShort());
+}
+
+void setup() {
+  hal::setTimeScale(0);
+  UNITY_BEGIN();
+  RUN_TEST(test_parse_range);
+  RUN_TEST(test_token_round_trip);
+  RUN_TEST(test_formats);
+  RUN_TEST(test_pieces_and_resume_are_byte_exact);
+  RUN_TEST(test_seek_into_recycled_block_fails);
+  RUN_TEST(test_reader_overtaken_by_recycling_stops_short);
+  RUN_TEST(test_complete_read_is_not_cut);
+  exit(UNITY_END());
+}
+
+void loop() {}
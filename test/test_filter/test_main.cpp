@@ -0,0 +1,172 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include "hal.h"
+#include "measurement.h"
+
+// Front end of the voltage channel pinned for fixed code sequences: the
+// filter stages, a burst through AdcBurst and the 11 dB calibration. A
+// change in any of these numbers changes every stored and uploaded value.
+
+static const int PIN = 4;
+static const char* CODES_FILE = "test_filter_codes.csv";
+
+// 64 codes around 2000, with a spike to full scale, a drop to 0 and a
+// single 3000 (one burst of VoltageFilter = 16 codes)
+static const int32_t CODES[64] = {
+  1989, 2003, 1994, 2008, 1999, 4095, 2004, 1995, 2009, 2000, 1991, 2005, 1996, 2010, 2001, 1992,
+  2006, 1997, 2011, 2002, 0,    2007, 1998, 1989, 2003, 1994, 2008, 1999, 1990, 2004, 1995, 2009,
+  2000, 1991, 2005, 1996, 2010, 2001, 1992, 2006, 3000, 2011, 2002, 1993, 2007, 1998, 1989, 2003,
+  1994, 2008, 1999, 1990, 2004, 1995, 2009, 2000, 1991, 2005, 1996, 2010, 2001, 1992, 2006, 1997,
+};
+static const int32_t BURSTS[4] = {2001, 1999, 2003, 2000};
+
+// The simulated ADC returns these codes, one per analogRead() on 11 dB
+static void feedCodes(const int32_t* codes, size_t count) {
+  FILE* f = fopen(CODES_FILE, "w");
+  for (size_t i = 0; i < count; i++) fprintf(f, "%.4f\n", codes[i] * 3300.0 / 4095.0);
+  fclose(f);
+  hal::loadAdcTrace(CODES_FILE);
+}
+
+template <typename Stage>
+static void runStage(Stage& stage, const int32_t* in, int32_t* out, size_t count) {
+  for (size_t i = 0; i < count; i++) TEST_ASSERT_TRUE(stage.process(in[i], out[i]));
+}
+
+void setUp() {
+  AdcRanging::begin(PIN);
+}
+
+void tearDown() {
+  remove(CODES_FILE);
+}
+
+void test_median_rejects_single_spike() {
+  MedianFilter<3> median;
+  const int32_t in[7] = {100, 100, 4000, 100, 100, 200, 200};
+  const int32_t expected[7] = {100, 100, 100, 100, 100, 100, 200};
+  int32_t out[7];
+  runStage(median, in, out, 7);
+  TEST_ASSERT_EQUAL_INT32_ARRAY(expected, out, 7);
+}
+
+void test_moving_average_rounds_over_filled_window() {
+  MovingAverage<8> average;
+  const int32_t in[10] = {8, 16, 24, 1, 2, 3, 100, 100, 100, 100};
+  const int32_t expected[10] = {8, 12, 16, 12, 10, 9, 22, 32, 43, 54};
+  int32_t out[10];
+  runStage(average, in, out, 10);
+  TEST_ASSERT_EQUAL_INT32_ARRAY(expected, out, 10);
+}
+
+void test_ema_starts_at_first_sample() {
+  EmaFilter<2> ema;
+  const int32_t in[5] = {1000, 2000, 2000, 2000, 2000};
+  const int32_t expected[5] = {1000, 1250, 1438, 1578, 1684};
+  int32_t out[5];
+  runStage(ema, in, out, 5);
+  TEST_ASSERT_EQUAL_INT32_ARRAY(expected, out, 5);
+}
+
+void test_decimator_passes_every_nth() {
+  Decimator<4> decimator;
+  int32_t out = -1;
+  for (int32_t i = 1; i <= 12; i++) {
+    bool passed = decimator.process(i, out);
+    TEST_ASSERT_EQUAL(i % 4 == 0, passed);
+    if (passed) TEST_ASSERT_EQUAL_INT32(i, out);
+  }
+}
+
+void test_voltage_filter_sequence() {
+  TEST_ASSERT_EQUAL_size_t(16, VoltageFilter::DECIMATION);
+  VoltageFilter filter;
+  int32_t outputs[4];
+  size_t n = 0;
+  for (size_t i = 0; i < 64; i++) {
+    int32_t out;
+    if (filter.process(CODES[i], out)) outputs[n++] = out;
+  }
+  TEST_ASSERT_EQUAL_size_t(4, n);
+  TEST_ASSERT_EQUAL_INT32_ARRAY(BURSTS, outputs, 4);
+
+  // reset() forgets everything
+  filter.reset();
+  n = 0;
+  for (size_t i = 0; i < 16; i++) {
+    int32_t out;
+    if (filter.process(CODES[i], out)) outputs[n++] = out;
+  }
+  TEST_ASSERT_EQUAL_size_t(1, n);
+  TEST_ASSERT_EQUAL_INT32(BURSTS[0], outputs[0]);
+}
+
+void test_voltage_filter_step_response() {
+  VoltageFilter filter;
+  const int32_t expected[4] = {1000, 2910, 2999, 3000};
+  for (size_t burst = 0; burst < 4; burst++) {
+    int32_t out = 0;
+    for (size_t i = 0; i < 16; i++) filter.process(burst == 0 ? 1000 : 3000, out);
+    TEST_ASSERT_EQUAL_INT32(expected[burst], out);
+  }
+}
+
+void test_adc_burst_reads_one_filtered_code() {
+  feedCodes(CODES, 64);
+  AdcBurst<PIN, VoltageFilter> burst;
+  for (size_t i = 0; i < 4; i++) {
+    Reading r = {};
+    TEST_ASSERT_TRUE(burst.read(r));
+    TEST_ASSERT_EQUAL_INT32(BURSTS[i], r.raw);
+    TEST_ASSERT_EQUAL_UINT8(ADC_RANGE_COUNT - 1, r.adcRange);
+  }
+}
+
+void test_adc_burst_peak_is_raw_maximum() {
+  feedCodes(CODES, 64);
+  AdcBurst<PIN, VoltageFilter> burst;
+  const int32_t peaks[4] = {4095, 2011, 3000, 2010};
+  for (size_t i = 0; i < 4; i++) {
+    Reading r = {};
+    burst.read(r);
+    TEST_ASSERT_EQUAL_INT32(peaks[i], r.peak);
+  }
+}
+
+void test_calibrate_11db() {
+  Reading r = {};
+  r.raw = 1241;
+  r.peak = 1241;
+  Calibrate calibrate;
+  TEST_ASSERT_TRUE(calibrate.process(r));
+  // 1241 x 3300 mV / 4095 x 0.91, times the 5:1 divider
+  TEST_ASSERT_FLOAT_WITHIN(0.0001f, 0.91007f, r.adcVolts);
+  TEST_ASSERT_FLOAT_WITHIN(0.0005f, 4.5503f, r.volts);
+
+  r.raw = 4095;
+  calibrate.process(r);
+  TEST_ASSERT_FLOAT_WITHIN(0.0001f, 3.003f, r.adcVolts);
+  TEST_ASSERT_FLOAT_WITHIN(0.0005f, 15.015f, r.volts);
+
+  r.raw = 0;
+  calibrate.process(r);
+  TEST_ASSERT_FLOAT_WITHIN(0.0001f, 0.0f, r.volts);
+}
+
+void setup() {
+  hal::setTimeScale(0);
+  UNITY_BEGIN();
+  RUN_TEST(test_median_rejects_single_spike);
+  RUN_TEST(test_moving_average_rounds_over_filled_window);
+  RUN_TEST(test_ema_starts_at_first_sample);
+  RUN_TEST(test_decimator_passes_every_nth);
+  RUN_TEST(test_voltage_filter_sequence);
+  RUN_TEST(test_voltage_filter_step_response);
+  RUN_TEST(test_adc_burst_reads_one_filtered_code);
+  RUN_TEST(test_adc_burst_peak_is_raw_maximum);
+  RUN_TEST(test_calibrate_11db);
+  exit(UNITY_END());
+}
+
+void loop() {}
@@ -0,0 +1,354 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <ArduinoJson.h>
+#include <limits.h>
+#include <string.h>
+#include "hal.h"
+#include "config.h"
+#include "firebase_handler.h"
+#include "firebase_layout.h"
+#include "logger.h"
+#include "time_service.h"
+
+// Firebase layout: day/hour buckets, record keys sorting like their time,
+// HourSummary roll-ups and the paths of a batch built by
+// buildRecordsUpdate(), before and after the SNTP stand-in's first sync.
+// Device registration against a stand-in whose rules refuse it (403, not
+// tried again this boot) or that is down (503, tried again after the
+// backoff, not with every batch).
+
+using namespace FirebaseLayout;
+
+static const uint32_t BOOT_ID = 0x1234abcd;
+static FirebaseSession session;
+
+// Stand-in Firebase: the registration's update at the root answers
+// rootCode, everything else 200
+static int rootCode = 200;
+static uint32_t tagReads = 0;       // registration's GET of info/tags
+static uint32_t registrations = 0;  // registration's PATCH at the root
+
+static int firebase(const char* method, const String& url, const String&, String& response) {
+  response = "null";
+  if (url.indexOf("/info/tags") >= 0) {
+    tagReads++;
+    return 200;
+  }
+  if (strcmp(method, "PATCH") == 0 && url.indexOf("test-device") < 0) {
+    registrations++;
+    return rootCode;
+  }
+  return 200;
+}
+
+static TelemetryRecord record(float voltage, unsigned long readTime, uint32_t count = 0, float lo = 0, float hi = 0) {
+  TelemetryRecord r = {};
+  r.voltage = voltage;
+  r.readTime = readTime;
+  r.summary.count = count;
+  r.summary.min = lo;
+  r.summary.max = hi;
+  return r;
+}
+
+static void expectedKey(const TelemetryRecord& r, char* key) {
+  time_t utc = TimeService::utcFromMillis(r.readTime);
+  recordKey(utc ? (uint64_t)utc * 1000 + r.readTime % 1000 : 0, BOOT_ID, r.readTime, key);
+}
+
+// "raw/<day>/<hh>/<key>" of a record, as a dashboard would look it up
+static String rawPath(const TelemetryRecord& r) {
+  char day[DAY_LEN], hh[HOUR_LEN], key[KEY_LEN];
+  time_t utc = TimeService::utcFromMillis(r.readTime);
+  dayKey(utc, day);
+  hourKey(utc, hh);
+  expectedKey(r, key);
+  return String("raw/") + day + "/" + hh + "/" + key;
+}
+
+static String hourlyPath(time_t utc) {
+  char day[DAY_LEN], hh[HOUR_LEN];
+  dayKey(utc, day);
+  hourKey(utc, hh);
+  return String("hourly/") + day + "/" + hh + "/1234abcd";
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_day_and_hour_keys() {
+  char day[DAY_LEN], hh[HOUR_LEN];
+  dayKey(0, day);
+  hourKey(0, hh);
+  TEST_ASSERT_EQUAL_STRING("unsynced", day);
+  TEST_ASSERT_EQUAL_STRING("", hh);
+
+  dayKey(1760000000, day);  // 2025-10-09 08:53:20 UTC
+  hourKey(1760000000, hh);
+  TEST_ASSERT_EQUAL_STRING("2025-10-09", day);
+  TEST_ASSERT_EQUAL_STRING("08", hh);
+
+  dayKey(1704067199, day);  // last second of 2023
+  hourKey(1704067199, hh);
+  TEST_ASSERT_EQUAL_STRING("2023-12-31", day);
+  TEST_ASSERT_EQUAL_STRING("23", hh);
+  dayKey(1704067200, day);
+  hourKey(1704067200, hh);
+  TEST_ASSERT_EQUAL_STRING("2024-01-01", day);
+  TEST_ASSERT_EQUAL_STRING("00", hh);
+
+  dayKey(1709164800, day);  // leap day
+  TEST_ASSERT_EQUAL_STRING("2024-02-29", day);
+}
+
+void test_record_key_format() {
+  char key[KEY_LEN];
+  recordKey(0, 0, 0, key);
+  TEST_ASSERT_EQUAL_STRING("--------------------", key);
+  recordKey(1, 0, 1, key);
+  TEST_ASSERT_EQUAL_STRING("-------0-----------0", key);
+  recordKey(63, 0, 64, key);
+  TEST_ASSERT_EQUAL_STRING("-------z----------0-", key);
+  // Boot ID in the top 32 bits of the second part
+  recordKey(0, 1, 0, key);
+  TEST_ASSERT_EQUAL_STRING("--------------3-----", key);
+
+  // Same inputs, same key: a retried upload overwrites itself
+  char again[KEY_LEN];
+  recordKey(1760000000123ULL, BOOT_ID, 987654, key);
+  recordKey(1760000000123ULL, BOOT_ID, 987654, again);
+  TEST_ASSERT_EQUAL_STRING(key, again);
+  TEST_ASSERT_EQUAL_size_t(KEY_LEN - 1, strlen(key));
+}
+
+void test_record_keys_sort_by_time() {
+  // Across digit carries, over years, and by uptime within one ms
+  const uint64_t times[] = {0, 1, 63, 64, 4095, 4096, 1704067199999ULL, 1704067200000ULL,
+                            1760000000000ULL, 1760000000001ULL, 1760000003600ULL, 4102444800000ULL};
+  char previous[KEY_LEN], key[KEY_LEN];
+  recordKey(times[0], BOOT_ID, 0, previous);
+  for (size_t i = 1; i < sizeof(times) / sizeof(times[0]); i++) {
+    recordKey(times[i], BOOT_ID, 0, key);
+    TEST_ASSERT_LESS_THAN(0, strcmp(previous, key));
+    strcpy(previous, key);
+  }
+  // Time decides before the boot and uptime part
+  recordKey(1760000000000ULL, 0xffffffff, 0xffffffff, previous);
+  recordKey(1760000000001ULL, 1, 0, key);
+  TEST_ASSERT_LESS_THAN(0, strcmp(previous, key));
+  for (uint32_t uptime = 1; uptime < 100000; uptime += 997) {
+    recordKey(1760000000000ULL, BOOT_ID, uptime - 1, previous);
+    recordKey(1760000000000ULL, BOOT_ID, uptime, key);
+    TEST_ASSERT_LESS_THAN(0, strcmp(previous, key));
+  }
+}
+
+void test_hour_summary_add() {
+  const time_t h = 1760000400 - 1760000400 % 3600;
+  HourSummary s;
+  // A record with a window summary counts its readings
+  TEST_ASSERT_TRUE(s.add(record(12.0f, 0, 60, 11.5f, 12.5f), h + 100));
+  // One without (count 0) is a single reading at its voltage
+  TEST_ASSERT_TRUE(s.add(record(13.0f, 0), h + 50));
+  TEST_ASSERT_TRUE(s.add(record(11.0f, 0, 20, 10.0f, 11.8f), h + 3599));
+  TEST_ASSERT_EQUAL(h, s.hour);
+  TEST_ASSERT_EQUAL_UINT32(3, s.records);
+  TEST_ASSERT_EQUAL_UINT32(81, s.samples);
+  TEST_ASSERT_FLOAT_WITHIN(1e-9, (12.0 * 60 + 13.0 + 11.0 * 20) / 81, s.sum / s.samples);
+  TEST_ASSERT_EQUAL_FLOAT(10.0f, s.min);
+  TEST_ASSERT_EQUAL_FLOAT(13.0f, s.max);
+  TEST_ASSERT_EQUAL(h + 50, s.first);
+  TEST_ASSERT_EQUAL(h + 3599, s.last);
+
+  // An earlier hour is refused and changes nothing
+  TEST_ASSERT_FALSE(s.add(record(99.0f, 0), h - 1));
+  TEST_ASSERT_EQUAL(h, s.hour);
+  TEST_ASSERT_EQUAL_UINT32(3, s.records);
+  TEST_ASSERT_EQUAL_FLOAT(13.0f, s.max);
+
+  // The next hour starts over
+  TEST_ASSERT_TRUE(s.add(record(5.0f, 0), h + 3600));
+  TEST_ASSERT_EQUAL(h + 3600, s.hour);
+  TEST_ASSERT_EQUAL_UINT32(1, s.records);
+  TEST_ASSERT_EQUAL_UINT32(1, s.samples);
+  TEST_ASSERT_EQUAL_FLOAT(5.0f, s.min);
+  TEST_ASSERT_EQUAL_FLOAT(5.0f, s.max);
+}
+
+void test_unsynced_batch_paths() {
+  TimeService::begin();
+  TEST_ASSERT_FALSE(TimeService::isSynced());
+  delay(200);
+  TelemetryRecord records[2] = {record(12.1f, millis() - 100), record(12.2f, millis())};
+
+  HourSummary hour;
+  time_t newest = 1;
+  String body;
+  TEST_ASSERT_TRUE(buildRecordsUpdate(records, 2, hour, newest, body));
+  TEST_ASSERT_EQUAL(0, newest);
+  TEST_ASSERT_EQUAL_UINT32(0, hour.records);  // no roll-up without a time
+
+  DynamicJsonDocument doc(4096);
+  TEST_ASSERT_FALSE(deserializeJson(doc, body));
+  JsonObject updates = doc.as<JsonObject>();
+  TEST_ASSERT_EQUAL_size_t(2, updates.size());
+  for (const TelemetryRecord& r : records) {
+    char key[KEY_LEN];
+    expectedKey(r, key);
+    JsonObject json = updates[String("raw/unsynced/") + key];
+    TEST_ASSERT_FALSE(json.isNull());
+    TEST_ASSERT_EQUAL(0, json["timestamp"].as<long>());
+    TEST_ASSERT_EQUAL_STRING("unsynced", json["utc_time"]);
+    TEST_ASSERT_EQUAL_STRING("test-device", json["device"]);
+  }
+}
+
+void test_batch_across_an_hour_boundary() {
+  delay(2000);  // the stand-in answers 1.5 s after configTime()
+  TimeService::loop();
+  TEST_ASSERT_TRUE(TimeService::isSynced());
+
+  // One record 2 s before the top of an hour, two just after
+  time_t wait = 3600 - TimeService::now() % 3600 - 2;
+  delay((wait > 0 ? wait : wait + 3600) * 1000UL);
+  TEST_ASSERT_EQUAL(3598, TimeService::now() % 3600);
+  TelemetryRecord records[3];
+  records[0] = record(12.0f, millis(), 10, 11.9f, 12.1f);
+  delay(4000);
+  records[1] = record(12.4f, millis() - 1000, 10, 12.3f, 12.5f);
+  records[2] = record(12.6f, millis(), 10, 12.5f, 12.8f);
+  time_t before = TimeService::utcFromMillis(records[0].readTime);
+  time_t after = TimeService::utcFromMillis(records[2].readTime);
+
+  HourSummary hour;
+  time_t newest = 0;
+  String body;
+  TEST_ASSERT_TRUE(buildRecordsUpdate(records, 3, hour, newest, body));
+  TEST_ASSERT_EQUAL(after, newest);
+  // The session's roll-up is left on the newer hour
+  TEST_ASSERT_EQUAL(after - after % 3600, hour.hour);
+  TEST_ASSERT_EQUAL_UINT32(2, hour.records);
+  TEST_ASSERT_EQUAL_UINT32(20, hour.samples);
+
+  DynamicJsonDocument doc(8192);
+  TEST_ASSERT_FALSE(deserializeJson(doc, body));
+  JsonObject updates = doc.as<JsonObject>();
+  TEST_ASSERT_EQUAL_size_t(5, updates.size());  // three records, two roll-ups
+  for (const TelemetryRecord& r : records) {
+    JsonObject json = updates[rawPath(r)];
+    TEST_ASSERT_FALSE(json.isNull());
+    TEST_ASSERT_EQUAL(TimeService::utcFromMillis(r.readTime), json["timestamp"].as<long>());
+  }
+
+  JsonObject earlier = updates[hourlyPath(before)];
+  TEST_ASSERT_FALSE(earlier.isNull());
+  TEST_ASSERT_EQUAL_UINT32(1, earlier["records"].as<uint32_t>());
+  TEST_ASSERT_EQUAL(before - before % 3600, earlier["timestamp"].as<long>());
+  JsonObject later = updates[hourlyPath(after)];
+  TEST_ASSERT_FALSE(later.isNull());
+  TEST_ASSERT_EQUAL_UINT32(2, later["records"].as<uint32_t>());
+  TEST_ASSERT_FLOAT_WITHIN(1e-4, 12.5, later["mean"].as<double>());
+  TEST_ASSERT_FLOAT_WITHIN(1e-4, 12.3, later["min"].as<float>());
+  TEST_ASSERT_FLOAT_WITHIN(1e-4, 12.8, later["max"].as<float>());
+
+  // A record of the earlier hour arriving late goes to raw/ but leaves the
+  // roll-up of the newer hour alone
+  TelemetryRecord late = record(11.0f, records[0].readTime - 1000);
+  body = "";
+  TEST_ASSERT_TRUE(buildRecordsUpdate(&late, 1, hour, newest, body));
+  doc.clear();
+  TEST_ASSERT_FALSE(deserializeJson(doc, body));
+  TEST_ASSERT_EQUAL_size_t(1, doc.as<JsonObject>().size());
+  TEST_ASSERT_FALSE(doc[rawPath(late)].isNull());
+  TEST_ASSERT_EQUAL_UINT32(2, hour.records);
+}
+
+static void resetRegistration(int code) {
+  session.registered = false;
+  session.registrationRefused = false;
+  session.registration = RetryPolicy();
+  session.initialized = true;
+  session.idToken = "token";
+  session.tokenExpiryTime = ULONG_MAX;
+  rootCode = code;
+  tagReads = 0;
+  registrations = 0;
+  Logger::clearLogs();
+}
+
+static void upload() {
+  TelemetryRecord r = record(12.0f, millis());
+  TEST_ASSERT_TRUE(sendRecordsToFirebase(&r, 1));
+}
+
+// Times register_failed was logged with the given severity
+static uint32_t registerFailures(LogSeverity severity) {
+  DynamicJsonDocument doc(4096);
+  TEST_ASSERT_FALSE(deserializeJson(doc, Logger::getLogsAsJSON()));
+  uint32_t count = 0;
+  for (JsonArray row : doc["events"].as<JsonArray>()) {
+    if (row[0].as<int>() == EVENT_REGISTER_FAILED && row[1].as<int>() == severity) count += row[2].as<uint32_t>();
+  }
+  return count;
+}
+
+void test_refused_registration_not_repeated() {
+  resetRegistration(403);
+  for (int i = 0; i < 20; i++) {
+    upload();
+    delay(60000);
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, tagReads);
+  TEST_ASSERT_EQUAL_UINT32(1, registrations);
+  TEST_ASSERT_TRUE(session.registrationRefused);
+  TEST_ASSERT_FALSE(session.registered);
+  TEST_ASSERT_EQUAL_UINT32(1, registerFailures(SEVERITY_ERROR));
+}
+
+void test_failed_registration_backs_off() {
+  resetRegistration(503);
+  upload();
+  TEST_ASSERT_EQUAL_UINT32(1, registrations);
+  unsigned long wait = session.registration.retryInMs();
+  TEST_ASSERT_TRUE(wait >= TELEMETRY_RETRY_MIN_MS);
+
+  // Batches within the backoff go up without it
+  for (int i = 0; i < 5; i++) upload();
+  TEST_ASSERT_EQUAL_UINT32(1, tagReads);
+  TEST_ASSERT_EQUAL_UINT32(1, registrations);
+
+  delay(wait);
+  rootCode = 200;
+  upload();
+  TEST_ASSERT_EQUAL_UINT32(2, registrations);
+  TEST_ASSERT_TRUE(session.registered);
+  upload();
+  TEST_ASSERT_EQUAL_UINT32(2, tagReads);
+  TEST_ASSERT_EQUAL_UINT32(2, registrations);
+  TEST_ASSERT_EQUAL_UINT32(1, registerFailures(SEVERITY_WARN));
+  TEST_ASSERT_EQUAL_UINT32(0, registerFailures(SEVERITY_ERROR));
+}
+
+void setup() {
+  hal::setTimeScale(0);
+  session.deviceId = "test-device";
+  session.tags = "";
+  session.bootId = BOOT_ID;
+  useFirebaseSession(&session);
+  hal::setHttpHandler(firebase);
+  initEEPROM();
+  Logger::init();
+  UNITY_BEGIN();
+  RUN_TEST(test_day_and_hour_keys);
+  RUN_TEST(test_record_key_format);
+  RUN_TEST(test_record_keys_sort_by_time);
+  RUN_TEST(test_hour_summary_add);
+  RUN_TEST(test_unsynced_batch_paths);
+  RUN_TEST(test_batch_across_an_hour_boundary);
+  RUN_TEST(test_refused_registration_not_repeated);
+  RUN_TEST(test_failed_registration_backs_off);
+  exit(UNITY_END());
+}
+
+void loop() {}
@@ -0,0 +1,213 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+#include <random>
+#include <vector>
+#include "hal.h"
+#include "ota_stream.h"
+
+// OTA decompress-and-verify against whole images: a firmware-like .bin
+// and the same image gzipped by zlib, with and without the optional header
+// fields (FEXTRA, FNAME, FCOMMENT, FHCRC), fed in random piece sizes and
+// byte by byte. What comes out is the .bin byte for byte; a bad CRC-32, a
+// wrong ISIZE, a truncated stream, corrupt deflate data, bytes after the
+// trailer and a header with reserved flags are refused.
+
+typedef std::vector<uint8_t> Bytes;
+
+// 0xE9 and a header, then runs of "code" (a few repeating words with
+// random immediates) and of random data, so it compresses about as well
+// as a real image
+static Bytes firmware(size_t size, uint32_t seed) {
+  std::mt19937 rng(seed);
+  Bytes out = {0xE9, 0x03, 0x02, 0x20};
+  while (out.size() < size) {
+    size_t run = 64 + rng() % 2048;
+    bool code = rng() % 4 != 0;
+    for (size_t i = 0; i < run && out.size() < size; i++) {
+      out.push_back(code ? (uint8_t)(i % 4 == 3 ? rng() : 0x13 + (i % 4) * 0x20) : (uint8_t)rng());
+    }
+  }
+  return out;
+}
+
+// gzip as zlib writes it; name and extra add the optional header fields
+static Bytes gzip(const Bytes& in, bool fields) {
+  z_stream z = {};
+  TEST_ASSERT_EQUAL_INT(Z_OK, deflateInit2(&z, 9, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY));
+  gz_header header = {};
+  Bytes extra = {'V', 'L', 4, 0, 1, 2, 3, 4};
+  if (fields) {
+    header.extra = extra.data();
+    header.extra_len = extra.size();
+    header.name = (Bytef*)"firmware.bin";
+    header.comment = (Bytef*)"voltagelog";
+    header.hcrc = 1;
+    TEST_ASSERT_EQUAL_INT(Z_OK, deflateSetHeader(&z, &header));
+  }
+  Bytes out(deflateBound(&z, in.size()) + 64);
+  z.next_in = (Bytef*)in.data();
+  z.avail_in = in.size();
+  z.next_out = out.data();
+  z.avail_out = out.size();
+  TEST_ASSERT_EQUAL_INT(Z_STREAM_END, deflate(&z, Z_FINISH));
+  out.resize(z.total_out);
+  deflateEnd(&z);
+  return out;
+}
+
+struct Result {
+  bool written;  // every write() returned true
+  bool finished;
+  Bytes out;
+  size_t largestPiece;
+  const char* error;
+};
+
+static bool collect(const uint8_t* data, size_t len, void* ctx) {
+  Result* r = (Result*)ctx;
+  r->out.insert(r->out.end(), data, data + len);
+  if (len > r->largestPiece) r->largestPiece = len;
+  return true;
+}
+
+// The whole image through an OtaStream in pieces of 1..maxPiece bytes
+// (maxPiece 1: byte by byte)
+static Result feed(const Bytes& image, size_t maxPiece, uint32_t seed) {
+  std::mt19937 rng(seed);
+  Result r = {true, false, {}, 0, nullptr};
+  OtaStream stream;
+  stream.begin(collect, &r);
+  size_t pos = 0;
+  while (pos < image.size() && r.written) {
+    size_t n = 1 + rng() % maxPiece;
+    if (n > image.size() - pos) n = image.size() - pos;
+    r.written = stream.write(image.data() + pos, n);
+    pos += n;
+  }
+  r.finished = r.written && stream.finish();
+  r.error = stream.error();
+  return r;
+}
+
+static const Bytes bin = firmware(300 * 1024, 1);
+static const Bytes gz = gzip(bin, false);
+static const Bytes gzFields = gzip(bin, true);
+
+static void assertImage(const Result& r) {
+  TEST_ASSERT_TRUE(r.written);
+  TEST_ASSERT_TRUE(r.finished);
+  TEST_ASSERT_NULL(r.error);
+  TEST_ASSERT_EQUAL_size_t(bin.size(), r.out.size());
+  TEST_ASSERT_EQUAL_MEMORY(bin.data(), r.out.data(), bin.size());
+}
+
+static void assertRefused(const Result& r, const char* error) {
+  TEST_ASSERT_FALSE(r.finished);
+  TEST_ASSERT_NOT_NULL(r.error);
+  TEST_ASSERT_EQUAL_STRING(error, r.error);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_raw_image_passes_through() {
+  const size_t pieces[] = {1, 97, 1460, 65536};
+  for (size_t i = 0; i < 4; i++) assertImage(feed(bin, pieces[i], i));
+  assertRefused(feed(Bytes{0x7F, 'E', 'L', 'F'}, 4, 0), "unknown image format");
+}
+
+void test_gzip_image_inflates_exactly() {
+  const size_t pieces[] = {97, 1460, 4096, 65536};
+  for (size_t i = 0; i < 4; i++) {
+    Result r = feed(gz, pieces[i], i);
+    assertImage(r);
+    TEST_ASSERT_TRUE(r.largestPiece <= OtaStream::WINDOW_SIZE);
+  }
+  assertImage(feed(gz, 1, 0));
+
+  char line[80];
+  snprintf(line, sizeof(line), "%u B image, %u B gzipped", (unsigned)bin.size(), (unsigned)gz.size());
+  TEST_MESSAGE(line);
+}
+
+void test_gzip_header_fields_skipped() {
+  // Piece boundaries land inside the extra field, the name and the comment
+  TEST_ASSERT_EQUAL_HEX8(0x04 | 0x08 | 0x10 | 0x02, gzFields[3]);
+  assertImage(feed(gzFields, 1, 0));
+  for (uint32_t seed = 0; seed < 8; seed++) assertImage(feed(gzFields, 7, seed));
+  assertImage(feed(gzFields, 1460, 1));
+
+  Bytes reserved = gz;
+  reserved[3] |= 0x20;
+  assertRefused(feed(reserved, 1460, 0), "bad gzip header");
+  Bytes notDeflate = gz;
+  notDeflate[2] = 7;
+  assertRefused(feed(notDeflate, 1460, 0), "bad gzip header");
+}
+
+void test_bad_trailer_refused() {
+  Bytes badCrc = gz;
+  badCrc[badCrc.size() - 8] ^= 0x01;
+  assertRefused(feed(badCrc, 1460, 0), "CRC mismatch");
+
+  Bytes badSize = gz;
+  badSize[badSize.size() - 4] ^= 0x01;
+  assertRefused(feed(badSize, 1460, 0), "length mismatch");
+}
+
+void test_truncated_refused() {
+  // In the trailer, in the deflate data and in the header
+  const size_t cuts[] = {1, 8, gz.size() / 2, gz.size() - 5};
+  for (size_t cut : cuts) {
+    Bytes shortImage(gz.begin(), gz.end() - cut);
+    Result r = feed(shortImage, 1460, 0);
+    TEST_ASSERT_TRUE(r.written);
+    assertRefused(r, "image truncated");
+  }
+}
+
+void test_corrupt_deflate_refused() {
+  // First block type 11 (reserved)
+  Bytes badBlock = gz;
+  badBlock[10] |= 0x06;
+  Result r = feed(badBlock, 1460, 0);
+  TEST_ASSERT_FALSE(r.written);
+  assertRefused(r, "corrupt deflate data");
+}
+
+void test_trailing_bytes_refused() {
+  Bytes longer = gz;
+  longer.push_back(0);
+  Result r = feed(longer, 1460, 0);
+  TEST_ASSERT_FALSE(r.written);
+  assertRefused(r, "data after end of image");
+
+  // Also when the extra bytes come as a piece of their own
+  OtaStream stream;
+  Result sink = {true, false, {}, 0, nullptr};
+  stream.begin(collect, &sink);
+  TEST_ASSERT_TRUE(stream.write(gz.data(), gz.size()));
+  TEST_ASSERT_TRUE(stream.done());
+  const uint8_t more[] = {0x1F, 0x8B};
+  TEST_ASSERT_FALSE(stream.write(more, sizeof(more)));
+  TEST_ASSERT_FALSE(stream.finish());
+}
+
+void setup() {
+  hal::setTimeScale(0);
+  UNITY_BEGIN();
+  RUN_TEST(test_raw_image_passes_through);
+  RUN_TEST(test_gzip_image_inflates_exactly);
+  RUN_TEST(test_gzip_header_fields_skipped);
+  RUN_TEST(test_bad_trailer_refused);
+  RUN_TEST(test_truncated_refused);
+  RUN_TEST(test_corrupt_deflate_refused);
+  RUN_TEST(test_trailing_bytes_refused);
+  exit(UNITY_END());
+}
+
+void loop() {}
@@ -0,0 +1,132 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <stdlib.h>
+#include "hal.h"
+#include "config.h"
+#include "measurement.h"
+#include "settings.h"
+#include "logger.h"
+
+// The voltage channel as main.cpp composes it, run for several send
+// intervals with the heap watched: after the first readings (lazy set-up
+// of the serial queue, EEPROM, ...) a step() must not allocate, nor may
+// reset(). Allocations are counted by wrapping glibc's malloc family, which
+// operator new and String go through too; only this thread's calls count,
+// not the HAL's server and serial threads.
+
+static thread_local bool counting = false;
+static size_t allocations = 0;
+
+#ifdef __GLIBC__
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t size);
+
+void* malloc(size_t size) {
+  if (counting) allocations++;
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+  if (counting) allocations++;
+  return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t size) {
+  if (counting) allocations++;
+  return __libc_realloc(p, size);
+}
+}
+#endif
+
+static const int PIN = 4;
+
+// Records handed to the sinks are only queued here
+class QueueOnlySink : public TelemetrySink {
+public:
+  QueueOnlySink() : TelemetrySink("queue") {}
+
+protected:
+  size_t sendBatch(const TelemetryRecord*, size_t) override { return 0; }
+};
+
+static VoltageStats stats;
+static SampleStore store;
+static DeadBand deadBand;
+static DeviceStatus status = {};
+static QueueOnlySink sink;
+
+static Pipeline<AdcBurst<PIN, VoltageFilter>, Calibrate, SerialReport, Accumulate, Store, Publish, StatusUpdate>
+    pipeline{AdcBurst<PIN, VoltageFilter>(), Calibrate(), SerialReport(), Accumulate(stats), Store(store),
+             Publish(stats, deadBand), StatusUpdate(status, stats)};
+
+// One reading a second, the input moving so the dead-band lets windows out
+static size_t run(size_t readings) {
+  size_t counted = 0;
+  for (size_t i = 0; i < readings; i++) {
+    delay(1000);
+    hal::setAdcMilliVolts(1500 + (float)(i % 120) * 2);
+    allocations = 0;
+    counting = true;
+    pipeline.step();
+    counting = false;
+    counted += allocations;
+  }
+  return counted;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_counter_sees_allocations() {
+#ifndef __GLIBC__
+  TEST_IGNORE_MESSAGE("malloc is only wrapped on glibc");
+#endif
+  allocations = 0;
+  counting = true;
+  String s("long enough not to fit the small string buffer");
+  s += " and then some more";
+  counting = false;
+  TEST_ASSERT_GREATER_THAN_UINT32(0, allocations);
+}
+
+void test_step_does_not_allocate() {
+  run(5);  // first readings: lazy set-up may allocate
+  uint32_t records = status.recordNumber;
+  size_t samples = store.samples();
+
+  TEST_ASSERT_EQUAL_size_t(0, run(Settings::get().sendIntervalMs / 1000 * 3 + 10));
+  // The run went through every stage, window hand-over included
+  TEST_ASSERT_GREATER_THAN_UINT32(records, status.recordNumber);
+  TEST_ASSERT_GREATER_THAN_UINT32(samples, store.samples());
+  TEST_ASSERT_GREATER_THAN_UINT32(0, sink.pending());
+}
+
+void test_reset_does_not_allocate() {
+  allocations = 0;
+  counting = true;
+  pipeline.reset();
+  counting = false;
+  TEST_ASSERT_EQUAL_size_t(0, allocations);
+  TEST_ASSERT_EQUAL_size_t(0, run(10));
+}
+
+void setup() {
+  hal::setTimeScale(0);
+  hal::setAdcNoise(3);
+  SerialLog::begin();
+  initEEPROM();
+  Settings::begin();
+  Logger::init();
+  AdcRanging::begin(PIN);
+  Telemetry::addSink(&sink);
+  UNITY_BEGIN();
+  RUN_TEST(test_counter_sees_allocations);
+  RUN_TEST(test_step_does_not_allocate);
+  RUN_TEST(test_reset_does_not_allocate);
+  exit(UNITY_END());
+}
+
+void loop() {}
@@ -0,0 +1,161 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "hal.h"
+#include "retry_policy.h"
+
+// RetryPolicy: HTTP code classes, the bounds of the jittered backoff and
+// the breaker going closed -> open -> half-open -> closed, in virtual time.
+
+static const unsigned long MIN_MS = TELEMETRY_RETRY_MIN_MS;
+static const unsigned long MAX_MS = TELEMETRY_RETRY_MAX_MS;
+static const unsigned long OPEN_MS = TELEMETRY_BREAKER_OPEN_MS;
+static const unsigned long OPEN_MAX_MS = TELEMETRY_BREAKER_OPEN_MAX_MS;
+static const int RUNS = 500;
+
+// Fail until the breaker opens
+static void trip(RetryPolicy& policy) {
+  for (int i = 0; i < TELEMETRY_BREAKER_THRESHOLD; i++) {
+    delay(policy.retryInMs());
+    TEST_ASSERT_TRUE(policy.allow());
+    policy.onFailure(RetryPolicy::ERROR_TRANSIENT);
+  }
+  TEST_ASSERT_EQUAL(RetryPolicy::BREAKER_OPEN, policy.state());
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_classify() {
+  const int none[] = {200, 201, 204, 299};
+  const int auth[] = {401, 403};
+  const int transient[] = {-1, -11, 0, 302, 408, 425, 429, 500, 502, 503, 504, 600};
+  const int permanent[] = {400, 404, 405, 409, 413, 422, 499};
+  for (int code : none) TEST_ASSERT_EQUAL(RetryPolicy::ERROR_NONE, RetryPolicy::classify(code));
+  for (int code : auth) TEST_ASSERT_EQUAL(RetryPolicy::ERROR_AUTH, RetryPolicy::classify(code));
+  for (int code : transient) TEST_ASSERT_EQUAL(RetryPolicy::ERROR_TRANSIENT, RetryPolicy::classify(code));
+  for (int code : permanent) TEST_ASSERT_EQUAL(RetryPolicy::ERROR_PERMANENT, RetryPolicy::classify(code));
+  TEST_ASSERT_EQUAL_STRING("transient", RetryPolicy::className(RetryPolicy::ERROR_TRANSIENT));
+  TEST_ASSERT_EQUAL_STRING("permanent", RetryPolicy::className(RetryPolicy::ERROR_PERMANENT));
+}
+
+void test_first_auth_failure_retries_soon() {
+  for (int run = 0; run < RUNS; run++) {
+    RetryPolicy policy;
+    policy.onFailure(RetryPolicy::ERROR_AUTH);
+    TEST_ASSERT_GREATER_OR_EQUAL(MIN_MS / 5, policy.retryInMs());
+    TEST_ASSERT_LESS_OR_EQUAL(MIN_MS, policy.retryInMs());
+  }
+}
+
+void test_backoff_jitter_bounds() {
+  unsigned long lowest = MAX_MS, highest = 0;
+  for (int run = 0; run < RUNS; run++) {
+    RetryPolicy policy;
+    unsigned long last = MIN_MS;
+    // Every failure below the breaker threshold backs off
+    for (int i = 1; i < TELEMETRY_BREAKER_THRESHOLD; i++) {
+      policy.onFailure(RetryPolicy::ERROR_TRANSIENT);
+      unsigned long wait = policy.retryInMs();
+      unsigned long high = last * 3 < MAX_MS ? last * 3 : MAX_MS;
+      TEST_ASSERT_GREATER_OR_EQUAL(MIN_MS, wait);
+      TEST_ASSERT_LESS_OR_EQUAL(high, wait);
+      TEST_ASSERT_EQUAL(RetryPolicy::BREAKER_CLOSED, policy.state());
+      if (i == 1) {
+        if (wait < lowest) lowest = wait;
+        if (wait > highest) highest = wait;
+      }
+      last = wait;
+    }
+  }
+  // Spread over the whole range, not stuck at one end
+  TEST_ASSERT_LESS_THAN(MIN_MS + MIN_MS / 5, lowest);
+  TEST_ASSERT_GREATER_THAN(3 * MIN_MS - MIN_MS / 5, highest);
+}
+
+void test_no_attempt_before_backoff_is_over() {
+  RetryPolicy policy;
+  TEST_ASSERT_TRUE(policy.allow());
+  policy.onFailure(RetryPolicy::ERROR_TRANSIENT);
+  unsigned long wait = policy.retryInMs();
+  TEST_ASSERT_FALSE(policy.allow());
+  delay(wait - 1);
+  TEST_ASSERT_FALSE(policy.allow());
+  TEST_ASSERT_EQUAL_UINT32(1, policy.retryInMs());
+  delay(1);
+  TEST_ASSERT_TRUE(policy.allow());
+  TEST_ASSERT_EQUAL_UINT32(0, policy.shortCircuits());  // only counted while open
+}
+
+void test_breaker_cycle_with_one_probe() {
+  RetryPolicy policy;
+  trip(policy);
+  TEST_ASSERT_EQUAL_UINT32(1, policy.breakerOpens());
+  TEST_ASSERT_EQUAL_UINT32(TELEMETRY_BREAKER_THRESHOLD, policy.consecutiveFailures());
+  unsigned long wait = policy.retryInMs();
+  TEST_ASSERT_GREATER_OR_EQUAL(OPEN_MS / 2, wait);
+  TEST_ASSERT_LESS_OR_EQUAL(OPEN_MS, wait);
+
+  // Open: everything short-circuits
+  TEST_ASSERT_FALSE(policy.allow());
+  TEST_ASSERT_FALSE(policy.allow());
+  TEST_ASSERT_EQUAL_UINT32(2, policy.shortCircuits());
+  TEST_ASSERT_EQUAL_STRING("open", policy.stateName());
+
+  // Half-open: one probe, the next caller waits for its outcome
+  delay(wait);
+  TEST_ASSERT_TRUE(policy.allow());
+  TEST_ASSERT_EQUAL(RetryPolicy::BREAKER_HALF_OPEN, policy.state());
+  TEST_ASSERT_FALSE(policy.allow());
+  TEST_ASSERT_FALSE(policy.allow());
+  TEST_ASSERT_EQUAL_UINT32(2, policy.shortCircuits());
+
+  // Probe fails: open again, twice as long
+  policy.onFailure(RetryPolicy::ERROR_TRANSIENT);
+  TEST_ASSERT_EQUAL(RetryPolicy::BREAKER_OPEN, policy.state());
+  TEST_ASSERT_EQUAL_UINT32(2, policy.breakerOpens());
+  wait = policy.retryInMs();
+  TEST_ASSERT_GREATER_OR_EQUAL(OPEN_MS, wait);
+  TEST_ASSERT_LESS_OR_EQUAL(2 * OPEN_MS, wait);
+
+  // Next probe succeeds: closed, counters and backoff reset
+  delay(wait);
+  TEST_ASSERT_TRUE(policy.allow());
+  TEST_ASSERT_FALSE(policy.allow());
+  policy.onSuccess();
+  TEST_ASSERT_EQUAL(RetryPolicy::BREAKER_CLOSED, policy.state());
+  TEST_ASSERT_EQUAL_UINT32(0, policy.consecutiveFailures());
+  TEST_ASSERT_EQUAL_UINT32(0, policy.retryInMs());
+  TEST_ASSERT_TRUE(policy.allow());
+  TEST_ASSERT_TRUE(policy.allow());
+
+  // And the open period starts from the beginning again
+  trip(policy);
+  TEST_ASSERT_LESS_OR_EQUAL(OPEN_MS, policy.retryInMs());
+}
+
+void test_open_period_is_capped() {
+  RetryPolicy policy;
+  trip(policy);
+  for (int i = 0; i < 10; i++) {
+    delay(policy.retryInMs());
+    TEST_ASSERT_TRUE(policy.allow());
+    policy.onFailure(RetryPolicy::ERROR_TRANSIENT);
+    TEST_ASSERT_LESS_OR_EQUAL(OPEN_MAX_MS, policy.retryInMs());
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(OPEN_MAX_MS / 2, policy.retryInMs());
+}
+
+void setup() {
+  hal::setTimeScale(0);
+  UNITY_BEGIN();
+  RUN_TEST(test_classify);
+  RUN_TEST(test_first_auth_failure_retries_soon);
+  RUN_TEST(test_backoff_jitter_bounds);
+  RUN_TEST(test_no_attempt_before_backoff_is_over);
+  RUN_TEST(test_breaker_cycle_with_one_probe);
+  RUN_TEST(test_open_period_is_capped);
+  exit(UNITY_END());
+}
+
+void loop() {}
@@ -0,0 +1,171 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <random>
+#include <vector>
+#include "hal.h"
+#include "sample_store.h"
+
+// SampleStore round trip: what comes back is within half a resolution step
+// of what went in (10 mV, 1 s by default), whatever the timing and jumps,
+// across a millis() wrap; from() seeks; an iterator whose block is
+// recycled under it goes on at the oldest sample and reports gap().
+
+static const int32_t HALF_MV = SAMPLE_STORE_VALUE_RES_MV / 2;
+static const int32_t HALF_MS = SAMPLE_STORE_TIME_RES_MS / 2;
+
+static SampleStore store;
+
+// Readings every 10 s with jitter, the odd long pause, a random walk with
+// the odd jump (divider change, load step), some of it below 0 V
+static std::vector<Sample> readings(size_t count, uint32_t start, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> jitter(-300, 300);
+  std::uniform_int_distribution<int> step(-25, 25);
+  std::uniform_int_distribution<int> event(0, 199);
+  std::vector<Sample> out;
+  uint32_t t = start;
+  int32_t v = 12000;
+  for (size_t i = 0; i < count; i++) {
+    int e = event(rng);
+    t += 10000 + jitter(rng) + (e == 0 ? 600000 : 0);
+    v += step(rng) + (e == 1 ? 9000 : e == 2 ? -20000 : 0);
+    out.push_back({t, v});
+  }
+  return out;
+}
+
+static void append(const std::vector<Sample>& in) {
+  for (const Sample& s : in) store.append(s.time, s.value);
+}
+
+static std::vector<Sample> readAll(SampleStore::Iterator it) {
+  std::vector<Sample> out;
+  Sample buf[37];
+  size_t n;
+  while ((n = it.read(buf, 37)) > 0) out.insert(out.end(), buf, buf + n);
+  return out;
+}
+
+void setUp() {
+  store.clear();
+}
+
+void tearDown() {}
+
+void test_empty_store() {
+  Sample s;
+  uint32_t oldest, newest;
+  TEST_ASSERT_FALSE(store.begin().next(s));
+  TEST_ASSERT_FALSE(store.from(1000).next(s));
+  TEST_ASSERT_FALSE(store.span(oldest, newest));
+  TEST_ASSERT_EQUAL_size_t(0, store.samples());
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, store.bitsPerSample());
+}
+
+void test_round_trip_within_half_a_step() {
+  const uint32_t starts[] = {0, 0xFFF00000};  // the second wraps millis()
+  for (uint32_t start : starts) {
+    store.clear();
+    const std::vector<Sample> in = readings(3000, start, start + 7);
+    append(in);
+    TEST_ASSERT_EQUAL_UINT32(0, store.dropped());
+    TEST_ASSERT_EQUAL_size_t(in.size(), store.samples());
+    TEST_ASSERT_GREATER_THAN_UINT32(1, store.blocks());
+
+    const std::vector<Sample> out = readAll(store.begin());
+    TEST_ASSERT_EQUAL_size_t(in.size(), out.size());
+    TEST_ASSERT_EQUAL_UINT32(in[0].time, out[0].time);  // first of a block: exact
+    TEST_ASSERT_EQUAL_INT32(in[0].value, out[0].value);
+    for (size_t i = 0; i < in.size(); i++) {
+      TEST_ASSERT_INT_WITHIN(HALF_MS, 0, (int32_t)(out[i].time - in[i].time));
+      TEST_ASSERT_INT_WITHIN(HALF_MV, in[i].value, out[i].value);
+    }
+
+    uint32_t oldest, newest;
+    TEST_ASSERT_TRUE(store.span(oldest, newest));
+    TEST_ASSERT_EQUAL_UINT32(out.front().time, oldest);
+    TEST_ASSERT_EQUAL_UINT32(out.back().time, newest);
+  }
+}
+
+void test_steady_readings_are_small() {
+  // A steady 10 s period and a slow voltage: a few bits each
+  for (uint32_t i = 0; i < 2000; i++) store.append(i * 10000, 12000 + (int32_t)(i / 50) * 10);
+  TEST_ASSERT_LESS_THAN_FLOAT(8.0f, store.bitsPerSample());
+  const std::vector<Sample> out = readAll(store.begin());
+  TEST_ASSERT_EQUAL_size_t(2000, out.size());
+  TEST_ASSERT_EQUAL_UINT32(19990000, out.back().time);
+  TEST_ASSERT_EQUAL_INT32(12000 + 39 * 10, out.back().value);
+}
+
+void test_from_finds_first_sample_at_or_after() {
+  append(readings(3000, 0xFFF00000, 3));
+  const std::vector<Sample> all = readAll(store.begin());
+  const size_t picks[] = {0, 1, 500, 1499, 2999};
+  for (size_t i : picks) {
+    // At a stored time, and just after the one before it
+    Sample s;
+    TEST_ASSERT_TRUE(store.from(all[i].time).next(s));
+    TEST_ASSERT_EQUAL_UINT32(all[i].time, s.time);
+    if (i > 0) {
+      TEST_ASSERT_TRUE(store.from(all[i - 1].time + 1).next(s));
+      TEST_ASSERT_EQUAL_UINT32(all[i].time, s.time);
+    }
+    TEST_ASSERT_EQUAL_size_t(all.size() - i, readAll(store.from(all[i].time)).size());
+  }
+  // Before the oldest: everything; after the newest: nothing yet
+  TEST_ASSERT_EQUAL_size_t(all.size(), readAll(store.from(all[0].time - 60000)).size());
+  SampleStore::Iterator late = store.from(all.back().time + 1);
+  Sample s;
+  TEST_ASSERT_FALSE(late.next(s));
+  store.append(all.back().time + 10000, 12000);
+  TEST_ASSERT_TRUE(late.next(s));
+  TEST_ASSERT_EQUAL_UINT32(all.back().time + 10000, s.time);
+}
+
+void test_gap_after_recycling() {
+  std::vector<Sample> in = readings(100, 0, 11);
+  append(in);
+  SampleStore::Iterator it = store.begin();
+  Sample buf[10];
+  TEST_ASSERT_EQUAL_size_t(10, it.read(buf, 10));
+  TEST_ASSERT_FALSE(it.gap());
+
+  // Keep recording until the block under the iterator is recycled
+  uint32_t t = in.back().time;
+  while (store.dropped() == 0) {
+    t += 10000;
+    store.append(t, 12000 + (int32_t)(t / 10000 % 97) * 10);
+  }
+
+  // It goes on at the oldest sample still stored and says it skipped
+  SampleStore::Iterator fresh = store.begin();
+  Sample expected, got;
+  TEST_ASSERT_TRUE(fresh.next(expected));
+  TEST_ASSERT_FALSE(fresh.gap());
+  TEST_ASSERT_TRUE(it.next(got));
+  TEST_ASSERT_TRUE(it.gap());
+  TEST_ASSERT_EQUAL_UINT32(expected.time, got.time);
+  TEST_ASSERT_EQUAL_INT32(expected.value, got.value);
+
+  // And reads the rest like a fresh one; gap() stays set
+  std::vector<Sample> rest = readAll(it);
+  std::vector<Sample> all = readAll(store.begin());
+  TEST_ASSERT_EQUAL_size_t(all.size() - 1, rest.size());
+  TEST_ASSERT_EQUAL_UINT32(all.back().time, rest.back().time);
+  TEST_ASSERT_TRUE(it.gap());
+  TEST_ASSERT_EQUAL_size_t(store.samples(), all.size());
+}
+
+void setup() {
+  hal::setTimeScale(0);
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_store);
+  RUN_TEST(test_round_trip_within_half_a_step);
+  RUN_TEST(test_steady_readings_are_small);
+  RUN_TEST(test_from_finds_first_sample_at_or_after);
+  RUN_TEST(test_gap_after_recycling);
+  exit(UNITY_END());
+}
+
+void loop() {}
@@ -0,0 +1,184 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "hal.h"
+#include "adc_range.h"
+#include "seqlock.h"
+#include "webserver.h"
+
+// SeqLock<DeviceStatus> under contention: one writer publishing versions
+// in which every field is derived from the same counter, several readers
+// checking that each copy they get comes from a single version. The
+// cost of read() and write() is printed alone and with the readers on.
+
+static const uint32_t WRITES = 200000;
+static const int READERS = 3;
+static const uint32_t CHECKS = 20000;
+
+static DeviceStatus version(uint32_t n) {
+  DeviceStatus s = {};
+  s.lastVoltage = n * 0.5f;
+  s.lastRawValue = (int)n;
+  s.lastAdcRange = n % ADC_RANGE_COUNT;
+  s.lastReadTime = n * 3;
+  s.lastSendTime = n * 7;
+  s.firebaseConnected = n & 1;
+  s.recordNumber = (int)n;
+  s.version = "test";
+  s.window.count = n;
+  s.window.mean = n * 0.25f;
+  s.lastWindow.count = n + 1;
+  s.total.count = n + 2;
+  s.windows = n;
+  s.rangeSwitches = ~n;
+  s.histogramMin = (float)n;
+  s.histogramUnder = n;
+  s.histogramOver = n ^ 0x5a5a5a5a;
+  for (size_t i = 0; i < STATS_HISTOGRAM_BINS; i++) s.histogram[i] = n + i;
+  return s;
+}
+
+static double nanosSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The version a copy claims to be, or -1 if its fields disagree
+static int64_t check(const DeviceStatus& s) {
+  uint32_t n = (uint32_t)s.lastRawValue;
+  const DeviceStatus expected = version(n);
+  if (s.lastVoltage != expected.lastVoltage || s.lastAdcRange != expected.lastAdcRange ||
+      s.lastReadTime != expected.lastReadTime || s.lastSendTime != expected.lastSendTime ||
+      s.firebaseConnected != expected.firebaseConnected || s.recordNumber != expected.recordNumber ||
+      s.window.count != expected.window.count || s.window.mean != expected.window.mean ||
+      s.lastWindow.count != expected.lastWindow.count || s.total.count != expected.total.count ||
+      s.windows != expected.windows || s.rangeSwitches != expected.rangeSwitches ||
+      s.histogramMin != expected.histogramMin || s.histogramUnder != expected.histogramUnder ||
+      s.histogramOver != expected.histogramOver) {
+    return -1;
+  }
+  for (size_t i = 0; i < STATS_HISTOGRAM_BINS; i++) {
+    if (s.histogram[i] != expected.histogram[i]) return -1;
+  }
+  return n;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_initial_value_is_zero() {
+  SeqLock<DeviceStatus> lock;
+  DeviceStatus s = lock.read();
+  TEST_ASSERT_EQUAL_INT(0, s.lastRawValue);
+  TEST_ASSERT_EQUAL_UINT32(0, s.windows);
+  TEST_ASSERT_EQUAL_UINT32(0, lock.version());
+}
+
+void test_read_returns_last_write() {
+  SeqLock<DeviceStatus> lock;
+  lock.write(version(41));
+  lock.write(version(42));
+  TEST_ASSERT_EQUAL_INT64(42, check(lock.read()));
+  TEST_ASSERT_EQUAL_UINT32(2, lock.version());
+}
+
+void test_uncontended_timing() {
+  SeqLock<DeviceStatus> lock;
+  const DeviceStatus value = version(1);
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t n = 0; n < WRITES; n++) lock.write(value);
+  double writeNs = nanosSince(start) / WRITES;
+
+  int64_t sum = 0;
+  start = std::chrono::steady_clock::now();
+  for (uint32_t n = 0; n < WRITES; n++) sum += lock.read().lastRawValue;
+  double readNs = nanosSince(start) / WRITES;
+  TEST_ASSERT_EQUAL_INT64(WRITES, sum);
+
+  char line[100];
+  snprintf(line, sizeof(line), "uncontended: write() %.0f ns, read() %.0f ns (%u B)", writeNs, readNs,
+           (unsigned)sizeof(DeviceStatus));
+  TEST_MESSAGE(line);
+}
+
+void test_no_torn_reads_under_contention() {
+  // version() stays outside the timed writes
+  std::vector<DeviceStatus> versions(WRITES + 1);
+  for (uint32_t n = 0; n <= WRITES; n++) versions[n] = version(n);
+
+  SeqLock<DeviceStatus> lock;
+  lock.write(versions[0]);
+  std::atomic<int> ready(0);
+  std::atomic<bool> done(false);
+  std::atomic<uint32_t> torn(0);
+  std::atomic<uint32_t> backwards(0);
+  std::atomic<uint32_t> reads(0);
+  std::atomic<uint64_t> readNanos(0);
+  std::atomic<int64_t> checked(0);
+
+  std::vector<std::thread> readers;
+  for (int i = 0; i < READERS; i++) {
+    readers.emplace_back([&]() {
+      // What check() costs by itself, taken off the loop's time below
+      const DeviceStatus copy = versions[WRITES];
+      auto start = std::chrono::steady_clock::now();
+      int64_t sum = 0;
+      for (uint32_t n = 0; n < CHECKS; n++) sum += check(copy);
+      double checkNs = nanosSince(start) / CHECKS;
+      checked += sum;
+
+      ready++;
+      int64_t last = 0;
+      uint32_t count = 0;
+      start = std::chrono::steady_clock::now();
+      while (!done.load(std::memory_order_acquire)) {
+        int64_t n = check(lock.read());
+        if (n < 0) {
+          torn++;
+        } else {
+          if (n < last) backwards++;  // versions only move forward
+          last = n;
+        }
+        count++;
+      }
+      double ns = nanosSince(start) - checkNs * count;
+      readNanos += ns > 0 ? (uint64_t)ns : 0;
+      reads += count;
+    });
+  }
+
+  while (ready.load() < READERS) std::this_thread::yield();
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t n = 1; n <= WRITES; n++) lock.write(versions[n]);
+  double writeNs = nanosSince(start) / WRITES;
+  done.store(true, std::memory_order_release);
+  for (std::thread& t : readers) t.join();
+
+  TEST_ASSERT_EQUAL_UINT32(0, torn.load());
+  TEST_ASSERT_EQUAL_UINT32(0, backwards.load());
+  TEST_ASSERT_GREATER_THAN_UINT32(0, reads.load());
+  TEST_ASSERT_EQUAL_INT64((int64_t)READERS * WRITES * CHECKS, checked.load());
+  TEST_ASSERT_EQUAL_INT64(WRITES, check(lock.read()));
+  TEST_ASSERT_EQUAL_UINT32(WRITES + 1, lock.version());
+
+  char line[120];
+  snprintf(line, sizeof(line), "%d readers: write() %.0f ns, read() %.0f ns (%u reads)", READERS, writeNs,
+           (double)readNanos.load() / reads.load(), (unsigned)reads.load());
+  TEST_MESSAGE(line);
+}
+
+void setup() {
+  hal::setTimeScale(0);
+  UNITY_BEGIN();
+  RUN_TEST(test_initial_value_is_zero);
+  RUN_TEST(test_read_returns_last_write);
+  RUN_TEST(test_uncontended_timing);
+  RUN_TEST(test_no_torn_reads_under_contention);
+  exit(UNITY_END());
+}
+
+void loop() {}
@@ -0,0 +1,115 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "hal.h"
+#include "stream_stats.h"
+
+// The online statistics against exact ones over the same samples: Welford
+// mean and stddev, P² quantiles of 100k Gaussian samples within 10 mV,
+// exact below five samples, the histogram's bins adding up, and windows
+// that start over while the run keeps going.
+
+static std::vector<float> gaussian(size_t count, float mean, float sigma, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> d(mean, sigma);
+  std::vector<float> out;
+  for (size_t i = 0; i < count; i++) out.push_back(d(rng));
+  return out;
+}
+
+// Same definition as the estimator's target: the sample at p of the way
+static float exactQuantile(std::vector<float> v, float p) {
+  std::sort(v.begin(), v.end());
+  return v[(size_t)lroundf(p * (v.size() - 1))];
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_running_stats_match_two_pass() {
+  const std::vector<float> v = gaussian(100000, 12.0f, 0.2f, 1);
+  RunningStats s;
+  double sum = 0;
+  for (float x : v) {
+    s.add(x);
+    sum += x;
+  }
+  double mean = sum / v.size();
+  double sq = 0;
+  for (float x : v) sq += (x - mean) * (x - mean);
+  TEST_ASSERT_EQUAL_UINT32(v.size(), s.count());
+  TEST_ASSERT_FLOAT_WITHIN(1e-5f, (float)mean, s.mean());
+  TEST_ASSERT_FLOAT_WITHIN(1e-5f, (float)sqrt(sq / (v.size() - 1)), s.stddev());
+  TEST_ASSERT_EQUAL_FLOAT(*std::min_element(v.begin(), v.end()), s.min());
+  TEST_ASSERT_EQUAL_FLOAT(*std::max_element(v.begin(), v.end()), s.max());
+}
+
+void test_p2_close_to_exact_quantiles() {
+  const std::vector<float> v = gaussian(100000, 12.0f, 0.2f, 2);
+  const float ps[] = {0.01f, 0.5f, 0.99f};
+  for (float p : ps) {
+    P2Quantile q(p);
+    for (float x : v) q.add(x);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, exactQuantile(v, p), q.value());
+  }
+}
+
+void test_p2_exact_below_five_samples() {
+  const float v[] = {12.3f, 11.9f, 12.1f, 12.0f};
+  P2Quantile median(0.5f);
+  P2Quantile high(0.99f);
+  for (float x : v) {
+    median.add(x);
+    high.add(x);
+  }
+  TEST_ASSERT_EQUAL_FLOAT(12.3f, high.value());
+  TEST_ASSERT_EQUAL_FLOAT(12.1f, median.value());  // nearest rank, ties up
+}
+
+void test_histogram_counts_every_sample() {
+  FixedHistogram h(STATS_HISTOGRAM_MIN_V, STATS_HISTOGRAM_MAX_V);
+  const float v[] = {-1.0f, 0.0f, 0.5f, 12.0f, 12.99f, 24.99f, 25.0f, 30.0f};
+  for (float x : v) h.add(x);
+  uint32_t inside = 0;
+  for (size_t i = 0; i < h.bins(); i++) inside += h.bin(i);
+  TEST_ASSERT_EQUAL_UINT32(1, h.underflow());
+  TEST_ASSERT_EQUAL_UINT32(2, h.overflow());
+  TEST_ASSERT_EQUAL_UINT32(5, inside);
+  TEST_ASSERT_EQUAL_UINT32(2, h.bin(0));
+  TEST_ASSERT_EQUAL_UINT32(2, h.bin(12));
+}
+
+void test_windows_start_over_run_goes_on() {
+  VoltageStats stats;
+  for (int i = 0; i < 6; i++) stats.add(12.0f);
+  VoltageSummary first = stats.closeWindow();
+  for (int i = 0; i < 6; i++) stats.add(13.0f);
+  VoltageSummary second = stats.closeWindow();
+
+  TEST_ASSERT_EQUAL_UINT32(6, first.count);
+  TEST_ASSERT_EQUAL_FLOAT(12.0f, first.mean);
+  TEST_ASSERT_EQUAL_UINT32(6, second.count);
+  TEST_ASSERT_EQUAL_FLOAT(13.0f, second.min);
+  TEST_ASSERT_EQUAL_UINT32(2, stats.windowsClosed());
+  TEST_ASSERT_EQUAL_UINT32(0, stats.window().count);
+  TEST_ASSERT_EQUAL_UINT32(12, stats.total().count);
+  TEST_ASSERT_FLOAT_WITHIN(1e-5f, 12.5f, stats.total().mean);
+  TEST_ASSERT_EQUAL_UINT32(6, stats.lastHistogram().bin(13));
+}
+
+void setup() {
+  hal::setTimeScale(0);
+  UNITY_BEGIN();
+  RUN_TEST(test_running_stats_match_two_pass);
+  RUN_TEST(test_p2_close_to_exact_quantiles);
+  RUN_TEST(test_p2_exact_below_five_samples);
+  RUN_TEST(test_histogram_counts_every_sample);
+  RUN_TEST(test_windows_start_over_run_goes_on);
+  exit(UNITY_END());
+}
+
+void loop() {}
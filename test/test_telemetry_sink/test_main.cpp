@@ -0,0 +1,396 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <ArduinoJson.h>
+#include <WiFi.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include "hal.h"
+#include "telemetry_sink.h"
+#include "http_sink.h"
+#include "mqtt_sink.h"
+#include "device_identity.h"
+
+// TelemetrySink queue and retries with a scripted transport: order and
+// batching, drop-oldest when full, backoff, a permanent error dropping one
+// record, partial delivery, the breaker. Then HttpPostSink against the
+// HAL's HTTP handler and MqttSink against its MQTT handler, in virtual time.
+
+// Transport whose batches succeed or fail as scripted; records are told
+// apart by readTime
+class ScriptedSink : public TelemetrySink {
+public:
+  ScriptedSink() : TelemetrySink("scripted") {}
+
+  std::deque<int> codes;     // result of the next batches, then 200
+  size_t accept = 1000;      // most records one batch delivers
+  size_t batch = 4;
+  bool ready = true;
+  std::vector<unsigned long> sent;
+  size_t calls = 0;
+
+protected:
+  size_t sendBatch(const TelemetryRecord* records, size_t count) override {
+    calls++;
+    int code = 200;
+    if (!codes.empty()) {
+      code = codes.front();
+      codes.pop_front();
+    }
+    if (code < 200 || code >= 300) {
+      setResultCode(code);
+      return 0;
+    }
+    size_t n = count < accept ? count : accept;
+    for (size_t i = 0; i < n; i++) sent.push_back(records[i].readTime);
+    return n;
+  }
+  size_t maxBatchSize() const override { return batch; }
+  bool isReady() override { return ready; }
+};
+
+static TelemetryRecord record(unsigned long n) {
+  TelemetryRecord r = {};
+  r.voltage = 12.0f + n / 100.0f;
+  r.rawValue = 2000 + (int)n;
+  r.readTime = n;
+  return r;
+}
+
+static void enqueue(TelemetrySink& sink, unsigned long first, unsigned long last) {
+  for (unsigned long n = first; n <= last; n++) sink.enqueue(record(n));
+}
+
+static void expectSent(const std::vector<unsigned long>& sent, unsigned long first, unsigned long last) {
+  TEST_ASSERT_EQUAL_size_t(last - first + 1, sent.size());
+  for (size_t i = 0; i < sent.size(); i++) TEST_ASSERT_EQUAL_UINT32(first + i, sent[i]);
+}
+
+static void wifiUp() {
+  hal::setWiFiUp(true);
+  WiFi.begin("test");
+  delay(hal::wifiConnectDelay());
+  TEST_ASSERT_EQUAL(WL_CONNECTED, WiFi.status());
+}
+
+void setUp() {
+  wifiUp();
+}
+
+void tearDown() {
+  hal::setHttpHandler(nullptr);
+  hal::setMqttHandler(nullptr);
+}
+
+void test_batches_in_order_up_to_flush_limit() {
+  ScriptedSink sink;
+  sink.batch = 3;
+  enqueue(sink, 1, TELEMETRY_QUEUE_SIZE);
+  sink.process();
+  // TELEMETRY_FLUSH_BATCHES batches per pass, the rest on the next
+  TEST_ASSERT_EQUAL_size_t(TELEMETRY_FLUSH_BATCHES, sink.calls);
+  expectSent(sink.sent, 1, 3 * TELEMETRY_FLUSH_BATCHES);
+  TEST_ASSERT_EQUAL_size_t(TELEMETRY_QUEUE_SIZE - 3 * TELEMETRY_FLUSH_BATCHES, sink.pending());
+  sink.process();
+  expectSent(sink.sent, 1, TELEMETRY_QUEUE_SIZE);
+  TEST_ASSERT_EQUAL_size_t(0, sink.pending());
+  TEST_ASSERT_EQUAL_UINT32(TELEMETRY_QUEUE_SIZE, sink.stats().published);
+  TEST_ASSERT_EQUAL_UINT32(TELEMETRY_QUEUE_SIZE, sink.stats().enqueued);
+}
+
+void test_full_queue_drops_oldest() {
+  ScriptedSink sink;
+  for (unsigned long n = 1; n <= TELEMETRY_QUEUE_SIZE; n++) TEST_ASSERT_TRUE(sink.enqueue(record(n)));
+  TEST_ASSERT_TRUE(sink.isBackpressured());
+  for (unsigned long n = TELEMETRY_QUEUE_SIZE + 1; n <= TELEMETRY_QUEUE_SIZE + 3; n++) {
+    TEST_ASSERT_FALSE(sink.enqueue(record(n)));
+  }
+  TEST_ASSERT_EQUAL_UINT32(3, sink.stats().dropped);
+  TEST_ASSERT_EQUAL_size_t(TELEMETRY_QUEUE_SIZE, sink.pending());
+
+  // The newest ones go out, oldest first
+  sink.process();
+  expectSent(sink.sent, 4, TELEMETRY_QUEUE_SIZE + 3);
+  TEST_ASSERT_FALSE(sink.isBackpressured());
+}
+
+void test_failure_backs_off_then_flushes() {
+  ScriptedSink sink;
+  sink.codes = {503};
+  enqueue(sink, 1, 6);
+  sink.process();
+  TEST_ASSERT_EQUAL_size_t(1, sink.calls);
+  TEST_ASSERT_EQUAL_size_t(6, sink.pending());
+  TEST_ASSERT_EQUAL_UINT32(1, sink.stats().failedBatches);
+
+  // Nothing is tried before the backoff is over
+  unsigned long wait = sink.retryPolicy().retryInMs();
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(TELEMETRY_RETRY_MIN_MS, wait);
+  TEST_ASSERT_FALSE(sink.retryDue());
+  delay(wait - 1);
+  sink.process();
+  TEST_ASSERT_EQUAL_size_t(1, sink.calls);
+  TEST_ASSERT_FALSE(sink.retryDue());
+
+  delay(1);
+  TEST_ASSERT_TRUE(sink.retryDue());
+  sink.process();
+  expectSent(sink.sent, 1, 6);
+  TEST_ASSERT_EQUAL_UINT32(0, sink.retryPolicy().consecutiveFailures());
+  TEST_ASSERT_FALSE(sink.retryDue());
+}
+
+void test_permanent_error_drops_one_record() {
+  ScriptedSink sink;
+  sink.codes = {400};
+  enqueue(sink, 1, 5);
+  sink.process();
+  // The refused record is gone, the rest went out in the same pass
+  expectSent(sink.sent, 2, 5);
+  TEST_ASSERT_EQUAL_UINT32(1, sink.stats().rejected);
+  TEST_ASSERT_EQUAL_UINT32(0, sink.stats().failedBatches);
+  TEST_ASSERT_EQUAL(RetryPolicy::BREAKER_CLOSED, sink.retryPolicy().state());
+}
+
+void test_partial_delivery_resends_the_rest() {
+  ScriptedSink sink;
+  sink.accept = 2;
+  enqueue(sink, 1, 5);
+  sink.process();
+  expectSent(sink.sent, 1, 5);
+  TEST_ASSERT_EQUAL_size_t(3, sink.calls);
+  TEST_ASSERT_EQUAL_UINT32(3, sink.stats().batches);
+}
+
+void test_breaker_opens_and_probes() {
+  ScriptedSink sink;
+  sink.codes.assign(TELEMETRY_BREAKER_THRESHOLD + 1, 503);
+  enqueue(sink, 1, 3);
+  for (int i = 0; i < TELEMETRY_BREAKER_THRESHOLD; i++) {
+    delay(sink.retryPolicy().retryInMs());
+    sink.process();
+  }
+  TEST_ASSERT_EQUAL(RetryPolicy::BREAKER_OPEN, sink.retryPolicy().state());
+  TEST_ASSERT_EQUAL_size_t(TELEMETRY_BREAKER_THRESHOLD, sink.calls);
+
+  // Open: records keep queueing, nothing is tried
+  enqueue(sink, 4, 5);
+  sink.process();
+  sink.process();
+  TEST_ASSERT_EQUAL_size_t(TELEMETRY_BREAKER_THRESHOLD, sink.calls);
+  TEST_ASSERT_EQUAL_size_t(5, sink.pending());
+
+  // One failed probe, then one that works flushes the backlog
+  delay(sink.retryPolicy().retryInMs());
+  sink.process();
+  TEST_ASSERT_EQUAL_size_t(TELEMETRY_BREAKER_THRESHOLD + 1, sink.calls);
+  TEST_ASSERT_EQUAL(RetryPolicy::BREAKER_OPEN, sink.retryPolicy().state());
+  delay(sink.retryPolicy().retryInMs());
+  sink.process();
+  expectSent(sink.sent, 1, 5);
+  TEST_ASSERT_EQUAL(RetryPolicy::BREAKER_CLOSED, sink.retryPolicy().state());
+}
+
+void test_not_ready_holds_records() {
+  ScriptedSink sink;
+  sink.ready = false;
+  enqueue(sink, 1, 3);
+  sink.process();
+  TEST_ASSERT_EQUAL_size_t(0, sink.calls);
+  TEST_ASSERT_EQUAL_size_t(3, sink.pending());
+  sink.ready = true;
+  sink.process();
+  expectSent(sink.sent, 1, 3);
+}
+
+// HttpPostSink against hal::setHttpHandler
+struct Request {
+  std::string method;
+  std::string url;
+  std::string body;
+};
+
+static const char* SINK_URL = "http://collector.local:8080/readings";
+
+void test_http_sink_posts_json_batches() {
+  std::vector<Request> requests;
+  hal::setHttpHandler([&](const char* method, const String& url, const String& body, String& response) {
+    requests.push_back({method, url.c_str(), body.c_str()});
+    response = "";
+    return 204;
+  });
+  HttpPostSink sink(SINK_URL);
+  enqueue(sink, 1, HTTP_SINK_BATCH_SIZE + 2);
+  sink.process();
+
+  TEST_ASSERT_EQUAL_size_t(2, requests.size());
+  TEST_ASSERT_EQUAL_size_t(0, sink.pending());
+  size_t bytes = 0;
+  unsigned long next = 1;
+  const size_t batches[2] = {HTTP_SINK_BATCH_SIZE, 2};
+  for (size_t i = 0; i < requests.size(); i++) {
+    const Request& r = requests[i];
+    TEST_ASSERT_EQUAL_STRING("POST", r.method.c_str());
+    TEST_ASSERT_EQUAL_STRING(SINK_URL, r.url.c_str());
+    DynamicJsonDocument doc(8192);
+    TEST_ASSERT_FALSE(deserializeJson(doc, r.body));
+    TEST_ASSERT_EQUAL_size_t(batches[i], doc.as<JsonArray>().size());
+    for (JsonObject json : doc.as<JsonArray>()) {
+      TEST_ASSERT_EQUAL_UINT32(next, json["readTime"].as<unsigned long>());
+      TEST_ASSERT_EQUAL_INT(2000 + (int)next, json["rawValue"].as<int>());
+      TEST_ASSERT_FLOAT_WITHIN(0.0005f, 12.0f + next / 100.0f, json["voltage"].as<float>());
+      next++;
+    }
+    bytes += r.body.size();
+  }
+  TEST_ASSERT_EQUAL_UINT32(HTTP_SINK_BATCH_SIZE + 3, next);
+  TEST_ASSERT_EQUAL_UINT32(bytes, sink.stats().bytesSent);
+}
+
+void test_http_sink_error_codes() {
+  std::deque<int> codes = {503, 400, 200};
+  size_t requests = 0;
+  hal::setHttpHandler([&](const char*, const String&, const String&, String& response) {
+    requests++;
+    response = "";
+    int code = codes.front();
+    codes.pop_front();
+    return code;
+  });
+  HttpPostSink sink(SINK_URL);
+  enqueue(sink, 1, 1);
+  sink.process();
+  TEST_ASSERT_EQUAL_size_t(1, requests);
+  TEST_ASSERT_EQUAL_UINT32(1, sink.stats().failedBatches);
+  TEST_ASSERT_EQUAL_size_t(1, sink.pending());
+
+  // 400 after the backoff: the record is dropped, the next one goes
+  enqueue(sink, 2, 2);
+  delay(sink.retryPolicy().retryInMs());
+  sink.process();
+  TEST_ASSERT_EQUAL_size_t(3, requests);
+  TEST_ASSERT_EQUAL_UINT32(1, sink.stats().rejected);
+  TEST_ASSERT_EQUAL_UINT32(1, sink.stats().published);
+  TEST_ASSERT_EQUAL_size_t(0, sink.pending());
+}
+
+void test_http_sink_waits_for_wifi() {
+  size_t requests = 0;
+  hal::setHttpHandler([&](const char*, const String&, const String&, String&) {
+    requests++;
+    return 200;
+  });
+  HttpPostSink sink(SINK_URL);
+  enqueue(sink, 1, 2);
+  hal::setWiFiUp(false);
+  sink.process();
+  TEST_ASSERT_EQUAL_size_t(0, requests);
+  TEST_ASSERT_EQUAL_UINT32(0, sink.stats().failedBatches);  // not a failure
+  hal::setWiFiUp(true);
+  sink.process();
+  TEST_ASSERT_EQUAL_size_t(1, requests);
+  TEST_ASSERT_EQUAL_size_t(0, sink.pending());
+}
+
+// MqttSink against hal::setMqttHandler
+struct Packet {
+  std::string clientId;
+  std::string topic;  // empty for CONNECT
+  std::string payload;
+};
+
+void test_mqtt_sink_publishes_after_connect() {
+  std::vector<Packet> packets;
+  hal::setMqttHandler([&](const char* clientId, const char* topic, const char* payload, size_t length) {
+    packets.push_back({clientId, topic ? topic : "", topic ? std::string(payload, length) : ""});
+    return true;
+  });
+  MqttSink sink("broker.local", 1883, "vl-%s", "voltagelog/%s/readings");
+  sink.begin();
+  enqueue(sink, 1, MQTT_BATCH_SIZE + 1);
+  sink.process();
+
+  // CONNECT, then a full batch and the rest
+  TEST_ASSERT_EQUAL_size_t(3, packets.size());
+  const std::string clientId = std::string("vl-") + DeviceIdentity::id();
+  const std::string topic = std::string("voltagelog/") + DeviceIdentity::id() + "/readings";
+  TEST_ASSERT_EQUAL_STRING(clientId.c_str(), packets[0].clientId.c_str());
+  TEST_ASSERT_TRUE(packets[0].topic.empty());
+  TEST_ASSERT_EQUAL_STRING(topic.c_str(), packets[1].topic.c_str());
+  DynamicJsonDocument doc(8192);
+  TEST_ASSERT_FALSE(deserializeJson(doc, packets[1].payload));
+  JsonArray batch = doc.as<JsonArray>();
+  TEST_ASSERT_EQUAL_size_t(MQTT_BATCH_SIZE, batch.size());
+  TEST_ASSERT_EQUAL_UINT32(1, batch[0]["readTime"].as<uint32_t>());
+  TEST_ASSERT_FALSE(deserializeJson(doc, packets[2].payload));
+  batch = doc.as<JsonArray>();
+  TEST_ASSERT_EQUAL_size_t(1, batch.size());
+  TEST_ASSERT_EQUAL_UINT32(MQTT_BATCH_SIZE + 1, batch[0]["readTime"].as<uint32_t>());
+  TEST_ASSERT_EQUAL_size_t(0, sink.pending());
+}
+
+void test_mqtt_sink_reconnects_and_resends() {
+  size_t connects = 0, publishes = 0;
+  bool refuse = true;
+  hal::setMqttHandler([&](const char*, const char* topic, const char*, size_t) {
+    if (!topic) {
+      connects++;
+      return true;
+    }
+    publishes++;
+    return !refuse;
+  });
+  MqttSink sink("broker.local", 1883, "vl-%s", "voltagelog/%s/readings");
+  sink.begin();
+  enqueue(sink, 1, 2);
+  sink.process();
+  // No PUBACK: the connection is dropped and the batch stays queued
+  TEST_ASSERT_EQUAL_size_t(1, connects);
+  TEST_ASSERT_EQUAL_size_t(1, publishes);
+  TEST_ASSERT_EQUAL_size_t(2, sink.pending());
+  TEST_ASSERT_EQUAL_UINT32(1, sink.stats().failedBatches);
+
+  refuse = false;
+  // Reconnects at most every 5 s, then sends once the backoff is over
+  for (int i = 0; i < 60 && sink.pending() > 0; i++) {
+    delay(1000);
+    sink.process();
+  }
+  TEST_ASSERT_EQUAL_size_t(2, connects);
+  TEST_ASSERT_EQUAL_size_t(2, publishes);
+  TEST_ASSERT_EQUAL_size_t(0, sink.pending());
+  TEST_ASSERT_EQUAL_UINT32(2, sink.stats().published);
+}
+
+void test_mqtt_sink_without_broker_never_ready() {
+  MqttSink sink("broker.local", 1883, "vl-%s", "voltagelog/%s/readings");
+  sink.begin();
+  enqueue(sink, 1, 1);
+  for (int i = 0; i < 3; i++) {
+    delay(6000);
+    sink.process();
+  }
+  TEST_ASSERT_EQUAL_size_t(1, sink.pending());
+  TEST_ASSERT_EQUAL_UINT32(0, sink.stats().failedBatches);
+}
+
+void setup() {
+  hal::setTimeScale(0);
+  UNITY_BEGIN();
+  RUN_TEST(test_batches_in_order_up_to_flush_limit);
+  RUN_TEST(test_full_queue_drops_oldest);
+  RUN_TEST(test_failure_backs_off_then_flushes);
+  RUN_TEST(test_permanent_error_drops_one_record);
+  RUN_TEST(test_partial_delivery_resends_the_rest);
+  RUN_TEST(test_breaker_opens_and_probes);
+  RUN_TEST(test_not_ready_holds_records);
+  RUN_TEST(test_http_sink_posts_json_batches);
+  RUN_TEST(test_http_sink_error_codes);
+  RUN_TEST(test_http_sink_waits_for_wifi);
+  RUN_TEST(test_mqtt_sink_publishes_after_connect);
+  RUN_TEST(test_mqtt_sink_reconnects_and_resends);
+  RUN_TEST(test_mqtt_sink_without_broker_never_ready);
+  exit(UNITY_END());
+}
+
+void loop() {}
@@ -0,0 +1,108 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <stdlib.h>
+#include "hal.h"
+#include "time_service.h"
+
+// TimeService against the NativeHAL SNTP stand-in, in virtual time, on a
+// device whose crystal runs 50 ppm fast. The tests run in order on one
+// TimeService, from before the first sync to a learned drift.
+
+static const double SKEW_PPM = 50.0;
+static const uint32_t SYNC_INTERVAL_S = 3600;  // the stand-in's default
+
+static unsigned long bootStamp;  // a millis() stamp taken before any sync
+
+// Virtual time passes in minute steps, with loop() after each like the
+// firmware's main loop
+static void run(uint32_t seconds) {
+  for (uint32_t s = 0; s < seconds; s += 60) {
+    delay(seconds - s < 60 ? (seconds - s) * 1000UL : 60000UL);
+    TimeService::loop();
+  }
+}
+
+// Mapping error now against the reference clock, in us
+static int64_t errorMicros() {
+  return TimeService::toUtcMicros(TimeService::monotonicMicros()) - hal::trueUtcMicros();
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_nothing_before_first_sync() {
+  bootStamp = millis();
+  TimeService::begin();
+  TEST_ASSERT_FALSE(TimeService::loop());
+  TEST_ASSERT_FALSE(TimeService::isSynced());
+  TEST_ASSERT_TRUE(TimeService::waitingForSync());
+  TEST_ASSERT_EQUAL_INT64(0, TimeService::now());
+  TEST_ASSERT_EQUAL_INT64(0, TimeService::utcFromMillis(bootStamp));
+  TEST_ASSERT_EQUAL_UINT32(0, TimeService::syncCount());
+}
+
+void test_first_sync_maps_earlier_stamps() {
+  delay(2000);  // the stand-in answers 1.5 s after configTime()
+  TEST_ASSERT_TRUE(TimeService::loop());
+  TEST_ASSERT_FALSE(TimeService::loop());  // only once
+  TEST_ASSERT_TRUE(TimeService::isSynced());
+  TEST_ASSERT_FALSE(TimeService::waitingForSync());
+  TEST_ASSERT_EQUAL_UINT32(1, TimeService::syncCount());
+  TEST_ASSERT_EQUAL_UINT32(millis(), TimeService::lastSyncMillis());
+
+  int64_t utcNow = hal::trueUtcMicros() / 1000000;
+  TEST_ASSERT_INT_WITHIN(1, utcNow, TimeService::now());
+  // The stamp from before the sync gets its UTC time retroactively
+  TEST_ASSERT_INT_WITHIN(1, utcNow - (millis() - bootStamp) / 1000, TimeService::utcFromMillis(bootStamp));
+  TEST_ASSERT_INT_WITHIN(500, 0, errorMicros());
+}
+
+void test_first_resync_measures_skew() {
+  run(SYNC_INTERVAL_S);
+  TEST_ASSERT_EQUAL_UINT32(2, TimeService::syncCount());
+
+  // Uncorrected for an hour: 50 ppm fast predicts 180 ms too far ahead
+  TEST_ASSERT_INT_WITHIN(2000, -(int32_t)(SKEW_PPM * SYNC_INTERVAL_S), TimeService::lastCorrectionMicros());
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, (float)SKEW_PPM, TimeService::driftPpm());
+}
+
+void test_correction_holds_between_syncs() {
+  // Half an interval after a sync an uncorrected mapping is 90 ms off
+  run(SYNC_INTERVAL_S / 2);
+  TEST_ASSERT_INT_WITHIN(2000, 0, errorMicros());
+
+  run(SYNC_INTERVAL_S / 2);
+  TEST_ASSERT_EQUAL_UINT32(3, TimeService::syncCount());
+  TEST_ASSERT_INT_WITHIN(2000, 0, TimeService::lastCorrectionMicros());
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, (float)SKEW_PPM, TimeService::driftPpm());
+}
+
+void test_utc_from_millis_after_correction() {
+  run(SYNC_INTERVAL_S / 2);
+  int64_t utcNow = hal::trueUtcMicros();
+  unsigned long now = millis();
+
+  TEST_ASSERT_INT_WITHIN(1, utcNow / 1000000, TimeService::utcFromMillis(now));
+  // 20 minutes back on the device clock is a little less in UTC
+  unsigned long stamp = now - 20 * 60 * 1000UL;
+  int64_t expected = (utcNow - (int64_t)(20 * 60 * 1000000LL * (1.0 - SKEW_PPM * 1e-6))) / 1000000;
+  TEST_ASSERT_INT_WITHIN(1, expected, TimeService::utcFromMillis(stamp));
+  // Stamps from before the first sync still map through the new drift
+  int64_t sinceBoot = (int64_t)((now - bootStamp) * 1000.0 * (1.0 - SKEW_PPM * 1e-6));
+  TEST_ASSERT_INT_WITHIN(1, (utcNow - sinceBoot) / 1000000, TimeService::utcFromMillis(bootStamp));
+}
+
+void setup() {
+  hal::setTimeScale(0);
+  hal::setClockDriftPpm(SKEW_PPM);
+  UNITY_BEGIN();
+  RUN_TEST(test_nothing_before_first_sync);
+  RUN_TEST(test_first_sync_maps_earlier_stamps);
+  RUN_TEST(test_first_resync_measures_skew);
+  RUN_TEST(test_correction_holds_between_syncs);
+  RUN_TEST(test_utc_from_millis_after_correction);
+  exit(UNITY_END());
+}
+
+void loop() {}